@@ -1,6 +1,6 @@
 // audio.cpp
-// Implements audio functions for the SNES synthesizer, including audio setup
-// and note playback using the Teensy Audio Library.
+// Implements the audio graph for the SNES synthesizer (Teensy Audio Library setup,
+// vibrato settings). Note start/stop and per-voice state live in voice_manager.cpp.
 
 #include "audio.h"
 #include "debug.h"
@@ -10,225 +10,182 @@
 #include "playstyles.h" // Include to get thunderstruckMidiNotes declaration
 #include "utils.h" // For midiToPitchFloat
 #include "midi.h" // Include for sendMidiNoteOn/Off
+#include "governor.h"
+#include "controller.h"
+#include "lfo_bank.h"
+#include "mod_matrix.h"
+#include <math.h>
 
-// Audio components (4 voices)
-AudioSynthWaveform waveform[4];  // Waveforms for each voice
-AudioSynthWaveformModulated waveformMod[4];  // Modulated waveforms for each voice
-AudioEffectEnvelope envelope[4];  // Envelopes for each voice
-AudioSynthWaveform lfo[4];          // LFOs for vibrato
+static_assert(NUM_VOICES <= 4, "All voices feed a single AudioMixer4");
+
+static ParamSmoother volumeSmoother; // Codec volume
+static float writtenVolume;          // Last value sent to the codec
+
+// Audio components (NUM_VOICES voices)
+GatedWaveformModulated waveformMod[NUM_VOICES];  // Modulated waveforms for each voice
+VoiceEnvelope envelope[NUM_VOICES];  // Envelopes for each voice
 AudioMixer4 mixer;  // Mixer to combine all voices
+AudioSynthDrumKit drums;  // Rhythm-mode percussion
+AudioSynthSDsp sdsp;  // BRR sample voices, driven by the allocator under "engine brr"
+AudioMixer4 outputMixer;  // Voices (0) + drums (1) + S-DSP (2) + WAV loop (3)
+DMAMEM static int16_t echoLine[ECHO_MAX_SAMPLES]; // 21 KB, kept out of the fast RAM
+AudioEffectSDspEcho masterEcho(echoLine);
+DMAMEM static int16_t recordQueue[WAV_QUEUE_BLOCKS * AUDIO_BLOCK_SAMPLES]; // 16 KB
+AudioRecordWav wavRecorder(recordQueue);
+AudioPlayWavLoop wavLoop;  // Streamed from the SD card
 AudioOutputI2S i2s1;  // I2S output
-AudioConnection* patchCords[16];  // Increased size from 12 to 16 
+AudioConnection patchCords[AUDIO_PATCH_CORDS]; // Static pool, patched in setupAudio()
 AudioControlSGTL5000 sgtl5000_1;  // Audio shield
 
-// Keep track of current frequencies for portamento
-static float voiceFrequencies[4] = {0, 0, 0, 0};  // Current frequency
-static float targetFrequencies[4] = {0, 0, 0, 0};  // Target frequency
-static float previousFrequencies[4] = {0, 0, 0, 0};  // Previous frequency (for returning on release)
-static bool portamentoActive[4] = {false, false, false, false};
-static bool voiceActive[4] = {false, false, false, false};  // Track if voice is currently playing
-static const float PORTAMENTO_RATE = 0.008;  // Rate of frequency change (Slowed down again from 0.02)
-
-// Helper array to map state index to Teensy waveform constants
-const int waveformTypes[] = {
-    WAVEFORM_SINE, 
-    WAVEFORM_SAWTOOTH, 
-    WAVEFORM_SQUARE, 
-    WAVEFORM_TRIANGLE
-};
-
 // Vibrato settings
 const float VIBRATO_RATES[] = {0.0, 5.0, 10.0}; // Hz (0=Off)
 // Depth now represents LFO Amplitude (0.0 to 1.0)
 // Adjusted values for Low/Medium/High intensity control via LFO amplitude
 const float VIBRATO_DEPTHS[] = {0.0, 0.1, 0.3, 0.7}; // LFO Amplitude (0=Off)
 
-void updatePortamento() {
-    for (int i = 0; i < 4; i++) {
-        if (portamentoActive[i] && voiceFrequencies[i] != targetFrequencies[i]) {
-            // Calculate the difference between current and target frequencies
-            float diff = targetFrequencies[i] - voiceFrequencies[i];
-            
-            // Move current frequency towards target by a percentage of the difference
-            voiceFrequencies[i] += diff * PORTAMENTO_RATE;
-            
-            // If we're very close to the target, snap to it
-            if (abs(diff) < 0.1) {
-                voiceFrequencies[i] = targetFrequencies[i];
-                portamentoActive[i] = false;
-            }
-            
-            // Update the actual frequency
-            waveformMod[i].frequency(voiceFrequencies[i]);
-            // DEBUG_INFO(CAT_AUDIO, "Portamento update voice %d: curr=%f target=%f diff=%f rate=%f", i, voiceFrequencies[i], targetFrequencies[i], diff, PORTAMENTO_RATE);
-        }
-    }
-}
+static bool voiceCordsConnected[NUM_VOICES];
+static int graphPlayStyle = -1; // Play style the graph was last configured for
 
 void setupAudio() {
-    DEBUG_INFO(CAT_AUDIO, "Allocating audio memory (40 blocks)");
-    AudioMemory(40); 
+    DEBUG_INFO(CAT_AUDIO, "Allocating audio memory (%d blocks)", AUDIO_MEMORY_BLOCKS);
+    AudioMemory(AUDIO_MEMORY_BLOCKS); 
 
     // Enable the audio shield
     DEBUG_INFO(CAT_AUDIO, "Enabling audio shield");
     sgtl5000_1.enable();
-    sgtl5000_1.volume(0.5);  // Set master volume to 50%
+    sgtl5000_1.volume(MASTER_VOLUME_DEFAULT);  // Set master volume to 50%
+    smoothJump(volumeSmoother, MASTER_VOLUME_DEFAULT);
+    writtenVolume = MASTER_VOLUME_DEFAULT;
     sgtl5000_1.lineOutLevel(13);  // Set line out level (0-31)
 
-    // Initialize 4 voices
-    for (int i = 0; i < 4; i++) {
+    // Initialize voices
+    for (int i = 0; i < NUM_VOICES; i++) {
         DEBUG_DEBUG(CAT_AUDIO, "Initializing voice %d", i);
-        waveform[i].begin(WAVEFORM_SINE);
-        waveform[i].amplitude(0.5);  // Lower amplitude to avoid clipping
         waveformMod[i].begin(WAVEFORM_SINE);
-        waveformMod[i].amplitude(0.5); 
-        waveformMod[i].frequencyModulation(0.1); 
+        waveformMod[i].amplitude(VOICE_AMPLITUDE); 
         envelope[i].attack(10);
         envelope[i].decay(200);
         envelope[i].sustain(1.0);
-        envelope[i].release(1);  // Set release time to minimum (1ms)
+        envelope[i].release(1);  // Shortest release; VoiceEnvelope floors it at the micro-fade
 
-        // Setup LFO for vibrato
-        lfo[i].begin(0.0, 0.0, WAVEFORM_SINE); 
+        waveformMod[i].gate(true); // Silent until its first note
 
         // Set up patch cords for each voice
-        // patchCords[i*4] = REMOVED
-        patchCords[i*4 + 1] = new AudioConnection(lfo[i], 0, waveformMod[i], 0); // LFO -> Freq Mod Input (Input 0)
-        patchCords[i*4 + 2] = new AudioConnection(waveformMod[i], 0, envelope[i], 0); // Modulated -> Envelope
-        patchCords[i*4 + 3] = new AudioConnection(envelope[i], 0, mixer, i);  // Envelope -> Mixer
+        // Two cords per voice; the last two are the mixer outputs. Vibrato is applied
+        // to the oscillator frequency from the shared LFO bank, not through a cord.
+        voiceCordsConnected[i] = false;
+        connectVoice(i);
     }
+    graphPlayStyle = -1;
 
     // Set mixer gains
     DEBUG_DEBUG(CAT_AUDIO, "Setting mixer gains");
-    mixer.gain(0, 0.24); // Increased gain for voice 0 (Monophonic)
-    DEBUG_DEBUG(CAT_AUDIO, "  - Mixer gain 0 set to 0.24");
-    for (int i = 1; i < 4; i++) { // Set gain for voices 1, 2, 3 (Chord/Poly)
-        mixer.gain(i, 0.12);
-        DEBUG_DEBUG(CAT_AUDIO, "  - Mixer gain %d set to 0.12", i);
+    mixer.gain(0, MIXER_GAIN_LEAD); // Increased gain for voice 0 (Monophonic)
+    DEBUG_DEBUG(CAT_AUDIO, "  - Mixer gain 0 set to %.2f", MIXER_GAIN_LEAD);
+    for (int i = 1; i < NUM_VOICES; i++) { // Set gain for voices 1, 2, 3 (Chord/Poly)
+        mixer.gain(i, MIXER_GAIN_CHORD);
+        DEBUG_DEBUG(CAT_AUDIO, "  - Mixer gain %d set to %.2f", i, MIXER_GAIN_CHORD);
     }
 
     // Route the mixer output to both left and right channels
-    patchCords[12] = new AudioConnection(mixer, 0, i2s1, 0); // Mixer to left
-    patchCords[13] = new AudioConnection(mixer, 0, i2s1, 1); // Mixer to right
-    // Indices 14, 15 unused
+    outputMixer.gain(0, 1.0);
+    outputMixer.gain(1, MIXER_GAIN_DRUMS);
+    outputMixer.gain(2, MIXER_GAIN_SDSP);
+    outputMixer.gain(3, MIXER_GAIN_LOOP);
+    patchCords[NUM_VOICES*2 + 0].connect(mixer, 0, outputMixer, 0); // Voices
+    patchCords[NUM_VOICES*2 + 1].connect(drums, 0, outputMixer, 1); // Drums
+    patchCords[NUM_VOICES*2 + 2].connect(sdsp, 0, outputMixer, 2); // S-DSP voices
+    patchCords[NUM_VOICES*2 + 3].connect(outputMixer, 0, masterEcho, 0); // Master echo
+    patchCords[NUM_VOICES*2 + 4].connect(masterEcho, 0, i2s1, 0); // Echo to left
+    patchCords[NUM_VOICES*2 + 5].connect(masterEcho, 0, i2s1, 1); // Echo to right
+    patchCords[NUM_VOICES*2 + 6].connect(masterEcho, 0, wavRecorder, 0); // Idle unless recording
+    patchCords[NUM_VOICES*2 + 7].connect(wavLoop, 0, outputMixer, 3); // Silent unless a loop plays
+
+    resetSmoothing();
+    resetVoices();
+    resetLfoBank();
+    resetModMatrix();
+    resetGovernor();
 
     DEBUG_INFO(CAT_AUDIO, "Audio setup complete");
 }
 
-// Function to apply vibrato settings based on state
-void applyVibrato(SynthState& state, int voice) {
-     // REMOVED: Waveform begin() call moved back to setupAudio and playNote
+void setMasterVolume(float level) {
+    volumeSmoother.target = level < 0.0f ? 0.0f : (level > 1.0f ? 1.0f : level);
+}
+
+float masterVolume() {
+    return volumeSmoother.target;
+}
 
-     // Apply vibrato rate/depth (now LFO amplitude)
-     if (state.vibratoRate > 0 && state.vibratoDepth > 0) {
-         float rate = VIBRATO_RATES[state.vibratoRate];
-         float depth_amplitude = VIBRATO_DEPTHS[state.vibratoDepth]; // Use amplitude depth value
-         lfo[voice].frequency(rate);
-         lfo[voice].amplitude(depth_amplitude); // CONTROL intensity via LFO amplitude
-         // REMOVED: Modulation depth is fixed now
-         Serial.printf("  applyVibrato: Voice=%d Rate=%.2f LFO_Amp=%.4f (Applied)\n", voice, rate, depth_amplitude);
-     } else {
-         lfo[voice].amplitude(0.0); // Turn LFO off by setting amplitude to 0
-         // REMOVED: Modulation depth is fixed now
-         // waveformMod[voice].frequencyModulation(0.0);
-         Serial.printf("  applyVibrato: Voice=%d LFO OFF (0.0 Amplitude Applied)\n", voice);
-     }
+void updateMasterVolume() {
+    if (volumeSmoother.value == volumeSmoother.target && writtenVolume == volumeSmoother.target) return;
+    float level = smoothTick(volumeSmoother, SMOOTH_VOLUME);
+    // Every write is an I2C transfer: only whole steps, and the final value
+    if (fabsf(level - writtenVolume) < MASTER_VOLUME_WRITE_STEP && level != volumeSmoother.target) return;
+    sgtl5000_1.volume(level);
+    writtenVolume = level;
 }
 
-void playNote(SynthState& state, int voice, int midiNote) {
-    float freq = 440.0 * pow(2.0, (midiNote - 69.0) / 12.0);  
-    DEBUG_INFO(CAT_AUDIO, ">>> playNote called: voice=%d, midiNote=%d, freq=%.2f", voice, midiNote, freq); // <<< ADDED DEBUG
-    
-    // Set Waveform Type (can potentially reset modulation depth? Keep testing)
-    int selectedWaveformType = waveformTypes[state.currentWaveform];
-    waveformMod[voice].begin(selectedWaveformType);
+void connectVoice(int voice) {
+    if (voiceCordsConnected[voice]) return;
+    patchCords[voice*2 + 0].connect(waveformMod[voice], 0, envelope[voice], 0); // Modulated -> Envelope
+    patchCords[voice*2 + 1].connect(envelope[voice], 0, mixer, voice);  // Envelope -> Mixer
+    voiceCordsConnected[voice] = true;
+}
 
-    // Apply Vibrato Settings (Rate and LFO Amplitude)
-    applyVibrato(state, voice); 
+static void disconnectVoice(int voice) {
+    if (!voiceCordsConnected[voice]) return;
+    patchCords[voice*2 + 0].disconnect();
+    patchCords[voice*2 + 1].disconnect();
+    voiceCordsConnected[voice] = false;
+}
 
-    // --- Portamento Logic --- 
-    if (state.portamentoEnabled) {
-        if (!voiceActive[voice]) {
-            // First note after initialization or stopping - set frequency directly
-            voiceFrequencies[voice] = freq;
-            targetFrequencies[voice] = freq;
-            previousFrequencies[voice] = freq;
-            portamentoActive[voice] = false;
-            waveformMod[voice].frequency(freq);
-            DEBUG_DEBUG(CAT_AUDIO, "Initial frequency set on voice %d: %f", voice, freq);
+bool voiceConnected(int voice) {
+    return voiceCordsConnected[voice];
+}
+
+static int voicesForPlayStyle(int playStyle) {
+    return playStyle == MONOPHONIC ? 1 : NUM_VOICES;
+}
+
+void updateAudioGraph(const SynthState& state) {
+    if (state.playStyle == graphPlayStyle) return;
+    int needed = voicesForPlayStyle(state.playStyle);
+    bool pending = false;
+    for (int v = 0; v < NUM_VOICES; v++) {
+        if (v < needed) {
+            connectVoice(v);
+        } else if (voices.envPhase[v] == ENV_IDLE) {
+            disconnectVoice(v);
         } else {
-            // Store current frequency as previous before updating target
-            previousFrequencies[voice] = voiceFrequencies[voice];
-            
-            // Set up portamento - keep current frequency and set new target
-            targetFrequencies[voice] = freq;
-            portamentoActive[voice] = true;
-            DEBUG_DEBUG(CAT_AUDIO, "Portamento active on voice %d: %f -> %f", voice, voiceFrequencies[voice], freq);
+            pending = true; // Let the note finish, unpatch on a later tick
         }
-    } else {
-        // No portamento, set frequency directly
-        previousFrequencies[voice] = freq;  // Store for future portamento
-        voiceFrequencies[voice] = freq;
-        targetFrequencies[voice] = freq;
-        portamentoActive[voice] = false;
-        waveformMod[voice].frequency(freq);
-        DEBUG_DEBUG(CAT_AUDIO, "Direct frequency set on voice %d: %f", voice, freq);
     }
-    
-    envelope[voice].noteOn();
-    voiceActive[voice] = true;  // Mark voice as active
-    
-    if (!envelope[voice].isActive()) {
-        DEBUG_WARNING(CAT_AUDIO, "Voice %d envelope not active after noteOn", voice);
+    if (!pending) {
+        graphPlayStyle = state.playStyle;
+        DEBUG_INFO(CAT_AUDIO, "Audio graph: %d voice(s) patched for play style %d", needed, state.playStyle);
     }
 }
 
-void stopNote(int voice) {
-    DEBUG_INFO(CAT_AUDIO, ">>> stopNote called: voice=%d", voice); // <<< ADDED DEBUG
-    DEBUG_VERBOSE(CAT_AUDIO, "Stopping voice %d", voice);
-    envelope[voice].noteOff();
-    voiceActive[voice] = false;  // Mark voice as inactive
-    lfo[voice].amplitude(0.0); // Stop LFO output
-    
-    // If portamento is active, start sliding back to the previous frequency
-    if (portamentoActive[voice] && previousFrequencies[voice] > 0) {
-        targetFrequencies[voice] = previousFrequencies[voice];
-        DEBUG_VERBOSE(CAT_AUDIO, "Portamento return on voice %d to %f", voice, previousFrequencies[voice]);
-    }
+float vibratoRateHz(const SynthState& state) {
+    return VIBRATO_RATES[state.vibratoRate];
 }
 
-// Call this function in your main loop
-void updateAudio(SynthState& state) {
-    if (state.portamentoEnabled) {
-        updatePortamento();
-    }
+// Depth now represents LFO amplitude, scaled to the pitch range the oscillator's
+// frequency modulation input used to have
+float vibratoDepthOctaves(const SynthState& state) {
+    // The load governor bypasses vibrato first when the audio CPU is overloaded
+    if (state.vibratoRate <= 0 || state.vibratoDepth <= 0 || governorVibratoBypassed()) return 0.0f;
+    return VIBRATO_DEPTHS[state.vibratoDepth] * VIBRATO_RANGE_OCTAVES;
 }
 
 // Helper function to get the current base MIDI note from pressed buttons
-// V12.1 - Uses lastPressedBuffer for priority (most recent held)
+// Uses the held order for priority (state.notePriority: most recent, lowest or highest held)
 int getBaseMidiNote(SynthState& state) {
-    int buttonToPlay = -1;
-    int readIndex = state.lastPressedIndex; // Start reading from the element AFTER the last one written
-
-    // Iterate backwards through the buffer to find the most recent press
-    for (int i = 0; i < LAST_PRESS_BUFFER_SIZE; ++i) {
-        // Decrement index, wrap around buffer
-        readIndex = (readIndex + LAST_PRESS_BUFFER_SIZE - 1) % LAST_PRESS_BUFFER_SIZE;
-        int bufferedButton = state.lastPressedBuffer[readIndex];
-
-        // Check if buffer slot is valid (>=0) AND the button is STILL held
-        if (bufferedButton >= 0 && bufferedButton < MAX_NOTE_BUTTONS && state.held[bufferedButton]) {
-            buttonToPlay = bufferedButton; // Found the most recent, still-held button
-            DEBUG_VERBOSE(CAT_AUDIO, "getBaseMidiNote: Found most recent held button %d from buffer.", buttonToPlay);
-            break; // Stop searching, priority found
-        }
-    }
-
-    // If no held button was found by checking the buffer, return -1
+    int buttonToPlay = priorityButton(state);
     if (buttonToPlay == -1) {
-        // Optional: Double check state.held[] directly as a fallback? Could be noisy.
-        // For now, trust the buffer check combined with current held state.
-        DEBUG_VERBOSE(CAT_AUDIO, "getBaseMidiNote: No valid held button found in recent press buffer. Returning -1.");
+        DEBUG_VERBOSE(CAT_AUDIO, "getBaseMidiNote: No note button held. Returning -1.");
         return -1;
     }
 
@@ -1,28 +1,83 @@
 // audio.h
-// Header file for audio-related functions, including setup and note playback
-// for the SNES synthesizer using the Teensy Audio Library.
+// Header file for the audio graph of the SNES synthesizer (Teensy Audio Library).
+// Voices are started and stopped through voice_manager.h.
 
 #ifndef AUDIO_H
 #define AUDIO_H
 
 #include <Audio.h>
 #include "synth_state.h"
+#include "voice_manager.h"
+#include "drum_voice.h"
+#include "sdsp.h"
+#include "echo.h"
+#include "voice_envelope.h"
+#include "wav_recorder.h"
+#include "wav_loop.h"
+
+// Two cords per voice (osc -> envelope, envelope -> mixer), voice mixer, drums and
+// S-DSP voices and the WAV loop into the output mixer, output mixer into the echo, and
+// echo to I2S L/R and the WAV recorder
+#define AUDIO_PATCH_CORDS (NUM_VOICES * 2 + 8)
+
+#define AUDIO_MEMORY_BLOCKS 40
+#define VOICE_AMPLITUDE 0.5f   // Oscillator level before the envelope
+#define MIXER_GAIN_LEAD 0.24f  // Voice 0 (Monophonic)
+#define MIXER_GAIN_CHORD 0.12f // Voices 1..NUM_VOICES-1 (Chord/Poly)
+#define MIXER_GAIN_DRUMS 0.35f // Drum kit into the output mixer
+#define MIXER_GAIN_SDSP 0.5f   // S-DSP voices into the output mixer (volume is per voice)
+#define MIXER_GAIN_LOOP 0.5f   // WAV loop backing track into the output mixer
+#define VIBRATO_RANGE_OCTAVES 0.1f // Pitch swing at full vibrato depth
+#define MASTER_VOLUME_DEFAULT 0.5f
+#define MASTER_VOLUME_WRITE_STEP (1.0f / 128.0f) // About one codec volume step: smaller moves wait
+
+// Voice oscillator that skips its update entirely while gated: no phase work and no
+// audio block allocated. A voice is gated once its envelope has faded to idle.
+class GatedWaveformModulated : public AudioSynthWaveformModulated {
+public:
+    void gate(bool closed) { gated = closed; }
+    bool isGated() const { return gated; }
+    virtual void update(void) {
+        if (!gated) AudioSynthWaveformModulated::update();
+    }
+private:
+    volatile bool gated = true;
+};
+
+static_assert(NUM_VOICES <= SDSP_VOICES, "each allocator voice needs an S-DSP voice");
 
 // Forward declarations for audio components
-extern AudioSynthWaveform waveform[4];
-extern AudioSynthWaveformModulated waveformMod[4];
-extern AudioEffectEnvelope envelope[4];
-extern AudioSynthWaveform lfo[4];
+extern GatedWaveformModulated waveformMod[NUM_VOICES];
+extern VoiceEnvelope envelope[NUM_VOICES]; // Ticked by updateVoices()
 extern AudioMixer4 mixer;  // Mixer to combine all voices
+extern AudioSynthDrumKit drums;
+extern AudioSynthSDsp sdsp;    // BRR sample voices ("engine brr")
+extern AudioMixer4 outputMixer; // Voices + drums + S-DSP + WAV loop
+extern AudioEffectSDspEcho masterEcho; // Whole mix, passes through while "echo off"
+extern AudioRecordWav wavRecorder; // Taps the echo output ("rec start")
+extern AudioPlayWavLoop wavLoop; // SD backing loop ("loop play")
 extern AudioOutputI2S i2s1;
 extern AudioControlSGTL5000 sgtl5000_1;  // Audio shield
-extern AudioConnection* patchCords[16];  // 4 voices to mixer (4), mixer to left (1), mixer to right (1), plus waveform to waveformMod (4) and waveformMod to envelope (4)
+extern AudioConnection patchCords[AUDIO_PATCH_CORDS];
 
 // Audio function declarations
 void setupAudio();
-void playNote(SynthState& state, int voice, int midiNote);
-void stopNote(int voice);
-void updateAudio(SynthState& state);
+
+// Patches in the voices the current play style needs and unpatches idle voices it
+// does not (Monophonic only uses voice 0). Once per control tick.
+void updateAudioGraph(const SynthState& state);
+void connectVoice(int voice); // Before a note starts on a voice
+bool voiceConnected(int voice);
+
+// Codec output volume, 0..1. The change is eased in (SMOOTH_VOLUME) and written to the
+// codec by updateMasterVolume(), once per control tick, only when it has moved a step.
+void setMasterVolume(float level);
+float masterVolume(); // The target
+void updateMasterVolume();
+
+// Vibrato settings for the shared LFO bank (lfo_bank.h)
+float vibratoRateHz(const SynthState& state);
+float vibratoDepthOctaves(const SynthState& state); // 0 when off or bypassed by the governor
 
 // MIDI Clock and Boogie Mode
 // void processMidiTick(SynthState& state); // Removed - Logic moved to main loop/callbacks
@@ -0,0 +1,310 @@
+// bench.cpp
+// Microbenchmark cases and runner. Each case runs in batches against a scratch copy
+// of the live SynthState; per-call min/median/mean/max over the batches is reported.
+
+#include "bench.h"
+#include "chords.h"
+#include "synth.h"
+#include "audio.h"
+#include "voice_manager.h"
+#include "controller.h"
+#include "commands.h"
+#include "playstyles.h"
+#include "button_defs.h"
+#include "debug.h"
+#include "drum_voice.h"
+#include "sdsp.h"
+#include "echo.h"
+#include <string.h>
+
+#ifdef SNES_HOST_BUILD
+#include <chrono>
+
+static void benchTimerInit() {}
+
+static inline uint32_t benchNow() {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+const char* benchUnit() {
+    return "ns";
+}
+#else
+static void benchTimerInit() {
+    // Teensy 4 enables the cycle counter at startup; Teensy 3.x needs it switched on
+    ARM_DEMCR |= ARM_DEMCR_TRCENA;
+    ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+}
+
+static inline uint32_t benchNow() {
+    return ARM_DWT_CYCCNT;
+}
+
+const char* benchUnit() {
+    return "cycles";
+}
+#endif
+
+struct BenchCase {
+    const char* name;
+    bool noisy; // Plays notes / sends MIDI / floods Serial: host only
+    void (*prepare)(SynthState& state);
+    void (*run)(SynthState& state, uint32_t i);
+};
+
+static SynthState benchState;
+static volatile int benchSink = 0; // Keeps results of pure functions alive
+
+// --- Cases ---
+
+static void prepareNothing(SynthState& state) {
+    (void)state;
+}
+
+static void runGetChordNotes(SynthState& state, uint32_t i) {
+    int chordNotes[4];
+    int numNotes = 0;
+    getChordNotes(state, i % 7, chordNotes, numNotes);
+    benchSink = benchSink + numNotes;
+}
+
+static void runUpdateScale(SynthState& state, uint32_t i) {
+    state.scaleMode = i % NUM_SCALES;
+    updateScale(state);
+}
+
+static void prepareGetBaseMidiNote(SynthState& state) {
+    // Every note button held; the held order makes the pick constant-time regardless
+    resetHeldOrder(state);
+    for (int i = 0; i < 12; i++) state.held[i] = i < MAX_NOTE_BUTTONS;
+    for (int i = 0; i < MAX_NOTE_BUTTONS; i++) heldOrderPress(state, i);
+}
+
+static void runGetBaseMidiNote(SynthState& state, uint32_t i) {
+    (void)i;
+    benchSink = benchSink + getBaseMidiNote(state);
+}
+
+static void runProcessButtonEdges(SynthState& state, uint32_t i) {
+    // Alternate between all released and one button down (active low)
+    state.snesRegister = (i & 1) ? (short)0xFFFF : (short)~(1 << ((i >> 1) % 12));
+    processButtonEdges(state);
+}
+
+static void prepareCheckCommands(SynthState& state) {
+    // Typical loop: a note button held, no L+R combo
+    for (int i = 0; i < 12; i++) state.held[i] = state.prevHeld[i] = false;
+    state.held[BTN_A] = state.prevHeld[BTN_A] = true;
+}
+
+static void runCheckCommands(SynthState& state, uint32_t i) {
+    (void)i;
+    checkCommands(state);
+}
+
+static void prepareDebugFiltered(SynthState& state) {
+    (void)state;
+    currentDebugLevel[CAT_GENERAL] = LEVEL_OFF;
+}
+
+static void prepareDebugEmitted(SynthState& state) {
+    (void)state;
+    currentDebugLevel[CAT_GENERAL] = LEVEL_INFO;
+}
+
+static void runDebugPrint(SynthState& state, uint32_t i) {
+    DEBUG_INFO(CAT_GENERAL, "Bench message %lu note %d", (unsigned long)i, state.currentMidiNote);
+}
+
+// Separate kit so the live one in the audio graph is never touched; retriggered often
+// enough that all three sounds are always rendering
+static AudioSynthDrumKit benchDrums;
+static int16_t benchDrumBlock[AUDIO_BLOCK_SAMPLES];
+
+static void runDrumKitBlock(SynthState& state, uint32_t i) {
+    (void)state;
+    if (i % 64 == 0) {
+        benchDrums.trigger(DRUM_KICK);
+        benchDrums.trigger(DRUM_SNARE);
+        benchDrums.trigger(DRUM_HAT);
+    }
+    benchDrums.renderBlock(benchDrumBlock);
+    benchSink = benchSink + benchDrumBlock[0];
+}
+
+// Separate S-DSP as well. One voice and all eight: the difference over seven is the
+// per-voice cost, the remainder the fixed block overhead
+static AudioSynthSDsp benchSDsp;
+static int16_t benchSDspBlock[AUDIO_BLOCK_SAMPLES];
+
+static void keyOnBenchVoices(int count) {
+    for (int v = 0; v < SDSP_VOICES; v++) {
+        if (v < count) benchSDsp.keyOn(v, brrSampleAt(v % brrSampleCount()), 110.0f * (v + 1));
+        else benchSDsp.keyOff(v);
+    }
+}
+
+static void prepareSDsp1(SynthState& state) {
+    (void)state;
+    keyOnBenchVoices(1);
+}
+
+static void prepareSDsp8(SynthState& state) {
+    (void)state;
+    keyOnBenchVoices(SDSP_VOICES);
+}
+
+static void runSDspBlock(SynthState& state, uint32_t i) {
+    (void)state;
+    (void)i;
+    benchSDsp.renderBlock(benchSDspBlock);
+    benchSink = benchSink + benchSDspBlock[0];
+}
+
+// Echo at its longest delay with feedback, fed a full-scale ramp every block
+DMAMEM static int16_t benchEchoLine[ECHO_MAX_SAMPLES];
+static AudioEffectSDspEcho benchEcho(benchEchoLine);
+static int16_t benchEchoIn[AUDIO_BLOCK_SAMPLES];
+static int16_t benchEchoOut[AUDIO_BLOCK_SAMPLES];
+
+static void prepareEcho(SynthState& state) {
+    (void)state;
+    for (int n = 0; n < AUDIO_BLOCK_SAMPLES; n++) benchEchoIn[n] = (int16_t)(n * 511 - 32768);
+    benchEcho.setEnabled(true);
+    benchEcho.setDelaySamples(ECHO_MAX_SAMPLES);
+    benchEcho.setVolume(64);
+    benchEcho.setFeedback(96);
+}
+
+static void runEchoBlock(SynthState& state, uint32_t i) {
+    (void)state;
+    (void)i;
+    benchEcho.renderBlock(benchEchoIn, benchEchoOut);
+    benchSink = benchSink + benchEchoOut[0];
+}
+
+static void prepareMonophonic(SynthState& state) {
+    state.playStyle = MONOPHONIC;
+    state.boogieModeEnabled = false;
+    state.rhythmicModeEnabled = false;
+    resetHeldOrder(state);
+}
+
+static void runMonophonic(SynthState& state, uint32_t i) {
+    // Alternate press and release, walking across the note buttons
+    int button = (i >> 1) % 8;
+    for (int b = 0; b < 12; b++) {
+        state.prevHeld[b] = state.held[b];
+        state.pressed[b] = 0;
+        state.released[b] = 0;
+    }
+    bool down = !(i & 1);
+    state.held[button] = down;
+    state.pressed[button] = down;
+    state.released[button] = !down;
+    if (down) heldOrderPress(state, button);
+    else heldOrderRelease(state, button);
+    handleMonophonic(state);
+}
+
+static void prepareBoogie(SynthState& state) {
+    state.boogieModeEnabled = true;
+    state.rhythmicModeEnabled = false;
+    state.tempoEstablished = true;
+    state.usPerMidiTick = 500000.0f / 24.0f; // 120 BPM
+    state.midiSyncEnabled = false;
+    state.prevMidiSyncEnabled = false;
+    for (int i = 0; i < 12; i++) state.held[i] = false;
+    state.held[0] = true;
+    resetHeldOrder(state);
+    heldOrderPress(state, 0);
+}
+
+static void runBoogie(SynthState& state, uint32_t i) {
+    (void)i;
+    handleBoogieTiming(state);
+}
+
+static const BenchCase benchCases[] = {
+    {"getChordNotes", false, prepareNothing, runGetChordNotes},
+    {"updateScale", false, prepareNothing, runUpdateScale},
+    {"getBaseMidiNote", false, prepareGetBaseMidiNote, runGetBaseMidiNote},
+    {"processButtonEdges", false, prepareNothing, runProcessButtonEdges},
+    {"checkCommands", false, prepareCheckCommands, runCheckCommands},
+    {"debugPrint_filtered", false, prepareDebugFiltered, runDebugPrint},
+    {"drumKit_block", false, prepareNothing, runDrumKitBlock},
+    {"sdsp_block1", false, prepareSDsp1, runSDspBlock},
+    {"sdsp_block8", false, prepareSDsp8, runSDspBlock},
+    {"echo_block", false, prepareEcho, runEchoBlock},
+    {"debugPrint_emitted", true, prepareDebugEmitted, runDebugPrint},
+    {"handleMonophonic", true, prepareMonophonic, runMonophonic},
+    {"handleBoogieTiming", true, prepareBoogie, runBoogie},
+};
+static const int NUM_BENCH_CASES = sizeof(benchCases) / sizeof(benchCases[0]);
+
+// --- Runner ---
+
+static void sortFloats(float* values, int count) {
+    for (int i = 1; i < count; i++) {
+        float v = values[i];
+        int j = i - 1;
+        while (j >= 0 && values[j] > v) { values[j + 1] = values[j]; j--; }
+        values[j + 1] = v;
+    }
+}
+
+int runBenchmarks(const SynthState& liveState, int batches, uint32_t iterations,
+                  bool includeNoisy, const char* filter, BenchReportFn report) {
+    if (batches < 1) batches = 1;
+    if (batches > BENCH_MAX_BATCHES) batches = BENCH_MAX_BATCHES;
+    if (iterations < 1) iterations = 1;
+
+    DebugLevel savedLevels[CAT_COUNT];
+    memcpy(savedLevels, currentDebugLevel, sizeof(savedLevels));
+    benchTimerInit();
+
+    int casesRun = 0;
+    for (int c = 0; c < NUM_BENCH_CASES; c++) {
+        const BenchCase& bench = benchCases[c];
+        if (bench.noisy && !includeNoisy) continue;
+        if (filter && filter[0] && !strstr(bench.name, filter)) continue;
+
+        float perCall[BENCH_MAX_BATCHES];
+        float sum = 0.0f;
+        for (int b = 0; b < batches; b++) {
+            benchState = liveState;
+            bench.prepare(benchState);
+            uint32_t start = benchNow();
+            for (uint32_t i = 0; i < iterations; i++) bench.run(benchState, i);
+            uint32_t elapsed = benchNow() - start;
+            perCall[b] = (float)elapsed / (float)iterations;
+            sum += perCall[b];
+        }
+        memcpy(currentDebugLevel, savedLevels, sizeof(savedLevels));
+        if (bench.noisy) {
+            for (int v = 0; v < NUM_VOICES; v++) stopNote(v);
+        }
+
+        sortFloats(perCall, batches);
+        BenchResult result;
+        result.name = bench.name;
+        result.batches = batches;
+        result.iterations = iterations;
+        result.minPerCall = perCall[0];
+        result.medianPerCall = perCall[batches / 2];
+        result.meanPerCall = sum / batches;
+        result.maxPerCall = perCall[batches - 1];
+        report(result);
+        casesRun++;
+    }
+    return casesRun;
+}
+
+void formatBenchResult(const BenchResult& result, char* buffer, size_t size) {
+    snprintf(buffer, size,
+             "{\"name\":\"%s\",\"firmware\":\"%s\",\"unit\":\"%s\",\"batches\":%d,\"iterations\":%lu,"
+             "\"min\":%.1f,\"median\":%.1f,\"mean\":%.1f,\"max\":%.1f}",
+             result.name, FIRMWARE_VERSION, benchUnit(), result.batches, (unsigned long)result.iterations,
+             result.minPerCall, result.medianPerCall, result.meanPerCall, result.maxPerCall);
+}
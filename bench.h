@@ -0,0 +1,44 @@
+// bench.h
+// Microbenchmarks for the per-loop control path (chord/scale lookup, button edges,
+// playstyle handlers, debug output). Shared by the host bench tool and the "bench"
+// Serial command, which runs a reduced, silent subset on the Teensy.
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "synth_state.h"
+#include <Arduino.h>
+
+#define FIRMWARE_VERSION "V12.7"
+
+// Iteration counts for the on-device run (kept short: getChordNotes prints every call)
+#define BENCH_DEVICE_BATCHES 5
+#define BENCH_DEVICE_ITERATIONS 50
+#define BENCH_MAX_BATCHES 31
+
+struct BenchResult {
+    const char* name;
+    int batches;
+    uint32_t iterations; // Calls per batch
+    // Time per call over all batches, in benchUnit() units
+    float minPerCall;
+    float medianPerCall;
+    float meanPerCall;
+    float maxPerCall;
+};
+
+typedef void (*BenchReportFn)(const BenchResult& result);
+
+// Runs every benchmark whose name contains 'filter' (nullptr = all) against a scratch
+// copy of 'liveState'. Cases that make sound or send MIDI only run when includeNoisy is
+// set. Debug levels are restored afterwards. Returns the number of benchmarks run.
+int runBenchmarks(const SynthState& liveState, int batches, uint32_t iterations,
+                  bool includeNoisy, const char* filter, BenchReportFn report);
+
+// "cycles" on the Teensy (DWT cycle counter), "ns" on the host
+const char* benchUnit();
+
+// One JSON object per result, no trailing newline
+void formatBenchResult(const BenchResult& result, char* buffer, size_t size);
+
+#endif // BENCH_H
@@ -0,0 +1,40 @@
+// brr_samples.cpp
+// Built-in BRR samples: single 16-sample cycles that loop on themselves, so they sound
+// at 2 kHz (32000 / 16) with the pitch register at unity.
+
+#include "sdsp.h"
+#include "sample_bank.h"
+
+// Header 0xC3: range 12, filter 0, loop + end. Nibbles -8..7.
+static const uint8_t brrSaw[] = {
+    0xC3, 0x89, 0xAB, 0xCD, 0xEF, 0x01, 0x23, 0x45, 0x67
+};
+
+// Header 0xB3: range 11, filter 0, loop + end. Eight +7s then eight -8s.
+static const uint8_t brrSquare[] = {
+    0xB3, 0x77, 0x77, 0x77, 0x77, 0x88, 0x88, 0x88, 0x88
+};
+
+// Header 0xC3: round(7 * sin) over one cycle
+static const uint8_t brrSine[] = {
+    0xC3, 0x03, 0x56, 0x76, 0x53, 0x0D, 0xBA, 0x9A, 0xBD
+};
+
+const BrrSample brrBuiltinSamples[] = {
+    {"saw", brrSaw, sizeof(brrSaw), 0, SDSP_SAMPLE_RATE / 16.0f},
+    {"square", brrSquare, sizeof(brrSquare), 0, SDSP_SAMPLE_RATE / 16.0f},
+    {"sine", brrSine, sizeof(brrSine), 0, SDSP_SAMPLE_RATE / 16.0f},
+};
+const int NUM_BRR_BUILTIN_SAMPLES = sizeof(brrBuiltinSamples) / sizeof(brrBuiltinSamples[0]);
+
+// The built-ins come first, then the SD card bank in directory order
+int brrSampleCount() {
+    return NUM_BRR_BUILTIN_SAMPLES + sampleBankCount();
+}
+
+const BrrSample* brrSampleAt(int index) {
+    if (index < 0) index = 0;
+    if (index >= brrSampleCount()) index = brrSampleCount() - 1;
+    if (index < NUM_BRR_BUILTIN_SAMPLES) return &brrBuiltinSamples[index];
+    return sampleBankAt(index - NUM_BRR_BUILTIN_SAMPLES);
+}
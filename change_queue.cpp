@@ -0,0 +1,136 @@
+// change_queue.cpp
+// Implements the pending-change queue: immediate or queued requests, the MIDI clock
+// count that finds the beat and bar lines, and the apply step that lands every queued
+// change in the same pass.
+
+#include "change_queue.h"
+#include "playstyles.h"
+#include "voice_manager.h"
+#include "debug.h"
+#include <string.h>
+
+static PendingChange queue[NUM_CHANGE_PARAMS]; // At most one change per parameter
+static int queued = 0;
+static int grid = QUANTIZE_OFF;
+static uint32_t clocks = 0; // MIDI clocks since Start; 0 is the downbeat
+
+static const char* const gridNames[NUM_QUANTIZE_GRIDS] = {"off", "beat", "bar"};
+
+static int currentMode(const SynthState& state) {
+    if (state.boogieModeEnabled) return PLAY_MODE_BOOGIE;
+    return state.rhythmicModeEnabled ? PLAY_MODE_RHYTHMIC : PLAY_MODE_STANDARD;
+}
+
+static void applyChange(SynthState& state, const PendingChange& change) {
+    switch (change.param) {
+        case CHANGE_SCALE:
+            state.scaleMode = change.value;
+            state.needsScaleUpdate = true;
+            break;
+        case CHANGE_BASE:
+            state.baseNote = change.value;
+            state.needsScaleUpdate = true;
+            break;
+        case CHANGE_OFFSET:
+            state.keyOffset = change.value;
+            state.needsScaleUpdate = true;
+            break;
+        case CHANGE_MODE:
+            if (change.value == currentMode(state)) break;
+            state.boogieModeEnabled = (change.value == PLAY_MODE_BOOGIE);
+            state.rhythmicModeEnabled = (change.value == PLAY_MODE_RHYTHMIC);
+            // Stop notes from the previous mode
+            if (state.boogieCurrentMidiNote != -1) { DEBUG_VERBOSE(CAT_MIDI, "Stopping Boogie note on mode change"); sendMidiNoteOff(state.boogieCurrentMidiNote, 0, MIDI_CHANNEL); stopNote(0); state.boogieCurrentMidiNote = -1; state.boogieTriggerButton = -1; state.boogieCurrentSlotIndex = -1; }
+            if (state.lastRhythmicMidiNote != -1) { DEBUG_VERBOSE(CAT_MIDI, "Stopping Rhythmic note on mode change"); sendMidiNoteOff(state.lastRhythmicMidiNote, 0, MIDI_CHANNEL); stopNote(0); state.lastRhythmicMidiNote = -1; }
+            break;
+    }
+}
+
+// Every queued change in one pass, in request order
+static void applyQueue(SynthState& state) {
+    if (queued == 0) return;
+    DEBUG_INFO(CAT_COMMAND, "Applying %d quantized change(s)", queued);
+    for (int i = 0; i < queued; i++) applyChange(state, queue[i]);
+    queued = 0;
+}
+
+void resetChangeQueue() {
+    queued = 0;
+    grid = QUANTIZE_OFF;
+    clocks = 0;
+}
+
+void setQuantizeGrid(int newGrid) {
+    if (newGrid < 0 || newGrid >= NUM_QUANTIZE_GRIDS) return;
+    grid = newGrid;
+}
+
+int quantizeGrid() {
+    return grid;
+}
+
+bool requestChange(SynthState& state, uint8_t param, int value) {
+    if (param >= NUM_CHANGE_PARAMS) return false;
+    PendingChange change = {param, (int16_t)value};
+    if (grid == QUANTIZE_OFF || !state.midiSyncEnabled) {
+        applyChange(state, change);
+        return false;
+    }
+    for (int i = 0; i < queued; i++) {
+        if (queue[i].param == param) {
+            queue[i].value = change.value;
+            return true;
+        }
+    }
+    queue[queued++] = change;
+    DEBUG_INFO(CAT_COMMAND, "Change queued for the next %s", gridNames[grid]);
+    return true;
+}
+
+int pendingValue(const SynthState& state, uint8_t param) {
+    for (int i = 0; i < queued; i++) {
+        if (queue[i].param == param) return queue[i].value;
+    }
+    switch (param) {
+        case CHANGE_SCALE: return state.scaleMode;
+        case CHANGE_BASE: return state.baseNote;
+        case CHANGE_OFFSET: return state.keyOffset;
+        case CHANGE_MODE: return currentMode(state);
+        default: return 0;
+    }
+}
+
+int pendingChangeCount() {
+    return queued;
+}
+
+const PendingChange& pendingChangeAt(int index) {
+    return queue[index];
+}
+
+void changeQueueClockStart() {
+    clocks = 0;
+}
+
+void changeQueueClockTick(SynthState& state) {
+    uint32_t ticksPerBeat = (uint32_t)state.ticksPerQuarterNote;
+    uint32_t gridTicks = (grid == QUANTIZE_BAR) ? ticksPerBeat * CHANGE_BEATS_PER_BAR : ticksPerBeat;
+    if (gridTicks > 0 && clocks % gridTicks == 0) applyQueue(state);
+    clocks++;
+}
+
+void updateChangeQueue(SynthState& state) {
+    // Clock stopped or timed out, or the grid was switched off: no line is coming
+    if (queued > 0 && (!state.midiSyncEnabled || grid == QUANTIZE_OFF)) applyQueue(state);
+}
+
+const char* quantizeGridName(int g) {
+    return (g >= 0 && g < NUM_QUANTIZE_GRIDS) ? gridNames[g] : "?";
+}
+
+int quantizeGridFromName(const char* name) {
+    for (int g = 0; g < NUM_QUANTIZE_GRIDS; g++) {
+        if (strcmp(name, gridNames[g]) == 0) return g;
+    }
+    return -1;
+}
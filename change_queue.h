@@ -0,0 +1,62 @@
+// change_queue.h
+// Musically quantized parameter changes. With a grid set and a MIDI clock running, key,
+// scale and play-mode changes wait in a small pending queue and are applied together on
+// the next beat or bar of the clock, so a change in a synced set lands on the grid
+// instead of in the middle of a note. Without a clock they apply at once.
+
+#ifndef CHANGE_QUEUE_H
+#define CHANGE_QUEUE_H
+
+#include "synth_state.h"
+
+#define CHANGE_BEATS_PER_BAR 4 // Bars counted from MIDI Start
+
+enum QuantizeGrid {
+    QUANTIZE_OFF,  // Apply immediately
+    QUANTIZE_BEAT,
+    QUANTIZE_BAR,
+    NUM_QUANTIZE_GRIDS
+};
+
+enum ChangeParam {
+    CHANGE_SCALE,  // state.scaleMode
+    CHANGE_BASE,   // state.baseNote
+    CHANGE_OFFSET, // state.keyOffset
+    CHANGE_MODE,   // PlayMode
+    NUM_CHANGE_PARAMS
+};
+
+enum PlayMode {
+    PLAY_MODE_STANDARD,
+    PLAY_MODE_BOOGIE,
+    PLAY_MODE_RHYTHMIC
+};
+
+struct PendingChange {
+    uint8_t param; // ChangeParam
+    int16_t value;
+};
+
+void resetChangeQueue(); // Empty queue, grid off
+void setQuantizeGrid(int grid);
+int quantizeGrid();
+
+// Applies the (already validated) change now, or queues it for the next grid line.
+// A queued change to the same parameter is replaced. Returns true when queued.
+bool requestChange(SynthState& state, uint8_t param, int value);
+// The value a parameter will have once the queue is applied
+int pendingValue(const SynthState& state, uint8_t param);
+int pendingChangeCount();
+const PendingChange& pendingChangeAt(int index);
+
+// Clock tracker: Start puts the next Clock on the downbeat; a Clock on a grid line
+// applies the whole queue at once
+void changeQueueClockStart();
+void changeQueueClockTick(SynthState& state);
+// Once per control tick: a queue left without a running clock is applied
+void updateChangeQueue(SynthState& state);
+
+const char* quantizeGridName(int grid);
+int quantizeGridFromName(const char* name); // -1 for unknown names
+
+#endif // CHANGE_QUEUE_H
@@ -8,7 +8,58 @@
 #include "button_defs.h"
 #include "synth_state.h" // Needed for SynthState reference
 #include "midi.h" // Add for sendMidiNoteOff, MIDI_CHANNEL
-#include "audio.h" // Add for stopNote
+#include "voice_manager.h" // Add for stopNote
+#include "synth.h" // For NUM_SCALES
+#include "bench.h"
+#include "controller.h"
+#include "governor.h"
+#include "lfo_bank.h"
+#include "mod_matrix.h"
+#include "audio.h"
+#include "sample_bank.h"
+#include "midi_capture.h"
+#include "smf_player.h"
+#include "wav_loop.h"
+#include "riff.h"
+#include "change_queue.h"
+
+// Collects Serial input into a line without blocking. Returns true once a full
+// line is available in 'command'. Unlike readStringUntil() this never waits on a
+// partial line, and over-long lines are dropped instead of growing without bound.
+bool readSerialCommand(String& command) {
+    static char lineBuffer[SERIAL_COMMAND_MAX_LENGTH + 1];
+    static int lineLength = 0;
+    static bool lineOverflow = false;
+
+    while (Serial.available() > 0) {
+        int c = Serial.read();
+        if (c < 0) break;
+        if (c == '\n') {
+            bool complete = !lineOverflow;
+            lineBuffer[lineLength] = '\0';
+            lineLength = 0;
+            lineOverflow = false;
+            if (complete) {
+                command = String(lineBuffer);
+                return true;
+            }
+            DEBUG_WARNING(CAT_COMMAND, "Discarded Serial command longer than %d chars", SERIAL_COMMAND_MAX_LENGTH);
+        } else if (lineLength < SERIAL_COMMAND_MAX_LENGTH) {
+            lineBuffer[lineLength++] = (char)c;
+        } else {
+            lineOverflow = true;
+        }
+    }
+    return false;
+}
+
+// Prints one benchmark result as a "BENCH {json}" line so it can be picked out of debug output
+static void printBenchResult(const BenchResult& result) {
+    char line[224];
+    formatBenchResult(result, line, sizeof(line));
+    Serial.print("BENCH ");
+    Serial.println(line);
+}
 
 void handleSerialCommand(String command, SynthState& state) {
     command.trim(); // Remove leading/trailing whitespace
@@ -17,8 +68,7 @@ void handleSerialCommand(String command, SynthState& state) {
         // Extract value after "scale "
         int scaleVal = command.substring(6).toInt();
         if (scaleVal >= 0 && scaleVal < 7) { // Assuming 7 scale modes (0-6)
-            state.scaleMode = scaleVal;
-            state.needsScaleUpdate = true;
+            requestChange(state, CHANGE_SCALE, scaleVal);
             DEBUG_INFO(CAT_COMMAND, "Scale command: Set to %d", scaleVal);
         } else {
             DEBUG_WARNING(CAT_COMMAND, "Scale command: Invalid value %d", scaleVal);
@@ -27,8 +77,7 @@ void handleSerialCommand(String command, SynthState& state) {
         // Extract value after "base "
         int baseVal = command.substring(5).toInt();
         if (baseVal >= 36 && baseVal <= 84) { // Range check for base note
-            state.baseNote = baseVal;
-            state.needsScaleUpdate = true;
+            requestChange(state, CHANGE_BASE, baseVal);
             DEBUG_INFO(CAT_COMMAND, "Base note command: Set to %d", baseVal);
         } else {
             DEBUG_WARNING(CAT_COMMAND, "Base note command: Invalid value %d", baseVal);
@@ -37,8 +86,7 @@ void handleSerialCommand(String command, SynthState& state) {
         // Extract value after "offset "
         int offsetVal = command.substring(7).toInt();
         if (offsetVal >= 0 && offsetVal <= 11) { // Range check for offset
-            state.keyOffset = offsetVal;
-            state.needsScaleUpdate = true;
+            requestChange(state, CHANGE_OFFSET, offsetVal);
             DEBUG_INFO(CAT_COMMAND, "Offset command: Set to %d", offsetVal);
         } else {
             DEBUG_WARNING(CAT_COMMAND, "Offset command: Invalid value %d", offsetVal);
@@ -92,6 +140,16 @@ void handleSerialCommand(String command, SynthState& state) {
     } else if (command == "chord") {
         state.playStyle = CHORD_BUTTON;
         DEBUG_INFO(CAT_COMMAND, "Play style set to chord button");
+    } else if (command.startsWith("priority ")) {
+        String name = command.substring(9);
+        name.toLowerCase();
+        int priority = notePriorityFromName(name.c_str());
+        if (priority >= 0) {
+            state.notePriority = priority;
+            DEBUG_INFO(CAT_COMMAND, "Note priority set to %s", notePriorityName(priority));
+        } else {
+            DEBUG_WARNING(CAT_COMMAND, "Unknown note priority: %s", name.c_str());
+        }
     } else if (command == "portamento") {
         state.portamentoEnabled = !state.portamentoEnabled;
         DEBUG_INFO(CAT_COMMAND, "Portamento %s", state.portamentoEnabled ? "enabled" : "disabled");
@@ -119,6 +177,85 @@ void handleSerialCommand(String command, SynthState& state) {
         } else {
              DEBUG_WARNING(CAT_COMMAND, "Invalid vibrato depth index: %d", newDepth);
         }
+    } else if (command.startsWith("lfo shape")) {
+        int newShape = command.substring(10).toInt();
+        if (newShape >= 0 && newShape < LFO_SHAPE_COUNT) {
+            lfoBank.shape[LFO_VIBRATO] = newShape;
+            DEBUG_INFO(CAT_COMMAND, "Vibrato LFO shape set to %d", newShape);
+        } else {
+            DEBUG_WARNING(CAT_COMMAND, "Invalid LFO shape: %d", newShape);
+        }
+    } else if (command.startsWith("lfo spread")) {
+        // Phase lag between neighbouring voices, percent of a cycle
+        int spreadPercent = command.substring(11).toInt();
+        if (spreadPercent >= 0 && spreadPercent <= 100) {
+            setLfoSpread(spreadPercent / 100.0f);
+            DEBUG_INFO(CAT_COMMAND, "LFO voice spread set to %d%%", spreadPercent);
+        } else {
+            DEBUG_WARNING(CAT_COMMAND, "Invalid LFO spread: %d", spreadPercent);
+        }
+    } else if (command.startsWith("lfo sync")) {
+        // Cycle length in MIDI clock ticks (24 = one beat), 0 = free-running
+        int ticks = command.substring(9).toInt();
+        if (ticks >= 0 && ticks <= 96) {
+            lfoBank.syncTicks[LFO_VIBRATO] = ticks;
+            DEBUG_INFO(CAT_COMMAND, "Vibrato LFO sync set to %d ticks", ticks);
+        } else {
+            DEBUG_WARNING(CAT_COMMAND, "Invalid LFO sync: %d", ticks);
+        }
+    } else if (command.startsWith("mod add ")) {
+        // Format: mod add <source> <destination> <amount>
+        String args = command.substring(8);
+        int firstSpace = args.indexOf(' ');
+        int secondSpace = args.indexOf(' ', firstSpace + 1);
+        uint8_t cc = 0;
+        int source = firstSpace > 0 ? modSourceFromName(args.substring(0, firstSpace).c_str(), cc) : -1;
+        int destination = secondSpace > 0 ? modDestinationFromName(args.substring(firstSpace + 1, secondSpace).c_str()) : -1;
+        if (source < 0 || destination < 0) {
+            DEBUG_WARNING(CAT_COMMAND, "Invalid mod route: %s", args.c_str());
+        } else if (addModRoute(source, cc, destination, args.substring(secondSpace + 1).toFloat()) < 0) {
+            DEBUG_WARNING(CAT_COMMAND, "Mod matrix full (%d routes)", MOD_MAX_ROUTES);
+        }
+    } else if (command.startsWith("mod del ")) {
+        if (!removeModRoute(command.substring(8).toInt())) DEBUG_WARNING(CAT_COMMAND, "No such mod route");
+    } else if (command == "mod clear") {
+        clearModRoutes();
+    } else if (command.startsWith("mod lfo rate ")) {
+        float rateHz = command.substring(13).toFloat();
+        if (rateHz >= 0.0f && rateHz <= 20.0f) lfoBank.rateHz[LFO_MOD] = rateHz;
+        else DEBUG_WARNING(CAT_COMMAND, "Invalid LFO rate: %s", command.substring(13).c_str());
+    } else if (command.startsWith("mod lfo shape ")) {
+        int newShape = command.substring(14).toInt();
+        if (newShape >= 0 && newShape < LFO_SHAPE_COUNT) lfoBank.shape[LFO_MOD] = newShape;
+        else DEBUG_WARNING(CAT_COMMAND, "Invalid LFO shape: %d", newShape);
+    } else if (command.startsWith("mod lfo sync ")) {
+        int ticks = command.substring(13).toInt();
+        if (ticks >= 0 && ticks <= 96) lfoBank.syncTicks[LFO_MOD] = ticks;
+        else DEBUG_WARNING(CAT_COMMAND, "Invalid LFO sync: %d", ticks);
+    } else if (command == "mod") {
+        Serial.printf("MOD routes=%d/%d lfo2 rate=%.2f shape=%u sync=%u\n", modRouteCount(), MOD_MAX_ROUTES,
+                      lfoBank.rateHz[LFO_MOD], lfoBank.shape[LFO_MOD], lfoBank.syncTicks[LFO_MOD]);
+        for (int i = 0; i < modRouteCount(); i++) {
+            const ModRoute& route = modRouteAt(i);
+            if (route.source == MOD_SRC_CC) Serial.printf("MOD %d cc%u -> %s %.2f\n", i, route.cc, modDestinationName(route.destination), route.amount);
+            else Serial.printf("MOD %d %s -> %s %.2f\n", i, modSourceName(route.source), modDestinationName(route.destination), route.amount);
+        }
+    } else if (command.startsWith("volume ")) {
+        int percent = command.substring(7).toInt();
+        if (percent >= 0 && percent <= 100) setMasterVolume(percent / 100.0f);
+        else DEBUG_WARNING(CAT_COMMAND, "Invalid volume: %d", percent);
+    } else if (command.startsWith("smooth ")) {
+        // Format: smooth <parameter> <ms>
+        String args = command.substring(7);
+        int space = args.indexOf(' ');
+        int param = space > 0 ? smoothParamFromName(args.substring(0, space).c_str()) : -1;
+        int ms = space > 0 ? args.substring(space + 1).toInt() : -1;
+        if (param >= 0 && ms >= 0 && ms <= SMOOTH_MAX_MS) setSmoothingTime(param, (float)ms);
+        else DEBUG_WARNING(CAT_COMMAND, "Invalid smoothing: %s", args.c_str());
+    } else if (command == "smooth") {
+        Serial.print("SMOOTH");
+        for (int p = 0; p < SMOOTH_PARAM_COUNT; p++) Serial.printf(" %s=%d", smoothParamName(p), (int)smoothingTime(p));
+        Serial.println();
     } else if (command.startsWith("pattern")) {
         // Format: pattern <numNotes> <totalTicks>
         int firstSpace = command.indexOf(' ');
@@ -130,7 +267,7 @@ void handleSerialCommand(String command, SynthState& state) {
             float totalTicks = command.substring(secondSpace + 1).toFloat();
 
             // Validate values
-            if (numNotes >= 1 && numNotes <= state.MAX_PATTERN_NOTES && totalTicks > 0.1f) { // Basic validation
+            if (numNotes >= 1 && numNotes <= state.MAX_PATTERN_NOTES && totalTicks > 0.1f && totalTicks <= MAX_PATTERN_LENGTH_TICKS) { // Basic validation
                  DEBUG_INFO(CAT_COMMAND, "Pattern command received: N=%d, TotalTicks=%.2f", numNotes, totalTicks);
                  
                  // Update state
@@ -175,36 +312,249 @@ void handleSerialCommand(String command, SynthState& state) {
     } else if (command.startsWith("mode")) {
         String modeName = command.substring(5); // Get name after "mode "
         modeName.toLowerCase(); // Consistent comparison
+        // The mode change stops notes from the previous mode when it is applied
         if (modeName == "standard") {
-            state.boogieModeEnabled = false;
-            state.rhythmicModeEnabled = false;
+            requestChange(state, CHANGE_MODE, PLAY_MODE_STANDARD);
             DEBUG_INFO(CAT_COMMAND, "Mode set to Standard");
         } else if (modeName == "boogie") {
-            state.boogieModeEnabled = true;
-            state.rhythmicModeEnabled = false;
+            requestChange(state, CHANGE_MODE, PLAY_MODE_BOOGIE);
             DEBUG_INFO(CAT_COMMAND, "Mode set to Boogie");
         } else if (modeName == "rhythmic") {
-            state.boogieModeEnabled = false;
-            state.rhythmicModeEnabled = true;
+            requestChange(state, CHANGE_MODE, PLAY_MODE_RHYTHMIC);
             DEBUG_INFO(CAT_COMMAND, "Mode set to Rhythmic");
         } else {
             DEBUG_WARNING(CAT_COMMAND, "Unknown mode: %s", modeName.c_str());
         }
-        // Stop notes from previous mode when changing via GUI
-        if (state.boogieCurrentMidiNote != -1) { DEBUG_VERBOSE(CAT_MIDI, "Stopping Boogie note on mode change (GUI)"); sendMidiNoteOff(state.boogieCurrentMidiNote, 0, MIDI_CHANNEL); stopNote(0); state.boogieCurrentMidiNote = -1; state.boogieTriggerButton = -1; state.boogieCurrentSlotIndex = -1; }
-        if (state.lastRhythmicMidiNote != -1) { DEBUG_VERBOSE(CAT_MIDI, "Stopping Rhythmic note on mode change (GUI)"); sendMidiNoteOff(state.lastRhythmicMidiNote, 0, MIDI_CHANNEL); stopNote(0); state.lastRhythmicMidiNote = -1; }
     } else if (strncmp(command.c_str(), "set mode ", 9) == 0) {
         int modeVal = atoi(command.c_str() + 9);
         if (modeVal >= 0 && modeVal < NUM_SCALES) { // Use NUM_SCALES defined in synth.h
-            state.scaleMode = modeVal;
-            state.needsScaleUpdate = true; // Trigger scale recalculation
-            Serial.printf("COMMAND: Scale Mode set to %d\n", state.scaleMode);
-            DEBUG_INFO(CAT_COMMAND, "Scale mode command: Set to %d", state.scaleMode);
+            bool queued = requestChange(state, CHANGE_SCALE, modeVal);
+            Serial.printf("COMMAND: Scale Mode set to %d%s\n", modeVal, queued ? " (quantized)" : "");
+            DEBUG_INFO(CAT_COMMAND, "Scale mode command: Set to %d", modeVal);
         } else {
             Serial.printf("ERROR: Invalid scale mode value %d (Valid: 0-%d)\n", modeVal, NUM_SCALES - 1);
             DEBUG_WARNING(CAT_COMMAND, "Scale mode command: Invalid value %d", modeVal);
         }
         state.commandJustExecuted = true;
+    } else if (command == "bench") {
+        // Reduced on-device run: silent cases only, state is left untouched
+        int count = runBenchmarks(state, BENCH_DEVICE_BATCHES, BENCH_DEVICE_ITERATIONS, false, nullptr, printBenchResult);
+        Serial.printf("BENCH_DONE %d\n", count);
+    } else if (command.startsWith("drums")) {
+        String setting = command.substring(6);
+        setting.toLowerCase();
+        if (setting == "on" || setting == "off") {
+            state.drumsEnabled = (setting == "on");
+            DEBUG_INFO(CAT_COMMAND, "Drums %s", state.drumsEnabled ? "enabled" : "disabled");
+        } else {
+            DEBUG_WARNING(CAT_COMMAND, "Invalid drums setting: %s", setting.c_str());
+        }
+    } else if (command.startsWith("engine")) {
+        String engineName = command.substring(7);
+        engineName.toLowerCase();
+        if (engineName == "osc" || engineName == "brr") {
+            state.voiceEngine = (engineName == "brr") ? ENGINE_SDSP : ENGINE_OSCILLATOR;
+            DEBUG_INFO(CAT_COMMAND, "Voice engine set to %s", engineName.c_str());
+        } else {
+            DEBUG_WARNING(CAT_COMMAND, "Unknown voice engine: %s", engineName.c_str());
+        }
+    } else if (command.startsWith("brr sample")) {
+        int index = command.substring(11).toInt();
+        if (index >= 0 && index < brrSampleCount()) {
+            state.brrSampleIndex = index;
+            sampleBankSelect(brrSampleAt(index)); // Key ons must not wait for the card
+            DEBUG_INFO(CAT_COMMAND, "BRR sample set to %d (%s)", index, brrSampleAt(index)->name);
+        } else {
+            DEBUG_WARNING(CAT_COMMAND, "Invalid BRR sample: %d", index);
+        }
+    } else if (command.startsWith("brr adsr")) {
+        // Format: brr adsr <attack 0-15> <decay 0-7> <sustain level 0-7> <sustain rate 0-31>
+        int attack = -1, decay = -1, sustainLevel = -1, sustainRate = -1;
+        sscanf(command.c_str() + 8, "%d %d %d %d", &attack, &decay, &sustainLevel, &sustainRate);
+        if (attack >= 0 && attack <= 15 && decay >= 0 && decay <= 7 &&
+            sustainLevel >= 0 && sustainLevel <= 7 && sustainRate >= 0 && sustainRate <= 31) {
+            uint8_t adsr1 = 0x80 | (decay << 4) | attack;
+            uint8_t adsr2 = (sustainLevel << 5) | sustainRate;
+            for (int v = 0; v < SDSP_VOICES; v++) sdsp.setAdsr(v, adsr1, adsr2);
+            DEBUG_INFO(CAT_COMMAND, "BRR ADSR set to %02X %02X", adsr1, adsr2);
+        } else {
+            DEBUG_WARNING(CAT_COMMAND, "Invalid BRR ADSR: %s", command.c_str() + 8);
+        }
+    } else if (command.startsWith("brr gain")) {
+        // Raw S-DSP GAIN register; switches the voices from ADSR to GAIN
+        int gain = command.length() > 9 ? command.substring(9).toInt() : -1;
+        if (gain >= 0 && gain <= 255) {
+            for (int v = 0; v < SDSP_VOICES; v++) {
+                sdsp.setAdsr(v, sdsp.voiceState(v).adsr1 & 0x7F, sdsp.voiceState(v).adsr2);
+                sdsp.setGain(v, (uint8_t)gain);
+            }
+            DEBUG_INFO(CAT_COMMAND, "BRR GAIN set to %02X", gain);
+        } else {
+            DEBUG_WARNING(CAT_COMMAND, "Invalid BRR GAIN: %d", gain);
+        }
+    } else if (command == "bank" || command == "bank scan") {
+        // SD card samples, numbered as "brr sample" numbers them
+        if (command == "bank scan") {
+            setupSampleBank();
+            setupWavRecorder();
+            sampleBankSelect(brrSampleAt(state.brrSampleIndex)); // Bank numbers may have moved
+        }
+        for (int i = 0; i < sampleBankCount(); i++) {
+            const BrrSample* sample = sampleBankAt(i);
+            Serial.printf("BANK %d %s length=%lu loop=%lu\n", NUM_BRR_BUILTIN_SAMPLES + i, sampleBankFileName(sample),
+                          (unsigned long)sample->length, (unsigned long)sample->loopOffset);
+        }
+        Serial.printf("BANK_DONE %d underruns=%lu\n", sampleBankCount(), (unsigned long)sampleBankUnderruns());
+    } else if (command == "echo on" || command == "echo off") {
+        state.echoEnabled = (command == "echo on");
+        DEBUG_INFO(CAT_COMMAND, "Echo %s", state.echoEnabled ? "enabled" : "disabled");
+    } else if (command.startsWith("echo volume") || command.startsWith("echo feedback")) {
+        // S-DSP EVOL / EFB: signed, 127 is about unity
+        bool isVolume = command.startsWith("echo volume");
+        int value = command.substring(isVolume ? 12 : 14).toInt();
+        if (value >= -128 && value <= 127) {
+            if (isVolume) state.echoVolume = value;
+            else state.echoFeedback = value;
+            DEBUG_INFO(CAT_COMMAND, "Echo %s set to %d", isVolume ? "volume" : "feedback", value);
+        } else {
+            DEBUG_WARNING(CAT_COMMAND, "Invalid echo level: %d", value);
+        }
+    } else if (command.startsWith("echo sync")) {
+        // Delay in MIDI clock ticks (6 = a 16th note), 0 = use "echo delay"
+        int ticks = command.substring(10).toInt();
+        if (ticks >= 0 && ticks <= 96) {
+            state.echoSyncTicks = ticks;
+            DEBUG_INFO(CAT_COMMAND, "Echo sync set to %d ticks", ticks);
+        } else {
+            DEBUG_WARNING(CAT_COMMAND, "Invalid echo sync: %d", ticks);
+        }
+    } else if (command.startsWith("echo delay")) {
+        int ms = command.substring(11).toInt();
+        if (ms >= 1 && ms <= ECHO_MAX_MS) {
+            state.echoDelayMs = ms;
+            DEBUG_INFO(CAT_COMMAND, "Echo delay set to %d ms", ms);
+        } else {
+            DEBUG_WARNING(CAT_COMMAND, "Invalid echo delay: %d", ms);
+        }
+    } else if (command.startsWith("echo fir")) {
+        // Format: echo fir <c0> ... <c7>, each -128..127 (FFC0 = oldest tap)
+        int c[ECHO_FIR_TAPS];
+        int parsed = sscanf(command.c_str() + 8, "%d %d %d %d %d %d %d %d", &c[0], &c[1], &c[2], &c[3], &c[4], &c[5], &c[6], &c[7]);
+        bool valid = (parsed == ECHO_FIR_TAPS);
+        for (int t = 0; valid && t < ECHO_FIR_TAPS; t++) valid = (c[t] >= -128 && c[t] <= 127);
+        if (valid) {
+            for (int t = 0; t < ECHO_FIR_TAPS; t++) masterEcho.setFir(t, (int8_t)c[t]);
+            DEBUG_INFO(CAT_COMMAND, "Echo FIR set");
+        } else {
+            DEBUG_WARNING(CAT_COMMAND, "Invalid echo FIR: %s", command.c_str() + 8);
+        }
+    } else if (command.startsWith("midi export")) {
+        // "midi export [serial] [minutes]": the captured MIDI output as a type-0 file
+        String args = command.substring(11);
+        args.trim();
+        SmfDestination destination = SMF_TO_SD;
+        if (args.startsWith("serial")) {
+            destination = SMF_TO_SERIAL;
+            args = args.substring(6);
+            args.trim();
+        }
+        int minutes = args.length() > 0 ? args.toInt() : MIDI_CAPTURE_DEFAULT_MINUTES;
+        if (exportMidiCapture(state, minutes, destination) < 0) Serial.println("SMF failed (no SD card?)");
+    } else if (command.startsWith("backing load ")) {
+        // Standard MIDI File from the card's root, or the built-in demo
+        String name = command.substring(13);
+        name.trim();
+        int notes = (name == "demo") ? loadSmfDemo() : loadSmfFromSd(name.c_str());
+        if (notes < 0) Serial.printf("BACKING failed to load %s\n", name.c_str());
+    } else if (command == "backing play") {
+        playSmf();
+    } else if (command == "backing stop") {
+        stopSmf();
+    } else if (command.startsWith("backing out ")) {
+        String outputs = command.substring(12);
+        if (outputs == "voices") setSmfOutput(SMF_OUT_VOICES);
+        else if (outputs == "midi") setSmfOutput(SMF_OUT_MIDI);
+        else if (outputs == "both") setSmfOutput(SMF_OUT_BOTH);
+        else DEBUG_WARNING(CAT_COMMAND, "Invalid backing output: %s", outputs.c_str());
+    } else if (command == "backing") {
+        static const char* outputNames[] = {"none", "voices", "midi", "both"};
+        Serial.printf("BACKING name=%s notes=%d division=%u length=%lu position=%lu playing=%d out=%s\n",
+                      smfName(), smfEventCount(), smfDivision(), (unsigned long)smfLengthTicks(),
+                      (unsigned long)smfPositionTicks(), smfPlaying() ? 1 : 0, outputNames[smfOutput() & SMF_OUT_BOTH]);
+    } else if (command == "rec start") {
+        if (!startWavRecording()) Serial.println("REC failed (no SD card or already recording)");
+    } else if (command == "rec stop") {
+        stopWavRecording(); // The file closes once the queue has drained
+    } else if (command == "rec") {
+        Serial.printf("REC %s file=%s bytes=%lu queuePeak=%lu/%d overruns=%lu\n",
+                      wavRecording() ? (wavRecorder.isArmed() ? "recording" : "stopping") : "idle",
+                      wavFileName(), (unsigned long)wavDataBytes(), (unsigned long)wavRecorder.queuePeak(),
+                      WAV_QUEUE_BLOCKS, (unsigned long)wavRecorder.overruns());
+    } else if (command.startsWith("loop load ")) {
+        String name = command.substring(10);
+        name.trim();
+        if (!loadWavLoop(name.c_str())) Serial.printf("LOOP failed to load %s\n", name.c_str());
+    } else if (command == "loop play") {
+        playWavLoop();
+    } else if (command == "loop stop") {
+        stopWavLoop();
+    } else if (command.startsWith("loop beats ")) {
+        setWavLoopBeats(command.substring(11).toInt());
+    } else if (command == "loop") {
+        // Fill is in mono frames out of both halves; size WAV_LOOP_HALF_FRAMES from minFill and underruns
+        Serial.printf("LOOP name=%s frames=%lu channels=%u rate=%lu beats=%d speed=%.4f position=%lu playing=%d "
+                      "fill=%lu/%d minFill=%lu underruns=%lu resyncs=%lu\n",
+                      wavLoopName(), (unsigned long)wavLoopFrames(), wavLoopChannels(),
+                      (unsigned long)wavLoopSampleRate(), wavLoopBeats(), wavLoop.rate() / 65536.0f,
+                      (unsigned long)wavLoopPosition(), wavLoopPlaying() ? 1 : 0, (unsigned long)wavLoopFill(),
+                      2 * WAV_LOOP_HALF_FRAMES, (unsigned long)wavLoopMinFill(), (unsigned long)wavLoopUnderruns(),
+                      (unsigned long)wavLoopResyncs());
+    } else if (command.startsWith("quantize ")) {
+        String name = command.substring(9);
+        name.toLowerCase();
+        int newGrid = quantizeGridFromName(name.c_str());
+        if (newGrid >= 0) setQuantizeGrid(newGrid);
+        else DEBUG_WARNING(CAT_COMMAND, "Unknown quantize grid: %s", name.c_str());
+    } else if (command == "quantize") {
+        static const char* paramNames[NUM_CHANGE_PARAMS] = {"scale", "base", "offset", "mode"};
+        Serial.printf("QUANTIZE grid=%s pending=%d", quantizeGridName(quantizeGrid()), pendingChangeCount());
+        for (int i = 0; i < pendingChangeCount(); i++) {
+            Serial.printf(" %s=%d", paramNames[pendingChangeAt(i).param], pendingChangeAt(i).value);
+        }
+        Serial.println();
+    } else if (command == "riff off") {
+        state.customProfileIndex = PROFILE_SCALE;
+    } else if (command.startsWith("riff ")) {
+        int index = command.substring(5).toInt();
+        if (index >= 0 && index < riffCount()) {
+            selectRiff(index);
+            state.customProfileIndex = PROFILE_RIFF;
+            DEBUG_INFO(CAT_COMMAND, "Riff %d (%s)", index, riffAt(index).name);
+        } else {
+            DEBUG_WARNING(CAT_COMMAND, "Invalid riff: %d", index);
+        }
+    } else if (command == "riff") {
+        const RiffDef& riff = riffAt(currentRiff());
+        Serial.printf("RIFF %d/%d name=%s step=%d/%u active=%d\n", currentRiff(), riffCount(), riff.name,
+                      riffCursor(), riff.length, state.customProfileIndex == PROFILE_RIFF ? 1 : 0);
+    } else if (command == "audio") {
+        // Audio CPU/memory since the last "audio", and how many voices are actually rendering
+        int running = 0, patched = 0;
+        float voiceCpu = 0.0f;
+        for (int v = 0; v < NUM_VOICES; v++) {
+            if (!waveformMod[v].isGated()) running++;
+            if (voiceConnected(v)) patched++;
+            voiceCpu += waveformMod[v].processorUsage() + envelope[v].processorUsage();
+        }
+        Serial.printf("AUDIO cpu=%.1f cpuMax=%.1f blocks=%d blocksMax=%d running=%d/%d patched=%d/%d voiceCpu=%.2f sdspCpu=%.2f echoCpu=%.2f\n",
+                      AudioProcessorUsage(), AudioProcessorUsageMax(), AudioMemoryUsage(), AudioMemoryUsageMax(),
+                      running, NUM_VOICES, patched, NUM_VOICES, voiceCpu, sdsp.processorUsage(), masterEcho.processorUsage());
+        AudioProcessorUsageMaxReset();
+        AudioMemoryUsageMaxReset();
+    } else if (command == "governor") {
+        Serial.printf("GOVERNOR level=%d cpu=%.1f blocks=%d degrades=%lu restores=%lu stolen=%lu\n",
+                      (int)governorLevel(), AudioProcessorUsage(), AudioMemoryUsage(),
+                      governorDegradeEvents(), governorRestoreEvents(), (unsigned long)voices.stolen);
     } else {
         DEBUG_WARNING(CAT_COMMAND, "Unknown command: %s", command.c_str());
     }
@@ -288,43 +638,42 @@ void checkCommands(SynthState& state) {
         }
     }
 
-    // Check for L+R+Select (Toggle Mapping Profile)
+    // Check for L+R+Down (Export the last minutes of MIDI output, to Serial without a card)
+    if (state.held[BTN_L] && state.held[BTN_R] && state.pressed[BTN_DOWN]) {
+        exportMidiCapture(state, MIDI_CAPTURE_DEFAULT_MINUTES, sdCardMounted() ? SMF_TO_SD : SMF_TO_SERIAL);
+        state.commandJustExecuted = true;
+    }
+
+    // Check for L+R+Select (Cycle Mapping Profile: Scale / Thunderstruck / Riff)
     if (state.held[BTN_L] && state.held[BTN_R] && state.pressed[BTN_SELECT]) {
-        state.customProfileIndex = (state.customProfileIndex == PROFILE_SCALE) ? PROFILE_THUNDERSTRUCK : PROFILE_SCALE;
-        DEBUG_DEBUG(CAT_COMMAND, "Toggling Mapping Profile: %s", state.customProfileIndex == PROFILE_SCALE ? "Scale" : "Thunderstruck");
-        Serial.printf("Switched to %s Mapping\n", state.customProfileIndex == PROFILE_SCALE ? "Scale" : "Thunderstruck");
+        state.customProfileIndex = (state.customProfileIndex + 1) % NUM_MAPPING_PROFILES;
+        DEBUG_DEBUG(CAT_COMMAND, "Cycling Mapping Profile: %s", profileName(state.customProfileIndex));
+        Serial.printf("Switched to %s Mapping\n", profileName(state.customProfileIndex));
         state.commandJustExecuted = true;
         return; // Ensure we exit after handling
     }
 
     // Check for L+R+Start (Cycle Play Mode: Standard / Boogie / Rhythmic)
     if (state.held[BTN_L] && state.held[BTN_R] && state.pressed[BTN_START]) {
-        // Always cycle the mode regardless of MIDI clock status
-        if (!state.boogieModeEnabled && !state.rhythmicModeEnabled) {
-            // Currently Standard -> Switch to Boogie
-            state.boogieModeEnabled = true;
-            state.rhythmicModeEnabled = false;
+        // Always cycle the mode regardless of MIDI clock status; repeated presses before a
+        // quantized change lands keep cycling from the pending mode
+        int nextMode = (pendingValue(state, CHANGE_MODE) + 1) % 3;
+        if (nextMode == PLAY_MODE_BOOGIE) {
+            // Standard -> Boogie
             Serial.print("MODE: Boogie");
             if (!state.midiSyncEnabled) Serial.print(" (MIDI Clock Inactive)"); // Warn if inactive
-            Serial.println();
-        } else if (state.boogieModeEnabled) {
-            // Currently Boogie -> Switch to Rhythmic
-            state.boogieModeEnabled = false;
-            state.rhythmicModeEnabled = true;
+        } else if (nextMode == PLAY_MODE_RHYTHMIC) {
+            // Boogie -> Rhythmic
             Serial.print("MODE: Rhythmic Pattern");
             if (!state.midiSyncEnabled) Serial.print(" (MIDI Clock Inactive)"); // Warn if inactive
-            Serial.println();
-        } else { // Currently Rhythmic -> Switch to Standard
-            state.boogieModeEnabled = false;
-            state.rhythmicModeEnabled = false;
-            Serial.println("MODE: Standard Play");
+        } else { // Rhythmic -> Standard
+            Serial.print("MODE: Standard Play");
         }
+        // Notes from the previous mode stop when the change is applied
+        if (requestChange(state, CHANGE_MODE, nextMode)) Serial.printf(" (next %s)", quantizeGridName(quantizeGrid()));
+        Serial.println();
         DEBUG_DEBUG(CAT_COMMAND, "Cycled Mode: Boogie=%d, Rhythmic=%d", state.boogieModeEnabled, state.rhythmicModeEnabled);
         
-        // Ensure previous mode notes are stopped regardless of clock status
-        if (state.boogieCurrentMidiNote != -1) { DEBUG_VERBOSE(CAT_MIDI, "Stopping Boogie note on mode change"); sendMidiNoteOff(state.boogieCurrentMidiNote, 0, MIDI_CHANNEL); stopNote(0); state.boogieCurrentMidiNote = -1; state.boogieTriggerButton = -1; state.boogieCurrentSlotIndex = -1; }
-        if (state.lastRhythmicMidiNote != -1) { DEBUG_VERBOSE(CAT_MIDI, "Stopping Rhythmic note on mode change"); sendMidiNoteOff(state.lastRhythmicMidiNote, 0, MIDI_CHANNEL); stopNote(0); state.lastRhythmicMidiNote = -1; }
-        
         state.commandJustExecuted = true;
         return;
     }
@@ -8,7 +8,14 @@
 #include "synth_state.h"
 #include <Arduino.h>
 
+// Longest accepted Serial command line; longer lines are discarded whole
+#define SERIAL_COMMAND_MAX_LENGTH 64
+
+// Longest accepted rhythm pattern ("pattern <n> <ticks>"): 16 bars of 4/4 at 24 PPQN
+#define MAX_PATTERN_LENGTH_TICKS 1536.0f
+
 // Function declarations
+bool readSerialCommand(String& command);
 void handleSerialCommand(String command, SynthState& state);
 void checkCommands(SynthState& state);
 
@@ -0,0 +1,79 @@
+// control_tick.cpp
+// Implements the control tick: an IntervalTimer on the Teensy (which also wakes the
+// core from WFI), or a count derived from micros() on the host so that simulated
+// time drives it deterministically.
+
+#include "control_tick.h"
+#include "debug.h"
+
+static unsigned long droppedTicks = 0;
+
+static int clampTicks(unsigned long ticks) {
+    if (ticks > MAX_CONTROL_TICKS_PER_PASS) {
+        droppedTicks += ticks - MAX_CONTROL_TICKS_PER_PASS;
+        DEBUG_WARNING(CAT_STATE, "Control tick overrun: dropped %lu ticks", ticks - MAX_CONTROL_TICKS_PER_PASS);
+        return MAX_CONTROL_TICKS_PER_PASS;
+    }
+    return (int)ticks;
+}
+
+#ifdef SNES_HOST_BUILD
+static unsigned long nextTickMicros = 0;
+
+void beginControlTick() {
+    nextTickMicros = micros() + CONTROL_TICK_US;
+    droppedTicks = 0;
+}
+
+int takeControlTicks() {
+    unsigned long now = micros();
+    if ((long)(nextTickMicros - now) > (long)CONTROL_TICK_US) {
+        nextTickMicros = now + CONTROL_TICK_US; // Clock was rewound (test reset): resync
+        return 0;
+    }
+    unsigned long ticks = 0;
+    while ((long)(now - nextTickMicros) >= 0) {
+        ticks++;
+        nextTickMicros += CONTROL_TICK_US;
+    }
+    return clampTicks(ticks);
+}
+
+unsigned long nextControlTickMicros() {
+    return nextTickMicros;
+}
+#else
+static IntervalTimer controlTimer;
+static volatile unsigned long pendingTicks = 0;
+static volatile unsigned long lastTickMicros = 0;
+
+static void onControlTimer() {
+    pendingTicks++;
+    lastTickMicros = micros();
+}
+
+void beginControlTick() {
+    pendingTicks = 0;
+    droppedTicks = 0;
+    lastTickMicros = micros();
+    if (!controlTimer.begin(onControlTimer, CONTROL_TICK_US)) {
+        DEBUG_ERROR(CAT_STATE, "Control tick: no free IntervalTimer");
+    }
+}
+
+int takeControlTicks() {
+    noInterrupts();
+    unsigned long ticks = pendingTicks;
+    pendingTicks = 0;
+    interrupts();
+    return clampTicks(ticks);
+}
+
+unsigned long nextControlTickMicros() {
+    return lastTickMicros + CONTROL_TICK_US;
+}
+#endif
+
+unsigned long droppedControlTicks() {
+    return droppedTicks;
+}
@@ -0,0 +1,27 @@
+// control_tick.h
+// Fixed-rate control tick. An IntervalTimer counts ticks in its interrupt; loop()
+// collects them with takeControlTicks() and runs the musical logic once per tick,
+// so portamento, sequencing and timeouts no longer depend on how long a pass takes.
+
+#ifndef CONTROL_TICK_H
+#define CONTROL_TICK_H
+
+#include <Arduino.h>
+
+#define CONTROL_RATE_HZ 2000
+#define CONTROL_TICK_US (1000000UL / CONTROL_RATE_HZ)
+// Catch-up bound after a stalled pass; older ticks are dropped (and counted)
+#define MAX_CONTROL_TICKS_PER_PASS 8
+
+void beginControlTick();
+
+// Number of ticks elapsed since the last call (at most MAX_CONTROL_TICKS_PER_PASS)
+int takeControlTicks();
+
+// When the next tick is due, for sleeping until then
+unsigned long nextControlTickMicros();
+
+// Ticks discarded because a pass fell more than MAX_CONTROL_TICKS_PER_PASS behind
+unsigned long droppedControlTicks();
+
+#endif // CONTROL_TICK_H
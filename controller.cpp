@@ -4,7 +4,9 @@
 
 #include "controller.h"
 #include "debug.h"
+#include "playstyles.h"
 #include <Arduino.h>
+#include <string.h>
 
 // Button order mapping (scaleorder2)
 // Maps raw SNES bits to desired order: down, left, up, right, select, start, y, b, x, a
@@ -39,14 +41,6 @@ void buttonState(SynthState& state) {
     // Save previous state
     state.snesRegOld = state.snesRegister;
     
-    // Save previous held state
-    for (int i = 0; i < 12; i++) {
-        state.prevHeld[i] = state.held[i];
-        state.pressed[i] = 0;
-        state.released[i] = 0;
-        state.held[i] = 0;
-    }
-    
     // Latch controller state
     digitalWrite(SNES_LATCH, HIGH);
     delayMicroseconds(12);
@@ -62,6 +56,18 @@ void buttonState(SynthState& state) {
         delayMicroseconds(6);
     }
     
+    processButtonEdges(state);
+}
+
+void processButtonEdges(SynthState& state) {
+    // Save previous held state
+    for (int i = 0; i < 12; i++) {
+        state.prevHeld[i] = state.held[i];
+        state.pressed[i] = 0;
+        state.released[i] = 0;
+        state.held[i] = 0;
+    }
+    
     // Process button states using the button order mapping
     for (int rawBit = 0; rawBit < 12; rawBit++) {
         int mappedIndex = buttonOrder[rawBit]; // This mapping is now direct
@@ -72,12 +78,70 @@ void buttonState(SynthState& state) {
         state.pressed[mappedIndex] = buttonPressed && !state.prevHeld[mappedIndex];
         state.released[mappedIndex] = !buttonPressed && state.prevHeld[mappedIndex];
 
-        // If any button (0-11) was just pressed, add it to the buffer
-        if (state.pressed[mappedIndex]) {
-            state.lastPressedBuffer[state.lastPressedIndex] = mappedIndex;
-            state.lastPressedIndex = (state.lastPressedIndex + 1) % LAST_PRESS_BUFFER_SIZE;
-            // Optional: Add debug print here if needed
-            // DEBUG_DEBUG(CAT_BUTTON, "Added button %d (%s) to press buffer", mappedIndex, buttonNames[mappedIndex]);
+        // Note buttons join the held order when pressed and leave it when released
+        if (mappedIndex < MAX_NOTE_BUTTONS) {
+            if (state.pressed[mappedIndex]) heldOrderPress(state, mappedIndex);
+            else if (state.released[mappedIndex]) heldOrderRelease(state, mappedIndex);
         }
     }
+}
+
+// --- Held order ---
+
+static const char* const priorityNames[NUM_NOTE_PRIORITIES] = {"last", "low", "high"};
+
+void resetHeldOrder(SynthState& state) {
+    state.heldNewest = -1;
+    state.heldPositions = 0;
+    for (int i = 0; i < MAX_NOTE_BUTTONS; i++) {
+        state.heldOlder[i] = -1;
+        state.heldNewer[i] = -1;
+    }
+}
+
+void heldOrderPress(SynthState& state, int button) {
+    uint16_t bit = 1 << buttonToMusicalPosition[button];
+    if (state.heldPositions & bit) heldOrderRelease(state, button); // Re-press moves it to the front
+    state.heldOlder[button] = state.heldNewest;
+    state.heldNewer[button] = -1;
+    if (state.heldNewest != -1) state.heldNewer[state.heldNewest] = button;
+    state.heldNewest = button;
+    state.heldPositions |= bit;
+}
+
+void heldOrderRelease(SynthState& state, int button) {
+    uint16_t bit = 1 << buttonToMusicalPosition[button];
+    if (!(state.heldPositions & bit)) return;
+    int older = state.heldOlder[button];
+    int newer = state.heldNewer[button];
+    if (older != -1) state.heldNewer[older] = newer;
+    if (newer != -1) state.heldOlder[newer] = older;
+    else state.heldNewest = older;
+    state.heldOlder[button] = -1;
+    state.heldNewer[button] = -1;
+    state.heldPositions &= ~bit;
+}
+
+int priorityButton(const SynthState& state) {
+    uint32_t mask = state.heldPositions;
+    if (mask == 0) return -1;
+    switch (state.notePriority) {
+        case PRIORITY_LOWEST:
+            return musicalPositionToButton[31 - __builtin_clz(mask & (0u - mask))]; // Isolate the lowest bit: one CLZ
+        case PRIORITY_HIGHEST:
+            return musicalPositionToButton[31 - __builtin_clz(mask)];
+        default:
+            return state.heldNewest;
+    }
+}
+
+const char* notePriorityName(int priority) {
+    return (priority >= 0 && priority < NUM_NOTE_PRIORITIES) ? priorityNames[priority] : "?";
+}
+
+int notePriorityFromName(const char* name) {
+    for (int p = 0; p < NUM_NOTE_PRIORITIES; p++) {
+        if (strcmp(name, priorityNames[p]) == 0) return p;
+    }
+    return -1;
 }
\ No newline at end of file
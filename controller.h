@@ -12,7 +12,21 @@
 #define SNES_CLOCK 2
 #define SNES_LATCH 3
 
+// Pad scan period used by loop() (the bit-banged scan itself takes ~0.2 ms)
+#define CONTROLLER_SCAN_INTERVAL_US 1000
+
 void setupController();
 void buttonState(SynthState& state);
+void processButtonEdges(SynthState& state); // held/pressed/released from state.snesRegister
+
+// Held-order tracking for note buttons (0..MAX_NOTE_BUTTONS-1). processButtonEdges()
+// keeps it in step with the pad; all O(1) whatever the number of presses.
+void resetHeldOrder(SynthState& state);
+void heldOrderPress(SynthState& state, int button);
+void heldOrderRelease(SynthState& state, int button);
+// The held note button state.notePriority selects, or -1 with none held
+int priorityButton(const SynthState& state);
+const char* notePriorityName(int priority);
+int notePriorityFromName(const char* name); // -1 for unknown names
 
 #endif
\ No newline at end of file
@@ -0,0 +1,174 @@
+// drum_voice.cpp
+// Implements the drum kit AudioStream. Every sound is a few oscillators with
+// exponential envelopes; decay coefficients are computed once per hit so the
+// per-sample work is only multiplies, adds and table lookups.
+
+#include "drum_voice.h"
+#include "audio.h"
+#include <math.h>
+
+// Kick
+static const float KICK_START_HZ = 160.0f;
+static const float KICK_END_HZ = 45.0f;
+static const float KICK_PITCH_DECAY_S = 0.030f;
+static const float KICK_AMP_DECAY_S = 0.250f;
+// Snare
+static const float SNARE_TONE_HZ = 185.0f;
+static const float SNARE_NOISE_DECAY_S = 0.110f;
+static const float SNARE_TONE_DECAY_S = 0.050f;
+// Hat: the classic 808 square-wave cluster
+static const float HAT_FREQUENCIES_HZ[DRUM_HAT_OSCILLATORS] = {205.3f, 304.4f, 369.6f, 522.7f, 540.0f, 800.0f};
+static const float HAT_AMP_DECAY_S = 0.045f;
+static const float HAT_LEVEL = 0.5f;
+
+static const float DRUM_SILENT = 0.0005f; // Envelope level treated as finished
+static const float HIGHPASS_COEFF = 0.85f; // One-pole high-pass, roughly 1 kHz corner
+
+#define DRUM_SINE_BITS 8
+static int16_t drumSine[(1 << DRUM_SINE_BITS) + 1];
+static float kickPitchDecay, kickAmpDecay, snareNoiseDecay, snareToneDecay, hatAmpDecay;
+static uint32_t snareToneIncrement;
+static uint32_t hatIncrement[DRUM_HAT_OSCILLATORS];
+
+static float decayPerSample(float seconds) {
+    return expf(-1.0f / (seconds * AUDIO_SAMPLE_RATE_EXACT));
+}
+
+static uint32_t phaseIncrement(float hz) {
+    return (uint32_t)(hz * (4294967296.0f / AUDIO_SAMPLE_RATE_EXACT));
+}
+
+static inline float sineAt(uint32_t phase) {
+    return drumSine[phase >> (32 - DRUM_SINE_BITS)] * (1.0f / 32767.0f);
+}
+
+AudioSynthDrumKit::AudioSynthDrumKit() : AudioStream(0, NULL) {
+    static bool tablesReady = false;
+    if (!tablesReady) {
+        for (int i = 0; i <= (1 << DRUM_SINE_BITS); i++) {
+            drumSine[i] = (int16_t)(32767.0f * sinf(2.0f * (float)M_PI * i / (1 << DRUM_SINE_BITS)));
+        }
+        kickPitchDecay = decayPerSample(KICK_PITCH_DECAY_S);
+        kickAmpDecay = decayPerSample(KICK_AMP_DECAY_S);
+        snareNoiseDecay = decayPerSample(SNARE_NOISE_DECAY_S);
+        snareToneDecay = decayPerSample(SNARE_TONE_DECAY_S);
+        hatAmpDecay = decayPerSample(HAT_AMP_DECAY_S);
+        snareToneIncrement = phaseIncrement(SNARE_TONE_HZ);
+        for (int o = 0; o < DRUM_HAT_OSCILLATORS; o++) hatIncrement[o] = phaseIncrement(HAT_FREQUENCIES_HZ[o]);
+        tablesReady = true;
+    }
+    pendingHits = 0;
+    for (int d = 0; d < NUM_DRUM_SOUNDS; d++) pendingVelocity[d] = 0.0f;
+    kickPhase = 0;
+    kickPitchEnv = kickAmp = 0.0f;
+    snarePhase = 0;
+    snareNoiseAmp = snareToneAmp = snareHighpassIn = snareHighpassOut = 0.0f;
+    for (int o = 0; o < DRUM_HAT_OSCILLATORS; o++) hatPhase[o] = 0;
+    hatAmp = hatHighpassIn = hatHighpassOut = 0.0f;
+    noiseSeed = 22222;
+}
+
+void AudioSynthDrumKit::trigger(DrumSound sound, float velocity) {
+    if (sound < 0 || sound >= NUM_DRUM_SOUNDS) return;
+    AudioNoInterrupts();
+    pendingVelocity[sound] = velocity;
+    pendingHits |= (uint8_t)(1 << sound);
+    AudioInterrupts();
+}
+
+bool AudioSynthDrumKit::isActive() const {
+    return pendingHits || kickAmp > DRUM_SILENT || snareNoiseAmp > DRUM_SILENT ||
+           snareToneAmp > DRUM_SILENT || hatAmp > DRUM_SILENT;
+}
+
+void AudioSynthDrumKit::startPendingHits() {
+    uint8_t hits = pendingHits;
+    pendingHits = 0;
+    if (hits & (1 << DRUM_KICK)) {
+        kickPhase = 0;
+        kickPitchEnv = 1.0f;
+        kickAmp = pendingVelocity[DRUM_KICK];
+    }
+    if (hits & (1 << DRUM_SNARE)) {
+        snarePhase = 0;
+        snareNoiseAmp = pendingVelocity[DRUM_SNARE];
+        snareToneAmp = 0.6f * pendingVelocity[DRUM_SNARE];
+    }
+    if (hits & (1 << DRUM_HAT)) {
+        hatAmp = HAT_LEVEL * pendingVelocity[DRUM_HAT];
+    }
+}
+
+bool AudioSynthDrumKit::renderBlock(int16_t* out) {
+    startPendingHits();
+    bool kick = kickAmp > DRUM_SILENT;
+    bool snare = snareNoiseAmp > DRUM_SILENT || snareToneAmp > DRUM_SILENT;
+    bool hat = hatAmp > DRUM_SILENT;
+    if (!kick && !snare && !hat) return false;
+
+    float mix[AUDIO_BLOCK_SAMPLES];
+    for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) mix[i] = 0.0f;
+
+    if (kick) {
+        for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+            float hz = KICK_END_HZ + (KICK_START_HZ - KICK_END_HZ) * kickPitchEnv;
+            mix[i] += sineAt(kickPhase) * kickAmp;
+            kickPhase += phaseIncrement(hz);
+            kickPitchEnv *= kickPitchDecay;
+            kickAmp *= kickAmpDecay;
+        }
+    }
+    if (snare) {
+        for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+            noiseSeed = noiseSeed * 1664525u + 1013904223u;
+            float noise = (float)(int32_t)noiseSeed * (1.0f / 2147483648.0f);
+            snareHighpassOut = HIGHPASS_COEFF * (snareHighpassOut + noise - snareHighpassIn);
+            snareHighpassIn = noise;
+            mix[i] += snareHighpassOut * snareNoiseAmp + sineAt(snarePhase) * snareToneAmp;
+            snarePhase += snareToneIncrement;
+            snareNoiseAmp *= snareNoiseDecay;
+            snareToneAmp *= snareToneDecay;
+        }
+    }
+    if (hat) {
+        for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+            float cluster = 0.0f;
+            for (int o = 0; o < DRUM_HAT_OSCILLATORS; o++) {
+                cluster += (hatPhase[o] & 0x80000000u) ? 1.0f : -1.0f;
+                hatPhase[o] += hatIncrement[o];
+            }
+            cluster *= 1.0f / DRUM_HAT_OSCILLATORS;
+            hatHighpassOut = HIGHPASS_COEFF * (hatHighpassOut + cluster - hatHighpassIn);
+            hatHighpassIn = cluster;
+            mix[i] += hatHighpassOut * hatAmp;
+            hatAmp *= hatAmpDecay;
+        }
+    }
+
+    for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+        float s = mix[i] * 32767.0f;
+        if (s > 32767.0f) s = 32767.0f;
+        if (s < -32768.0f) s = -32768.0f;
+        out[i] = (int16_t)s;
+    }
+    return true;
+}
+
+void AudioSynthDrumKit::update(void) {
+    if (!isActive()) return; // Silent: no block allocated
+    audio_block_t* block = allocate();
+    if (!block) return;
+    if (renderBlock(block->data)) transmit(block);
+    release(block);
+}
+
+void triggerRhythmDrum(const SynthState& state, unsigned long beat, int slot) {
+    if (!state.drumsEnabled) return;
+    if (slot != 0) {
+        drums.trigger(DRUM_HAT, 0.7f);
+    } else if (beat % 2 == 0) {
+        drums.trigger(DRUM_KICK);
+    } else {
+        drums.trigger(DRUM_SNARE);
+    }
+}
@@ -0,0 +1,58 @@
+// drum_voice.h
+// Synthesized percussion for the rhythm modes: a pitch-swept sine kick, a noise snare
+// and a metallic hat, rendered together by one AudioStream with no sample memory.
+// Boogie and Rhythmic trigger it on their note onsets when state.drumsEnabled is set.
+
+#ifndef DRUM_VOICE_H
+#define DRUM_VOICE_H
+
+#include <Audio.h>
+#include "synth_state.h"
+
+enum DrumSound {
+    DRUM_KICK,
+    DRUM_SNARE,
+    DRUM_HAT,
+    NUM_DRUM_SOUNDS
+};
+
+#define DRUM_HAT_OSCILLATORS 6
+
+class AudioSynthDrumKit : public AudioStream {
+public:
+    AudioSynthDrumKit();
+
+    // Safe to call from the main loop; the hit starts at the next audio block
+    void trigger(DrumSound sound, float velocity = 1.0f);
+
+    // Renders one block of all sounding drums. Called by update(); public for the
+    // host tests and benchmarks. Returns false (and leaves 'out' alone) when silent.
+    bool renderBlock(int16_t* out);
+
+    bool isActive() const;
+    virtual void update(void);
+
+private:
+    void startPendingHits();
+
+    volatile uint8_t pendingHits;    // Bit per DrumSound, set by trigger()
+    float pendingVelocity[NUM_DRUM_SOUNDS];
+
+    // Kick: sine with an exponential pitch drop
+    uint32_t kickPhase;
+    float kickPitchEnv, kickAmp;
+    // Snare: high-passed noise plus a short sine body
+    uint32_t snarePhase;
+    float snareNoiseAmp, snareToneAmp, snareHighpassIn, snareHighpassOut;
+    // Hat: six detuned square waves, high-passed
+    uint32_t hatPhase[DRUM_HAT_OSCILLATORS];
+    float hatAmp, hatHighpassIn, hatHighpassOut;
+
+    uint32_t noiseSeed;
+};
+
+// Picks and triggers the drum for a rhythm-mode onset: kick on the downbeat of odd
+// beats, snare on even beats, hat on every other subdivision. No-op unless enabled.
+void triggerRhythmDrum(const SynthState& state, unsigned long beat, int slot);
+
+#endif // DRUM_VOICE_H
@@ -0,0 +1,146 @@
+// echo.cpp
+// Implements the S-DSP style echo. Each block reads its 128 delayed samples in one
+// pass, runs the FIR over them two taps per instruction (SMLAD), then writes the
+// feedback and the output with saturating shifts (SSAT). The delay is never shorter
+// than a block, so no sample written in a block is read back within that block.
+
+#include "echo.h"
+#include "audio.h"
+#include "governor.h"
+#include <dspinst.h>
+#include <string.h>
+
+// A gentle low-pass common in SNES games; the coefficients sum to 128 (unity at DC)
+static const int8_t DEFAULT_FIR[ECHO_FIR_TAPS] = {12, 33, 43, 43, 19, -2, -13, -7};
+
+// Tempo changes smaller than this leave the delay alone, so MIDI clock jitter does
+// not keep moving the echo
+#define ECHO_DELAY_HYSTERESIS_SAMPLES 64
+
+AudioEffectSDspEcho::AudioEffectSDspEcho(int16_t* delayLine)
+    : AudioStream(1, inputQueueArray), line(delayLine) {
+    enabled = false;
+    clearPending = true;
+    length = ECHO_MAX_SAMPLES / 2;
+    position = 0;
+    silentSamples = 0;
+    volume = 0;
+    feedback = 0;
+    for (int t = 0; t < ECHO_FIR_TAPS; t++) setFir(t, DEFAULT_FIR[t]);
+    memset(firHistory, 0, sizeof(firHistory));
+}
+
+void AudioEffectSDspEcho::setEnabled(bool on) {
+    if (on && !enabled) clearPending = true;
+    enabled = on;
+}
+
+void AudioEffectSDspEcho::setDelaySamples(uint32_t samples) {
+    if (samples < AUDIO_BLOCK_SAMPLES) samples = AUDIO_BLOCK_SAMPLES;
+    if (samples > ECHO_MAX_SAMPLES) samples = ECHO_MAX_SAMPLES;
+    if (samples == length) return;
+    AudioNoInterrupts();
+    length = samples;
+    if (position >= length) position = 0;
+    silentSamples = 0; // The newly exposed part of the line may hold old echoes
+    AudioInterrupts();
+}
+
+void AudioEffectSDspEcho::setVolume(int8_t newVolume) {
+    volume = newVolume;
+}
+
+void AudioEffectSDspEcho::setFeedback(int8_t newFeedback) {
+    feedback = newFeedback;
+}
+
+void AudioEffectSDspEcho::setFir(int tap, int8_t coefficient) {
+    if (tap < 0 || tap >= ECHO_FIR_TAPS) return;
+    firCoefficients[tap] = coefficient;
+    int pair = tap >> 1;
+    firPairs[pair] = pack_16b_16b(firCoefficients[pair * 2 + 1], firCoefficients[pair * 2]);
+}
+
+bool AudioEffectSDspEcho::renderBlock(const int16_t* in, int16_t* out) {
+    if (!enabled) return false;
+    if (clearPending) {
+        memset(line, 0, ECHO_MAX_SAMPLES * sizeof(int16_t));
+        memset(firHistory, 0, sizeof(firHistory));
+        silentSamples = ECHO_MAX_SAMPLES + ECHO_FIR_TAPS;
+        clearPending = false;
+    }
+    // Nothing in the line or the FIR history: skip the block entirely
+    if (!in && silentSamples >= length + ECHO_FIR_TAPS) return false;
+
+    // Delayed samples, oldest first, behind the previous block's last seven
+    int16_t delayed[ECHO_FIR_TAPS - 1 + AUDIO_BLOCK_SAMPLES];
+    memcpy(delayed, firHistory, sizeof(firHistory));
+    uint32_t readPos = position;
+    for (int n = 0; n < AUDIO_BLOCK_SAMPLES; n++) {
+        delayed[ECHO_FIR_TAPS - 1 + n] = line[readPos];
+        if (++readPos >= length) readPos = 0;
+    }
+    memcpy(firHistory, delayed + AUDIO_BLOCK_SAMPLES, sizeof(firHistory));
+
+    for (int n = 0; n < AUDIO_BLOCK_SAMPLES; n++) {
+        // FFC0 weights the oldest sample, FFC7 the newest
+        const int16_t* x = delayed + n;
+        int32_t sum = multiply_16tx16t_add_16bx16b(pack_16b_16b(x[1], x[0]), firPairs[0]);
+        sum = multiply_accumulate_16tx16t_add_16bx16b(sum, pack_16b_16b(x[3], x[2]), firPairs[1]);
+        sum = multiply_accumulate_16tx16t_add_16bx16b(sum, pack_16b_16b(x[5], x[4]), firPairs[2]);
+        sum = multiply_accumulate_16tx16t_add_16bx16b(sum, pack_16b_16b(x[7], x[6]), firPairs[3]);
+        int32_t filtered = signed_saturate_rshift(sum, 16, 7);
+
+        int32_t dry = in ? ((int32_t)in[n] << 7) : 0;
+        out[n] = (int16_t)signed_saturate_rshift(dry + filtered * volume, 16, 7);
+        int16_t written = (int16_t)signed_saturate_rshift(dry + filtered * feedback, 16, 7);
+        line[position] = written;
+        if (++position >= length) position = 0;
+        if (written) silentSamples = 0;
+        else if (silentSamples < ECHO_MAX_SAMPLES + ECHO_FIR_TAPS) silentSamples++;
+    }
+    return true;
+}
+
+void AudioEffectSDspEcho::update(void) {
+    audio_block_t* in = receiveReadOnly(0);
+    if (!enabled) {
+        if (in) {
+            transmit(in);
+            release(in);
+        }
+        return;
+    }
+    audio_block_t* out = allocate();
+    if (out) {
+        if (renderBlock(in ? in->data : nullptr, out->data)) transmit(out);
+        release(out);
+    } else if (in) {
+        transmit(in); // Out of blocks: drop the echo, keep the dry signal
+    }
+    if (in) release(in);
+}
+
+uint32_t echoDelaySamplesFor(const SynthState& state) {
+    float ms = (float)state.echoDelayMs;
+    if (state.echoSyncTicks > 0 && state.tempoEstablished && state.usPerMidiTick > 0.0f) {
+        ms = state.usPerMidiTick * state.echoSyncTicks / 1000.0f;
+        while (ms > ECHO_MAX_MS) ms *= 0.5f; // Next shorter note value that fits
+    }
+    return (uint32_t)(ms * AUDIO_SAMPLE_RATE_EXACT / 1000.0f + 0.5f);
+}
+
+void updateEcho(const SynthState& state) {
+    // Under the load governor the echo passes through; re-enabled, it starts silent
+    bool enabled = state.echoEnabled && !governorEchoBypassed();
+    masterEcho.setEnabled(enabled);
+    if (!enabled) return;
+    masterEcho.setVolume((int8_t)state.echoVolume);
+    masterEcho.setFeedback((int8_t)state.echoFeedback);
+    uint32_t samples = echoDelaySamplesFor(state);
+    uint32_t current = masterEcho.delaySamples();
+    uint32_t hysteresis = (state.echoSyncTicks > 0) ? ECHO_DELAY_HYSTERESIS_SAMPLES : 0;
+    if (samples > current + hysteresis || samples + hysteresis < current) {
+        masterEcho.setDelaySamples(samples);
+    }
+}
@@ -0,0 +1,59 @@
+// echo.h
+// Master echo modelled on the SNES S-DSP echo unit: a delay line of up to 240 ms
+// whose output runs through an 8-tap FIR, with echo volume (EVOL) and feedback (EFB)
+// as on the chip. The delay can lock to the MIDI clock tempo ("echo sync").
+
+#ifndef ECHO_H
+#define ECHO_H
+
+#include <Audio.h>
+#include "synth_state.h"
+
+#define ECHO_MAX_MS 240 // The S-DSP's longest delay (EDL = 15)
+#define ECHO_MAX_SAMPLES ((uint32_t)(ECHO_MAX_MS * AUDIO_SAMPLE_RATE_EXACT / 1000.0f))
+#define ECHO_FIR_TAPS 8
+
+class AudioEffectSDspEcho : public AudioStream {
+public:
+    // delayLine holds ECHO_MAX_SAMPLES samples (DMAMEM on the Teensy)
+    explicit AudioEffectSDspEcho(int16_t* delayLine);
+
+    // Disabled, the input passes straight through and the delay line is left alone;
+    // enabling it again starts from a silent delay line
+    void setEnabled(bool on);
+    bool isEnabled() const { return enabled; }
+    void setDelaySamples(uint32_t samples); // Clamped to AUDIO_BLOCK_SAMPLES..ECHO_MAX_SAMPLES
+    uint32_t delaySamples() const { return length; }
+    void setVolume(int8_t volume);     // EVOL: wet level, 127 ~ unity
+    void setFeedback(int8_t feedback); // EFB: echo fed back into the delay line
+    void setFir(int tap, int8_t coefficient); // FFC0..FFC7, 128 total = unity gain
+    int8_t fir(int tap) const { return firCoefficients[tap]; }
+
+    // Processes one block: out = in + echo. 'in' may be nullptr (silence). Called by
+    // update(); public for host tests and benchmarks. Returns false, leaving 'out'
+    // alone, while disabled or once the delay line has run silent with no input.
+    bool renderBlock(const int16_t* in, int16_t* out);
+    virtual void update(void);
+
+private:
+    audio_block_t* inputQueueArray[1];
+    int16_t* line;
+    volatile bool enabled;
+    volatile bool clearPending; // Zero the delay line on the next block
+    uint32_t length;            // Delay line length in samples
+    uint32_t position;          // Read, then write, index into the delay line
+    uint32_t silentSamples;     // Consecutive zero samples written to the delay line
+    int8_t volume, feedback;
+    int8_t firCoefficients[ECHO_FIR_TAPS];
+    uint32_t firPairs[ECHO_FIR_TAPS / 2];  // Coefficients packed two per word for SMLAD
+    int16_t firHistory[ECHO_FIR_TAPS - 1]; // Last delayed samples of the previous block
+};
+
+// Delay length from the state: syncTicks of the MIDI clock while a tempo is known
+// (halved until it fits in ECHO_MAX_MS), otherwise echoDelayMs
+uint32_t echoDelaySamplesFor(const SynthState& state);
+
+// Pushes the state's echo settings to the audio graph's echo. Once per control tick.
+void updateEcho(const SynthState& state);
+
+#endif // ECHO_H
@@ -0,0 +1,86 @@
+// governor.cpp
+// Implements the audio load governor: counts consecutive ticks over the high marks or
+// under the low marks and applies one level change when a count runs out.
+
+#include "governor.h"
+#include "voice_manager.h"
+#include "debug.h"
+#include <Audio.h>
+
+static GovernorLevel level = GOVERNOR_FULL;
+static int ticksOverHigh = 0;
+static int ticksUnderLow = 0;
+static unsigned long degradeEvents = 0;
+static unsigned long restoreEvents = 0;
+
+static const int levelVoiceLimits[GOVERNOR_LEVEL_COUNT] = {
+    NUM_VOICES,     // GOVERNOR_FULL
+    NUM_VOICES,     // GOVERNOR_NO_VIBRATO
+    NUM_VOICES,     // GOVERNOR_NO_ECHO
+    NUM_VOICES / 2, // GOVERNOR_HALF_VOICES
+    1               // GOVERNOR_ONE_VOICE
+};
+
+void resetGovernor() {
+    level = GOVERNOR_FULL;
+    ticksOverHigh = 0;
+    ticksUnderLow = 0;
+    degradeEvents = 0;
+    restoreEvents = 0;
+}
+
+static void applyLevel(GovernorLevel newLevel) {
+    // Vibrato and echo bypass are picked up by updateVoices() and updateEcho() on the
+    // next tick
+    level = newLevel;
+    setVoiceLimit(levelVoiceLimits[level]);
+}
+
+void updateGovernor() {
+    float cpu = AudioProcessorUsage();
+    int blocks = AudioMemoryUsage();
+
+    if (cpu > GOVERNOR_CPU_HIGH_PERCENT || blocks > GOVERNOR_MEMORY_HIGH_BLOCKS) {
+        ticksOverHigh++;
+        ticksUnderLow = 0;
+    } else if (cpu < GOVERNOR_CPU_LOW_PERCENT && blocks < GOVERNOR_MEMORY_LOW_BLOCKS) {
+        ticksUnderLow++;
+        ticksOverHigh = 0;
+    } else {
+        // Between the marks: hold the current level
+        ticksOverHigh = 0;
+        ticksUnderLow = 0;
+    }
+
+    if (ticksOverHigh >= GOVERNOR_DEGRADE_TICKS && level < GOVERNOR_ONE_VOICE) {
+        applyLevel((GovernorLevel)(level + 1));
+        degradeEvents++;
+        ticksOverHigh = 0;
+        DEBUG_WARNING(CAT_AUDIO, "Governor: audio load high (CPU %.1f%%, %d blocks), level %d", cpu, blocks, level);
+    } else if (ticksUnderLow >= GOVERNOR_RESTORE_TICKS && level > GOVERNOR_FULL) {
+        applyLevel((GovernorLevel)(level - 1));
+        restoreEvents++;
+        ticksUnderLow = 0;
+        DEBUG_INFO(CAT_AUDIO, "Governor: audio load low (CPU %.1f%%, %d blocks), level %d", cpu, blocks, level);
+    }
+}
+
+GovernorLevel governorLevel() {
+    return level;
+}
+
+bool governorVibratoBypassed() {
+    return level >= GOVERNOR_NO_VIBRATO;
+}
+
+bool governorEchoBypassed() {
+    return level >= GOVERNOR_NO_ECHO;
+}
+
+unsigned long governorDegradeEvents() {
+    return degradeEvents;
+}
+
+unsigned long governorRestoreEvents() {
+    return restoreEvents;
+}
@@ -0,0 +1,41 @@
+// governor.h
+// Audio load governor. Every control tick it reads the audio library's CPU and block
+// memory usage; under sustained pressure it steps down one level at a time (vibrato
+// off, echo off, then fewer sounding voices) and steps back up once the load has
+// stayed low.
+
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+#include "synth_state.h"
+#include "audio.h"
+#include "control_tick.h"
+
+// Pressure starts above the high marks and ends below the low marks; the gap between
+// them plus the longer restore hold keeps the governor from flapping
+#define GOVERNOR_CPU_HIGH_PERCENT 80.0f
+#define GOVERNOR_CPU_LOW_PERCENT 55.0f
+#define GOVERNOR_MEMORY_HIGH_BLOCKS (AUDIO_MEMORY_BLOCKS - 6)
+#define GOVERNOR_MEMORY_LOW_BLOCKS (AUDIO_MEMORY_BLOCKS / 2)
+#define GOVERNOR_DEGRADE_TICKS (CONTROL_RATE_HZ / 100) // 10 ms over a high mark
+#define GOVERNOR_RESTORE_TICKS (CONTROL_RATE_HZ * 2)   // 2 s under both low marks
+
+enum GovernorLevel {
+    GOVERNOR_FULL,        // Nothing reduced
+    GOVERNOR_NO_VIBRATO,  // Vibrato LFOs bypassed
+    GOVERNOR_NO_ECHO,     // Master echo passes the dry signal through
+    GOVERNOR_HALF_VOICES, // At most NUM_VOICES / 2 voices sound
+    GOVERNOR_ONE_VOICE,   // Only the highest-priority voice sounds
+    GOVERNOR_LEVEL_COUNT
+};
+
+void resetGovernor();
+void updateGovernor(); // Once per control tick
+
+GovernorLevel governorLevel();
+bool governorVibratoBypassed();
+bool governorEchoBypassed();
+unsigned long governorDegradeEvents(); // Steps down since boot
+unsigned long governorRestoreEvents(); // Steps back up since boot
+
+#endif // GOVERNOR_H
@@ -0,0 +1,177 @@
+// Arduino.h (host stand-in)
+// Minimal Linux implementation of the Arduino/Teensyduino core API used by the
+// SNES synth sources: pins, micros/millis, String, Serial and usbMIDI.
+// Only compiled into the host build (see CMakeLists.txt); the Teensy build uses the real core.
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <ctype.h>
+#include <string>
+
+typedef uint8_t byte;
+
+// --- Pins ---
+#define LOW  0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+uint8_t digitalRead(uint8_t pin);
+
+// --- Memory placement (Teensy 4 linker sections); one address space on the host ---
+#define DMAMEM
+#define FASTRUN
+#define PROGMEM
+
+// --- Time ---
+unsigned long micros();
+unsigned long millis();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+// --- Math helpers (Teensy defines these as macros) ---
+template <class A, class B> inline auto min(A a, B b) -> decltype(a < b ? a : b) { return (b < a) ? b : a; }
+template <class A, class B> inline auto max(A a, B b) -> decltype(a < b ? a : b) { return (a < b) ? b : a; }
+template <class T, class L, class H> inline T constrain(T x, L lo, H hi) { return (x < lo) ? lo : ((x > hi) ? hi : x); }
+
+// --- String ---
+class String {
+public:
+    String() {}
+    String(const char* s) : str_(s ? s : "") {}
+    String(const std::string& s) : str_(s) {}
+    String(char c) : str_(1, c) {}
+    String(int value) : str_(std::to_string(value)) {}
+    String(long value) : str_(std::to_string(value)) {}
+    String(unsigned long value) : str_(std::to_string(value)) {}
+
+    const char* c_str() const { return str_.c_str(); }
+    unsigned int length() const { return (unsigned int)str_.length(); }
+    char charAt(unsigned int index) const { return index < str_.length() ? str_[index] : 0; }
+    char operator[](unsigned int index) const { return charAt(index); }
+
+    bool equals(const String& other) const { return str_ == other.str_; }
+    bool operator==(const String& other) const { return str_ == other.str_; }
+    bool operator==(const char* other) const { return str_ == (other ? other : ""); }
+    bool operator!=(const String& other) const { return !(*this == other); }
+    bool operator!=(const char* other) const { return !(*this == other); }
+
+    String& operator+=(const String& other) { str_ += other.str_; return *this; }
+    String& operator+=(const char* other) { if (other) str_ += other; return *this; }
+    String& operator+=(char c) { str_ += c; return *this; }
+    friend String operator+(String lhs, const String& rhs) { lhs += rhs; return lhs; }
+
+    bool startsWith(const String& prefix) const { return str_.compare(0, prefix.str_.length(), prefix.str_) == 0; }
+    bool endsWith(const String& suffix) const {
+        return str_.length() >= suffix.str_.length() &&
+               str_.compare(str_.length() - suffix.str_.length(), suffix.str_.length(), suffix.str_) == 0;
+    }
+
+    int indexOf(char c, unsigned int from = 0) const {
+        if (from >= str_.length()) return -1;
+        size_t pos = str_.find(c, from);
+        return pos == std::string::npos ? -1 : (int)pos;
+    }
+    int indexOf(const String& s, unsigned int from = 0) const {
+        if (from > str_.length()) return -1;
+        size_t pos = str_.find(s.str_, from);
+        return pos == std::string::npos ? -1 : (int)pos;
+    }
+
+    // Same clamping rules as the Teensy core: swapped bounds are reordered,
+    // an out-of-range start yields an empty string.
+    String substring(unsigned int beginIndex) const { return substring(beginIndex, length()); }
+    String substring(unsigned int beginIndex, unsigned int endIndex) const {
+        if (beginIndex > endIndex) { unsigned int t = beginIndex; beginIndex = endIndex; endIndex = t; }
+        if (beginIndex >= str_.length()) return String();
+        if (endIndex > str_.length()) endIndex = (unsigned int)str_.length();
+        return String(str_.substr(beginIndex, endIndex - beginIndex));
+    }
+
+    void trim() {
+        size_t begin = 0, end = str_.length();
+        while (begin < end && isspace((unsigned char)str_[begin])) begin++;
+        while (end > begin && isspace((unsigned char)str_[end - 1])) end--;
+        str_ = str_.substr(begin, end - begin);
+    }
+    void toUpperCase() { for (auto& c : str_) c = (char)toupper((unsigned char)c); }
+    void toLowerCase() { for (auto& c : str_) c = (char)tolower((unsigned char)c); }
+
+    long toInt() const { return strtol(str_.c_str(), nullptr, 10); }
+    float toFloat() const { return strtof(str_.c_str(), nullptr); }
+
+private:
+    std::string str_;
+};
+
+// --- Serial ---
+class HostSerial {
+public:
+    void begin(unsigned long) {}
+    explicit operator bool() const { return true; }
+    int available();
+    int read();
+    String readStringUntil(char terminator);
+    void flush() {}
+
+    size_t write(const char* data, size_t len);
+    size_t print(const char* s) { return write(s, strlen(s)); }
+    size_t print(const String& s) { return write(s.c_str(), s.length()); }
+    size_t print(char c) { return write(&c, 1); }
+    size_t print(int n) { return printf("%d", n); }
+    size_t print(unsigned int n) { return printf("%u", n); }
+    size_t print(long n) { return printf("%ld", n); }
+    size_t print(unsigned long n) { return printf("%lu", n); }
+    size_t print(double n, int digits = 2) { return printf("%.*f", digits, n); }
+    size_t println() { return write("\r\n", 2); }
+    template <class T> size_t println(const T& value) { size_t n = print(value); return n + println(); }
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+extern HostSerial Serial;
+
+// --- USB MIDI ---
+class usb_midi_class {
+public:
+    void setHandleNoteOn(void (*fptr)(uint8_t channel, uint8_t note, uint8_t velocity)) { handleNoteOn = fptr; }
+    void setHandleNoteOff(void (*fptr)(uint8_t channel, uint8_t note, uint8_t velocity)) { handleNoteOff = fptr; }
+    void setHandleControlChange(void (*fptr)(uint8_t channel, uint8_t control, uint8_t value)) { handleControlChange = fptr; }
+    void setHandleClock(void (*fptr)()) { handleClock = fptr; }
+    void setHandleStart(void (*fptr)()) { handleStart = fptr; }
+    void setHandleContinue(void (*fptr)()) { handleContinue = fptr; }
+    void setHandleStop(void (*fptr)()) { handleStop = fptr; }
+    void setHandleSystemExclusive(void (*fptr)(uint8_t* data, unsigned int size)) { handleSystemExclusive = fptr; }
+
+    // Dispatches at most one queued incoming message, like the Teensy core.
+    bool read();
+
+    void sendNoteOn(uint8_t note, uint8_t velocity, uint8_t channel);
+    void sendNoteOff(uint8_t note, uint8_t velocity, uint8_t channel);
+    void sendControlChange(uint8_t control, uint8_t value, uint8_t channel);
+    void send_now() {}
+
+private:
+    void (*handleNoteOn)(uint8_t, uint8_t, uint8_t) = nullptr;
+    void (*handleNoteOff)(uint8_t, uint8_t, uint8_t) = nullptr;
+    void (*handleControlChange)(uint8_t, uint8_t, uint8_t) = nullptr;
+    void (*handleClock)() = nullptr;
+    void (*handleStart)() = nullptr;
+    void (*handleContinue)() = nullptr;
+    void (*handleStop)() = nullptr;
+    void (*handleSystemExclusive)(uint8_t*, unsigned int) = nullptr;
+};
+
+extern usb_midi_class usbMIDI;
+
+#endif // HOST_ARDUINO_H
@@ -0,0 +1,131 @@
+// Audio.h (host stand-in)
+// Parameter-recording stand-ins for the Teensy Audio Library objects used in audio.cpp.
+// They keep the last value written to each control so host tests can inspect what the
+// synth asked the audio graph to do; no samples are rendered.
+
+#ifndef HOST_AUDIO_H
+#define HOST_AUDIO_H
+
+#include <Arduino.h>
+
+#define AUDIO_BLOCK_SAMPLES 128
+#define AUDIO_SAMPLE_RATE_EXACT 44117.64706f
+
+#define WAVEFORM_SINE              0
+#define WAVEFORM_SAWTOOTH          1
+#define WAVEFORM_SQUARE            2
+#define WAVEFORM_TRIANGLE          3
+#define WAVEFORM_ARBITRARY         4
+#define WAVEFORM_PULSE             5
+#define WAVEFORM_SAWTOOTH_REVERSE  6
+#define WAVEFORM_SAMPLE_HOLD       7
+
+typedef struct audio_block_struct {
+    uint8_t ref_count;
+    int16_t data[AUDIO_BLOCK_SAMPLES];
+} audio_block_t;
+
+class AudioStream {
+public:
+    AudioStream() {}
+    AudioStream(unsigned char ninput, audio_block_t** iqueue) { (void)ninput; (void)iqueue; }
+    virtual ~AudioStream() {}
+    virtual void update() {}
+    float processorUsage() { return 0.0f; }
+    float processorUsageMax() { return 0.0f; }
+
+protected:
+    // Blocks come from the heap; nothing is connected, so transmit() is a no-op and
+    // nothing is ever received
+    static audio_block_t* allocate() { return new audio_block_t(); }
+    static void release(audio_block_t* block) { delete block; }
+    void transmit(audio_block_t* block, unsigned char index = 0) { (void)block; (void)index; }
+    audio_block_t* receiveReadOnly(unsigned int index = 0) { (void)index; return nullptr; }
+    audio_block_t* receiveWritable(unsigned int index = 0) { (void)index; return nullptr; }
+};
+
+#define AudioNoInterrupts() ((void)0)
+#define AudioInterrupts() ((void)0)
+
+class AudioConnection {
+public:
+    AudioConnection() {}
+    AudioConnection(AudioStream& source, unsigned char sourceOutput,
+                    AudioStream& destination, unsigned char destinationInput) {
+        connect(source, sourceOutput, destination, destinationInput);
+    }
+    int connect(AudioStream& source, unsigned char sourceOutput,
+                AudioStream& destination, unsigned char destinationInput) {
+        src = &source;
+        dst = &destination;
+        srcIndex = sourceOutput;
+        dstIndex = destinationInput;
+        connected = true;
+        return 0;
+    }
+    int disconnect() { connected = false; return 0; }
+
+    AudioStream* src = nullptr;
+    AudioStream* dst = nullptr;
+    unsigned char srcIndex = 0;
+    unsigned char dstIndex = 0;
+    bool connected = false;
+};
+
+class AudioSynthWaveform : public AudioStream {
+public:
+    void begin(short type) { waveType = type; }
+    void begin(float amp, float freq, short type) { amplitudeLevel = amp; frequencyHz = freq; waveType = type; }
+    void amplitude(float n) { amplitudeLevel = n; }
+    void frequency(float freq) { frequencyHz = freq; }
+
+    short waveType = WAVEFORM_SINE;
+    float amplitudeLevel = 0.0f;
+    float frequencyHz = 0.0f;
+};
+
+class AudioSynthWaveformModulated : public AudioStream {
+public:
+    void begin(short type) { waveType = type; beginCount++; }
+    void amplitude(float n) { amplitudeLevel = n; }
+    void frequency(float freq) { frequencyHz = freq; }
+    void frequencyModulation(float octaves) { modulationOctaves = octaves; }
+
+    short waveType = WAVEFORM_SINE;
+    float amplitudeLevel = 0.0f;
+    float frequencyHz = 0.0f;
+    float modulationOctaves = 0.0f;
+    unsigned int beginCount = 0;
+};
+
+class AudioMixer4 : public AudioStream {
+public:
+    void gain(unsigned int channel, float level) { if (channel < 4) gains[channel] = level; }
+    float gains[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+};
+
+class AudioOutputI2S : public AudioStream {
+};
+
+class AudioControlSGTL5000 {
+public:
+    bool enable() { enabled = true; return true; }
+    bool volume(float n) { volumeLevel = n; return true; }
+    unsigned short lineOutLevel(uint8_t n) { lineOut = n; return 0; }
+
+    bool enabled = false;
+    float volumeLevel = 0.0f;
+    uint8_t lineOut = 0;
+};
+
+#define AudioMemory(num) ((void)(num))
+
+// Audio load as last set by hostSetAudioLoad() (hal_host.cpp)
+float AudioProcessorUsage();
+float AudioProcessorUsageMax();
+void AudioProcessorUsageMaxReset();
+int AudioMemoryUsage();
+int AudioMemoryUsageMax();
+void AudioMemoryUsageMaxReset();
+
+#endif // HOST_AUDIO_H
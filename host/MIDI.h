@@ -0,0 +1,9 @@
+// MIDI.h (host stand-in)
+// midi.cpp only needs the usbMIDI object, which the host Arduino.h already provides.
+
+#ifndef HOST_MIDI_H
+#define HOST_MIDI_H
+
+#include <Arduino.h>
+
+#endif // HOST_MIDI_H
@@ -0,0 +1,131 @@
+// SD.h (host stand-in)
+// Subset of the Teensy SD library backed by a local directory, set with hostSetSdRoot()
+// (hal_host.h). With no root set, SD.begin() fails like a missing card.
+
+#ifndef HOST_SD_H
+#define HOST_SD_H
+
+#include <Arduino.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <memory>
+#include <string>
+
+#define FILE_READ 0
+#define FILE_WRITE 1 // Created if missing, positioned at the end
+
+const char* hostSdRoot(); // nullptr = no card
+void hostCountSdAccess();  // Every open, read, write and exists (hostSdAccesses())
+
+class File {
+public:
+    File() {}
+
+    explicit operator bool() const { return file || dir; }
+    bool isDirectory() const { return dir != nullptr; }
+    const char* name() const { return fileName.c_str(); }
+    uint64_t size() const { return fileSize; }
+
+    int read(void* buffer, size_t count) {
+        if (!file) return -1;
+        hostCountSdAccess();
+        return (int)fread(buffer, 1, count, file.get());
+    }
+    size_t write(const void* buffer, size_t count) {
+        if (!file) return 0;
+        hostCountSdAccess();
+        return fwrite(buffer, 1, count, file.get());
+    }
+    void flush() {
+        if (file) fflush(file.get());
+    }
+    bool seek(uint64_t position) {
+        return file && fseek(file.get(), (long)position, SEEK_SET) == 0;
+    }
+    uint64_t position() const { return file ? (uint64_t)ftell(file.get()) : 0; }
+
+    File openNextFile() {
+        if (!dir) return File();
+        while (struct dirent* entry = readdir(dir.get())) {
+            if (entry->d_name[0] == '.') continue;
+            return File::open(hostPath + "/" + entry->d_name, entry->d_name);
+        }
+        return File();
+    }
+
+    void close() {
+        file.reset();
+        dir.reset();
+    }
+
+    // Host side: open a local path
+    static File open(const std::string& path, const std::string& displayName, uint8_t mode = FILE_READ) {
+        File f;
+        f.hostPath = path;
+        f.fileName = displayName;
+        struct stat info;
+        if (mode == FILE_WRITE) {
+            bool exists = stat(path.c_str(), &info) == 0;
+            FILE* fp = fopen(path.c_str(), exists ? "r+b" : "w+b");
+            if (!fp) return File();
+            fseek(fp, 0, SEEK_END);
+            f.file.reset(fp, fclose);
+            return f;
+        }
+        if (stat(path.c_str(), &info) != 0) return File();
+        if (S_ISDIR(info.st_mode)) {
+            DIR* d = opendir(path.c_str());
+            if (d) f.dir.reset(d, closedir);
+        } else {
+            FILE* fp = fopen(path.c_str(), "rb");
+            if (fp) f.file.reset(fp, fclose);
+            f.fileSize = (uint64_t)info.st_size;
+        }
+        return f;
+    }
+
+private:
+    std::shared_ptr<FILE> file; // Copies share the handle, as on the Teensy
+    std::shared_ptr<DIR> dir;
+    std::string hostPath;
+    std::string fileName;
+    uint64_t fileSize = 0;
+};
+
+// SdFat card handle, reached as SD.sdfs.card() on the Teensy; only the busy poll is
+// used. Busy while a test holds it so with hostSetSdBusy().
+struct HostSdCard {
+    bool isBusy() const;
+};
+
+struct HostSdFs {
+    HostSdCard* card() { return &sdCard; }
+    HostSdCard sdCard;
+};
+
+class SDClass {
+public:
+    HostSdFs sdfs;
+
+    bool begin(uint8_t csPin) {
+        (void)csPin;
+        return hostSdRoot() != nullptr;
+    }
+    File open(const char* path, uint8_t mode = FILE_READ) {
+        if (!hostSdRoot()) return File();
+        hostCountSdAccess();
+        std::string name = path;
+        size_t slash = name.find_last_of('/');
+        if (slash != std::string::npos) name = name.substr(slash + 1);
+        return File::open(std::string(hostSdRoot()) + "/" + path, name, mode);
+    }
+    bool exists(const char* path) {
+        struct stat info;
+        hostCountSdAccess();
+        return hostSdRoot() && stat((std::string(hostSdRoot()) + "/" + path).c_str(), &info) == 0;
+    }
+};
+
+extern SDClass SD;
+
+#endif // HOST_SD_H
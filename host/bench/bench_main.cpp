@@ -0,0 +1,51 @@
+// bench_main.cpp
+// Host microbenchmark tool. Boots the sketch on the simulated clock, then runs every
+// bench.cpp case on the real clock and prints one JSON object per line to stdout.
+// Usage: snes_bench [--batches=N] [--iterations=N] [--filter=name] [--quick]
+
+#include "hal_host.h"
+#include "../../bench.h"
+#include "../../synth_state.h"
+#include <string>
+
+extern SynthState state;
+void setup();
+
+static void printResult(const BenchResult& result) {
+    char line[256];
+    formatBenchResult(result, line, sizeof(line));
+    printf("%s\n", line);
+    fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+    int batches = 15;
+    unsigned long iterations = 2000;
+    std::string filter;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("--batches=", 0) == 0) batches = atoi(arg.c_str() + 10);
+        else if (arg.rfind("--iterations=", 0) == 0) iterations = strtoul(arg.c_str() + 13, nullptr, 10);
+        else if (arg.rfind("--filter=", 0) == 0) filter = arg.substr(9);
+        else if (arg == "--quick") { batches = 3; iterations = 20; }
+        else {
+            fprintf(stderr, "Unknown argument: %s\n", arg.c_str());
+            return 2;
+        }
+    }
+
+    static SimulatedTimeSource bootClock;
+    hostSetTimeSource(&bootClock);
+    setup();
+    hostSetTimeSource(nullptr);
+    hostClearMidiOutput();
+    hostSetSerialCapture(false); // Output is still formatted, just not buffered
+
+    int count = runBenchmarks(state, batches, (uint32_t)iterations, true, filter.c_str(), printResult);
+    if (count == 0) {
+        fprintf(stderr, "No benchmark matches '%s'\n", filter.c_str());
+        return 1;
+    }
+    return 0;
+}
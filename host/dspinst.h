@@ -0,0 +1,34 @@
+// dspinst.h (host stand-in)
+// Portable C versions of the Teensy Audio Library's ARM DSP instruction wrappers
+// used by the synth's own AudioStreams. Same names, same results.
+
+#ifndef HOST_DSPINST_H
+#define HOST_DSPINST_H
+
+#include <stdint.h>
+
+// SSAT: (val >> rshift) saturated to a signed 'bits'-bit value
+static inline int32_t signed_saturate_rshift(int32_t val, int bits, int rshift) {
+    int32_t out = val >> rshift;
+    int32_t limit = (int32_t)1 << (bits - 1);
+    if (out > limit - 1) return limit - 1;
+    if (out < -limit) return -limit;
+    return out;
+}
+
+// PKHBT: (a[15:0] << 16) | b[15:0]
+static inline uint32_t pack_16b_16b(int32_t a, int32_t b) {
+    return ((uint32_t)a << 16) | ((uint32_t)b & 0xFFFF);
+}
+
+// SMUAD: a[31:16] * b[31:16] + a[15:0] * b[15:0]
+static inline int32_t multiply_16tx16t_add_16bx16b(uint32_t a, uint32_t b) {
+    return (int32_t)(int16_t)(a >> 16) * (int16_t)(b >> 16) + (int32_t)(int16_t)a * (int16_t)b;
+}
+
+// SMLAD: sum + a[31:16] * b[31:16] + a[15:0] * b[15:0]
+static inline int32_t multiply_accumulate_16tx16t_add_16bx16b(int32_t sum, uint32_t a, uint32_t b) {
+    return sum + multiply_16tx16t_add_16bx16b(a, b);
+}
+
+#endif // HOST_DSPINST_H
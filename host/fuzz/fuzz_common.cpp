@@ -0,0 +1,112 @@
+// fuzz_common.cpp
+// Boot/reset and invariant checks shared by the host fuzz targets.
+
+#include "fuzz_common.h"
+#include "../../synth_state.h"
+#include "../../synth.h"
+#include "../../commands.h"
+#include "../../debug.h"
+#include "../../voice_manager.h"
+#include <math.h>
+
+extern SynthState state;
+void setup();
+void loop();
+
+// Simulated time a single loop() pass may take (controller scan is ~0.2 ms)
+static const unsigned long LOOP_BUDGET_MICROS = 2000;
+
+static SimulatedTimeSource simClock;
+static SynthState bootState;
+static unsigned long bootMicros = 0;
+static bool booted = false;
+
+SimulatedTimeSource& fuzzClock() {
+    return simClock;
+}
+
+void fuzzBoot() {
+    hostSetTimeSource(&simClock);
+    if (!booted) {
+        simClock.set(1000000);
+        setup();
+        bootState = state;
+        bootMicros = simClock.micros();
+        booted = true;
+    }
+    hostReset();
+    // Drop any partial line left in the command reader by the previous input
+    hostSerialInput("\n");
+    String discarded;
+    readSerialCommand(discarded);
+
+    state = bootState;
+    simClock.set(bootMicros);
+    setGlobalDebugLevel(LEVEL_OFF);
+    hostClearSerialOutput();
+}
+
+void fuzzLoop() {
+    unsigned long before = simClock.micros();
+    loop();
+    if (simClock.micros() - before > LOOP_BUDGET_MICROS) {
+        fprintf(stderr, "loop() took %lu us of simulated time\n", simClock.micros() - before);
+        abort();
+    }
+}
+
+static void fail(const char* where, const char* what, long value) {
+    fprintf(stderr, "Invariant violated after %s: %s (value %ld)\n", where, what, value);
+    abort();
+}
+
+#define REQUIRE(cond, value) do { if (!(cond)) fail(where, #cond, (long)(value)); } while (0)
+
+static bool validNote(int note) {
+    return note >= -1 && note <= 127;
+}
+
+void fuzzCheckInvariants(const char* where) {
+    REQUIRE(state.scaleMode >= 0 && state.scaleMode < NUM_SCALES, state.scaleMode);
+    REQUIRE(state.baseNote >= 0 && state.baseNote <= 127, state.baseNote);
+    REQUIRE(state.keyOffset >= 0 && state.keyOffset <= 11, state.keyOffset);
+    REQUIRE(state.playStyle == MONOPHONIC || state.playStyle == POLYPHONIC || state.playStyle == CHORD_BUTTON, state.playStyle);
+    REQUIRE(state.customProfileIndex >= PROFILE_SCALE && state.customProfileIndex < NUM_MAPPING_PROFILES, state.customProfileIndex);
+    REQUIRE(state.currentWaveform >= 0 && state.currentWaveform < 4, state.currentWaveform);
+    REQUIRE(state.vibratoRate >= 0 && state.vibratoRate <= 2, state.vibratoRate);
+    REQUIRE(state.vibratoDepth >= 0 && state.vibratoDepth <= 3, state.vibratoDepth);
+    REQUIRE(state.notePriority >= 0 && state.notePriority < NUM_NOTE_PRIORITIES, state.notePriority);
+
+    // The held order lists exactly the held note buttons
+    int listed = 0;
+    for (int b = state.heldNewest; b != -1 && listed <= MAX_NOTE_BUTTONS; b = state.heldOlder[b]) {
+        REQUIRE(b >= 0 && b < MAX_NOTE_BUTTONS && state.held[b], b);
+        listed++;
+    }
+    int heldNotes = 0;
+    for (int b = 0; b < MAX_NOTE_BUTTONS; b++) heldNotes += state.held[b];
+    REQUIRE(listed == heldNotes && listed == __builtin_popcount(state.heldPositions), listed);
+
+    REQUIRE(validNote(state.currentMidiNote), state.currentMidiNote);
+    REQUIRE(validNote(state.boogieCurrentMidiNote), state.boogieCurrentMidiNote);
+    REQUIRE(validNote(state.lastRhythmicMidiNote), state.lastRhythmicMidiNote);
+    for (int i = 0; i < NUM_VOICES; i++) REQUIRE(validNote(voiceNote(i)), voiceNote(i));
+    REQUIRE(state.boogieCurrentSlotIndex >= -1 && state.boogieCurrentSlotIndex <= 2, state.boogieCurrentSlotIndex);
+
+    REQUIRE(state.numNotesInPattern >= 1 && state.numNotesInPattern <= state.MAX_PATTERN_NOTES, state.numNotesInPattern);
+    REQUIRE(isfinite(state.currentRhythmPatternLengthTicks), 0);
+    REQUIRE(state.currentRhythmPatternLengthTicks > 0.0f && state.currentRhythmPatternLengthTicks <= MAX_PATTERN_LENGTH_TICKS,
+            state.currentRhythmPatternLengthTicks);
+    REQUIRE(state.boogieRTimingRatio >= 0.0f && state.boogieRTimingRatio <= 1.0f, state.boogieRTimingRatio * 1000);
+
+    REQUIRE(isfinite(state.usPerMidiTick) && state.usPerMidiTick >= 0.0f, state.usPerMidiTick);
+    REQUIRE(state.sampleTickCount >= 0 && state.sampleTickCount <= NUM_SAMPLES_FOR_LOCK, state.sampleTickCount);
+    if (state.tempoEstablished) {
+        REQUIRE(state.usPerMidiTick >= MIN_LOCKED_US_PER_TICK && state.usPerMidiTick <= MAX_LOCKED_US_PER_TICK, state.usPerMidiTick);
+    }
+
+    for (const HostMidiMessage& msg : hostMidiOutput()) {
+        REQUIRE(msg.data1 < 128, msg.data1);
+        REQUIRE(msg.data2 < 128, msg.data2);
+    }
+}
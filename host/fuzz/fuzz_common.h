@@ -0,0 +1,27 @@
+// fuzz_common.h
+// Shared harness for the host fuzz targets: boots the sketch once on the simulated
+// clock, restores the post-boot state before every input, and aborts (so the fuzzer
+// reports a crash) when an input leaves SynthState out of range or stalls loop().
+
+#ifndef FUZZ_COMMON_H
+#define FUZZ_COMMON_H
+
+#include "hal_host.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// libFuzzer entry point implemented by each target
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+// Restores the synth to its freshly booted state with no pending input.
+void fuzzBoot();
+
+// Runs one loop() pass and checks it finished within the per-loop time budget.
+void fuzzLoop();
+
+// Aborts with a message if any SynthState field or sent MIDI byte is out of range.
+void fuzzCheckInvariants(const char* where);
+
+SimulatedTimeSource& fuzzClock();
+
+#endif // FUZZ_COMMON_H
@@ -0,0 +1,34 @@
+// fuzz_midi_clock.cpp
+// Fuzz target for the MIDI clock/start/stop/continue handler sequence. Each input
+// byte is an operation (transport message, time jump, button change or mode switch)
+// followed by one loop() pass, so arbitrary tick timing reaches the tempo sampler,
+// Boogie and Rhythmic schedulers and the clock timeout.
+
+#include "fuzz_common.h"
+
+static const char* const MODE_COMMANDS[] = {"mode standard\n", "mode boogie\n", "mode rhythmic\n"};
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    fuzzBoot();
+
+    size_t pos = 0;
+    while (pos < size) {
+        uint8_t op = data[pos++];
+        uint8_t arg0 = pos < size ? data[pos] : 0;
+        uint8_t arg1 = pos + 1 < size ? data[pos + 1] : 0;
+
+        switch (op % 8) {
+            case 0: hostMidiInput(0xF8); break; // Clock
+            case 1: hostMidiInput(0xFA); break; // Start
+            case 2: hostMidiInput(0xFC); break; // Stop
+            case 3: hostMidiInput(0xFB); break; // Continue
+            case 4: fuzzClock().advance((unsigned long)arg0 * 250); pos++; break; // Jittered tick spacing
+            case 5: fuzzClock().advance(((unsigned long)arg0 << 8 | arg1) * 10); pos += 2; break; // Up to ~655 ms
+            case 6: hostSetButtons((uint16_t)((arg0 << 8 | arg1) & 0x0FFF)); pos += 2; break;
+            case 7: hostSerialInput(MODE_COMMANDS[arg0 % 3]); pos++; break;
+        }
+        fuzzLoop();
+        fuzzCheckInvariants("clock op");
+    }
+    return 0;
+}
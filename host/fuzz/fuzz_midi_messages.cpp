@@ -0,0 +1,38 @@
+// fuzz_midi_messages.cpp
+// Fuzz target for the incoming MIDI message path: the input is parsed as a raw
+// MIDI byte stream (channel voice messages, SysEx, realtime) and every message is
+// dispatched through usbMIDI.read() to the sketch's Note/CC/clock handlers.
+
+#include "fuzz_common.h"
+
+// Data bytes that follow each channel voice status nibble (0x8n-0xEn)
+static const uint8_t CHANNEL_DATA_LENGTH[8] = {2, 2, 2, 2, 1, 1, 2, 0};
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    fuzzBoot();
+
+    size_t pos = 0;
+    while (pos < size) {
+        uint8_t status = data[pos++];
+        if (status == 0xF0) {
+            // SysEx runs to F7 (or the end of the input); data bytes keep 7 bits
+            uint8_t sysex[256];
+            size_t length = 0;
+            sysex[length++] = 0xF0;
+            while (pos < size && data[pos] != 0xF7 && length < sizeof(sysex) - 1) sysex[length++] = data[pos++] & 0x7F;
+            if (pos < size && data[pos] == 0xF7) pos++;
+            sysex[length++] = 0xF7;
+            hostMidiSysExInput(sysex, length);
+        } else if (status >= 0xF0) {
+            hostMidiInput(status);
+        } else {
+            if (status < 0x80) status = 0x90 | (status & 0x0F); // Stray data byte: treat as Note On
+            uint8_t d[2] = {0, 0};
+            for (int i = 0; i < CHANNEL_DATA_LENGTH[(status >> 4) & 0x07] && pos < size; i++) d[i] = data[pos++] & 0x7F;
+            hostMidiInput(status, d[0], d[1]);
+        }
+        fuzzLoop();
+        fuzzCheckInvariants("MIDI message");
+    }
+    return 0;
+}
@@ -0,0 +1,21 @@
+// fuzz_serial_command.cpp
+// Fuzz target for the Serial command path: arbitrary bytes go through the
+// non-blocking line reader and handleSerialCommand() via the real loop().
+
+#include "fuzz_common.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    fuzzBoot();
+
+    std::string input((const char*)data, size);
+    hostSerialInput(input.c_str());
+
+    // One command is handled per loop(); bound the passes by the input size
+    for (size_t pass = 0; pass <= size && Serial.available() > 0; pass++) {
+        fuzzLoop();
+        fuzzCheckInvariants("serial command");
+    }
+    fuzzLoop();
+    fuzzCheckInvariants("serial command");
+    return 0;
+}
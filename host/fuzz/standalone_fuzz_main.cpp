@@ -0,0 +1,87 @@
+// standalone_fuzz_main.cpp
+// Driver for the fuzz targets when libFuzzer is unavailable (e.g. GCC builds).
+// Replays every file/directory given on the command line, then runs -runs=N
+// deterministic mutations of those inputs (byte flips, inserts, deletes, splices).
+// Accepts and ignores other libFuzzer-style "-flag=value" arguments.
+
+#include "fuzz_common.h"
+#include <dirent.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+static bool readFile(const std::string& path, std::vector<uint8_t>& out) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) return false;
+    uint8_t buffer[4096];
+    size_t n;
+    out.clear();
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) out.insert(out.end(), buffer, buffer + n);
+    fclose(f);
+    return true;
+}
+
+static void collectInputs(const std::string& path, std::vector<std::vector<uint8_t>>& corpus) {
+    DIR* dir = opendir(path.c_str());
+    if (!dir) {
+        std::vector<uint8_t> data;
+        if (readFile(path, data)) corpus.push_back(data);
+        return;
+    }
+    while (struct dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] == '.') continue;
+        std::vector<uint8_t> data;
+        if (readFile(path + "/" + entry->d_name, data)) corpus.push_back(data);
+    }
+    closedir(dir);
+}
+
+static void mutate(std::vector<uint8_t>& data, std::mt19937& rng) {
+    int edits = 1 + (int)(rng() % 4);
+    for (int i = 0; i < edits; i++) {
+        size_t pos = data.empty() ? 0 : rng() % data.size();
+        switch (rng() % 5) {
+            case 0: if (!data.empty()) data[pos] ^= (uint8_t)(1u << (rng() % 8)); break;
+            case 1: data.insert(data.begin() + pos, (uint8_t)rng()); break;
+            case 2: if (!data.empty()) data.erase(data.begin() + pos); break;
+            case 3: if (!data.empty()) data[pos] = "0123456789 -.\n"[rng() % 14]; break;
+            case 4: { // Duplicate a short run to grow repeated structure
+                size_t len = data.empty() ? 0 : 1 + rng() % 8;
+                if (pos + len > data.size()) len = data.size() - pos;
+                std::vector<uint8_t> run(data.begin() + pos, data.begin() + pos + len);
+                data.insert(data.begin() + pos, run.begin(), run.end());
+                break;
+            }
+        }
+    }
+    if (data.size() > 4096) data.resize(4096);
+}
+
+int main(int argc, char** argv) {
+    unsigned long runs = 0;
+    unsigned long seed = 1;
+    std::vector<std::vector<uint8_t>> corpus;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("-runs=", 0) == 0) runs = strtoul(arg.c_str() + 6, nullptr, 10);
+        else if (arg.rfind("-seed=", 0) == 0) seed = strtoul(arg.c_str() + 6, nullptr, 10);
+        else if (arg[0] != '-') collectInputs(arg, corpus);
+    }
+
+    for (const auto& input : corpus) LLVMFuzzerTestOneInput(input.data(), input.size());
+    printf("Replayed %zu inputs\n", corpus.size());
+
+    std::mt19937 rng((uint32_t)seed);
+    for (unsigned long run = 0; run < runs; run++) {
+        std::vector<uint8_t> data;
+        if (!corpus.empty() && rng() % 8 != 0) data = corpus[rng() % corpus.size()];
+        else data.resize(rng() % 64), std::generate(data.begin(), data.end(), [&] { return (uint8_t)rng(); });
+        mutate(data, rng);
+        LLVMFuzzerTestOneInput(data.data(), data.size());
+        if (rng() % 16 == 0) corpus.push_back(data); // Keep some mutants to compound edits
+    }
+    printf("Executed %lu mutated inputs (seed %lu)\n", runs, seed);
+    return 0;
+}
@@ -0,0 +1,300 @@
+// hal_host.cpp
+// Linux implementation of the Arduino/Teensy HAL stand-in: injectable time source,
+// an emulated SNES pad shift register, and captured Serial/USB MIDI traffic.
+
+#include "hal_host.h"
+#include "../controller.h"
+#include <Audio.h>
+#include <SD.h>
+#include <chrono>
+#include <deque>
+#include <thread>
+
+HostSerial Serial;
+usb_midi_class usbMIDI;
+
+// --- Time ---
+static const std::chrono::steady_clock::time_point bootTime = std::chrono::steady_clock::now();
+
+unsigned long RealTimeSource::micros() {
+    return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - bootTime).count();
+}
+
+void RealTimeSource::sleepMicros(unsigned long us) {
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+static RealTimeSource realTimeSource;
+static TimeSource* activeTimeSource = &realTimeSource;
+
+void hostSetTimeSource(TimeSource* source) {
+    activeTimeSource = source ? source : &realTimeSource;
+}
+
+TimeSource& hostTimeSource() {
+    return *activeTimeSource;
+}
+
+unsigned long micros() {
+    return activeTimeSource->micros();
+}
+
+unsigned long millis() {
+    return activeTimeSource->micros() / 1000;
+}
+
+void delay(unsigned long ms) {
+    activeTimeSource->sleepMicros(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+    activeTimeSource->sleepMicros(us);
+}
+
+void yield() {
+}
+
+// --- Pins / emulated SNES pad ---
+static uint16_t padHeldMask = 0;
+static uint16_t padShiftRegister = 0xFFFF;
+static uint8_t pinLevels[64] = {0};
+
+void hostSetButtons(uint16_t heldMask) {
+    padHeldMask = heldMask;
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+    (void)pin;
+    (void)mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+    if (pin >= sizeof(pinLevels)) return;
+    uint8_t previous = pinLevels[pin];
+    pinLevels[pin] = value ? HIGH : LOW;
+
+    if (pin == SNES_LATCH && value) {
+        // Parallel load: buttons are active low, bits 12-15 always read high
+        padShiftRegister = (uint16_t)~padHeldMask | 0xF000;
+    } else if (pin == SNES_CLOCK && value && !previous) {
+        // Rising clock edge shifts the next bit onto the data line
+        padShiftRegister = (uint16_t)((padShiftRegister >> 1) | 0x8000);
+    }
+}
+
+uint8_t digitalRead(uint8_t pin) {
+    if (pin == SNES_DATA) return padShiftRegister & 1;
+    return pin < sizeof(pinLevels) ? pinLevels[pin] : LOW;
+}
+
+// --- Serial ---
+static std::deque<char> serialInput;
+static std::string serialOutput;
+static bool serialEcho = false;
+static bool serialCapture = true;
+
+void hostSerialInput(const char* text) {
+    while (*text) serialInput.push_back(*text++);
+}
+
+const std::string& hostSerialOutput() {
+    return serialOutput;
+}
+
+void hostClearSerialOutput() {
+    serialOutput.clear();
+}
+
+void hostSetSerialEcho(bool echo) {
+    serialEcho = echo;
+}
+
+void hostSetSerialCapture(bool capture) {
+    serialCapture = capture;
+}
+
+int HostSerial::available() {
+    return (int)serialInput.size();
+}
+
+int HostSerial::read() {
+    if (serialInput.empty()) return -1;
+    char c = serialInput.front();
+    serialInput.pop_front();
+    return (unsigned char)c;
+}
+
+String HostSerial::readStringUntil(char terminator) {
+    std::string result;
+    int c;
+    while ((c = read()) >= 0 && c != (unsigned char)terminator) {
+        result += (char)c;
+    }
+    return String(result);
+}
+
+size_t HostSerial::write(const char* data, size_t len) {
+    if (serialCapture) serialOutput.append(data, len);
+    if (serialEcho) fwrite(data, 1, len, stdout);
+    return len;
+}
+
+size_t HostSerial::printf(const char* format, ...) {
+    char buffer[512];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (len < 0) return 0;
+    if ((size_t)len >= sizeof(buffer)) len = sizeof(buffer) - 1;
+    return write(buffer, (size_t)len);
+}
+
+// --- USB MIDI ---
+static std::deque<HostMidiMessage> midiInput;
+static std::vector<HostMidiMessage> midiOutput;
+static std::deque<std::vector<uint8_t>> sysExInput; // Payloads for queued 0xF0 messages, in order
+
+void hostMidiInput(uint8_t status, uint8_t data1, uint8_t data2) {
+    midiInput.push_back({status, data1, data2, 0});
+}
+
+void hostMidiSysExInput(const uint8_t* data, size_t length) {
+    midiInput.push_back({0xF0, 0, 0, 0});
+    sysExInput.emplace_back(data, data + length);
+}
+
+const std::vector<HostMidiMessage>& hostMidiOutput() {
+    return midiOutput;
+}
+
+void hostClearMidiOutput() {
+    midiOutput.clear();
+}
+
+bool usb_midi_class::read() {
+    if (midiInput.empty()) return false;
+    HostMidiMessage msg = midiInput.front();
+    midiInput.pop_front();
+
+    uint8_t channel = (msg.status & 0x0F) + 1;
+    switch (msg.status & 0xF0) {
+        case 0x80: if (handleNoteOff) handleNoteOff(channel, msg.data1, msg.data2); return true;
+        case 0x90: if (handleNoteOn) handleNoteOn(channel, msg.data1, msg.data2); return true;
+        case 0xB0: if (handleControlChange) handleControlChange(channel, msg.data1, msg.data2); return true;
+        default: break;
+    }
+    switch (msg.status) {
+        case 0xF8: if (handleClock) handleClock(); return true;
+        case 0xFA: if (handleStart) handleStart(); return true;
+        case 0xFB: if (handleContinue) handleContinue(); return true;
+        case 0xFC: if (handleStop) handleStop(); return true;
+        case 0xF0: {
+            std::vector<uint8_t> payload;
+            if (!sysExInput.empty()) {
+                payload = std::move(sysExInput.front());
+                sysExInput.pop_front();
+            }
+            if (handleSystemExclusive) handleSystemExclusive(payload.data(), (unsigned int)payload.size());
+            return true;
+        }
+        default: return true; // Unhandled message types are consumed silently
+    }
+}
+
+void usb_midi_class::sendNoteOn(uint8_t note, uint8_t velocity, uint8_t channel) {
+    midiOutput.push_back({(uint8_t)(0x90 | ((channel - 1) & 0x0F)), note, velocity, micros()});
+}
+
+void usb_midi_class::sendNoteOff(uint8_t note, uint8_t velocity, uint8_t channel) {
+    midiOutput.push_back({(uint8_t)(0x80 | ((channel - 1) & 0x0F)), note, velocity, micros()});
+}
+
+void usb_midi_class::sendControlChange(uint8_t control, uint8_t value, uint8_t channel) {
+    midiOutput.push_back({(uint8_t)(0xB0 | ((channel - 1) & 0x0F)), control, value, micros()});
+}
+
+// --- Audio load ---
+static float audioCpuPercent = 0.0f;
+static int audioMemoryBlocks = 0;
+static float audioCpuPercentMax = 0.0f;
+static int audioMemoryBlocksMax = 0;
+
+void hostSetAudioLoad(float cpuPercent, int memoryBlocks) {
+    audioCpuPercent = cpuPercent;
+    audioMemoryBlocks = memoryBlocks;
+    if (cpuPercent > audioCpuPercentMax) audioCpuPercentMax = cpuPercent;
+    if (memoryBlocks > audioMemoryBlocksMax) audioMemoryBlocksMax = memoryBlocks;
+}
+
+float AudioProcessorUsage() {
+    return audioCpuPercent;
+}
+
+float AudioProcessorUsageMax() {
+    return audioCpuPercentMax;
+}
+
+void AudioProcessorUsageMaxReset() {
+    audioCpuPercentMax = audioCpuPercent;
+}
+
+int AudioMemoryUsage() {
+    return audioMemoryBlocks;
+}
+
+int AudioMemoryUsageMax() {
+    return audioMemoryBlocksMax;
+}
+
+void AudioMemoryUsageMaxReset() {
+    audioMemoryBlocksMax = audioMemoryBlocks;
+}
+
+// --- SD card ---
+SDClass SD;
+static std::string sdRoot;
+static bool sdInserted = false;
+static unsigned long sdAccesses = 0;
+static bool sdBusy = false;
+
+void hostSetSdRoot(const char* directory) {
+    sdInserted = (directory != nullptr);
+    sdRoot = directory ? directory : "";
+}
+
+const char* hostSdRoot() {
+    return sdInserted ? sdRoot.c_str() : nullptr;
+}
+
+void hostCountSdAccess() {
+    sdAccesses++;
+}
+
+unsigned long hostSdAccesses() {
+    return sdAccesses;
+}
+
+void hostSetSdBusy(bool busy) {
+    sdBusy = busy;
+}
+
+bool HostSdCard::isBusy() const {
+    return sdBusy;
+}
+
+void hostReset() {
+    padHeldMask = 0;
+    padShiftRegister = 0xFFFF;
+    memset(pinLevels, 0, sizeof(pinLevels));
+    serialInput.clear();
+    serialOutput.clear();
+    midiInput.clear();
+    sysExInput.clear();
+    midiOutput.clear();
+    audioCpuPercent = 0.0f;
+    audioMemoryBlocks = 0;
+    audioCpuPercentMax = 0.0f;
+    audioMemoryBlocksMax = 0;
+}
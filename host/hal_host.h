@@ -0,0 +1,52 @@
+// hal_host.h
+// Host-side controls for the Linux HAL stand-in: drive the emulated SNES pad,
+// feed Serial/MIDI input and inspect what the synth sent back out.
+
+#ifndef HAL_HOST_H
+#define HAL_HOST_H
+
+#include <Arduino.h>
+#include "time_source.h"
+#include <string>
+#include <vector>
+
+struct HostMidiMessage {
+    uint8_t status; // Status byte including channel (e.g. 0x90 | (channel - 1))
+    uint8_t data1;
+    uint8_t data2;
+    unsigned long timeMicros; // micros() when the synth sent it (output only)
+};
+
+// Emulated SNES controller on the controller.h pins. Bit i set = button BTN_i held.
+void hostSetButtons(uint16_t heldMask);
+
+// Serial
+void hostSerialInput(const char* text);
+const std::string& hostSerialOutput();
+void hostClearSerialOutput();
+void hostSetSerialEcho(bool echo); // Mirror Serial output to stdout
+void hostSetSerialCapture(bool capture); // false = discard output instead of buffering it
+
+// USB MIDI. Channel messages use 1-16 channels like the Teensy callbacks.
+void hostMidiInput(uint8_t status, uint8_t data1 = 0, uint8_t data2 = 0);
+void hostMidiSysExInput(const uint8_t* data, size_t length); // Full message including F0/F7
+const std::vector<HostMidiMessage>& hostMidiOutput();
+void hostClearMidiOutput();
+
+// Audio library load reported by AudioProcessorUsage() (percent) and AudioMemoryUsage() (blocks)
+void hostSetAudioLoad(float cpuPercent, int memoryBlocks);
+
+// Local directory served as the SD card root; nullptr = no card (the default).
+// Not cleared by hostReset().
+void hostSetSdRoot(const char* directory);
+// SD card opens, reads, writes and exists() checks so far (SD.h), for tests that
+// check a path never touches the card
+unsigned long hostSdAccesses();
+// Card reports busy (programming a write) to SD.sdfs.card()->isBusy() until cleared.
+// Not cleared by hostReset().
+void hostSetSdBusy(bool busy);
+
+// Clears all queued input, captured output and pin state.
+void hostReset();
+
+#endif // HAL_HOST_H
@@ -0,0 +1,6 @@
+// sketch.cpp
+// Compiles main.ino as an ordinary translation unit for the host build,
+// standing in for the Arduino IDE's .ino preprocessing step.
+
+#include <Arduino.h>
+#include "../main.ino"
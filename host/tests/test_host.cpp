@@ -0,0 +1,1631 @@
+// test_host.cpp
+// Host-side tests for the control path: runs the real setup()/loop() from main.ino
+// against the Linux HAL stand-in and checks the MIDI and state it produces.
+
+#include "hal_host.h"
+#include "../../synth_state.h"
+#include "../../button_defs.h"
+#include "../../synth.h"
+#include "../../audio.h"
+#include "../../controller.h"
+#include "../../playstyles.h"
+#include "../../control_tick.h"
+#include "../../voice_manager.h"
+#include "../../governor.h"
+#include "../../lfo_bank.h"
+#include "../../mod_matrix.h"
+#include "../../sample_bank.h"
+#include "../../midi_capture.h"
+#include "../../smf_player.h"
+#include "../../riff.h"
+#include "../../change_queue.h"
+#include <algorithm>
+#include <random>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+
+extern SynthState state;
+void setup();
+void loop();
+
+static int failures = 0;
+static SimulatedTimeSource simClock;
+
+#define CHECK(cond) do { if (!(cond)) { printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+// Boots a fresh synth with no buttons held.
+static void boot() {
+    hostReset();
+    simClock.set(0);
+    hostSetTimeSource(&simClock);
+    state = SynthState();
+    setup();
+    hostClearMidiOutput();
+}
+
+// Runs loop() for one pad scan period so the new button state is picked up
+static void press(uint16_t mask) {
+    hostSetButtons(mask);
+    unsigned long until = micros() + CONTROLLER_SCAN_INTERVAL_US;
+    while ((long)(micros() - until) < 0) loop();
+}
+
+static void runFor(unsigned long us) {
+    unsigned long until = micros() + us;
+    while ((long)(micros() - until) < 0) loop();
+}
+
+static void testMonophonicPressRelease() {
+    boot();
+    int expected = state.scaleHolder[7]; // BTN_B -> musical position 7
+
+    press(1 << BTN_B);
+    CHECK(hostMidiOutput().size() == 1);
+    CHECK(hostMidiOutput()[0].status == 0x90);
+    CHECK(hostMidiOutput()[0].data1 == expected);
+    CHECK(state.currentMidiNote == expected);
+
+    hostClearMidiOutput();
+    press(0);
+    CHECK(hostMidiOutput().size() == 1);
+    CHECK(hostMidiOutput()[0].status == 0x80);
+    CHECK(hostMidiOutput()[0].data1 == expected);
+    CHECK(state.currentMidiNote == -1);
+}
+
+static void testSerialScaleCommand() {
+    boot();
+    hostSerialInput("scale 1\n");
+    loop();
+    CHECK(state.scaleMode == 1);
+    CHECK(state.scaleHolder[2] == state.baseNote + SCALE_DEFINITIONS[1][2]);
+}
+
+static void testPortamentoCombo() {
+    boot();
+    bool before = state.portamentoEnabled;
+    press((1 << BTN_L) | (1 << BTN_R));
+    press((1 << BTN_L) | (1 << BTN_R) | (1 << BTN_A));
+    CHECK(state.portamentoEnabled != before);
+    CHECK(hostMidiOutput().empty());
+}
+
+// Chord voices are owned and tracked by the VoiceManager and freed on release
+static void testChordVoicesTracked() {
+    boot();
+    state.playStyle = CHORD_BUTTON;
+    press(1 << BTN_B);
+    int sounding = 0;
+    for (int v = 0; v < NUM_VOICES; v++) {
+        if (voiceActive(v)) {
+            sounding++;
+            CHECK(voices.owner[v] == OWNER_CHORD);
+            CHECK(voiceNote(v) >= 0 && voiceNote(v) <= 127);
+        }
+    }
+    CHECK(sounding >= 3);
+
+    press(0);
+    for (int v = 0; v < NUM_VOICES; v++) {
+        CHECK(!voiceActive(v));
+        CHECK(voiceNote(v) == -1);
+        CHECK(voices.envPhase[v] == ENV_RELEASE);
+    }
+    runFor(VOICE_FADE_US + VOICE_SETTLE_US + CONTROL_TICK_US); // Shortest release, then settle
+    for (int v = 0; v < NUM_VOICES; v++) CHECK(voices.envPhase[v] == ENV_IDLE);
+}
+
+// Sounding chord notes as a sorted list
+static std::vector<int> chordNotesSounding() {
+    std::vector<int> notes;
+    for (int v = 0; v < NUM_VOICES; v++) {
+        if (voiceNote(v) != -1) notes.push_back(voiceNote(v));
+    }
+    std::sort(notes.begin(), notes.end());
+    return notes;
+}
+
+// Changing chord keeps shared tones on their voices with no MIDI for them; only the
+// changed tones are released and started
+static void testChordCommonTonesSustain() {
+    boot();
+    state.playStyle = CHORD_BUTTON;
+    press(1 << BTN_RIGHT); // IV
+    std::vector<int> expected = chordNotesSounding();
+    press(0);
+    runFor(VOICE_FADE_US + VOICE_SETTLE_US + CONTROL_TICK_US);
+
+    press(1 << BTN_LEFT); // ii, sharing two tones with IV
+    int oldNote[NUM_VOICES];
+    uint32_t oldOn[NUM_VOICES];
+    for (int v = 0; v < NUM_VOICES; v++) {
+        oldNote[v] = voiceNote(v);
+        oldOn[v] = voices.onMicros[v];
+    }
+    runFor(CONTROL_TICK_US * 4);
+    hostClearMidiOutput();
+    press(1 << BTN_RIGHT);
+    CHECK(chordNotesSounding() == expected);
+
+    int shared = 0;
+    for (int v = 0; v < NUM_VOICES; v++) {
+        if (oldNote[v] == -1 || !std::count(expected.begin(), expected.end(), oldNote[v])) continue;
+        shared++;
+        CHECK(voiceNote(v) == oldNote[v]);
+        CHECK(voices.onMicros[v] == oldOn[v]); // Not retriggered
+        for (const HostMidiMessage& m : hostMidiOutput()) CHECK(m.data1 != oldNote[v]);
+    }
+    CHECK(shared == 2);
+    int ons = 0, offs = 0;
+    for (const HostMidiMessage& m : hostMidiOutput()) {
+        if ((m.status & 0xF0) == 0x90) ons++;
+        if ((m.status & 0xF0) == 0x80) offs++;
+        CHECK((m.status & 0xF0) != 0xB0); // No all-notes-off
+    }
+    CHECK(ons == (int)expected.size() - shared);
+    CHECK(offs == ons);
+}
+
+// Backing track voices are not chord voices: a chord change neither keeps a backing note
+// as one of its tones nor drops or stops one, and sends MIDI only for its own tones
+static void testChordLeavesBackingVoices() {
+    boot();
+    state.playStyle = CHORD_BUTTON;
+    press(1 << BTN_LEFT); // ii
+    std::vector<int> ii = chordNotesSounding();
+    press(0);
+    runFor(VOICE_FADE_US + VOICE_SETTLE_US + CONTROL_TICK_US);
+
+    hostSerialInput("backing load demo\n");
+    loop();
+    hostSerialInput("backing out voices\n");
+    loop();
+    hostSerialInput("backing play\n"); // The demo bar; its next note is 250 ms away
+    loop();
+    runFor(2 * CONTROL_TICK_US);
+    const int backing = NUM_VOICES - 1;
+    CHECK(voices.owner[backing] == OWNER_BACKING && voiceNote(backing) == 36);
+
+    hostClearMidiOutput();
+    press(1 << BTN_RIGHT); // IV
+    press(1 << BTN_LEFT);  // ii: tones are dropped and started around the backing voice
+    CHECK(voices.owner[backing] == OWNER_BACKING && voiceNote(backing) == 36 && voiceActive(backing));
+    for (const HostMidiMessage& m : hostMidiOutput()) CHECK(m.data1 != 36);
+    press(0);
+    CHECK(voiceActive(backing));
+
+    // The backing voice sounds one of the chord's tones: the chord still plays it itself
+    playNote(state, backing, ii[0], OWNER_BACKING);
+    hostClearMidiOutput();
+    press(1 << BTN_LEFT);
+    int ons = 0;
+    bool sharedToneOn = false;
+    for (const HostMidiMessage& m : hostMidiOutput()) {
+        if ((m.status & 0xF0) != 0x90) continue;
+        ons++;
+        sharedToneOn = sharedToneOn || m.data1 == ii[0];
+    }
+    int chordVoices = 0;
+    for (int v = 0; v < NUM_VOICES; v++) {
+        if (voices.owner[v] == OWNER_CHORD && voiceActive(v)) chordVoices++;
+    }
+    CHECK(sharedToneOn);
+    CHECK(chordVoices == std::min((int)ii.size(), NUM_VOICES - 1)); // The backing voice is not free
+    CHECK(ons == chordVoices);
+    press(0);
+    CHECK(voices.owner[backing] == OWNER_BACKING && voiceNote(backing) == ii[0] && voiceActive(backing));
+
+    hostSerialInput("backing stop\n");
+    loop();
+}
+
+static int buttonNote(int button) {
+    return state.scaleHolder[buttonToMusicalPosition[button]];
+}
+
+// Mono falls back to the most recent still-held button however many presses came
+// between; low/high priority hold the lowest/highest held button through new presses
+static void testNotePriority() {
+    boot();
+    press(1 << BTN_Y);
+    press((1 << BTN_Y) | (1 << BTN_A));
+    press((1 << BTN_Y) | (1 << BTN_A) | (1 << BTN_B));
+    for (int i = 0; i < 12; i++) { // Far more presses than buttons
+        press((1 << BTN_Y) | (1 << BTN_A) | (1 << BTN_B) | (1 << BTN_X));
+        press((1 << BTN_Y) | (1 << BTN_A) | (1 << BTN_B));
+    }
+    CHECK(state.currentMidiNote == buttonNote(BTN_B));
+    press((1 << BTN_Y) | (1 << BTN_A));
+    CHECK(state.currentMidiNote == buttonNote(BTN_A)); // Not the lowest index (Y)
+    press(1 << BTN_Y);
+    CHECK(state.currentMidiNote == buttonNote(BTN_Y));
+    press(0);
+
+    hostSerialInput("priority low\n");
+    loop();
+    CHECK(state.notePriority == PRIORITY_LOWEST);
+    press(1 << BTN_A);                      // Position 9
+    press((1 << BTN_A) | (1 << BTN_RIGHT)); // Position 3
+    CHECK(state.currentMidiNote == buttonNote(BTN_RIGHT));
+    hostClearMidiOutput();
+    press((1 << BTN_A) | (1 << BTN_RIGHT) | (1 << BTN_X)); // Position 8: higher, no change
+    CHECK(state.currentMidiNote == buttonNote(BTN_RIGHT));
+    CHECK(hostMidiOutput().empty());
+    press((1 << BTN_A) | (1 << BTN_X));
+    CHECK(state.currentMidiNote == buttonNote(BTN_X));
+    press(0);
+
+    hostSerialInput("priority high\n");
+    loop();
+    CHECK(state.notePriority == PRIORITY_HIGHEST);
+    press(1 << BTN_DOWN);                      // Position 0
+    press((1 << BTN_DOWN) | (1 << BTN_A));     // Position 9
+    press((1 << BTN_DOWN) | (1 << BTN_A) | (1 << BTN_UP));
+    CHECK(state.currentMidiNote == buttonNote(BTN_A));
+    press((1 << BTN_DOWN) | (1 << BTN_UP));
+    CHECK(state.currentMidiNote == buttonNote(BTN_UP));
+    press(0);
+    CHECK(state.heldNewest == -1 && state.heldPositions == 0);
+}
+
+// The riff profile walks its sequence: step, repeat, back, jump to marks, next riff
+static void testRiffSteps() {
+    boot();
+    hostSerialInput("riff 0\n");
+    loop();
+    CHECK(state.customProfileIndex == PROFILE_RIFF);
+    const RiffDef& riff = riffAt(0);
+
+    press(1 << BTN_B);
+    CHECK(state.currentMidiNote == riff.notes[0]);
+    press(0);
+    CHECK(state.currentMidiNote == -1);
+    press(1 << BTN_X);
+    press((1 << BTN_X) | (1 << BTN_B)); // Alternating step buttons, legato
+    CHECK(riffCursor() == 2 && state.currentMidiNote == riff.notes[2]);
+    press(1 << BTN_Y);
+    CHECK(riffCursor() == 2 && state.currentMidiNote == riff.notes[2]);
+    press(1 << BTN_A);
+    CHECK(riffCursor() == 1 && state.currentMidiNote == riff.notes[1]);
+    press(1 << BTN_UP);
+    CHECK(riffCursor() == riff.marks[2] && state.currentMidiNote == riff.notes[riff.marks[2]]);
+    hostClearMidiOutput();
+    press((1 << BTN_UP) | (1 << BTN_RIGHT)); // No fourth mark: nothing moves or sounds
+    CHECK(riffCursor() == riff.marks[2]);
+    CHECK(hostMidiOutput().empty());
+    for (int i = 0; i < riff.length - riff.marks[2]; i++) {
+        press(0);
+        press(1 << BTN_B);
+    }
+    CHECK(riffCursor() == 0); // Wrapped
+
+    press(1 << BTN_START);
+    CHECK(currentRiff() == 1 && riffCursor() == -1);
+    CHECK(state.currentMidiNote == -1);
+    press((1 << BTN_START) | (1 << BTN_B));
+    CHECK(state.currentMidiNote == riffAt(1).notes[0]);
+    press((1 << BTN_START) | (1 << BTN_B) | (1 << BTN_R));
+    press((1 << BTN_START) | (1 << BTN_R));
+    press((1 << BTN_START) | (1 << BTN_B) | (1 << BTN_R));
+    CHECK(state.currentMidiNote == riffAt(1).notes[1] + 12);
+    press(0);
+
+    hostSerialInput("riff off\n");
+    loop();
+    press(1 << BTN_B);
+    CHECK(state.currentMidiNote == state.scaleHolder[7]);
+}
+
+// MIDI clocks 20 ms apart (125 BPM)
+static void sendClocks(int count) {
+    for (int i = 0; i < count; i++) {
+        hostMidiInput(0xF8);
+        runFor(20000);
+    }
+}
+
+// With a bar grid and a clock running, key and mode changes wait for the next bar line
+// and land together; without a clock they apply at once
+static void testQuantizedChanges() {
+    boot();
+    hostSerialInput("offset 2\n");
+    loop();
+    CHECK(state.keyOffset == 2); // No clock: immediate
+
+    hostSerialInput("quantize bar\n");
+    loop();
+    CHECK(quantizeGrid() == QUANTIZE_BAR);
+    hostMidiInput(0xFA);
+    sendClocks(1); // Downbeat
+    hostSerialInput("offset 5\nmode boogie\nscale 3\n");
+    runFor(CONTROL_TICK_US);
+    CHECK(pendingChangeCount() == 3);
+    CHECK(state.keyOffset == 2 && state.scaleMode == 0 && !state.boogieModeEnabled);
+    hostClearSerialOutput();
+    hostSerialInput("quantize\n");
+    loop();
+    CHECK(hostSerialOutput().find("QUANTIZE grid=bar pending=3 offset=5 mode=1 scale=3") != std::string::npos);
+
+    sendClocks(95); // Rest of the bar
+    CHECK(pendingChangeCount() == 3 && state.keyOffset == 2);
+    sendClocks(1);  // Next downbeat
+    CHECK(pendingChangeCount() == 0);
+    CHECK(state.keyOffset == 5 && state.scaleMode == 3 && state.boogieModeEnabled);
+
+    // Repeated mode presses cycle from the pending mode
+    press((1 << BTN_L) | (1 << BTN_R));
+    press((1 << BTN_L) | (1 << BTN_R) | (1 << BTN_START));
+    press((1 << BTN_L) | (1 << BTN_R));
+    press((1 << BTN_L) | (1 << BTN_R) | (1 << BTN_START));
+    press(0);
+    CHECK(state.boogieModeEnabled && pendingValue(state, CHANGE_MODE) == PLAY_MODE_STANDARD);
+
+    // MIDI Stop: no bar line is coming, the queue lands on the next control tick
+    hostMidiInput(0xFC);
+    runFor(CONTROL_TICK_US * 2);
+    CHECK(pendingChangeCount() == 0);
+    CHECK(!state.boogieModeEnabled && !state.rhythmicModeEnabled);
+}
+
+// An idle synth wakes once per control tick; queued input skips the sleep
+static void testIdleLoopSleepsBetweenTicks() {
+    boot();
+    loop();
+    unsigned long until = micros() + 10000;
+    int passes = 0;
+    while ((long)(micros() - until) < 0) {
+        loop();
+        passes++;
+    }
+    CHECK(passes >= 10000 / (int)CONTROL_TICK_US - 1 && passes <= 10000 / (int)CONTROL_TICK_US + 1);
+
+    hostSerialInput("scale 2\nscale 3\n");
+    unsigned long before = micros();
+    loop();
+    CHECK(state.scaleMode == 2);
+    CHECK(micros() - before < CONTROL_TICK_US);
+    loop();
+    CHECK(state.scaleMode == 3);
+}
+
+// Simulated time for a portamento glide from B to A, optionally with Serial traffic
+// forcing many extra loop passes
+static unsigned long glideMicros(bool busyLoop) {
+    boot();
+    state.portamentoEnabled = true;
+    press(1 << BTN_B);
+    while (voicesGliding()) loop(); // Let B settle first
+    press((1 << BTN_B) | (1 << BTN_A));
+    unsigned long start = micros();
+    while (voicesGliding() && micros() - start < 2000000) {
+        if (busyLoop) hostSerialInput("offset 0\n");
+        loop();
+        simClock.advance(10);
+    }
+    return micros() - start;
+}
+
+// The glide runs on the control tick, so loop load must not change its speed
+static void testPortamentoIndependentOfLoopRate() {
+    unsigned long quiet = glideMicros(false);
+    unsigned long busy = glideMicros(true);
+    printf("  glide %lu us quiet, %lu us busy\n", quiet, busy);
+    CHECK(quiet > 50000 && quiet < 2000000);
+    long difference = (long)quiet - (long)busy;
+    CHECK(difference < 2 * (long)CONTROL_TICK_US && difference > -2 * (long)CONTROL_TICK_US);
+}
+
+static int soundingVoices() {
+    int sounding = 0;
+    for (int v = 0; v < NUM_VOICES; v++) {
+        if (voiceSounding(v)) sounding++;
+    }
+    return sounding;
+}
+
+// Sustained audio overload sheds vibrato, then the echo, then voices (lead voice last); low load
+// brings them back one level at a time, and load between the marks changes nothing
+static void testGovernorDegradesAndRestores() {
+    boot();
+    state.playStyle = CHORD_BUTTON;
+    state.vibratoRate = 1;
+    state.vibratoDepth = 2;
+    state.echoEnabled = true;
+    press(1 << BTN_B);
+    CHECK(masterEcho.isEnabled());
+    int held = soundingVoices();
+    CHECK(held >= 3);
+    CHECK(waveformMod[0].frequencyHz != voices.frequency[0]); // Vibrato on
+
+    hostSetAudioLoad(95.0f, 10);
+    runFor(GOVERNOR_DEGRADE_TICKS * CONTROL_TICK_US + 1000);
+    CHECK(governorLevel() == GOVERNOR_NO_VIBRATO);
+    CHECK(voices.vibratoDepth.target == 0.0f); // Eased out (SMOOTH_VIBRATO), not cut
+    CHECK(soundingVoices() == held);
+    CHECK(masterEcho.isEnabled());
+
+    runFor(GOVERNOR_DEGRADE_TICKS * CONTROL_TICK_US);
+    CHECK(governorLevel() == GOVERNOR_NO_ECHO);
+    CHECK(!masterEcho.isEnabled() && state.echoEnabled); // Passes through; the setting stays
+    CHECK(soundingVoices() == held);
+
+    runFor(GOVERNOR_DEGRADE_TICKS * CONTROL_TICK_US);
+    CHECK(governorLevel() == GOVERNOR_HALF_VOICES);
+    CHECK(soundingVoices() == NUM_VOICES / 2);
+    CHECK(voiceSounding(0));
+
+    hostSetAudioLoad(40.0f, AUDIO_MEMORY_BLOCKS); // Memory alone keeps the pressure on
+    runFor(GOVERNOR_DEGRADE_TICKS * CONTROL_TICK_US);
+    CHECK(governorLevel() == GOVERNOR_ONE_VOICE);
+    CHECK(soundingVoices() == 1 && voiceSounding(0));
+    CHECK(waveformMod[1].isGated()); // Faded out, then gated
+    for (int v = 0; v < NUM_VOICES; v++) {
+        if (v < held) CHECK(voiceNote(v) >= 0); // Silenced voices keep their notes
+    }
+    CHECK(governorDegradeEvents() == 4);
+
+    hostSetAudioLoad(70.0f, 10); // Between the marks: hold
+    runFor(3 * GOVERNOR_RESTORE_TICKS * CONTROL_TICK_US);
+    CHECK(governorLevel() == GOVERNOR_ONE_VOICE);
+    CHECK(waveformMod[0].frequencyHz == voices.frequency[0]); // Vibrato has settled to nothing
+
+    hostSetAudioLoad(30.0f, 10);
+    runFor(GOVERNOR_RESTORE_TICKS * CONTROL_TICK_US + 1000);
+    CHECK(governorLevel() == GOVERNOR_HALF_VOICES);
+    runFor(GOVERNOR_RESTORE_TICKS * CONTROL_TICK_US);
+    CHECK(governorLevel() == GOVERNOR_NO_ECHO && !masterEcho.isEnabled());
+    runFor(GOVERNOR_RESTORE_TICKS * CONTROL_TICK_US);
+    CHECK(governorLevel() == GOVERNOR_NO_VIBRATO && masterEcho.isEnabled());
+    runFor(GOVERNOR_RESTORE_TICKS * CONTROL_TICK_US);
+    CHECK(governorLevel() == GOVERNOR_FULL);
+    CHECK(governorRestoreEvents() == 4);
+    CHECK(soundingVoices() == held);
+    CHECK(waveformMod[1].amplitudeLevel == VOICE_AMPLITUDE);
+    CHECK(waveformMod[0].frequencyHz != voices.frequency[0]);
+
+    press(0);
+    CHECK(soundingVoices() == 0);
+    int noteOns = 0, noteOffs = 0;
+    for (const auto& m : hostMidiOutput()) {
+        if ((m.status & 0xF0) == 0x90 && m.data2 > 0) noteOns++;
+        else if ((m.status & 0xF0) == 0x80 || (m.status & 0xF0) == 0x90) noteOffs++;
+    }
+    CHECK(noteOns == held && noteOffs == held); // MIDI out is never degraded
+}
+
+// One shared LFO drives every voice: spread offsets the voices' phases, sample-and-hold
+// holds within a cycle, and a synced LFO follows the clock tempo
+static void testSharedLfoBank() {
+    boot();
+    state.playStyle = CHORD_BUTTON;
+    press(1 << BTN_B);
+    runFor(30000);
+    for (int v = 1; v < NUM_VOICES; v++) {
+        if (voiceActive(v)) CHECK(lfoValue(LFO_VIBRATO, v) == lfoValue(LFO_VIBRATO, 0));
+    }
+    hostSerialInput("lfo spread 25\n");
+    loop();
+    CHECK(fabsf(lfoValue(LFO_VIBRATO, 1) - lfoValue(LFO_VIBRATO, 0)) > 0.1f);
+    float cents = 1200.0f * log2f(waveformMod[1].frequencyHz / voices.frequency[1]);
+    CHECK(fabsf(cents) <= 1200.0f * vibratoDepthOctaves(state) + 0.01f);
+
+    hostSerialInput("lfo shape 3\n"); // Sample and hold
+    loop();
+    float first = lfoValue(LFO_VIBRATO, 0);
+    CHECK(first >= -1.0f && first <= 1.0f);
+    int changes = 0;
+    float last = first;
+    for (int i = 0; i < 200; i++) { // 100 ms: half a 5 Hz cycle
+        runFor(CONTROL_TICK_US);
+        if (lfoValue(LFO_VIBRATO, 0) != last) changes++;
+        last = lfoValue(LFO_VIBRATO, 0);
+    }
+    CHECK(changes <= 1);
+
+    hostSerialInput("lfo shape 0\nlfo sync 24\n"); // One cycle per beat
+    loop();
+    loop();
+    state.tempoEstablished = true;
+    state.usPerMidiTick = 500000.0f / 24.0f; // 120 BPM: 2 Hz
+    uint32_t start = lfoBank.phase[LFO_VIBRATO];
+    runFor(250000);
+    uint32_t advanced = lfoBank.phase[LFO_VIBRATO] - start;
+    CHECK(advanced > 0x78000000u && advanced < 0x88000000u); // Half a cycle
+}
+
+// Routes apply only while they exist: a CC bends pitch, held time fades the voice,
+// swing follows a CC, and clearing the list puts every voice back as it was
+static void testModMatrix() {
+    boot();
+    hostSerialInput("vibrato depth 0\n");
+    loop();
+    press(1 << BTN_B);
+    runFor(10000);
+    float base = voices.frequency[0];
+    CHECK(fabsf(waveformMod[0].frequencyHz - base) < 0.01f);
+
+    hostMidiInput(0xB0, 74, 127);
+    hostSerialInput("mod add cc74 pitch 12\n");
+    loop();
+    runFor(2 * CONTROL_TICK_US);
+    CHECK(fabsf(waveformMod[0].frequencyHz / base - 2.0f) < 0.001f);
+    hostMidiInput(0xB0, 74, 0);
+    runFor(300000); // The CC is smoothed (SMOOTH_CC)
+    CHECK(fabsf(waveformMod[0].frequencyHz - base) < 0.01f);
+
+    hostSerialInput("mod add held amp -0.5\n");
+    loop();
+    runFor(1000000 - 312000); // About 1 s after the note-on: halfway
+    CHECK(fabsf(envelope[0].voiceGain() - 0.75f) < 0.01f);
+    runFor(2000000);
+    CHECK(fabsf(envelope[0].voiceGain() - 0.5f) < 0.001f);
+
+    hostMidiInput(0xB0, 74, 64);
+    hostSerialInput("mod add cc74 swing -1\n");
+    loop();
+    runFor(2 * CONTROL_TICK_US);
+    CHECK(fabsf(modulatedSwing(state) - (state.swingAmount - 64.0f / 127.0f)) < 0.001f);
+    hostSerialInput("mod add cc74 pitch 7\n"); // Same route: new amount, not a new route
+    loop();
+    hostClearSerialOutput();
+    hostSerialInput("mod\n");
+    loop();
+    CHECK(hostSerialOutput().find("MOD routes=3/8") != std::string::npos);
+    CHECK(hostSerialOutput().find("MOD 0 cc74 -> pitch 7.00") != std::string::npos);
+    CHECK(hostSerialOutput().find("MOD 1 held -> amp -0.50") != std::string::npos);
+
+    hostSerialInput("mod clear\n");
+    loop();
+    runFor(100000); // Gains ease back to unity
+    CHECK(fabsf(waveformMod[0].frequencyHz - base) < 0.01f);
+    CHECK(envelope[0].voiceGain() == 1.0f && !voices.amplitudeModulated);
+    CHECK(modulatedSwing(state) == state.swingAmount && modDeltas.active == 0);
+
+    for (int s = 0; s < MOD_SRC_CC; s++) {
+        for (int d = 0; d < MOD_DST_COUNT; d++) addModRoute(s, 0, d, 0.1f);
+    }
+    CHECK(modRouteCount() == MOD_MAX_ROUTES);
+    CHECK(addModRoute(MOD_SRC_CC, 1, MOD_DST_PITCH, 1.0f) < 0);
+    clearModRoutes();
+}
+
+// Gain changes reach the samples as a ramp, the codec volume eases towards its target
+// in steps, and a zero time constant makes a parameter jump again
+static void testParameterSmoothing() {
+    boot();
+    VoiceEnvelope env;
+    env.attack(1.0f);
+    env.noteOn();
+    for (int i = 0; i < 100; i++) env.tick(CONTROL_TICK_US);
+    int16_t block[AUDIO_BLOCK_SAMPLES];
+    for (int n = 0; n < AUDIO_BLOCK_SAMPLES; n++) block[n] = 16384;
+    env.renderBlock(block);
+    env.setGain(0.5f);
+    for (int n = 0; n < AUDIO_BLOCK_SAMPLES; n++) block[n] = 16384;
+    env.renderBlock(block);
+    int largestStep = 0;
+    for (int n = 1; n < AUDIO_BLOCK_SAMPLES; n++) largestStep = std::max(largestStep, block[n - 1] - block[n]);
+    CHECK(block[0] > 16000 && abs(block[AUDIO_BLOCK_SAMPLES - 1] - 8192) <= 2);
+    CHECK(largestStep <= 8192 / AUDIO_BLOCK_SAMPLES + 1);
+
+    hostSerialInput("volume 100\n");
+    loop();
+    runFor(2 * CONTROL_TICK_US);
+    CHECK(sgtl5000_1.volumeLevel >= MASTER_VOLUME_DEFAULT && sgtl5000_1.volumeLevel < 0.6f);
+    runFor(20000);
+    CHECK(sgtl5000_1.volumeLevel > 0.6f && sgtl5000_1.volumeLevel < 1.0f);
+    runFor(1000000);
+    CHECK(sgtl5000_1.volumeLevel == 1.0f);
+
+    hostSerialInput("vibrato depth 3\n");
+    loop();
+    runFor(2 * CONTROL_TICK_US);
+    CHECK(voices.vibratoDepth.value > 0.0f && voices.vibratoDepth.value < vibratoDepthOctaves(state));
+    hostSerialInput("smooth vibrato 0\n");
+    loop();
+    runFor(2 * CONTROL_TICK_US);
+    CHECK(voices.vibratoDepth.value == vibratoDepthOctaves(state));
+    hostClearSerialOutput();
+    hostSerialInput("smooth\n");
+    loop();
+    CHECK(hostSerialOutput().find("SMOOTH vibrato=0 amp=5 cc=20 volume=50") != std::string::npos);
+    resetSmoothing();
+}
+
+// Idle voices render nothing; Monophonic leaves only voice 0 patched, and a voice
+// the new play style drops is unpatched once its note has finished
+static void testIdleVoicesGated() {
+    boot();
+    runFor(2 * CONTROL_TICK_US);
+    for (int v = 0; v < NUM_VOICES; v++) CHECK(waveformMod[v].isGated());
+    CHECK(voiceConnected(0) && !voiceConnected(1));
+    hostClearSerialOutput();
+    hostSerialInput("audio\n");
+    loop();
+    CHECK(hostSerialOutput().find("running=0/4 patched=1/4") != std::string::npos);
+
+    press(1 << BTN_B);
+    CHECK(!waveformMod[0].isGated());
+    CHECK(waveformMod[1].isGated());
+    press(0);
+    runFor(CONTROL_TICK_US);
+    CHECK(!waveformMod[0].isGated()); // Still fading out
+    runFor(VOICE_FADE_US + VOICE_SETTLE_US);
+    CHECK(waveformMod[0].isGated());
+
+    hostSerialInput("chord\n");
+    loop();
+    runFor(CONTROL_TICK_US);
+    for (int v = 0; v < NUM_VOICES; v++) CHECK(voiceConnected(v));
+    press(1 << BTN_B);
+    CHECK(!waveformMod[1].isGated());
+    CHECK(patchCords[2].connected && patchCords[3].connected);
+
+    hostSerialInput("mono\n"); // Chord still sounding: voice 1 stays patched
+    loop();
+    runFor(CONTROL_TICK_US);
+    CHECK(voiceConnected(1));
+    hostSerialInput("chord\n");
+    loop();
+    press(0);
+    hostSerialInput("mono\n");
+    loop();
+    runFor(VOICE_FADE_US + VOICE_SETTLE_US + CONTROL_TICK_US);
+    CHECK(!voiceConnected(1) && !patchCords[2].connected && !patchCords[3].connected);
+    CHECK(voiceConnected(0) && patchCords[2 * NUM_VOICES].connected);
+}
+
+static int blockPeak(const int16_t* block) {
+    int peak = 0;
+    for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) peak = std::max(peak, abs((int)block[i]));
+    return peak;
+}
+
+// Each drum renders a decaying hit from nothing, and the kit goes quiet afterwards
+static void testDrumKitRenders() {
+    static AudioSynthDrumKit kit;
+    int16_t block[AUDIO_BLOCK_SAMPLES];
+    CHECK(!kit.isActive());
+    CHECK(!kit.renderBlock(block));
+    for (int d = 0; d < NUM_DRUM_SOUNDS; d++) {
+        kit.trigger((DrumSound)d);
+        CHECK(kit.isActive());
+        CHECK(kit.renderBlock(block));
+        int first = blockPeak(block);
+        int blocks = 1;
+        int later = 0;
+        while (kit.renderBlock(block) && blocks < 2000) {
+            if (blocks == 40) later = blockPeak(block); // ~115 ms in
+            blocks++;
+        }
+        CHECK(first > 3000);
+        CHECK(later < first);
+        CHECK(blocks > 5 && blocks < 1000); // Finished within ~3 s
+        CHECK(!kit.isActive());
+    }
+}
+
+// Boogie onsets trigger the drum kit only when drums are switched on
+static void testBoogieTriggersDrums() {
+    for (int enabled = 0; enabled < 2; enabled++) {
+        boot();
+        int16_t block[AUDIO_BLOCK_SAMPLES];
+        while (drums.renderBlock(block)) {} // Let a previous boot's hits finish
+        hostSerialInput("mode boogie\n");
+        if (enabled) hostSerialInput("drums on\n");
+        state.tempoEstablished = true;
+        state.usPerMidiTick = 500000.0f / 24.0f; // 120 BPM
+        press(1 << BTN_A);
+        int activeSteps = 0;
+        for (int step = 0; step < 1000; step++) { // 1 s
+            runFor(1000);
+            if (drums.isActive()) activeSteps++;
+            drums.renderBlock(block);
+        }
+        CHECK(state.drumsEnabled == (enabled != 0));
+        if (enabled) CHECK(activeSteps > 100);
+        else CHECK(activeSteps == 0);
+    }
+}
+
+// BRR decode of the built-in saw: range 12, no filter, nibbles -8..7 in steps of 4096
+static void testBrrDecode() {
+    int16_t buffer[2 + BRR_BLOCK_SAMPLES] = {0, 0};
+    uint8_t header = brrDecodeBlock(brrBuiltinSamples[0].data, buffer + 2);
+    CHECK(header == 0xC3);
+    CHECK((header & (BRR_FLAG_END | BRR_FLAG_LOOP)) == (BRR_FLAG_END | BRR_FLAG_LOOP));
+    CHECK(buffer[2] == -32768);
+    CHECK(buffer[2 + 15] == 28672);
+    for (int i = 1; i < BRR_BLOCK_SAMPLES; i++) CHECK(buffer[2 + i] - buffer[2 + i - 1] == 4096);
+}
+
+// Key on, envelope up to full scale, release back to silence; one-shot samples stop
+static void testSDspVoice() {
+    static AudioSynthSDsp dsp;
+    int16_t block[AUDIO_BLOCK_SAMPLES];
+    CHECK(!dsp.renderBlock(block));
+
+    dsp.keyOn(0, brrSampleAt(0), 440.0f);
+    CHECK(dsp.voiceState(0).pitch == sdspPitchFor(brrSampleAt(0), 440.0f));
+    CHECK(dsp.voiceState(0).pitch > SDSP_PITCH_UNITY / 8 && dsp.voiceState(0).pitch < SDSP_PITCH_UNITY / 2);
+    int peak = 0;
+    for (int i = 0; i < 20; i++) {
+        CHECK(dsp.renderBlock(block));
+        peak = std::max(peak, blockPeak(block));
+    }
+    CHECK(dsp.voiceState(0).envelope == SDSP_ENVELOPE_MAX);
+    CHECK(peak > 3000);
+
+    dsp.keyOff(0);
+    int blocks = 0;
+    while (dsp.renderBlock(block) && blocks < 100) blocks++;
+    CHECK(!dsp.voiceActive(0));
+    CHECK(blocks > 0 && blocks <= 4); // Release is ~8 ms
+
+    // Two blocks, no loop flag: ends after 32 samples at unity pitch
+    static const uint8_t oneShot[2 * BRR_BLOCK_BYTES] = {
+        0xC0, 0x77, 0x77, 0x77, 0x77, 0x77, 0x77, 0x77, 0x77,
+        0xC1, 0x77, 0x77, 0x77, 0x77, 0x77, 0x77, 0x77, 0x77,
+    };
+    static const BrrSample shot = {"shot", oneShot, sizeof(oneShot), 0, 2000.0f};
+    dsp.keyOn(1, &shot, shot.rootHz);
+    CHECK(dsp.renderBlock(block)); // 128 output samples = ~93 S-DSP samples: past the end
+    CHECK(!dsp.voiceActive(1));
+    CHECK(dsp.voiceState(1).ended);
+}
+
+// "engine brr" sends new notes to the S-DSP voice; the oscillator stays gated
+static void testBrrEngineVoices() {
+    boot();
+    hostSerialInput("engine brr\n");
+    loop();
+    hostSerialInput("brr sample 1\n");
+    loop();
+    CHECK(state.voiceEngine == ENGINE_SDSP);
+    CHECK(state.brrSampleIndex == 1);
+
+    press(1 << BTN_B);
+    runFor(2 * CONTROL_TICK_US);
+    CHECK(sdsp.voiceActive(0));
+    CHECK(sdsp.voiceState(0).sample == brrSampleAt(1));
+    CHECK(waveformMod[0].isGated());
+    CHECK(voices.engine[0] == ENGINE_SDSP);
+
+    press(0);
+    int16_t block[AUDIO_BLOCK_SAMPLES];
+    for (int i = 0; i < 10; i++) sdsp.renderBlock(block); // The host has no audio interrupt
+    runFor(2 * CONTROL_TICK_US);
+    CHECK(!sdsp.voiceActive(0));
+    CHECK(voices.envPhase[0] == ENV_IDLE);
+
+    // Back to the oscillators for the next note
+    hostSerialInput("engine osc\n");
+    loop();
+    press(1 << BTN_B);
+    runFor(2 * CONTROL_TICK_US);
+    CHECK(!waveformMod[0].isGated());
+    CHECK(!sdsp.voiceActive(0));
+    press(0);
+}
+
+// A retrigger that needs a fresh oscillator fades the sounding note out and attacks
+// again from silence: the gain never steps, and neither engine restarts its voice until
+// the old note is inaudible
+static void testRetriggerFades() {
+    static VoiceEnvelope env;
+    int16_t block[AUDIO_BLOCK_SAMPLES];
+    env.attack(1);
+    env.noteOn();
+    for (int t = 0; t < 8; t++) env.tick(CONTROL_TICK_US);
+    std::fill(block, block + AUDIO_BLOCK_SAMPLES, 20000);
+    env.renderBlock(block);
+    int last = block[AUDIO_BLOCK_SAMPLES - 1];
+    CHECK(last > 10000);
+
+    env.noteOn();
+    CHECK(env.retriggering() && env.currentStage() == VENV_FADE);
+    int ticks = 0, maxStep = 0;
+    while (env.retriggering() && ticks < 100) {
+        env.tick(CONTROL_TICK_US); // One block per tick: a much steeper ramp than on the Teensy
+        ticks++;
+        std::fill(block, block + AUDIO_BLOCK_SAMPLES, 20000);
+        if (!env.renderBlock(block)) std::fill(block, block + AUDIO_BLOCK_SAMPLES, 0); // Not transmitted
+        for (int n = 0; n < AUDIO_BLOCK_SAMPLES; n++) {
+            maxStep = std::max(maxStep, abs(block[n] - last));
+            last = block[n];
+        }
+    }
+    CHECK(env.currentStage() == VENV_ATTACK);
+    CHECK(ticks * CONTROL_TICK_US >= VOICE_FADE_US + VOICE_SETTLE_US);
+    CHECK(last == 0);
+    CHECK(maxStep < 200);
+
+    // Mono with a waveform change: the new note's begin() and pitch wait for the fade
+    boot();
+    press(1 << BTN_B);
+    runFor(20000);
+    unsigned int begins = waveformMod[0].beginCount;
+    float oldHz = waveformMod[0].frequencyHz;
+    state.currentWaveform = 1;
+    press(1 << BTN_A);
+    CHECK(envelope[0].retriggering());
+    CHECK(waveformMod[0].beginCount == begins && waveformMod[0].frequencyHz == oldHz);
+    runFor(VOICE_FADE_US + VOICE_SETTLE_US + 2 * CONTROL_TICK_US);
+    CHECK(waveformMod[0].beginCount == begins + 1);
+    CHECK(fabsf(waveformMod[0].frequencyHz / voices.frequency[0] - 1.0f) < 0.1f); // Within vibrato
+    CHECK(fabsf(oldHz / voices.frequency[0] - 1.0f) > 0.1f);
+    press(0);
+    state.currentWaveform = 0;
+
+    // S-DSP: a key on while sounding fades the old sample over SDSP_FADE_SAMPLES first
+    static AudioSynthSDsp dsp;
+    dsp.keyOn(0, brrSampleAt(0), 440.0f);
+    int peak = 0;
+    for (int i = 0; i < 20; i++) {
+        dsp.renderBlock(block);
+        peak = std::max(peak, blockPeak(block));
+    }
+    dsp.keyOn(0, brrSampleAt(1), 330.0f);
+    CHECK(dsp.voiceState(0).sample == brrSampleAt(0));
+    dsp.renderBlock(block);
+    CHECK(dsp.voiceState(0).sample == brrSampleAt(1));
+    CHECK(abs(block[SDSP_FADE_SAMPLES - 2]) <= 2 * peak / SDSP_FADE_SAMPLES + 1);
+}
+
+// Lowest magnitude in a block; 0 if any sample is silent
+static int blockFloor(const int16_t* block) {
+    int floor = 32767;
+    for (int n = 0; n < AUDIO_BLOCK_SAMPLES; n++) floor = std::min(floor, abs(block[n]));
+    return floor;
+}
+
+// A retrigger on the same waveform keeps the oscillator running: the pitch changes at
+// once and the attack climbs from the current level, so sound comes within one block of
+// the note-on and never drops out
+static void testRetriggerInPlace() {
+    int16_t block[AUDIO_BLOCK_SAMPLES];
+    boot();
+    for (int t = 0; t < 2000 && envelope[0].isActive(); t++) runFor(CONTROL_TICK_US); // Earlier tests' release
+    press(1 << BTN_B);
+    runFor(CONTROL_TICK_US); // Well inside one audio block
+    std::fill(block, block + AUDIO_BLOCK_SAMPLES, 20000);
+    CHECK(envelope[0].renderBlock(block) && blockPeak(block) > 0); // From silence
+    runFor(20000);
+    std::fill(block, block + AUDIO_BLOCK_SAMPLES, 20000);
+    envelope[0].renderBlock(block);
+    unsigned int begins = waveformMod[0].beginCount;
+    float oldHz = waveformMod[0].frequencyHz;
+
+    press(1 << BTN_A);
+    CHECK(!envelope[0].retriggering() && !voices.restartPending[0]);
+    CHECK(envelope[0].currentStage() == VENV_ATTACK || envelope[0].currentStage() == VENV_DECAY ||
+          envelope[0].currentStage() == VENV_SUSTAIN);
+    CHECK(waveformMod[0].beginCount == begins);
+    CHECK(fabsf(waveformMod[0].frequencyHz / voices.frequency[0] - 1.0f) < 0.1f); // Within vibrato
+    CHECK(fabsf(oldHz / voices.frequency[0] - 1.0f) > 0.1f);
+    std::fill(block, block + AUDIO_BLOCK_SAMPLES, 20000);
+    CHECK(envelope[0].renderBlock(block) && blockFloor(block) > 0); // First block after the note-on
+    for (int t = 0; t < (int)((VOICE_FADE_US + VOICE_SETTLE_US) / CONTROL_TICK_US) + 2; t++) {
+        runFor(CONTROL_TICK_US);
+        std::fill(block, block + AUDIO_BLOCK_SAMPLES, 20000);
+        CHECK(envelope[0].renderBlock(block) && blockFloor(block) > 0);
+    }
+    CHECK(waveformMod[0].beginCount == begins);
+    press(0);
+}
+
+// Decodes the "SMF <hex>" lines of a Serial export
+static std::vector<uint8_t> smfFromSerial(const std::string& output) {
+    std::vector<uint8_t> bytes;
+    size_t line = 0;
+    while ((line = output.find("SMF ", line)) != std::string::npos) {
+        line += 4;
+        while (line + 1 < output.size() && isxdigit((unsigned char)output[line])) {
+            bytes.push_back((uint8_t)std::stoi(output.substr(line, 2), nullptr, 16));
+            line += 2;
+        }
+    }
+    return bytes;
+}
+
+// Notes sent while playing come back as a type-0 file: tempo from the clock tracking,
+// deltas in ticks at that tempo, the note still held closed at the end
+static void testMidiExport() {
+    boot();
+    clearMidiCapture();
+    press(1 << BTN_B);
+    runFor(250000);
+    press(0);
+    press(1 << BTN_A);
+    runFor(125000);
+    CHECK(midiCaptureCount() == 3);
+
+    hostClearSerialOutput();
+    hostSerialInput("midi export serial 2\n");
+    loop();
+    CHECK(hostSerialOutput().find("SMF_DONE events=3") != std::string::npos);
+    std::vector<uint8_t> smf = smfFromSerial(hostSerialOutput());
+    const uint8_t header[] = {'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 0, 0, 1, SMF_DIVISION >> 8, SMF_DIVISION & 0xFF};
+    CHECK(smf.size() > 22 && memcmp(smf.data(), header, sizeof(header)) == 0);
+    if (smf.size() <= 22) return;
+    uint32_t trackBytes = (smf[18] << 24) | (smf[19] << 16) | (smf[20] << 8) | smf[21];
+    CHECK(trackBytes == smf.size() - 22);
+    const uint8_t tempo[] = {0x00, 0xFF, 0x51, 0x03, 0x07, 0xA1, 0x20}; // 500000 us: 120 BPM default
+    CHECK(memcmp(&smf[22], tempo, sizeof(tempo)) == 0);
+
+    // Walk the events: delta (one or two bytes here), status, note, velocity
+    std::vector<uint32_t> times;
+    std::vector<uint8_t> statuses;
+    uint32_t ticks = 0;
+    size_t i = 22 + sizeof(tempo);
+    while (i + 3 < smf.size() && smf[i + (smf[i] & 0x80 ? 2 : 1)] != 0xFF) {
+        uint32_t delta = smf[i] & 0x7F;
+        if (smf[i++] & 0x80) delta = (delta << 7) | smf[i++];
+        ticks += delta;
+        times.push_back(ticks);
+        statuses.push_back(smf[i] & 0xF0);
+        i += 3;
+    }
+    CHECK(statuses.size() == 4);
+    if (statuses.size() != 4) return;
+    CHECK(statuses[0] == 0x90 && statuses[1] == 0x80 && statuses[2] == 0x90 && statuses[3] == 0x80);
+    CHECK(times[0] == 0);
+    CHECK(times[1] >= 235 && times[1] <= 250); // 250 ms at 120 BPM = 240 ticks
+    CHECK(times[3] - times[2] >= 115 && times[3] - times[2] <= 125);
+    const uint8_t endOfTrack[] = {0x00, 0xFF, 0x2F, 0x00};
+    CHECK(memcmp(&smf[smf.size() - 4], endOfTrack, 4) == 0);
+
+    // Only the last N minutes are exported
+    simClock.advance(3 * 60000000UL);
+    hostClearSerialOutput();
+    hostSerialInput("midi export serial 2\n");
+    loop();
+    CHECK(hostSerialOutput().find("SMF_DONE events=0") != std::string::npos);
+    press(0);
+}
+
+static std::vector<unsigned long> midiNoteOnTimes() {
+    std::vector<unsigned long> times;
+    for (const HostMidiMessage& m : hostMidiOutput()) {
+        if ((m.status & 0xF0) == 0x90 && m.data2 > 0) times.push_back(m.timeMicros);
+    }
+    return times;
+}
+
+// Type 1 with running status, a sysex and a tempo track; then the demo bar looping at
+// the file tempo, then following a MIDI clock at another tempo
+static void testSmfBackingTrack() {
+    static const uint8_t song[] = {
+        'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 1, 0, 2, 0, 96,
+        'M', 'T', 'r', 'k', 0, 0, 0, 11,
+        0x00, 0xFF, 0x51, 0x03, 0x0F, 0x42, 0x40, // 60 BPM
+        0x00, 0xFF, 0x2F, 0x00,
+        'M', 'T', 'r', 'k', 0, 0, 0, 24,
+        0x00, 0xF0, 0x02, 0x7E, 0xF7,             // SysEx, skipped
+        0x00, 0x91, 0x3C, 0x40, 0x60, 0x3C, 0x00, // Running status, velocity-0 off
+        0x00, 0x3E, 0x40, 0x60, 0x81, 0x3E, 0x00, // Explicit note-off
+        0x00, 0xFF, 0x2F, 0x00,
+    };
+    boot();
+    CHECK(loadSmf(song, sizeof(song), "song") == 4);
+    CHECK(smfDivision() == 96 && smfLengthTicks() == 193);
+    CHECK(loadSmf(song, 30, "cut") == -1 && smfEventCount() == 0);
+    CHECK(loadSmf(song, sizeof(song), "song") == 4);
+    hostSerialInput("backing out midi\n");
+    loop();
+    hostSerialInput("backing play\n");
+    loop();
+    hostClearMidiOutput();
+    runFor(1500000);
+    std::vector<unsigned long> onTimes = midiNoteOnTimes();
+    CHECK(onTimes.size() == 1 && hostMidiOutput().size() == 2); // Note 62 due at 1 s (a quarter at 60 BPM)
+    CHECK(hostMidiOutput()[0].status == 0x81 && hostMidiOutput()[0].data1 == 0x3C);
+    CHECK(hostMidiOutput()[1].status == 0x91 && hostMidiOutput()[1].data1 == 0x3E);
+
+    // Demo bar at its own 120 BPM: 8th notes, and the bar loops after 2 s
+    hostSerialInput("backing load demo\n");
+    loop();
+    hostClearSerialOutput();
+    hostSerialInput("backing\n");
+    loop();
+    CHECK(hostSerialOutput().find("BACKING name=demo notes=16 division=96 length=384") != std::string::npos);
+    hostSerialInput("backing play\n");
+    loop();
+    hostClearMidiOutput();
+    runFor(2600000);
+    onTimes = midiNoteOnTimes();
+    CHECK(onTimes.size() >= 10);
+    if (onTimes.size() >= 10) {
+        CHECK(labs((long)(onTimes[1] - onTimes[0]) - 250000) <= CONTROL_TICK_US);
+        CHECK(labs((long)(onTimes[8] - onTimes[0]) - 2000000) <= CONTROL_TICK_US);
+    }
+
+    // MIDI clock at 100 BPM: once locked, the 8th notes follow it (300 ms apart)
+    const unsigned long tickPeriod = 25000;
+    hostMidiInput(0xFA);
+    unsigned long nextTick = micros() + tickPeriod;
+    unsigned long lockedAt = 0;
+    for (unsigned long end = micros() + 5000000; micros() < end;) {
+        if (micros() >= nextTick) {
+            hostMidiInput(0xF8);
+            nextTick += tickPeriod;
+        }
+        if (!lockedAt && state.tempoEstablished) {
+            lockedAt = micros();
+            hostClearMidiOutput();
+        }
+        loop();
+        simClock.advance(40);
+    }
+    CHECK(lockedAt != 0);
+    onTimes = midiNoteOnTimes();
+    CHECK(onTimes.size() >= 10);
+    for (size_t i = 1; i < onTimes.size(); i++) {
+        CHECK(labs((long)(onTimes[i] - onTimes[i - 1]) - 300000) <= 2 * CONTROL_TICK_US);
+    }
+
+    // Spare voices: never voice 0
+    hostSerialInput("backing out voices\n");
+    loop();
+    CHECK(hostMidiOutput().back().status == 0x80); // Switching outputs released the MIDI note
+    hostMidiInput(0xFC);
+    loop();
+    hostSerialInput("backing play\n");
+    loop();
+    runFor(2 * CONTROL_TICK_US);
+    CHECK(voices.owner[NUM_VOICES - 1] == OWNER_BACKING && voiceNote(NUM_VOICES - 1) == 36);
+    CHECK(voices.owner[0] != OWNER_BACKING);
+    hostSerialInput("backing stop\n");
+    loop();
+    CHECK(!voiceActive(NUM_VOICES - 1));
+}
+
+// An impulse comes back after the delay, scaled by EVOL, and again via EFB; with no
+// feedback the echo goes quiet once the delay line has drained
+static void testEchoImpulse() {
+    static int16_t line[ECHO_MAX_SAMPLES];
+    static AudioEffectSDspEcho fx(line);
+    int16_t in[AUDIO_BLOCK_SAMPLES] = {16384};
+    int16_t out[AUDIO_BLOCK_SAMPLES];
+    CHECK(!fx.renderBlock(in, out)); // Disabled: passes through untouched
+
+    for (int t = 0; t < ECHO_FIR_TAPS; t++) fx.setFir(t, t == ECHO_FIR_TAPS - 1 ? 127 : 0);
+    fx.setEnabled(true);
+    fx.setDelaySamples(1000);
+    fx.setVolume(127);
+    fx.setFeedback(64);
+    std::vector<int16_t> rendered;
+    CHECK(fx.renderBlock(in, out));
+    rendered.insert(rendered.end(), out, out + AUDIO_BLOCK_SAMPLES);
+    for (int b = 1; b < 20; b++) {
+        CHECK(fx.renderBlock(nullptr, out));
+        rendered.insert(rendered.end(), out, out + AUDIO_BLOCK_SAMPLES);
+    }
+    CHECK(rendered[0] == 16384);
+    CHECK(rendered[1000] > 15000 && rendered[1000] < 16384);
+    CHECK(rendered[2000] > 7000 && rendered[2000] < 8192);
+    int stray = 0;
+    for (size_t n = 1; n < rendered.size(); n++) {
+        if (n % 1000 != 0 && rendered[n] != 0) stray++;
+    }
+    CHECK(stray == 0);
+
+    fx.setFeedback(0);
+    int blocks = 0;
+    while (fx.renderBlock(nullptr, out) && blocks < 100) blocks++;
+    CHECK(blocks < 20); // Drained within one delay plus the FIR history
+}
+
+// "echo sync" locks the delay to the clock, halving notes that exceed 240 ms
+static void testEchoTempoLock() {
+    boot();
+    state.tempoEstablished = true;
+    state.usPerMidiTick = 500000.0f / 24.0f; // 120 BPM
+    hostSerialInput("echo on\n");
+    loop();
+    hostSerialInput("echo sync 9\n"); // Dotted 16th, 187.5 ms
+    loop();
+    runFor(2 * CONTROL_TICK_US);
+    CHECK(masterEcho.isEnabled());
+    uint32_t expected = (uint32_t)(0.1875f * AUDIO_SAMPLE_RATE_EXACT + 0.5f);
+    CHECK(masterEcho.delaySamples() == expected);
+
+    state.usPerMidiTick = 500000.0f / 24.0f * 1.001f; // Clock jitter: delay stays put
+    runFor(2 * CONTROL_TICK_US);
+    CHECK(masterEcho.delaySamples() == expected);
+
+    hostSerialInput("echo sync 24\n"); // Quarter note, 500 ms -> 125 ms
+    loop();
+    runFor(2 * CONTROL_TICK_US);
+    uint32_t quarter = masterEcho.delaySamples();
+    CHECK(quarter > (uint32_t)(0.124f * AUDIO_SAMPLE_RATE_EXACT) && quarter < (uint32_t)(0.126f * AUDIO_SAMPLE_RATE_EXACT));
+
+    hostSerialInput("echo off\n");
+    loop();
+    runFor(2 * CONTROL_TICK_US);
+    CHECK(!masterEcho.isEnabled());
+}
+
+static void writeHostFile(const std::string& path, const std::vector<uint8_t>& bytes) {
+    FILE* f = fopen(path.c_str(), "wb");
+    fwrite(bytes.data(), 1, bytes.size(), f);
+    fclose(f);
+}
+
+// 'count' saw blocks; the last carries 'lastHeader' (end, maybe loop)
+static std::vector<uint8_t> brrBlocks(int count, uint8_t lastHeader) {
+    std::vector<uint8_t> bytes;
+    for (int b = 0; b < count; b++) {
+        bytes.push_back(b == count - 1 ? lastHeader : 0xC0);
+        for (int i = 1; i < BRR_BLOCK_BYTES; i++) bytes.push_back(brrBuiltinSamples[0].data[i] + b);
+    }
+    return bytes;
+}
+
+// A .brr and an .spc in /BRR are indexed at boot, and a streamed sample plays back
+// exactly like the same bytes held in memory, across refills and loop jumps
+static void testSampleBankStreaming() {
+    char root[] = "/tmp/snes_sd_XXXXXX";
+    CHECK(mkdtemp(root) != nullptr);
+    std::string dir = std::string(root) + "/BRR";
+    mkdir(dir.c_str(), 0755);
+
+    // 40 blocks (over one stream half) looping back to block 3, with the loop header
+    std::vector<uint8_t> saw = brrBlocks(40, 0xC3);
+    std::vector<uint8_t> brrFile = {3 * BRR_BLOCK_BYTES, 0};
+    brrFile.insert(brrFile.end(), saw.begin(), saw.end());
+    writeHostFile(dir + "/LOOPSAW.BRR", brrFile);
+
+    // SPC dump: directory at $0200 with a looping and a one-shot sample, then a terminator
+    std::vector<uint8_t> spc(SPC_DSP_OFFSET + 128, 0);
+    memcpy(spc.data(), "SNES-SPC700 Sound File Data v0.30", 33);
+    spc[SPC_DSP_OFFSET + SPC_DSP_DIR] = 0x02;
+    const uint8_t directory[] = {0x00, 0x10, 0x09, 0x10, 0x00, 0x20, 0x00, 0x20};
+    memcpy(&spc[SPC_HEADER_BYTES + 0x200], directory, sizeof(directory));
+    std::vector<uint8_t> looped = brrBlocks(3, 0xC3), oneShot = brrBlocks(2, 0xC1);
+    memcpy(&spc[SPC_HEADER_BYTES + 0x1000], looped.data(), looped.size());
+    memcpy(&spc[SPC_HEADER_BYTES + 0x2000], oneShot.data(), oneShot.size());
+    writeHostFile(dir + "/GAME.SPC", spc);
+    writeHostFile(dir + "/README.TXT", {'h', 'i'});
+
+    hostSetSdRoot(root);
+    boot();
+    CHECK(sampleBankCount() == 3);
+    CHECK(brrSampleCount() == NUM_BRR_BUILTIN_SAMPLES + 3);
+    const BrrSample* streamed = nullptr;
+    for (int i = 0; i < sampleBankCount(); i++) {
+        const BrrSample* sample = sampleBankAt(i);
+        CHECK(sample->data == nullptr);
+        if (strcmp(sampleBankFileName(sample), "LOOPSAW.BRR") == 0) {
+            streamed = sample;
+            CHECK(sample->length == saw.size());
+            CHECK(sample->loopOffset == 3 * BRR_BLOCK_BYTES);
+        } else {
+            CHECK(strcmp(sampleBankFileName(sample), "GAME.SPC") == 0);
+            CHECK(sample->length == 3 * BRR_BLOCK_BYTES || sample->length == 2 * BRR_BLOCK_BYTES);
+            CHECK(sample->loopOffset == (sample->length == 3 * BRR_BLOCK_BYTES ? BRR_BLOCK_BYTES : 0u));
+        }
+    }
+    CHECK(streamed != nullptr);
+    if (!streamed) return;
+
+    // Blocks arrive in playback order (0..39, then 3..39 on every loop) while the
+    // main loop refills behind an audio update taking 20 blocks at a time (~4x pitch)
+    const int voice = SDSP_VOICES - 1; // Not driven by the allocator; never rendered here
+    sampleBankSelect(streamed);
+    unsigned long accesses = hostSdAccesses();
+    BrrStream* stream = sampleBankPrime(voice, streamed);
+    CHECK(hostSdAccesses() == accesses); // The first half comes from the read-ahead
+    CHECK(stream != nullptr);
+    if (!stream) return;
+    sdsp.keyOn(voice, streamed, 1000.0f, stream); // Takes block 0
+    CHECK(sdsp.voiceState(voice).stream == stream);
+    int expectedBlock = 1;
+    int mismatches = 0;
+    for (int update = 0; update < 50; update++) {
+        for (int n = 0; n < 20; n++) {
+            const uint8_t* block = brrStreamNextBlock(*stream);
+            if (!block || memcmp(block, &saw[expectedBlock * BRR_BLOCK_BYTES], BRR_BLOCK_BYTES) != 0) mismatches++;
+            expectedBlock = (expectedBlock == 39) ? 3 : expectedBlock + 1;
+        }
+        serviceSampleBank();
+    }
+    CHECK(mismatches == 0);
+    CHECK(sampleBankUnderruns() == 0);
+    sdsp.keyOff(voice);
+
+    // Through the allocator: "brr sample" picks the bank sample by number
+    hostClearSerialOutput();
+    hostSerialInput("bank\n");
+    loop();
+    CHECK(hostSerialOutput().find("BANK_DONE 3") != std::string::npos);
+    hostSerialInput("engine brr\n");
+    loop();
+    hostSerialInput(("brr sample " + std::to_string(NUM_BRR_BUILTIN_SAMPLES)).c_str());
+    hostSerialInput("\n");
+    loop();
+    press(1 << BTN_B);
+    CHECK(sdsp.voiceActive(0));
+    CHECK(sdsp.voiceState(0).sample == sampleBankAt(0));
+    CHECK(sdsp.voiceState(0).stream != nullptr);
+    press(0);
+
+    // A note on (also from the control tick) never waits for the card; the main loop
+    // reads the second half
+    accesses = hostSdAccesses();
+    playNote(state, 1, 60, OWNER_MONO);
+    CHECK(hostSdAccesses() == accesses);
+    const BrrStream* started = sdsp.voiceState(1).stream;
+    CHECK(started != nullptr);
+    if (started) {
+        CHECK(started->count[1] == 0);
+        serviceSampleBank();
+        CHECK(hostSdAccesses() > accesses && started->count[1] > 0);
+    }
+    stopNote(1);
+
+    for (const char* name : {"LOOPSAW.BRR", "GAME.SPC", "README.TXT"}) remove((dir + "/" + name).c_str());
+    rmdir(dir.c_str());
+    rmdir(root);
+    hostSetSdRoot(nullptr);
+    boot();
+    CHECK(sampleBankCount() == 0);
+}
+
+// A clean key on from silence, then the same sample re-keyed while it sounds at top pitch
+static void rekeyBankSample(const BrrSample* sample) {
+    // 25 Hz: a whole output block stays inside the first BRR block
+    const int voice = SDSP_VOICES - 1;
+    sampleBankSelect(sample);
+    int16_t block[AUDIO_BLOCK_SAMPLES];
+    sdsp.keyOn(voice, sample, 25.0f, sampleBankPrime(voice, sample));
+    sdsp.renderBlock(block);
+    SDspVoice clean = sdsp.voiceState(voice);
+    uint8_t cleanReadBlock = clean.stream->readBlock;
+    sdsp.keyOff(voice);
+    for (int i = 0; i < 100 && sdsp.voiceActive(voice); i++) sdsp.renderBlock(block);
+    CHECK(!sdsp.voiceActive(voice));
+
+    // Sounding at top pitch: the fade alone plays about ten more blocks
+    sdsp.keyOn(voice, sample, 2000.0f, sampleBankPrime(voice, sample));
+    sdsp.renderBlock(block);
+    const BrrStream* oldStream = sdsp.voiceState(voice).stream;
+    sdsp.keyOn(voice, sample, 25.0f, sampleBankPrime(voice, sample));
+    CHECK(sdsp.voiceState(voice).pendingStream != oldStream);
+    sdsp.renderBlock(block); // Fade, then the new note's first samples
+    const SDspVoice& rekeyed = sdsp.voiceState(voice);
+    CHECK(rekeyed.sample == sample && !rekeyed.pendingSample);
+    CHECK(rekeyed.header == clean.header);
+    CHECK(memcmp(rekeyed.decoded + 3, clean.decoded + 3, sizeof(int16_t) * BRR_BLOCK_SAMPLES) == 0);
+    CHECK(rekeyed.stream->readBlock == cleanReadBlock && rekeyed.stream->readHalf == 0);
+    int newPeak = 0;
+    for (int n = SDSP_FADE_SAMPLES; n < AUDIO_BLOCK_SAMPLES; n++) newPeak = std::max(newPeak, abs((int)block[n]));
+    CHECK(newPeak > 0);
+    sdsp.keyOff(voice);
+    for (int i = 0; i < 100 && sdsp.voiceActive(voice); i++) sdsp.renderBlock(block);
+}
+
+// Re-keying a sounding bank sample: the old note fades out from its own stream, and the
+// new one starts on block 0 exactly as a key on from silence does
+static void testSampleBankRekey() {
+    char root[] = "/tmp/snes_sd_XXXXXX";
+    CHECK(mkdtemp(root) != nullptr);
+    std::string dir = std::string(root) + "/BRR";
+    mkdir(dir.c_str(), 0755);
+    writeHostFile(dir + "/RAMP.BRR", brrBlocks(40, 0xC3)); // Every block different
+    hostSetSdRoot(root);
+    boot();
+    const BrrSample* sample = sampleBankAt(0);
+    CHECK(sample != nullptr);
+    if (sample) rekeyBankSample(sample);
+
+    remove((dir + "/RAMP.BRR").c_str());
+    rmdir(dir.c_str());
+    rmdir(root);
+    hostSetSdRoot(nullptr);
+}
+
+static uint32_t readLe32(const std::vector<uint8_t>& bytes, size_t offset) {
+    return bytes[offset] | (bytes[offset + 1] << 8) | (bytes[offset + 2] << 16) | ((uint32_t)bytes[offset + 3] << 24);
+}
+
+// The audio side only queues blocks; the loop creates the file, then writes whole
+// sectors, the rest and the header sizes at "rec stop", one step per pass and none
+// while the card is busy. A stalled writer drops blocks and counts overruns.
+static void testWavRecording() {
+    char root[] = "/tmp/snes_sd_XXXXXX";
+    CHECK(mkdtemp(root) != nullptr);
+    writeHostFile(std::string(root) + "/REC000.WAV", {0}); // Taken: the next name is used
+    hostSetSdRoot(root);
+    boot();
+    unsigned long accesses = hostSdAccesses();
+    CHECK(startWavRecording()); // Name from the boot scan: no card access
+    CHECK(hostSdAccesses() == accesses);
+    CHECK(wavRecording() && strcmp(wavFileName(), "REC001.WAV") == 0);
+    stopWavRecording();
+    for (int i = 0; i < 4 && wavRecording(); i++) serviceWavRecorder();
+    CHECK(!wavRecording());
+    remove((std::string(root) + "/REC001.WAV").c_str());
+
+    hostSerialInput("rec start\n");
+    loop(); // Creates the file
+    CHECK(wavRecording() && strcmp(wavFileName(), "REC002.WAV") == 0);
+
+    int16_t block[AUDIO_BLOCK_SAMPLES];
+    const int blocks = 3 * WAV_CHUNK_BLOCKS + 1;
+    for (int b = 0; b < blocks; b++) {
+        for (int n = 0; n < AUDIO_BLOCK_SAMPLES; n++) block[n] = (int16_t)(b * AUDIO_BLOCK_SAMPLES + n);
+        wavRecorder.captureBlock(b == 3 ? nullptr : block); // Block 3: nothing arrived, silence
+    }
+    hostSetSdBusy(true); // Programming: the writer leaves the card alone
+    accesses = hostSdAccesses();
+    for (int i = 0; i < 10; i++) loop();
+    CHECK(hostSdAccesses() == accesses && wavDataBytes() == 0);
+    hostSetSdBusy(false);
+    for (int i = 0; i < 6; i++) loop(); // Header, then three sectors
+    CHECK(wavDataBytes() == 3 * WAV_CHUNK_BLOCKS * AUDIO_BLOCK_SAMPLES * 2); // Remainder waits
+    hostSerialInput("rec stop\n");
+    loop();
+    loop();
+    CHECK(!wavRecording());
+    CHECK(wavDataBytes() == blocks * AUDIO_BLOCK_SAMPLES * 2);
+
+    std::vector<uint8_t> wav;
+    FILE* f = fopen((std::string(root) + "/REC002.WAV").c_str(), "rb");
+    CHECK(f != nullptr);
+    for (int c; f && (c = fgetc(f)) != EOF;) wav.push_back((uint8_t)c);
+    if (f) fclose(f);
+    CHECK(wav.size() == WAV_HEADER_BYTES + wavDataBytes());
+    if (wav.size() == WAV_HEADER_BYTES + wavDataBytes()) { // Short file: the SD root still has to be cleaned up
+        CHECK(memcmp(wav.data(), "RIFF", 4) == 0 && memcmp(&wav[8], "WAVEfmt ", 8) == 0);
+        CHECK(readLe32(wav, 4) == wav.size() - 8);
+        CHECK(memcmp(&wav[WAV_HEADER_BYTES - 8], "data", 4) == 0);
+        CHECK(readLe32(wav, WAV_HEADER_BYTES - 4) == wavDataBytes());
+        CHECK(readLe32(wav, 40) + 44 + 8 == WAV_HEADER_BYTES); // JUNK chunk pads to the data
+        const int16_t* samples = (const int16_t*)&wav[WAV_HEADER_BYTES];
+        CHECK(samples[5] == 5 && samples[3 * AUDIO_BLOCK_SAMPLES + 1] == 0);
+        CHECK(samples[blocks * AUDIO_BLOCK_SAMPLES - 1] == blocks * AUDIO_BLOCK_SAMPLES - 1);
+    }
+
+    // Card stalled: the queue fills, then blocks are dropped, never waited for
+    CHECK(startWavRecording());
+    for (int b = 0; b < WAV_QUEUE_BLOCKS + 7; b++) wavRecorder.captureBlock(block);
+    CHECK(wavRecorder.overruns() == 7 && wavRecorder.queuePeak() == WAV_QUEUE_BLOCKS);
+    hostClearSerialOutput();
+    hostSerialInput("rec\n");
+    loop(); // Also creates the file
+    CHECK(hostSerialOutput().find("REC recording file=REC003.WAV") != std::string::npos);
+    CHECK(hostSerialOutput().find("overruns=7") != std::string::npos);
+    stopWavRecording();
+    for (int i = 0; i < WAV_QUEUE_BLOCKS / WAV_CHUNK_BLOCKS + 2; i++) serviceWavRecorder(); // Header, sectors, close
+    CHECK(!wavRecording());
+    CHECK(wavDataBytes() == WAV_QUEUE_BLOCKS * AUDIO_BLOCK_SAMPLES * 2);
+
+    for (const char* name : {"REC000.WAV", "REC002.WAV", "REC003.WAV"}) remove((std::string(root) + "/" + name).c_str());
+    rmdir(root);
+    hostSetSdRoot(nullptr);
+}
+
+// A stereo loop streams through the double buffer a half ahead of the audio side, is
+// resampled to span its beats at the tempo, and snaps back onto a locked clock
+static void testWavLoopStreaming() {
+    char root[] = "/tmp/snes_sd_XXXXXX";
+    CHECK(mkdtemp(root) != nullptr);
+    const uint32_t frames = 22059; // One beat at 120 BPM and 44117.6 Hz
+    std::vector<uint8_t> wav = {'R', 'I', 'F', 'F', 0, 0, 0, 0, 'W', 'A', 'V', 'E',
+                                'f', 'm', 't', ' ', 16, 0, 0, 0, 1, 0, 2, 0, 0x44, 0xAC, 0, 0,
+                                0x10, 0xB1, 0x02, 0, 4, 0, 16, 0,
+                                'L', 'I', 'S', 'T', 3, 0, 0, 0, 'x', 'y', 'z', 0, // Odd chunk, padded
+                                'd', 'a', 't', 'a'};
+    uint32_t dataBytes = frames * 4;
+    for (int i = 0; i < 4; i++) wav.push_back((uint8_t)(dataBytes >> (8 * i)));
+    for (uint32_t f = 0; f < frames; f++) {
+        int16_t left = (int16_t)(2 * (f % 1000)), right = 0; // Downmixes to f % 1000
+        wav.push_back((uint8_t)left);
+        wav.push_back((uint8_t)(left >> 8));
+        wav.push_back((uint8_t)right);
+        wav.push_back((uint8_t)(right >> 8));
+    }
+    writeHostFile(std::string(root) + "/LOOP.WAV", wav);
+    hostSetSdRoot(root);
+    boot();
+    hostSerialInput("loop load LOOP.WAV\n");
+    loop();
+    hostSerialInput("loop beats 1\n");
+    loop();
+    hostSerialInput("loop play\n");
+    loop();
+    runFor(2 * CONTROL_TICK_US);
+    CHECK(wavLoopPlaying() && wavLoopFrames() == frames && wavLoopChannels() == 2);
+    CHECK(abs((int)wavLoop.rate() - 0x10000) < 8); // Internal 120 BPM: about 1:1
+    CHECK(wavLoopFill() == 2 * WAV_LOOP_HALF_FRAMES);
+
+    int16_t block[AUDIO_BLOCK_SAMPLES];
+    bool ramp = true;
+    for (int b = 0; b < 200; b++) { // Wraps the loop once
+        CHECK(wavLoop.renderBlock(block));
+        for (int n = 1; n < AUDIO_BLOCK_SAMPLES && b == 0; n++) ramp = ramp && abs(block[n] - (n - 1)) <= 1;
+        for (int n = 1; n < AUDIO_BLOCK_SAMPLES; n++) {
+            int step = block[n] - block[n - 1];
+            if ((step < 0 || step > 2) && block[n] > 1) ramp = false; // Only the ramp and loop wraps jump, back to 0
+        }
+        serviceWavLoop();
+    }
+    CHECK(ramp);
+    CHECK(wavLoopUnderruns() == 0);
+    CHECK(wavLoopMinFill() >= WAV_LOOP_HALF_FRAMES - AUDIO_BLOCK_SAMPLES); // A half is refilled once played out
+
+    // The filler stalls: the buffer runs dry after two halves and the audio side counts it
+    for (int b = 0; b < 2 * WAV_LOOP_HALF_FRAMES / AUDIO_BLOCK_SAMPLES + 2; b++) wavLoop.renderBlock(block);
+    CHECK(wavLoopUnderruns() > 0 && wavLoopMinFill() == 0);
+    CHECK(block[AUDIO_BLOCK_SAMPLES - 1] == 0);
+    hostClearSerialOutput();
+    hostSerialInput("loop\n");
+    loop();
+    CHECK(hostSerialOutput().find("LOOP name=LOOP.WAV frames=22059 channels=2") != std::string::npos);
+    CHECK(hostSerialOutput().find("minFill=0") != std::string::npos);
+
+    // Twice the tempo, twice the speed
+    state.usPerMidiTick = 250000.0f / 24.0f;
+    runFor(2 * CONTROL_TICK_US);
+    CHECK(abs((int)wavLoop.rate() - 0x20000) < 16);
+
+    // Locked clock: Start restarts on the downbeat, a loop far behind the clock jumps to
+    // where the clock is, a small lag is trimmed by speeding up
+    hostMidiInput(0xFA);
+    loop();
+    CHECK(wavLoopPosition() == 0 && wavLoopFill() == 2 * WAV_LOOP_HALF_FRAMES);
+    state.tempoEstablished = true;
+    state.usPerMidiTick = 500000.0f / 24.0f;
+    // No audio rendered meanwhile: 3 clocks behind (62 ms) is a jump, 1 or 2 is trimmed
+    for (int clock = 0; clock < 10; clock++) wavLoopClockTick(state);
+    CHECK(wavLoopResyncs() == 3);
+    CHECK(wavLoopPosition() == frames * 9 / 24);
+    wavLoopClockTick(state); // One clock (~21 ms) behind
+    CHECK(wavLoopResyncs() == 3);
+    runFor(2 * CONTROL_TICK_US);
+    CHECK(fabsf(wavLoop.rate() / 65536.0f - 1.0f * (1.0f + WAV_LOOP_MAX_TRIM)) < 0.001f);
+
+    hostMidiInput(0xFC);
+    loop();
+    CHECK(!wavLoop.renderBlock(block));
+    hostSerialInput("loop stop\n");
+    loop();
+    CHECK(!wavLoopPlaying());
+    remove((std::string(root) + "/LOOP.WAV").c_str());
+    rmdir(root);
+    hostSetSdRoot(nullptr);
+}
+
+// The on-device "bench" command must report every silent case and leave the synth alone
+static void testBenchSerialCommand() {
+    boot();
+    SynthState before = state;
+    hostClearSerialOutput();
+    hostSerialInput("bench\n");
+    loop();
+    const std::string& out = hostSerialOutput();
+    CHECK(out.find("BENCH {\"name\":\"getChordNotes\"") != std::string::npos);
+    CHECK(out.find("BENCH {\"name\":\"checkCommands\"") != std::string::npos);
+    CHECK(out.find("handleMonophonic") == std::string::npos);
+    CHECK(out.find("BENCH_DONE 10") != std::string::npos);
+    CHECK(hostMidiOutput().empty());
+    CHECK(state.scaleMode == before.scaleMode);
+    CHECK(state.heldNewest == before.heldNewest);
+}
+
+// Ten minutes of Boogie against a jittery 24-PPQN clock: every note must start on its
+// swung 8th-note slot, no later than one loop() pass after the slot opens.
+static void testBoogieOnsetsWithJitteryClock() {
+    boot();
+    hostSerialInput("mode boogie\n");
+    loop();
+
+    const unsigned long tickPeriod = 20833; // 120 BPM
+    const unsigned long sessionMicros = 10UL * 60UL * 1000000UL;
+    std::mt19937 rng(76);
+    std::uniform_int_distribution<int> jitter(-1500, 1500);
+
+    unsigned long startTime = micros() + 1000;
+    unsigned long tickIndex = 0;
+    unsigned long nextTick = startTime + tickPeriod;
+    bool started = false;
+    bool holding = false;
+    unsigned long maxLoopMicros = 0;
+
+    while (micros() < startTime + sessionMicros) {
+        unsigned long now = micros();
+        if (!started && now >= startTime) {
+            hostMidiInput(0xFA);
+            started = true;
+        } else if (started && now >= nextTick) {
+            hostMidiInput(0xF8);
+            tickIndex++;
+            nextTick = startTime + (tickIndex + 1) * tickPeriod + jitter(rng);
+        }
+        if (!holding && state.tempoEstablished) {
+            hostSetButtons(1 << BTN_B);
+            hostClearMidiOutput();
+            holding = true;
+        }
+        loop();
+        simClock.advance(40);
+        if (micros() - now > maxLoopMicros) maxLoopMicros = micros() - now;
+    }
+
+    CHECK(state.tempoEstablished);
+    CHECK(state.midiSyncEnabled);
+    CHECK(fabsf(state.usPerMidiTick - tickPeriod) < 200.0f);
+
+    // Same slot geometry handleBoogieTiming() derives from the locked tempo
+    float quarter = state.usPerMidiTick * 24.0f;
+    unsigned long quarterMicros = (unsigned long)quarter;
+    unsigned long slot1Rel = (unsigned long)(quarter / 2.0f + state.swingAmount * (quarter / 6.0f));
+    unsigned long beatRef = state.beatStartTimeMicros;
+
+    int noteOns = 0;
+    int lateOnsets = 0;
+    bool sounding = false;
+    for (const HostMidiMessage& msg : hostMidiOutput()) {
+        if ((msg.status & 0xF0) == 0x90) {
+            CHECK(!sounding); // Mono line: every note is released before the next starts
+            sounding = true;
+            if (noteOns++ == 0) continue; // First note may start mid-slot when the button goes down
+            unsigned long rel = (msg.timeMicros - beatRef) % quarterMicros;
+            bool onSlot0 = rel < maxLoopMicros;
+            bool onSlot1 = rel >= slot1Rel && rel - slot1Rel < maxLoopMicros;
+            if (!onSlot0 && !onSlot1) lateOnsets++;
+        } else if ((msg.status & 0xF0) == 0x80) {
+            sounding = false;
+        }
+    }
+    int expectedNotes = (int)(2 * (sessionMicros / quarterMicros));
+    printf("  %d notes, max loop %lu us\n", noteOns, maxLoopMicros);
+    CHECK(lateOnsets == 0);
+    CHECK(noteOns > expectedNotes - 8 && noteOns <= expectedNotes);
+}
+
+int main() {
+    struct { const char* name; void (*fn)(); } tests[] = {
+        {"monophonic press/release", testMonophonicPressRelease},
+        {"serial scale command", testSerialScaleCommand},
+        {"portamento combo", testPortamentoCombo},
+        {"chord voices tracked", testChordVoicesTracked},
+        {"chord common tones sustain", testChordCommonTonesSustain},
+        {"chord leaves backing voices", testChordLeavesBackingVoices},
+        {"note priority", testNotePriority},
+        {"riff steps", testRiffSteps},
+        {"quantized changes", testQuantizedChanges},
+        {"idle loop sleeps between ticks", testIdleLoopSleepsBetweenTicks},
+        {"portamento independent of loop rate", testPortamentoIndependentOfLoopRate},
+        {"governor degrades and restores", testGovernorDegradesAndRestores},
+        {"shared lfo bank", testSharedLfoBank},
+        {"mod matrix", testModMatrix},
+        {"parameter smoothing", testParameterSmoothing},
+        {"idle voices gated", testIdleVoicesGated},
+        {"drum kit renders", testDrumKitRenders},
+        {"boogie triggers drums", testBoogieTriggersDrums},
+        {"brr decode", testBrrDecode},
+        {"s-dsp voice", testSDspVoice},
+        {"brr engine voices", testBrrEngineVoices},
+        {"retrigger fades", testRetriggerFades},
+        {"retrigger in place", testRetriggerInPlace},
+        {"sample bank streaming", testSampleBankStreaming},
+        {"sample bank re-key", testSampleBankRekey},
+        {"wav recording", testWavRecording},
+        {"wav loop streaming", testWavLoopStreaming},
+        {"echo impulse", testEchoImpulse},
+        {"echo tempo lock", testEchoTempoLock},
+        {"midi export", testMidiExport},
+        {"smf backing track", testSmfBackingTrack},
+        {"bench serial command", testBenchSerialCommand},
+        {"boogie onsets, 10 min jittery clock", testBoogieOnsetsWithJitteryClock},
+    };
+    for (auto& t : tests) {
+        printf("%s\n", t.name);
+        t.fn();
+    }
+    printf("%s (%d failures)\n", failures ? "FAILED" : "OK", failures);
+    return failures ? 1 : 0;
+}
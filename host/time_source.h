@@ -0,0 +1,40 @@
+// time_source.h
+// Injectable monotonic clock behind the host micros()/millis()/delay().
+// RealTimeSource follows the Linux steady clock; SimulatedTimeSource only moves when
+// a test advances it (or the firmware calls delay/delayMicroseconds), so long timing
+// scenarios run faster than real time with fully deterministic timestamps.
+
+#ifndef TIME_SOURCE_H
+#define TIME_SOURCE_H
+
+class TimeSource {
+public:
+    virtual ~TimeSource() {}
+    virtual unsigned long micros() = 0;
+    virtual void sleepMicros(unsigned long us) = 0;
+};
+
+class RealTimeSource : public TimeSource {
+public:
+    unsigned long micros() override;
+    void sleepMicros(unsigned long us) override;
+};
+
+class SimulatedTimeSource : public TimeSource {
+public:
+    explicit SimulatedTimeSource(unsigned long startMicros = 0) : nowMicros(startMicros) {}
+    unsigned long micros() override { return nowMicros; }
+    void sleepMicros(unsigned long us) override { nowMicros += us; }
+
+    void advance(unsigned long us) { nowMicros += us; }
+    void set(unsigned long us) { nowMicros = us; }
+
+private:
+    unsigned long nowMicros;
+};
+
+// Installs the clock used by micros()/millis()/delay(). nullptr restores the real clock.
+void hostSetTimeSource(TimeSource* source);
+TimeSource& hostTimeSource();
+
+#endif // TIME_SOURCE_H
@@ -0,0 +1,93 @@
+// lfo_bank.cpp
+// Implements the shared LFO bank: a phase accumulator per LFO, a sine wavetable with
+// linear interpolation, and a short history of random values so lagging voices still
+// read the sample-and-hold/random value of the cycle they are in.
+
+#include "lfo_bank.h"
+#include "audio.h"
+#include "control_tick.h"
+#include <math.h>
+
+LfoBank lfoBank;
+
+static float sineTable[LFO_TABLE_SIZE + 1]; // Last entry repeats the first for interpolation
+static uint32_t randomSeed = 0x2545F491;
+
+static float nextRandom() {
+    // xorshift32, mapped to -1..1
+    randomSeed ^= randomSeed << 13;
+    randomSeed ^= randomSeed >> 17;
+    randomSeed ^= randomSeed << 5;
+    return (float)(randomSeed >> 8) * (2.0f / 16777216.0f) - 1.0f;
+}
+
+void resetLfoBank() {
+    for (int i = 0; i <= LFO_TABLE_SIZE; i++) {
+        sineTable[i] = sinf(2.0f * (float)M_PI * (float)i / LFO_TABLE_SIZE);
+    }
+    for (int l = 0; l < NUM_LFOS; l++) {
+        lfoBank.shape[l] = LFO_SINE;
+        lfoBank.rateHz[l] = 0.0f;
+        lfoBank.syncTicks[l] = 0;
+        lfoBank.phase[l] = 0;
+        for (int h = 0; h < 3; h++) lfoBank.held[l][h] = nextRandom();
+    }
+    setLfoSpread(0.0f);
+}
+
+void setLfoSpread(float spread) {
+    for (int v = 0; v < NUM_VOICES; v++) {
+        float lag = v * spread;
+        lag -= floorf(lag);
+        lfoBank.voiceOffset[v] = (uint32_t)(lag * 4294967296.0);
+    }
+}
+
+void updateLfoBank(const SynthState& state) {
+    lfoBank.rateHz[LFO_VIBRATO] = vibratoRateHz(state);
+
+    for (int l = 0; l < NUM_LFOS; l++) {
+        float rate = lfoBank.rateHz[l];
+        if (lfoBank.syncTicks[l] > 0 && state.tempoEstablished && state.usPerMidiTick > 0.0f) {
+            rate = 1000000.0f / (state.usPerMidiTick * lfoBank.syncTicks[l]);
+        }
+        uint32_t increment = (uint32_t)(rate * (4294967296.0f / CONTROL_RATE_HZ));
+        uint32_t previous = lfoBank.phase[l];
+        lfoBank.phase[l] = previous + increment;
+        if (lfoBank.phase[l] < previous) {
+            // New cycle: age the random history
+            lfoBank.held[l][2] = lfoBank.held[l][1];
+            lfoBank.held[l][1] = lfoBank.held[l][0];
+            lfoBank.held[l][0] = nextRandom();
+        }
+    }
+}
+
+float lfoValue(int lfo, int voice) {
+    uint32_t phase = lfoBank.phase[lfo];
+    uint32_t p = phase - lfoBank.voiceOffset[voice];
+    int cycle = (p > phase) ? 1 : 0; // The lag reaches back into the previous cycle
+
+    switch (lfoBank.shape[lfo]) {
+        case LFO_TRIANGLE: {
+            float x = (float)p * (1.0f / 4294967296.0f);
+            return x < 0.5f ? 4.0f * x - 1.0f : 3.0f - 4.0f * x;
+        }
+        case LFO_SQUARE:
+            return p < 0x80000000u ? 1.0f : -1.0f;
+        case LFO_SAMPLE_HOLD:
+            return lfoBank.held[lfo][cycle];
+        case LFO_RANDOM: {
+            float from = lfoBank.held[lfo][cycle + 1];
+            float to = lfoBank.held[lfo][cycle];
+            float x = (float)p * (1.0f / 4294967296.0f);
+            return from + (to - from) * x;
+        }
+        case LFO_SINE:
+        default: {
+            uint32_t index = p >> (32 - LFO_TABLE_BITS);
+            float frac = (float)(p << LFO_TABLE_BITS) * (1.0f / 4294967296.0f);
+            return sineTable[index] + (sineTable[index + 1] - sineTable[index]) * frac;
+        }
+    }
+}
@@ -0,0 +1,49 @@
+// lfo_bank.h
+// Shared control-rate LFOs. Each LFO advances once per control tick and every voice
+// reads it at its own phase offset, so one oscillator serves all voices instead of an
+// AudioSynthWaveform per voice. LFO_VIBRATO drives pitch vibrato; LFO_MOD only feeds
+// the modulation matrix.
+
+#ifndef LFO_BANK_H
+#define LFO_BANK_H
+
+#include "synth_state.h"
+#include "voice_manager.h"
+#include <stdint.h>
+
+#define NUM_LFOS 2
+#define LFO_VIBRATO 0 // Rate follows state.vibratoRate unless tempo-synced
+#define LFO_MOD 1     // Modulation matrix source "lfo2" ("mod lfo ...")
+#define LFO_TABLE_BITS 8
+#define LFO_TABLE_SIZE (1 << LFO_TABLE_BITS)
+
+enum LfoShape {
+    LFO_SINE,
+    LFO_TRIANGLE,
+    LFO_SQUARE,
+    LFO_SAMPLE_HOLD, // New random value each cycle
+    LFO_RANDOM,      // Random values joined by straight lines
+    LFO_SHAPE_COUNT
+};
+
+struct LfoBank {
+    uint8_t shape[NUM_LFOS];      // LfoShape
+    float rateHz[NUM_LFOS];       // Free-running rate
+    uint8_t syncTicks[NUM_LFOS];  // Cycle length in 24-PPQN MIDI ticks, 0 = free-running
+    uint32_t phase[NUM_LFOS];     // 2^32 = one cycle
+    float held[NUM_LFOS][3];      // Random values for this cycle and the two before it
+    uint32_t voiceOffset[NUM_VOICES]; // Phase lag of each voice behind the LFO
+};
+
+extern LfoBank lfoBank;
+
+void resetLfoBank();
+void updateLfoBank(const SynthState& state); // Once per control tick
+
+// Value of 'lfo' as heard by 'voice', -1..1
+float lfoValue(int lfo, int voice);
+
+// Voice v lags v * spread cycles behind voice 0 (0 = all voices in phase)
+void setLfoSpread(float spread);
+
+#endif // LFO_BANK_H
@@ -6,13 +6,27 @@
 #include "controller.h"
 #include "utils.h"
 #include "audio.h"
+#include "voice_manager.h"
 #include "synth.h"
 #include "commands.h"
 #include "debug.h"
 #include "playstyles.h"
+#include "power.h"
+#include "control_tick.h"
+#include "governor.h"
+#include "lfo_bank.h"
+#include "mod_matrix.h"
+#include "echo.h"
+#include "sample_bank.h"
+#include "wav_recorder.h"
+#include "smf_player.h"
+#include "wav_loop.h"
+#include "riff.h"
+#include "change_queue.h"
 
 // --- Constants ---
 #define MIDI_CLOCK_TIMEOUT_MS 500 // Timeout in milliseconds
+#define MAX_MIDI_MESSAGES_PER_PASS 16    // Bound the MIDI drain so a flood can't starve the pad scan
 
 // --- Global State ---
 SynthState state;
@@ -21,6 +35,7 @@ const unsigned long printCooldown = 50;  // 50ms cooldown between prints
 unsigned long lastHeldChangeTime = 0;
 const unsigned long debouncePeriod = 20;  // 20ms debounce period
 bool pendingPrint = false;
+unsigned long lastControllerScanMicros = 0;
 
 // Forward declarations
 void handleSerialCommand(String command, SynthState& state);
@@ -28,6 +43,11 @@ void handleSerialCommand(String command, SynthState& state);
 void handleClock();
 void handleStart();
 void handleStop();
+void runStandardPlaystyles(SynthState& state);
+void runControlTick(SynthState& state);
+void runRhythmicTiming(SynthState& state);
+void OnNoteOn(byte channel, byte note, byte velocity);
+void OnControlChange(byte channel, byte control, byte value);
 
 // How aggressively to correct phase errors (0.0 to 1.0). Smaller values are smoother but slower.
 // #define PHASE_CORRECTION_FACTOR 0.1f 
@@ -55,6 +75,11 @@ void setup() {
     setupAudio();
     DEBUG_INFO(CAT_AUDIO, "Audio system initialized");
 
+    // Index the BRR sample bank on the SD card (no sample data is loaded)
+    setupSampleBank();
+    // Find the next free recording name now, so "rec start" never probes the card
+    setupWavRecorder();
+
     // Initialize synth state
     initializeSynthState(state);
     DEBUG_INFO(CAT_STATE, "Synth state initialized");
@@ -69,30 +94,199 @@ void setup() {
     usbMIDI.setHandleClock(handleClock);
     usbMIDI.setHandleStart(handleStart);
     usbMIDI.setHandleStop(handleStop);
+
+    // Start the fixed-rate control tick last so the first tick sees a complete state
+    beginControlTick();
+    DEBUG_INFO(CAT_STATE, "Control tick started at %d Hz", CONTROL_RATE_HZ);
 }
 
 void loop() {
     // Reset command flag at start of loop
     state.commandJustExecuted = false;
 
+    // The loop is event-driven and only does I/O: each pass handles whatever is pending
+    // (MIDI, Serial, a due pad scan), runs the control ticks that have elapsed, and then
+    // sleeps until the next event. All timing-sensitive musical logic runs in
+    // runControlTick() at CONTROL_RATE_HZ, so it behaves the same however long a pass takes.
+
     // Read USB MIDI messages - Calls handleClock, handleStart, handleStop internally
-    usbMIDI.read(); 
+    int midiMessages = 0;
+    while (midiMessages < MAX_MIDI_MESSAGES_PER_PASS && usbMIDI.read()) {
+        midiMessages++;
+    }
 
     // Check for Serial commands from Processing (GUI)
-    if (Serial.available() > 0) {
-        String command = Serial.readStringUntil('\n');
+    String command;
+    if (readSerialCommand(command)) {
         DEBUG_INFO(CAT_COMMAND, "Received command: %s", command.c_str());
         handleSerialCommand(command, state);
     }
 
-    // Update button states
-    buttonState(state);
+    // Update button states when the next scan is due; handlers that act on button
+    // edges only run on passes where the pad actually changed
+    bool inputChanged = false;
+    unsigned long passStartMicros = micros();
+    if (passStartMicros - lastControllerScanMicros >= CONTROLLER_SCAN_INTERVAL_US) {
+        lastControllerScanMicros = passStartMicros;
+        buttonState(state);
+        inputChanged = (state.snesRegister != state.snesRegOld);
+    }
     
     // --- Update Scale if Needed --- 
     if (state.needsScaleUpdate) {
         updateScale(state); // Update state.scaleHolder based on state.scaleMode
     }
     
+    // Check for commands (scale changes, portamento toggle, etc.)
+    if (inputChanged) {
+        checkCommands(state);
+    }
+    
+    // Update scale if needed
+    if (state.needsScaleUpdate) {
+        updateScale(state);
+        state.needsScaleUpdate = false;
+    }
+    
+    // Call the edge-driven playstyle functions ONLY if a command wasn't just executed.
+    // Boogie and Rhythmic timing run on the control tick below.
+    if (inputChanged && !state.commandJustExecuted) {
+        if (state.boogieModeEnabled) {
+            if (!state.tempoEstablished) {
+                 // Tempo not established (pre-Start, during sampling, or sampling failed)
+                 // --> Fall back to acting like Monophonic mode <--
+                 DEBUG_VERBOSE(CAT_PLAYSTYLE, "Boogie Mode Active, Tempo Not Established -> Running Monophonic");
+                 handleMonophonic(state); // Call standard monophonic handler
+            }
+        } else if (!state.rhythmicModeEnabled) {
+            // Neither Boogie nor Rhythmic mode active: Run Standard Playstyles
+            runStandardPlaystyles(state);
+        }
+    } // else: Skip playstyle handler this cycle because a command took priority
+
+    // --- Control Rate Logic ---
+    int controlTicks = takeControlTicks();
+    for (int i = 0; i < controlTicks; i++) {
+        runControlTick(state);
+        if (i == 0) {
+            // Button edges are seen by the first tick after the scan that produced them
+            for (int b = 0; b < 12; b++) {
+                state.pressed[b] = 0;
+                state.released[b] = 0;
+            }
+        }
+    }
+
+    // Refill the SD sample streams the audio update has drained
+    serviceSampleBank();
+    // Refill the WAV loop's free buffer half
+    serviceWavLoop();
+    // Write out queued recording blocks (one SD write at most)
+    serviceWavRecorder();
+
+    unsigned long currentTime = millis();
+
+    // If a command was executed this frame, flag that a print is pending
+    if (state.commandJustExecuted) {
+        lastHeldChangeTime = currentTime; // Use the same timer variable for simplicity
+        pendingPrint = true;
+        DEBUG_DEBUG(CAT_COMMAND, "Command executed, print pending");
+    }
+
+    // If enough time has passed since the last COMMAND and there's a pending print
+    if (pendingPrint && (currentTime - lastHeldChangeTime >= debouncePeriod)) {
+        // Only print if enough time has passed since the last print (cooldown)
+        if (currentTime - lastPrintTime >= printCooldown) {
+            printStatus(state);
+            lastPrintTime = currentTime;
+            DEBUG_DEBUG(CAT_STATE, "State printed after debounce");
+        }
+        pendingPrint = false;  // Reset pending print
+    }
+
+    // Update prevHeld for the next iteration
+    for (int i = 0; i < MAX_NOTE_BUTTONS; i++) {
+        state.prevHeld[i] = state.held[i];
+    }
+
+    // --- Sleep Until the Next Event ---
+    // More input already queued: come straight back
+    if (midiMessages == MAX_MIDI_MESSAGES_PER_PASS || Serial.available() > 0) {
+        return;
+    }
+    unsigned long nextWakeMicros = lastControllerScanMicros + CONTROLLER_SCAN_INTERVAL_US;
+    unsigned long tickWakeMicros = nextControlTickMicros();
+    if ((long)(tickWakeMicros - nextWakeMicros) < 0) nextWakeMicros = tickWakeMicros;
+    sleepUntilMicros(nextWakeMicros); // Also ends early on USB/audio/control tick interrupts
+}
+
+// --- Control Tick: all time-driven musical logic, at a fixed CONTROL_RATE_HZ ---
+void runControlTick(SynthState& state) {
+    // Always update L/R active states (Rhythmic triggers)
+    state.boogieLActive = state.held[BTN_L];
+    state.boogieRActive = state.held[BTN_R];
+
+    // Quantized changes with no clock left to land on
+    updateChangeQueue(state);
+
+    runRhythmicTiming(state);
+
+    // Backing track events due this tick, before the voices update
+    updateSmfPlayer(state);
+    // WAV loop speed from the tempo
+    updateWavLoop(state);
+
+    // Shared LFOs first, so every voice reads the same tick's values
+    updateLfoBank(state);
+
+    // Modulation routes into per-voice deltas, read by updateVoices() and the swing timing
+    updateModMatrix(state);
+
+    // Per-voice work (portamento glides, vibrato, envelope release tracking)
+    updateVoices(state);
+
+    // Unpatch voices the play style no longer uses once they fall silent
+    updateAudioGraph(state);
+    // Codec volume easing towards its target
+    updateMasterVolume();
+
+    // Echo on/off, levels, and the delay following the clock tempo
+    updateEcho(state);
+
+    // Shed vibrato/voices while the audio update is overloaded, restore them after
+    updateGovernor();
+
+    // Boogie slot evaluation. Skipped on a pass where a button combo took priority.
+    if (state.boogieModeEnabled && state.tempoEstablished && !state.commandJustExecuted) {
+        handleBoogieTiming(state);
+    }
+
+    // --- Update Previous State for Next Tick ---
+    state.prevMidiSyncEnabled = state.midiSyncEnabled; // Added for Boogie V12.5
+
+    // --- MIDI Clock Timeout --- 
+    // If clock is enabled but we haven't received a tick in a while, disable sync
+    if (state.midiSyncEnabled && (millis() - state.lastMidiClockTime > MIDI_CLOCK_TIMEOUT_MS)) {
+        DEBUG_WARNING(CAT_MIDI, "MIDI Clock Timeout! Disabling sync.");
+        state.midiSyncEnabled = false; 
+        // --- Keep Established Tempo --- 
+        // state.tempoEstablished = false; // Keep true if already established
+        // state.usPerMidiTick = 0.0f; // Keep the locked value
+        state.isSamplingTempo = false; // Ensure sampling stops
+        // Optionally stop notes here too if desired on timeout
+        if (state.boogieModeEnabled && state.boogieCurrentMidiNote != -1) {
+             DEBUG_INFO(CAT_MIDI, "Stopping Boogie note due to Clock Timeout");
+             sendMidiNoteOff(state.boogieCurrentMidiNote, 0, MIDI_CHANNEL);
+             stopNote(0);
+             state.boogieCurrentMidiNote = -1;
+             state.boogieTriggerButton = -1; 
+        }
+    }
+
+}
+
+// --- Rhythmic Mode: trigger pattern notes whose time has come ---
+void runRhythmicTiming(SynthState& state) {
     // --- Handle High-Resolution Rhythmic Timing --- 
     // Run if Rhythmic mode is ON and tempo is available (live clock OR established)
     if (state.rhythmicModeEnabled && (state.midiSyncEnabled || state.tempoEstablished)) {
@@ -145,8 +339,11 @@ void loop() {
                             if (baseMidiNote < 0) baseMidiNote = 0;
                             
                             DEBUG_INFO(CAT_PLAYSTYLE, "Rhythmic %s Trigger (Note Index %d): %d", (triggerL ? "L" : "R"), i, baseMidiNote);
-                            playNote(state, 0, baseMidiNote);
+                            playNote(state, 0, baseMidiNote, OWNER_RHYTHMIC);
                             sendMidiNoteOn(baseMidiNote, MIDI_VELOCITY, MIDI_CHANNEL);
+                            // Drum on the same onset: pattern ticks are 24 per beat
+                            int patternTick = (int)state.currentRhythmPatternTicks[i];
+                            triggerRhythmDrum(state, patternTick / 24, (patternTick % 24) ? 1 : 0);
                             state.lastRhythmicMidiNote = baseMidiNote;
                         }
                     } // End if (triggerL || triggerR)
@@ -167,101 +364,6 @@ void loop() {
         }
 
     } // End if (rhythmicModeEnabled && (midiSyncEnabled || tempoEstablished))
-    
-    // Check for commands (scale changes, portamento toggle, etc.)
-    checkCommands(state);
-    
-    // Update scale if needed
-    if (state.needsScaleUpdate) {
-        updateScale(state);
-        state.needsScaleUpdate = false;
-    }
-    
-    // Update audio system (handle portamento)
-    updateAudio(state);
-    
-    // Call the appropriate playstyle function ONLY if a command wasn't just executed
-    if (!state.commandJustExecuted) {
-        
-        // --- Mode Logic --- 
-        // Check modes directly, Tempo availability handled within modes
-
-        // Always update L/R active states
-        state.boogieLActive = state.held[BTN_L];
-        state.boogieRActive = state.held[BTN_R];
-        
-        if (state.boogieModeEnabled) {
-            // If Boogie Mode is selected...
-            if (state.tempoEstablished) { 
-                 // Tempo is established (locked), run the rhythmic Boogie timing logic
-                 handleBoogieTiming(state); 
-            } else {
-                 // Tempo not established (pre-Start, during sampling, or sampling failed)
-                 // --> Fall back to acting like Monophonic mode <--
-                 DEBUG_VERBOSE(CAT_PLAYSTYLE, "Boogie Mode Active, Tempo Not Established -> Running Monophonic");
-                 handleMonophonic(state); // Call standard monophonic handler
-            }
-        } else if (state.rhythmicModeEnabled) {
-            // Rhythmic mode timing logic is handled entirely by the high-resolution block earlier in the loop.
-            // This block runs if rhythmicModeEnabled is true AND (midiSyncEnabled OR tempoEstablished) is true.
-            // We don't need to call anything specific here, just ensure standard styles don't run.
-            ; // Explicitly do nothing, handled above
-        } else {
-            // Neither Boogie nor Rhythmic mode active: Run Standard Playstyles
-            runStandardPlaystyles(state);
-        }
-        
-    } // else: Skip playstyle handler this cycle because a command took priority
-
-    unsigned long currentTime = millis();
-
-    // If a command was executed this frame, flag that a print is pending
-    if (state.commandJustExecuted) {
-        lastHeldChangeTime = currentTime; // Use the same timer variable for simplicity
-        pendingPrint = true;
-        DEBUG_DEBUG(CAT_COMMAND, "Command executed, print pending");
-    }
-
-    // If enough time has passed since the last COMMAND and there's a pending print
-    if (pendingPrint && (currentTime - lastHeldChangeTime >= debouncePeriod)) {
-        // Only print if enough time has passed since the last print (cooldown)
-        if (currentTime - lastPrintTime >= printCooldown) {
-            printStatus(state);
-            lastPrintTime = currentTime;
-            DEBUG_DEBUG(CAT_STATE, "State printed after debounce");
-        }
-        pendingPrint = false;  // Reset pending print
-    }
-
-    // Update prevHeld for the next iteration
-    for (int i = 0; i < MAX_NOTE_BUTTONS; i++) {
-        state.prevHeld[i] = state.held[i];
-    }
-
-    // --- Update Previous State for Next Loop ---
-    state.prevMidiSyncEnabled = state.midiSyncEnabled; // Added for Boogie V12.5
-
-    // --- MIDI Clock Timeout --- 
-    // If clock is enabled but we haven't received a tick in a while, disable sync
-    if (state.midiSyncEnabled && (millis() - state.lastMidiClockTime > MIDI_CLOCK_TIMEOUT_MS)) {
-        DEBUG_WARNING(CAT_MIDI, "MIDI Clock Timeout! Disabling sync.");
-        state.midiSyncEnabled = false; 
-        // --- Keep Established Tempo --- 
-        // state.tempoEstablished = false; // Keep true if already established
-        // state.usPerMidiTick = 0.0f; // Keep the locked value
-        state.isSamplingTempo = false; // Ensure sampling stops
-        // Optionally stop notes here too if desired on timeout
-        if (state.boogieModeEnabled && state.boogieCurrentMidiNote != -1) {
-             DEBUG_INFO(CAT_MIDI, "Stopping Boogie note due to Clock Timeout");
-             sendMidiNoteOff(state.boogieCurrentMidiNote, 0, MIDI_CHANNEL);
-             stopNote(0);
-             state.boogieCurrentMidiNote = -1;
-             state.boogieTriggerButton = -1; 
-        }
-    }
-
-    // No delay in the main loop - let the audio system run as fast as possible
-    yield();  // Allow other tasks to run if needed
 }
 
 // --- Helper function to run standard playstyles ---
@@ -270,6 +372,12 @@ void runStandardPlaystyles(SynthState& state) {
     state.boogieLActive = state.held[BTN_L];
     state.boogieRActive = state.held[BTN_R];
     
+    // The riff profile plays its sequence monophonically whatever the play style
+    if (state.customProfileIndex == PROFILE_RIFF) {
+        handleRiff(state);
+        return;
+    }
+
     switch (state.playStyle) {
         case MONOPHONIC:
             handleMonophonic(state);
@@ -317,7 +425,7 @@ void handleClock() {
                          averageInterval = (float)(state.samplingIntervalSum / (double)state.sampleTickCount);
                      }
                      
-                     if (averageInterval > 0.0f) {
+                     if (averageInterval >= MIN_LOCKED_US_PER_TICK && averageInterval <= MAX_LOCKED_US_PER_TICK) {
                         state.usPerMidiTick = averageInterval; // Set the final locked tempo
                         state.lockedUsPerMidiTick = averageInterval; // Store separately for clarity/future use if needed
                         state.tempoEstablished = true; // LOCK IT IN!
@@ -325,8 +433,8 @@ void handleClock() {
                         float bpm = 60000000.0f / (24.0f * state.usPerMidiTick);
                         DEBUG_INFO(CAT_MIDI, "Tempo Sampling Complete. Locked Avg Interval: %.2f us (%.2f BPM) from %d samples", state.usPerMidiTick, bpm, state.sampleTickCount);
                      } else {
-                         // Sampling failed (e.g., all deltas were invalid)
-                         DEBUG_ERROR(CAT_MIDI, "Tempo Sampling Failed! Invalid average interval.");
+                         // Sampling failed (e.g., all deltas were invalid or the tempo is implausible)
+                         DEBUG_ERROR(CAT_MIDI, "Tempo Sampling Failed! Invalid average interval %.2f us.", averageInterval);
                          state.tempoEstablished = false;
                          state.isSamplingTempo = false; // Stop trying
                      }
@@ -350,6 +458,13 @@ void handleClock() {
     }
     
     // Removed previous averaging and phase correction logic here
+
+    // Quantized changes land on the clock's beat/bar lines, before anything plays on it
+    changeQueueClockTick(state);
+
+    // Keep the backing track on the clock
+    smfClockTick(state);
+    wavLoopClockTick(state);
 }
 
 void handleStart() {
@@ -380,6 +495,9 @@ void handleStart() {
     state.boogieInternalBeatStartTimeMicros = 0;
 
     state.lastMidiClockTime = millis();
+    smfClockStart(); // Backing track back to its first beat
+    wavLoopClockStart();
+    changeQueueClockStart();
 }
 
 void handleStop() {
@@ -390,6 +508,8 @@ void handleStop() {
     // state.usPerMidiTick = 0.0f; // Keep the locked value
     // state.lockedUsPerMidiTick = 0.0f; // Keep the locked value
     state.isSamplingTempo = false; // Ensure sampling stops if it was somehow active
+    smfClockStop();
+    wavLoopClockStop();
     state.sampleTickCount = 0;
     // Reset tick buffer state (not strictly necessary but cleans up)
     state.tickBufferFilled = false;
@@ -416,6 +536,6 @@ void OnNoteOn(byte channel, byte note, byte velocity) {
 }
 
 void OnControlChange(byte channel, byte control, byte value) {
-    // Implement later if needed
     DEBUG_DEBUG(CAT_MIDI, "MIDI CC: Chan=%d Ctrl=%d Val=%d", channel, control, value);
+    modMatrixControlChange(control, value); // "ccN" modulation sources
 }
\ No newline at end of file
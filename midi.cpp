@@ -1,5 +1,6 @@
 #include "midi.h"
 #include <MIDI.h> // Assuming standard MIDI library is used
+#include "midi_capture.h"
 
 // Define MIDI Constants
 const int MIDI_CHANNEL = 1;
@@ -9,11 +10,13 @@ void sendMidiNoteOn(int note, int velocity, int channel) {
     // Assuming 'usbMIDI' is the instance name from the Teensy USB MIDI setup
     usbMIDI.sendNoteOn(note, velocity, channel);
     usbMIDI.send_now(); // Ensure data is sent immediately
+    captureMidiEvent(0x90 | ((channel - 1) & 0x0F), note & 0x7F, velocity & 0x7F);
 }
 
 void sendMidiNoteOff(int note, int velocity, int channel) {
     usbMIDI.sendNoteOff(note, velocity, channel);
     usbMIDI.send_now();
+    captureMidiEvent(0x80 | ((channel - 1) & 0x0F), note & 0x7F, velocity & 0x7F);
 }
 
 // Include other MIDI related functions if any
@@ -0,0 +1,208 @@
+// midi_capture.cpp
+// Implements MIDI output capture and Standard MIDI File export. The file is written
+// twice over the same events: once only counting bytes for the track length, then for
+// real, so no copy of the file is ever held in RAM.
+
+#include "midi_capture.h"
+#include "sample_bank.h"
+#include "debug.h"
+#include <SD.h>
+#include <string.h>
+
+#define SMF_NAME_LENGTH 13
+#define SMF_HEX_LINE_BYTES 32
+#define SMF_DEFAULT_US_PER_QUARTER 500000.0f // 120 BPM before any clock
+
+static_assert((MIDI_CAPTURE_EVENTS & (MIDI_CAPTURE_EVENTS - 1)) == 0, "ring index is masked");
+
+struct CapturedEvent {
+    uint32_t timeMicros;
+    uint8_t status;
+    uint8_t data1;
+    uint8_t data2;
+};
+
+static CapturedEvent captured[MIDI_CAPTURE_EVENTS];
+static uint32_t capturedTotal = 0; // Ever captured; the ring holds the newest
+
+void captureMidiEvent(uint8_t status, uint8_t data1, uint8_t data2) {
+    CapturedEvent& event = captured[capturedTotal & (MIDI_CAPTURE_EVENTS - 1)];
+    event.timeMicros = micros();
+    event.status = status;
+    event.data1 = data1;
+    event.data2 = data2;
+    capturedTotal++;
+}
+
+void clearMidiCapture() {
+    capturedTotal = 0;
+}
+
+int midiCaptureCount() {
+    return capturedTotal < MIDI_CAPTURE_EVENTS ? (int)capturedTotal : MIDI_CAPTURE_EVENTS;
+}
+
+// Byte sink for the file: counts only, or buffers towards the card or Serial
+struct SmfSink {
+    SmfDestination destination;
+    bool countOnly;
+    File file;
+    uint8_t buffer[SMF_HEX_LINE_BYTES];
+    int used;
+    uint32_t total;
+    bool failed;
+
+    void put(uint8_t byte) {
+        total++;
+        if (countOnly) return;
+        buffer[used++] = byte;
+        if (used == SMF_HEX_LINE_BYTES) flush();
+    }
+
+    void flush() {
+        if (used == 0) return;
+        if (destination == SMF_TO_SD) {
+            if (file.write(buffer, used) != (size_t)used) failed = true;
+        } else {
+            Serial.print("SMF ");
+            for (int i = 0; i < used; i++) Serial.printf("%02X", buffer[i]);
+            Serial.println();
+        }
+        used = 0;
+    }
+
+    void put32(uint32_t value) {
+        for (int shift = 24; shift >= 0; shift -= 8) put((uint8_t)(value >> shift));
+    }
+
+    void putVariableLength(uint32_t value) {
+        uint8_t bytes[4];
+        int count = 0;
+        do {
+            bytes[count++] = value & 0x7F;
+            value >>= 7;
+        } while (value && count < 4);
+        while (count-- > 1) put(bytes[count] | 0x80);
+        put(bytes[0]);
+    }
+};
+
+struct ExportWindow {
+    uint32_t first;         // capturedTotal index of the first exported event
+    uint32_t end;           // One past the last
+    uint32_t startMicros;   // Tick 0
+    uint32_t endMicros;     // Where held notes are closed
+    float usPerQuarter;
+};
+
+static uint32_t ticksAt(const ExportWindow& window, uint32_t timeMicros) {
+    return (uint32_t)((double)(uint32_t)(timeMicros - window.startMicros) * SMF_DIVISION / window.usPerQuarter);
+}
+
+static void writeTrack(SmfSink& sink, const ExportWindow& window) {
+    uint32_t usPerQuarter = (uint32_t)(window.usPerQuarter + 0.5f);
+    const uint8_t tempo[] = {0x00, 0xFF, 0x51, 0x03, (uint8_t)(usPerQuarter >> 16), (uint8_t)(usPerQuarter >> 8), (uint8_t)usPerQuarter};
+    for (uint8_t byte : tempo) sink.put(byte);
+
+    uint8_t held[16][128 / 8];
+    memset(held, 0, sizeof(held));
+    uint32_t lastTicks = 0;
+    for (uint32_t i = window.first; i != window.end; i++) {
+        const CapturedEvent& event = captured[i & (MIDI_CAPTURE_EVENTS - 1)];
+        uint32_t ticks = ticksAt(window, event.timeMicros);
+        sink.putVariableLength(ticks - lastTicks);
+        lastTicks = ticks;
+        sink.put(event.status);
+        sink.put(event.data1);
+        sink.put(event.data2);
+
+        uint8_t channel = event.status & 0x0F;
+        uint8_t mask = 1 << (event.data1 & 7);
+        uint8_t& noteBits = held[channel][(event.data1 & 0x7F) >> 3];
+        if ((event.status & 0xF0) == 0x90 && event.data2 > 0) noteBits |= mask;
+        else if ((event.status & 0xF0) == 0x80 || (event.status & 0xF0) == 0x90) noteBits &= ~mask;
+    }
+
+    // Notes still held are closed where the export was made
+    uint32_t endTicks = ticksAt(window, window.endMicros);
+    for (int channel = 0; channel < 16; channel++) {
+        for (int note = 0; note < 128; note++) {
+            if (!(held[channel][note >> 3] & (1 << (note & 7)))) continue;
+            sink.putVariableLength(endTicks - lastTicks);
+            lastTicks = endTicks;
+            sink.put(0x80 | channel);
+            sink.put(note);
+            sink.put(0);
+        }
+    }
+    const uint8_t endOfTrack[] = {0x00, 0xFF, 0x2F, 0x00};
+    for (uint8_t byte : endOfTrack) sink.put(byte);
+}
+
+int exportMidiCapture(const SynthState& state, int minutes, SmfDestination destination) {
+    if (minutes < 1) minutes = 1;
+    if (minutes > MIDI_CAPTURE_MAX_MINUTES) minutes = MIDI_CAPTURE_MAX_MINUTES;
+
+    ExportWindow window;
+    window.endMicros = micros();
+    window.end = capturedTotal;
+    window.first = window.end - (uint32_t)midiCaptureCount();
+    uint32_t windowMicros = (uint32_t)minutes * 60000000UL;
+    while (window.first != window.end &&
+           window.endMicros - captured[window.first & (MIDI_CAPTURE_EVENTS - 1)].timeMicros > windowMicros) {
+        window.first++;
+    }
+    window.startMicros = (window.first != window.end) ? captured[window.first & (MIDI_CAPTURE_EVENTS - 1)].timeMicros
+                                                       : window.endMicros;
+    window.usPerQuarter = (state.usPerMidiTick > 0.0f) ? state.usPerMidiTick * state.ticksPerQuarterNote
+                                                       : SMF_DEFAULT_US_PER_QUARTER;
+
+    SmfSink sink;
+    sink.destination = destination;
+    sink.countOnly = true;
+    sink.used = 0;
+    sink.total = 0;
+    sink.failed = false;
+    writeTrack(sink, window);
+    uint32_t trackBytes = sink.total;
+
+    char fileName[SMF_NAME_LENGTH] = "";
+    if (destination == SMF_TO_SD) {
+        if (!sdCardMounted()) {
+            DEBUG_WARNING(CAT_MIDI, "No SD card, MIDI export skipped");
+            return -1;
+        }
+        int number = 0;
+        for (; number < SMF_MAX_FILES; number++) {
+            snprintf(fileName, sizeof(fileName), "MIDI%03d.MID", number);
+            if (!SD.exists(fileName)) break;
+        }
+        if (number < SMF_MAX_FILES) sink.file = SD.open(fileName, FILE_WRITE);
+        if (!sink.file) {
+            DEBUG_WARNING(CAT_MIDI, "Cannot create a MIDI file on the SD card");
+            return -1;
+        }
+    }
+
+    sink.countOnly = false;
+    sink.total = 0;
+    const uint8_t header[] = {'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 0, 0, 1, SMF_DIVISION >> 8, SMF_DIVISION & 0xFF,
+                              'M', 'T', 'r', 'k'};
+    for (uint8_t byte : header) sink.put(byte);
+    sink.put32(trackBytes);
+    writeTrack(sink, window);
+    sink.flush();
+
+    int exported = (int)(window.end - window.first);
+    if (destination == SMF_TO_SD) {
+        sink.file.close();
+        if (sink.failed) {
+            DEBUG_WARNING(CAT_MIDI, "SD write failed, %s is incomplete", fileName);
+            return -1;
+        }
+        Serial.printf("SMF_DONE file=%s events=%d bytes=%lu\n", fileName, exported, (unsigned long)sink.total);
+    } else {
+        Serial.printf("SMF_DONE events=%d bytes=%lu\n", exported, (unsigned long)sink.total);
+    }
+    return exported;
+}
@@ -0,0 +1,35 @@
+// midi_capture.h
+// Keeps the synth's recent MIDI output in a ring of timestamped events so a
+// performance can be saved after the fact. Capturing is one ring write in the send
+// path; the type-0 Standard MIDI File is only assembled on export, straight to the SD
+// card or as hex lines over Serial.
+
+#ifndef MIDI_CAPTURE_H
+#define MIDI_CAPTURE_H
+
+#include <Arduino.h>
+#include "synth_state.h"
+
+#define MIDI_CAPTURE_EVENTS 2048        // 16 KB, about 17 minutes of steady 8th notes at 120 BPM
+#define MIDI_CAPTURE_DEFAULT_MINUTES 5  // Window exported by the L+R+Down combo
+#define MIDI_CAPTURE_MAX_MINUTES 60     // micros() wraps after ~71 minutes
+#define SMF_DIVISION 480                // Ticks per quarter note in exported files
+#define SMF_MAX_FILES 1000              // MIDI000.MID .. MIDI999.MID in the card's root
+
+enum SmfDestination {
+    SMF_TO_SD,
+    SMF_TO_SERIAL // "SMF <hex>" lines, then "SMF_DONE"
+};
+
+// Called by sendMidiNoteOn/Off with the bytes actually sent
+void captureMidiEvent(uint8_t status, uint8_t data1, uint8_t data2);
+void clearMidiCapture();
+int midiCaptureCount(); // Events held (oldest are overwritten when full)
+
+// Writes the events of the last 'minutes' as a type-0 file. Event times are converted
+// to ticks at the tracked MIDI clock tempo, which is also written as the file's tempo,
+// and notes still held are closed at the end. Returns the events exported, or -1 when
+// the file cannot be written.
+int exportMidiCapture(const SynthState& state, int minutes, SmfDestination destination);
+
+#endif // MIDI_CAPTURE_H
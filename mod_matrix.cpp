@@ -0,0 +1,180 @@
+// mod_matrix.cpp
+// Implements the modulation matrix: the route list, the source readers and the
+// per-tick evaluation. Sources that are the same for every voice (beat, CC) are read
+// once per route (CC values through a smoother); per-voice sources are read for each
+// voice the route reaches.
+
+#include "mod_matrix.h"
+#include "lfo_bank.h"
+#include "audio.h"
+#include <Arduino.h>
+#include <math.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define MOD_DEFAULT_US_PER_QUARTER 500000.0f // 120 BPM before any tempo is known
+
+ModDeltas modDeltas;
+
+static ModRoute routes[MOD_MAX_ROUTES];
+static int numRoutes = 0;
+static uint8_t ccValues[128];
+
+static const char* const sourceNames[MOD_SRC_COUNT] = {"lfo1", "lfo2", "env", "beat", "held", "cc"};
+static const char* const destinationNames[MOD_DST_COUNT] = {"pitch", "amp", "swing"};
+
+void resetModMatrix() {
+    numRoutes = 0;
+    memset(ccValues, 0, sizeof(ccValues));
+    memset(&modDeltas, 0, sizeof(modDeltas));
+}
+
+int addModRoute(uint8_t source, uint8_t cc, uint8_t destination, float amount) {
+    if (source >= MOD_SRC_COUNT || destination >= MOD_DST_COUNT || cc > 127) return -1;
+    if (source != MOD_SRC_CC) cc = 0;
+    if (destination == MOD_DST_PITCH) {
+        if (amount > MOD_PITCH_MAX_SEMITONES) amount = MOD_PITCH_MAX_SEMITONES;
+        if (amount < -MOD_PITCH_MAX_SEMITONES) amount = -MOD_PITCH_MAX_SEMITONES;
+    } else {
+        if (amount > 1.0f) amount = 1.0f;
+        if (amount < -1.0f) amount = -1.0f;
+    }
+    for (int i = 0; i < numRoutes; i++) {
+        if (routes[i].source == source && routes[i].cc == cc && routes[i].destination == destination) {
+            routes[i].amount = amount;
+            return i;
+        }
+    }
+    if (numRoutes == MOD_MAX_ROUTES) return -1;
+    ModRoute& route = routes[numRoutes];
+    route.source = source;
+    route.cc = cc;
+    route.destination = destination;
+    route.amount = amount;
+    smoothJump(route.ccLevel, ccValues[cc] * (1.0f / 127.0f)); // Starts where the controller is
+    return numRoutes++;
+}
+
+bool removeModRoute(int index) {
+    if (index < 0 || index >= numRoutes) return false;
+    for (int i = index; i < numRoutes - 1; i++) routes[i] = routes[i + 1];
+    numRoutes--;
+    return true;
+}
+
+void clearModRoutes() {
+    numRoutes = 0;
+}
+
+int modRouteCount() {
+    return numRoutes;
+}
+
+const ModRoute& modRouteAt(int index) {
+    return routes[index];
+}
+
+void modMatrixControlChange(uint8_t control, uint8_t value) {
+    ccValues[control & 0x7F] = value & 0x7F;
+}
+
+// --- Sources ---
+
+static float beatPhase(const SynthState& state) {
+    float usPerQuarter = (state.usPerMidiTick > 0.0f) ? state.usPerMidiTick * state.ticksPerQuarterNote
+                                                      : MOD_DEFAULT_US_PER_QUARTER;
+    unsigned long reference = state.midiSyncEnabled ? state.beatStartTimeMicros
+                                                    : state.boogieInternalBeatStartTimeMicros;
+    uint32_t quarter = (uint32_t)usPerQuarter;
+    return (float)((uint32_t)(micros() - reference) % quarter) / quarter;
+}
+
+static float voiceSource(uint8_t source, int voice) {
+    switch (source) {
+        case MOD_SRC_LFO1:
+            return lfoValue(LFO_VIBRATO, voice);
+        case MOD_SRC_LFO2:
+            return lfoValue(LFO_MOD, voice);
+        case MOD_SRC_ENVELOPE:
+            if (voices.engine[voice] == ENGINE_SDSP) return (float)sdsp.voiceState(voice).envelope / SDSP_ENVELOPE_MAX;
+            return envelope[voice].level();
+        case MOD_SRC_HELD: {
+            if (voices.envPhase[voice] == ENV_IDLE) return 0.0f;
+            uint32_t heldUs = micros() - voices.onMicros[voice];
+            return heldUs >= MOD_HELD_FULL_US ? 1.0f : (float)heldUs / MOD_HELD_FULL_US;
+        }
+        default:
+            return 0.0f;
+    }
+}
+
+// --- Evaluation ---
+
+void updateModMatrix(const SynthState& state) {
+    if (numRoutes == 0 && modDeltas.active == 0) return; // Nothing routed, nothing to undo
+    memset(&modDeltas, 0, sizeof(modDeltas));
+
+    for (int r = 0; r < numRoutes; r++) {
+        ModRoute& route = routes[r];
+        modDeltas.active |= 1 << route.destination;
+
+        // Voice-independent sources are read once
+        bool global = route.source == MOD_SRC_BEAT || route.source == MOD_SRC_CC;
+        float globalValue = 0.0f;
+        if (route.source == MOD_SRC_BEAT) globalValue = beatPhase(state);
+        else if (route.source == MOD_SRC_CC) {
+            // 7-bit controller steps would land as audible jumps
+            route.ccLevel.target = ccValues[route.cc] * (1.0f / 127.0f);
+            globalValue = smoothTick(route.ccLevel, SMOOTH_CC);
+        }
+
+        if (route.destination == MOD_DST_SWING) {
+            modDeltas.swing += route.amount * (global ? globalValue : voiceSource(route.source, 0));
+            continue;
+        }
+        float* deltas = (route.destination == MOD_DST_PITCH) ? modDeltas.pitchOctaves : modDeltas.amplitude;
+        float scale = (route.destination == MOD_DST_PITCH) ? route.amount / 12.0f : route.amount;
+        for (int v = 0; v < NUM_VOICES; v++) {
+            if (voices.envPhase[v] == ENV_IDLE) continue;
+            deltas[v] += scale * (global ? globalValue : voiceSource(route.source, v));
+        }
+    }
+}
+
+float modulatedSwing(const SynthState& state) {
+    float swing = state.swingAmount + modDeltas.swing;
+    if (swing < 0.0f) return 0.0f;
+    return swing > 1.0f ? 1.0f : swing;
+}
+
+// --- Names ---
+
+int modSourceFromName(const char* name, uint8_t& cc) {
+    cc = 0;
+    if (strncmp(name, "cc", 2) == 0) {
+        char* end;
+        long number = strtol(name + 2, &end, 10);
+        if (end == name + 2 || *end != '\0' || number < 0 || number > 127) return -1;
+        cc = (uint8_t)number;
+        return MOD_SRC_CC;
+    }
+    for (int s = 0; s < MOD_SRC_COUNT; s++) {
+        if (s != MOD_SRC_CC && strcmp(name, sourceNames[s]) == 0) return s;
+    }
+    return -1;
+}
+
+int modDestinationFromName(const char* name) {
+    for (int d = 0; d < MOD_DST_COUNT; d++) {
+        if (strcmp(name, destinationNames[d]) == 0) return d;
+    }
+    return -1;
+}
+
+const char* modSourceName(uint8_t source) {
+    return source < MOD_SRC_COUNT ? sourceNames[source] : "?";
+}
+
+const char* modDestinationName(uint8_t destination) {
+    return destination < MOD_DST_COUNT ? destinationNames[destination] : "?";
+}
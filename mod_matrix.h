@@ -0,0 +1,78 @@
+// mod_matrix.h
+// Sparse modulation matrix. Routes (source -> destination, amount) are kept as a short
+// list of the active ones only and evaluated once per control tick into per-voice
+// deltas that updateVoices() and the swing timing apply, so the cost follows the number
+// of routes rather than sources x destinations. Vibrato keeps its own fixed path.
+
+#ifndef MOD_MATRIX_H
+#define MOD_MATRIX_H
+
+#include "synth_state.h"
+#include "voice_manager.h"
+#include "param_smooth.h"
+#include <stdint.h>
+
+#define MOD_MAX_ROUTES 8
+#define MOD_HELD_FULL_US 2000000 // The held-time source reaches 1 after this long
+#define MOD_AMPLITUDE_MAX 1.25f  // Highest voice gain amplitude routes can reach
+#define MOD_PITCH_MAX_SEMITONES 24.0f
+
+enum ModSource {
+    MOD_SRC_LFO1,     // Vibrato LFO, -1..1 at each voice's phase
+    MOD_SRC_LFO2,     // Modulation LFO (LFO_MOD), -1..1
+    MOD_SRC_ENVELOPE, // Voice envelope level, 0..1
+    MOD_SRC_BEAT,     // Position within the quarter note at the clock or internal tempo, 0..1
+    MOD_SRC_HELD,     // Time since the voice's note-on, 0..1 over MOD_HELD_FULL_US
+    MOD_SRC_CC,       // Last value of a MIDI CC, 0..1
+    MOD_SRC_COUNT
+};
+
+enum ModDestination {
+    MOD_DST_PITCH,     // Amount in semitones
+    MOD_DST_AMPLITUDE, // Added to unity voice gain
+    MOD_DST_SWING,     // Added to state.swingAmount (global: voice 0's sources)
+    MOD_DST_COUNT
+};
+
+struct ModRoute {
+    uint8_t source;      // ModSource
+    uint8_t cc;          // Controller number for MOD_SRC_CC
+    uint8_t destination; // ModDestination
+    float amount;
+    ParamSmoother ccLevel; // MOD_SRC_CC: the controller's value eased in (SMOOTH_CC), 0..1
+};
+
+// Result of the last evaluation
+struct ModDeltas {
+    float pitchOctaves[NUM_VOICES];
+    float amplitude[NUM_VOICES];
+    float swing;
+    uint8_t active; // Bit (1 << ModDestination) for each destination some route reaches
+};
+
+extern ModDeltas modDeltas;
+
+void resetModMatrix();
+// Appends a route, or updates the amount of an identical one. Returns its index, or
+// -1 when the list is full or the route is invalid.
+int addModRoute(uint8_t source, uint8_t cc, uint8_t destination, float amount);
+bool removeModRoute(int index); // Later routes move down one
+void clearModRoutes();
+int modRouteCount();
+const ModRoute& modRouteAt(int index);
+
+void modMatrixControlChange(uint8_t control, uint8_t value); // From the MIDI CC handler
+
+// After updateLfoBank() and before updateVoices(), once per control tick
+void updateModMatrix(const SynthState& state);
+
+// state.swingAmount plus any swing routes, 0..1
+float modulatedSwing(const SynthState& state);
+
+// Serial names ("lfo1", "cc74", "pitch", ...); parsing returns -1 for unknown names
+int modSourceFromName(const char* name, uint8_t& cc);
+int modDestinationFromName(const char* name);
+const char* modSourceName(uint8_t source);
+const char* modDestinationName(uint8_t destination);
+
+#endif // MOD_MATRIX_H
@@ -0,0 +1,48 @@
+// param_smooth.cpp
+// Implements the parameter smoothers. Each class keeps its time constant and the
+// per-tick coefficient derived from it, so a tick is one multiply-add per parameter.
+
+#include "param_smooth.h"
+#include "control_tick.h"
+#include <math.h>
+#include <string.h>
+
+static const char* const paramNames[SMOOTH_PARAM_COUNT] = {"vibrato", "amp", "cc", "volume"};
+static const float defaultMs[SMOOTH_PARAM_COUNT] = {50.0f, 5.0f, 20.0f, 50.0f};
+
+static float timeMs[SMOOTH_PARAM_COUNT];
+static float coefficient[SMOOTH_PARAM_COUNT]; // Share of the remaining distance covered per tick
+
+void resetSmoothing() {
+    for (int p = 0; p < SMOOTH_PARAM_COUNT; p++) setSmoothingTime(p, defaultMs[p]);
+}
+
+void setSmoothingTime(int param, float ms) {
+    if (param < 0 || param >= SMOOTH_PARAM_COUNT) return;
+    if (ms < 0.0f) ms = 0.0f;
+    if (ms > SMOOTH_MAX_MS) ms = SMOOTH_MAX_MS;
+    timeMs[param] = ms;
+    coefficient[param] = (ms > 0.0f) ? 1.0f - expf(-(float)CONTROL_TICK_US / (ms * 1000.0f)) : 1.0f;
+}
+
+float smoothingTime(int param) {
+    return (param >= 0 && param < SMOOTH_PARAM_COUNT) ? timeMs[param] : 0.0f;
+}
+
+const char* smoothParamName(int param) {
+    return (param >= 0 && param < SMOOTH_PARAM_COUNT) ? paramNames[param] : "?";
+}
+
+int smoothParamFromName(const char* name) {
+    for (int p = 0; p < SMOOTH_PARAM_COUNT; p++) {
+        if (strcmp(name, paramNames[p]) == 0) return p;
+    }
+    return -1;
+}
+
+float smoothTick(ParamSmoother& smoother, int param) {
+    float distance = smoother.target - smoother.value;
+    if (fabsf(distance) < SMOOTH_SETTLE) smoother.value = smoother.target;
+    else smoother.value += distance * coefficient[param];
+    return smoother.value;
+}
@@ -0,0 +1,43 @@
+// param_smooth.h
+// One-pole smoothing for parameters the control path changes while notes sound. A
+// smoother eases its value towards the target once per control tick, with a time
+// constant set per parameter class; the audio objects then interpolate between the
+// per-tick values sample by sample (VoiceEnvelope's gain ramp, the S-DSP volume slew),
+// so a sweep reaches the audio as a ramp instead of a staircase.
+
+#ifndef PARAM_SMOOTH_H
+#define PARAM_SMOOTH_H
+
+#include <stdint.h>
+
+#define SMOOTH_MAX_MS 1000
+#define SMOOTH_SETTLE 0.00001f // Closer than this snaps onto the target
+
+enum SmoothParam {
+    SMOOTH_VIBRATO,   // Vibrato depth
+    SMOOTH_AMPLITUDE, // Voice gain from amplitude routes
+    SMOOTH_CC,        // CC values feeding modulation routes
+    SMOOTH_VOLUME,    // Codec output volume
+    SMOOTH_PARAM_COUNT
+};
+
+struct ParamSmoother {
+    float value;
+    float target;
+};
+
+void resetSmoothing(); // Default time constants
+void setSmoothingTime(int param, float ms); // Time constant; 0 steps straight to the target
+float smoothingTime(int param);
+const char* smoothParamName(int param);
+int smoothParamFromName(const char* name); // -1 for unknown names
+
+// One control tick towards the target; returns the new value
+float smoothTick(ParamSmoother& smoother, int param);
+
+inline void smoothJump(ParamSmoother& smoother, float value) {
+    smoother.value = value;
+    smoother.target = value;
+}
+
+#endif // PARAM_SMOOTH_H
@@ -6,10 +6,13 @@
 #include "synth.h"
 #include "chords.h"
 #include "audio.h"
+#include "voice_manager.h"
+#include "mod_matrix.h"
 #include "utils.h"
 #include "midi.h" // Include for MIDI functions
 #include "midi_utils.h" // Add back for midiToPitchFloat
 #include "button_defs.h" // Include for BTN_ defines
+#include "controller.h"
 #include "synth_state.h" // Include for PROFILE_ defines
 #include "debug.h"       // Include for DEBUG_DEBUG
 #include <Arduino.h>
@@ -28,6 +31,11 @@ const int buttonToMusicalPosition[MAX_NOTE_BUTTONS] = {
     8  // BTN_X (9)      -> musical position 8
 };
 
+// Inverse of buttonToMusicalPosition
+const int musicalPositionToButton[MAX_NOTE_BUTTONS] = {
+    BTN_DOWN, BTN_LEFT, BTN_UP, BTN_RIGHT, BTN_SELECT, BTN_START, BTN_Y, BTN_B, BTN_X, BTN_A
+};
+
 // Mapping for Thunderstruck Intro Profile
 // Indices correspond to BTN_B(0), Y(1), Select(2), Start(3), Up(4), Down(5), Left(6), Right(7), A(8), X(9)
 const int thunderstruckMidiNotes[MAX_NOTE_BUTTONS] = {
@@ -182,7 +190,7 @@ void handleBoogieTiming(SynthState& state) {
     } else {
         // --- SWING 8TH NOTE MODE --- 
         float eighthNoteNominalDuration = quarterNoteDurationMicros / 2.0f;
-        float swingDelayMicros = state.swingAmount * (quarterNoteDurationMicros / 6.0f);
+        float swingDelayMicros = modulatedSwing(state) * (quarterNoteDurationMicros / 6.0f);
         unsigned long slot0StartTimeRel = 0; 
         unsigned long slot1StartTimeRel = (unsigned long)(eighthNoteNominalDuration + swingDelayMicros);
         unsigned long note0IntendedDuration = (unsigned long)(eighthNoteNominalDuration * 0.5f); 
@@ -251,24 +259,23 @@ void handleBoogieTiming(SynthState& state) {
     if (targetSlot != -1) {
         int targetNote = prioritizedBaseMidiNote - 24; if (targetNote < 0) targetNote = 0; if (targetNote > 127) targetNote = 127;
         unsigned long targetAbsStopTime; // Recalculate based on target slot for clarity
+        unsigned long beatNumCurrent = (nowMicros - currentBeatRefTimeMicros) / (unsigned long)quarterNoteDurationMicros;
         if (state.held[BTN_L] && state.held[BTN_R]) { // Triplet timings
             float tripletDurationMicros = quarterNoteDurationMicros / 3.0f;
             unsigned long tripletNoteDuration = (unsigned long)(tripletDurationMicros * 0.5f);
-             unsigned long beatNumCurrent = (nowMicros - currentBeatRefTimeMicros) / (unsigned long)quarterNoteDurationMicros;
             unsigned long targetAbsStartTime = currentBeatRefTimeMicros + (beatNumCurrent * (unsigned long)quarterNoteDurationMicros) + (unsigned long)(targetSlot * tripletDurationMicros);
              targetAbsStopTime = targetAbsStartTime + tripletNoteDuration;
              DEBUG_VERBOSE(CAT_PLAYSTYLE, "Boogie Triplet Note Start: Slot %d, Note %d, Stop @ %lu", targetSlot, targetNote, targetAbsStopTime);
               state.boogieNoteStartTimeMicros = targetAbsStartTime; // Store actual start time
         } else { // 8th note timings
              float eighthNoteNominalDuration = quarterNoteDurationMicros / 2.0f;
-             float swingDelayMicros = state.swingAmount * (quarterNoteDurationMicros / 6.0f);
+             float swingDelayMicros = modulatedSwing(state) * (quarterNoteDurationMicros / 6.0f);
              unsigned long slot0StartTimeRel = 0; 
              unsigned long slot1StartTimeRel = (unsigned long)(eighthNoteNominalDuration + swingDelayMicros);
              unsigned long note0IntendedDuration = (unsigned long)(eighthNoteNominalDuration * 0.5f); 
              unsigned long note1IntendedDuration = (unsigned long)(eighthNoteNominalDuration * 0.5f); 
              unsigned long slot0StopTimeRel = min(note0IntendedDuration, slot1StartTimeRel); 
              unsigned long slot1StopTimeRel = min(slot1StartTimeRel + note1IntendedDuration, (unsigned long)quarterNoteDurationMicros);
-             unsigned long beatNumCurrent = (nowMicros - currentBeatRefTimeMicros) / (unsigned long)quarterNoteDurationMicros;
              unsigned long targetAbsStartTime = currentBeatRefTimeMicros + (beatNumCurrent * (unsigned long)quarterNoteDurationMicros) + 
                                              ((targetSlot == 0) ? slot0StartTimeRel : slot1StartTimeRel);
              targetAbsStopTime = currentBeatRefTimeMicros + (beatNumCurrent * (unsigned long)quarterNoteDurationMicros) + 
@@ -277,8 +284,9 @@ void handleBoogieTiming(SynthState& state) {
              state.boogieNoteStartTimeMicros = targetAbsStartTime; // Store actual start time
         }
 
-        playNote(state, 0, targetNote);
+        playNote(state, 0, targetNote, OWNER_BOOGIE);
         sendMidiNoteOn(targetNote, MIDI_VELOCITY, MIDI_CHANNEL);
+        triggerRhythmDrum(state, beatNumCurrent, targetSlot);
         state.boogieCurrentMidiNote = targetNote;
         state.boogieCurrentSlotIndex = targetSlot; // Use targetSlot (0,1, or 2)
         state.boogieNoteStopTimeMicros = targetAbsStopTime; // Store calculated stop time
@@ -313,6 +321,11 @@ void handleMonophonic(SynthState& state) {
         // L can be the "held" button in TS if nothing else is held
         if (highestPriorityHeldButton == -1) highestPriorityHeldButton = BTN_L; 
     }
+    // A press moves to the button the note priority picks; none when that is already sounding
+    if (newlyPressedButton != -1 && newlyPressedButton < MAX_NOTE_BUTTONS) {
+        int priority = priorityButton(state);
+        newlyPressedButton = (priority != state.currentButton) ? priority : -1;
+    }
 
 
     // --- Determine Current Pitch Bend ---
@@ -355,7 +368,7 @@ void handleMonophonic(SynthState& state) {
              if (finalMidiNote < 0) finalMidiNote = 0; if (finalMidiNote > 127) finalMidiNote = 127;
 
              DEBUG_INFO(CAT_PLAYSTYLE, "Mono Press: base=%d, bend=%d, final=%d (Button %d)", baseMidiNote, currentPitchBend, finalMidiNote, newlyPressedButton);
-             playNote(state, 0, finalMidiNote);
+             playNote(state, 0, finalMidiNote, OWNER_MONO);
              sendMidiNoteOn(finalMidiNote, MIDI_VELOCITY, MIDI_CHANNEL);
 
              state.currentMidiNote = finalMidiNote;
@@ -371,15 +384,8 @@ void handleMonophonic(SynthState& state) {
     // 2. Handle Release of the Playing Button (If no new button was pressed)
     else if (releasedButton != -1) {
         // --- Retrigger Check ---
-        // Find the highest priority button *still held*
-        int buttonToRetrigger = -1;
-         for (int i = 0; i < MAX_NOTE_BUTTONS; ++i) { 
-             // Check state.held[] directly for what is held NOW
-             if (i != releasedButton && state.held[i]) { 
-                 buttonToRetrigger = i;
-                 break;
-             }
-         }
+        // The button the note priority picks among those still held
+        int buttonToRetrigger = priorityButton(state);
          // Retriggering L in Thunderstruck is handled by its own press logic if needed.
 
         if (buttonToRetrigger != -1) {
@@ -408,7 +414,7 @@ void handleMonophonic(SynthState& state) {
                  if (finalMidiNote < 0) finalMidiNote = 0; if (finalMidiNote > 127) finalMidiNote = 127;
 
                  DEBUG_INFO(CAT_PLAYSTYLE, "Mono Retrigger Play: base=%d, bend=%d, final=%d (Button %d)", baseMidiNote, currentPitchBend, finalMidiNote, buttonToRetrigger);
-                 playNote(state, 0, finalMidiNote);
+                 playNote(state, 0, finalMidiNote, OWNER_MONO);
                  sendMidiNoteOn(finalMidiNote, MIDI_VELOCITY, MIDI_CHANNEL);
 
                  state.currentMidiNote = finalMidiNote;
@@ -458,7 +464,7 @@ void handleMonophonic(SynthState& state) {
               if (state.currentMidiNote != -1 && state.currentMidiNote != finalMidiNote) {
                   sendMidiNoteOff(state.currentMidiNote, 0, MIDI_CHANNEL);
               }
-             playNote(state, 0, finalMidiNote); // Retrigger audio with new pitch
+             playNote(state, 0, finalMidiNote, OWNER_MONO); // Retrigger audio with new pitch
              
              // Send Note On only if note number changed or was previously off
               if (state.currentMidiNote == -1 || state.currentMidiNote != finalMidiNote) {
@@ -478,7 +484,64 @@ void handleMonophonic(SynthState& state) {
 }
 
 // ChordButton playstyle
+// Moves the sounding chord onto 'notes' as a diff: a tone that is already sounding keeps
+// its voice and MIDI note untouched, dropped tones get their note off, and new tones
+// start on the freed voices (gliding from a dropped tone under portamento). Voice n
+// is preferred for the chord's n-th tone, so the root keeps voice 0's lead level.
+// Only chord voices and free ones take part; a backing track voice is never matched,
+// dropped or taken.
+static void changeChord(SynthState& state, const int* notes, int numNotes) {
+    if (numNotes > NUM_VOICES) numNotes = NUM_VOICES; // placed[] is indexed by tone
+    bool claimed[NUM_VOICES];           // Keeps its tone, takes a new one, or is not ours
+    bool placed[NUM_VOICES] = {false};  // Tone already sounding
+    for (int v = 0; v < NUM_VOICES; v++) {
+        claimed[v] = voices.owner[v] != OWNER_CHORD && voices.owner[v] != OWNER_NONE;
+    }
+    for (int n = 0; n < numNotes; n++) {
+        for (int v = 0; v < NUM_VOICES; v++) {
+            if (!claimed[v] && voiceNote(v) == notes[n]) {
+                claimed[v] = true;
+                placed[n] = true;
+                break;
+            }
+        }
+    }
+
+    // Dropped tones: note off first. Under portamento the voice keeps sounding for a
+    // new tone to glide from; otherwise it is released now.
+    for (int v = 0; v < NUM_VOICES; v++) {
+        if (claimed[v] || voiceNote(v) == -1) continue;
+        DEBUG_VERBOSE(CAT_MIDI, "Chord MIDI Note Off (Dropped Tone): %d", voiceNote(v));
+        sendMidiNoteOff(voiceNote(v), 0, MIDI_CHANNEL);
+        if (!state.portamentoEnabled) stopNote(v);
+    }
+
+    for (int n = 0; n < numNotes; n++) {
+        if (placed[n]) continue;
+        int voice = -1;
+        for (int v = 0; v < NUM_VOICES && state.portamentoEnabled && voice < 0; v++) {
+            if (!claimed[v] && voiceNote(v) != -1) voice = v; // Glide from a dropped tone
+        }
+        if (voice < 0 && n < NUM_VOICES && !claimed[n]) voice = n;
+        for (int v = 0; v < NUM_VOICES && voice < 0; v++) {
+            if (!claimed[v]) voice = v;
+        }
+        if (voice < 0) break;
+        claimed[voice] = true;
+        playNote(state, voice, notes[n], OWNER_CHORD);
+        sendMidiNoteOn(notes[n], MIDI_VELOCITY, MIDI_CHANNEL);
+    }
+
+    // Dropped tones no new tone glided from
+    for (int v = 0; v < NUM_VOICES; v++) {
+        if (!claimed[v] && voiceNote(v) != -1) stopNote(v);
+    }
+}
+
 void handleChordButton(SynthState& state) {
+    // currentButton can still be L from Thunderstruck mono after a style switch; L has no chord
+    if (state.currentButton >= MAX_NOTE_BUTTONS) state.currentButton = -1;
+
     // --- Determine current input states --- (Pitch Bend, New Press, Release, Pitch Change)
     int currentLState = state.held[BTN_L];
     int currentRState = state.held[BTN_R];
@@ -492,6 +555,11 @@ void handleChordButton(SynthState& state) {
     for (int btnIndex = 0; btnIndex < 10; ++btnIndex) {
         if (state.pressed[btnIndex]) { newlyPressedButton = btnIndex; break; }
     }
+    // A press moves to the button the note priority picks; none when that is already sounding
+    if (newlyPressedButton != -1) {
+        int priority = priorityButton(state);
+        newlyPressedButton = (priority != state.currentButton) ? priority : -1;
+    }
     bool currentButtonReleased = (state.currentButton != -1 && state.released[state.currentButton]);
     bool pitchBendChanged = (state.currentButton != -1 && newPitchBend != state.prevPitchBend);
     
@@ -505,39 +573,13 @@ void handleChordButton(SynthState& state) {
         buttonToPlay = newlyPressedButton;
     } else if (currentButtonReleased) {
         // --- Chord Retrigger Logic (Similar to Mono) ---
-        // 1. Try buffer
-        int lastHeldButtonInBuffer = -1;
-        int readIndex = state.lastPressedIndex; 
-        for (int i = 0; i < LAST_PRESS_BUFFER_SIZE; ++i) {
-            readIndex = (readIndex + LAST_PRESS_BUFFER_SIZE - 1) % LAST_PRESS_BUFFER_SIZE;
-            int bufferedButton = state.lastPressedBuffer[readIndex];
-            if (bufferedButton >= 0 && bufferedButton < MAX_NOTE_BUTTONS && 
-                state.held[bufferedButton] && bufferedButton != state.currentButton) { 
-                lastHeldButtonInBuffer = bufferedButton;
-                break; 
-            }
-        }
-        if (lastHeldButtonInBuffer != -1) {
-            // Serial.print("Retriggering chord (Buffer Hit) for button: "); Serial.println(lastHeldButtonInBuffer); // Commented out
+        // The button the note priority picks among those still held, else stop
+        int nextButton = priorityButton(state);
+        if (nextButton != -1) {
             triggerNewChord = true;
-            buttonToPlay = lastHeldButtonInBuffer;
+            buttonToPlay = nextButton;
         } else {
-            // 2. Fallback: lowest index held
-            int lowestFallbackHeld = -1;
-            for (int btnIndex = 0; btnIndex < MAX_NOTE_BUTTONS; ++btnIndex) {
-                 if (state.held[btnIndex] && btnIndex != state.currentButton) { 
-                     lowestFallbackHeld = btnIndex;
-                     break; 
-                 }
-            }
-            if (lowestFallbackHeld != -1) {
-                 // Serial.print("Retriggering chord (Fallback Held - Lowest) for button: "); Serial.println(lowestFallbackHeld); // Commented out
-                 triggerNewChord = true;
-                 buttonToPlay = lowestFallbackHeld;
-            } else {
-                 // 3. Nothing else held, stop.
-                 shouldStopNotes = true;
-            }
+            shouldStopNotes = true;
         }
     } else if (pitchBendChanged) {
         triggerNewChord = true;
@@ -555,15 +597,13 @@ void handleChordButton(SynthState& state) {
         if (state.currentButton != -1) { 
              // Serial.println("Stopping chord (button released w/o retrigger or none held)"); // Commented out
             bool notesWerePlaying = false;
-            for (int i = 0; i < 4; i++) {
-                if (state.currentChordNotes[i] != -1) {
+            for (int i = 0; i < NUM_VOICES; i++) {
+                int chordNote = voiceNote(i);
+                if (chordNote != -1 && voices.owner[i] == OWNER_CHORD) {
                     notesWerePlaying = true;
                     stopNote(i);
-                    DEBUG_VERBOSE(CAT_MIDI, "Chord MIDI Note Off (Stopping Chord): %d", state.currentChordNotes[i]);
-                    sendMidiNoteOff(state.currentChordNotes[i], 0, MIDI_CHANNEL); 
-                    state.currentChordNotes[i] = -1;
-                    state.currentChordFrequencies[i] = 0.0;
-                    state.waveformOpen[i] = 1;
+                    DEBUG_VERBOSE(CAT_MIDI, "Chord MIDI Note Off (Stopping Chord): %d", chordNote);
+                    sendMidiNoteOff(chordNote, 0, MIDI_CHANNEL); 
                 }
             }
             // Send MIDI All Notes Off if any notes were stopped
@@ -574,33 +614,7 @@ void handleChordButton(SynthState& state) {
             state.currentButton = -1; 
         }
     } else if (triggerNewChord && buttonToPlay != -1) { 
-        // --- Play / Retrigger Chord --- 
-        bool isNewButton = (newlyPressedButton != -1 && newlyPressedButton != state.currentButton);
-
-        // Prepare previous voices: Send MIDI Note Offs. Stop audio voices only if Portamento is OFF.
-        if (state.currentButton != -1 && (isNewButton || pitchBendChanged)) {
-            // Serial.println("Preparing voices for new/changed chord..."); // Commented out
-             for (int i = 0; i < 4; i++) {
-                if (state.currentChordNotes[i] != -1) {
-                     DEBUG_VERBOSE(CAT_MIDI, "Chord MIDI Note Off (Prep New Chord): %d", state.currentChordNotes[i]);
-                     sendMidiNoteOff(state.currentChordNotes[i], 0, MIDI_CHANNEL); 
-                     
-                     // *** CORRECTED STOP LOGIC ***
-                     // Only stop audio voice if Portamento is OFF.
-                     if (!state.portamentoEnabled) {
-                         // Serial.println("   Stopping voice (Porta OFF)"); // Commented out
-                         stopNote(i);
-                         state.currentChordNotes[i] = -1; 
-                         state.currentChordFrequencies[i] = 0.0;
-                         state.waveformOpen[i] = 1;
-                     } else {
-                         // Serial.println("   Porta ON: Keeping voice active for slide."); // Commented out
-                         // Keep voice active for slide, state will be updated below
-                     }
-                }
-            }
-        }
-        
+        // --- Play / Change Chord --- 
         state.currentButton = buttonToPlay; 
 
         // Get the chord notes 
@@ -609,35 +623,16 @@ void handleChordButton(SynthState& state) {
         int numNotes;
         getChordNotes(state, musicalPosition + 1, chordNotes, numNotes); 
 
-        // Serial.print("Playing new chord for button "); Serial.print(state.currentButton); Serial.print(" (musical pos "); Serial.print(musicalPosition); Serial.println(")"); // Commented out
-        
-        // Play each note in the new chord
-        for (int i = 0; i < numNotes; i++) {
-            if (chordNotes[i] != -1) {
-                int finalMidiNote = chordNotes[i] + newPitchBend; 
-                if (finalMidiNote < 0) finalMidiNote = 0;
-                if (finalMidiNote > 127) finalMidiNote = 127;
-                
-                // Serial.print("  Voice "); Serial.print(i); Serial.print(": MIDI "); Serial.println(finalMidiNote); // Commented out
-                playNote(state, i, finalMidiNote); 
-                sendMidiNoteOn(finalMidiNote, MIDI_VELOCITY, MIDI_CHANNEL);
-                state.currentChordNotes[i] = finalMidiNote;
-                state.currentChordFrequencies[i] = midiToPitchFloat[finalMidiNote];
-                state.waveformOpen[i] = 0;
-            } 
+        int targetNotes[NUM_VOICES];
+        int numTargets = 0;
+        for (int i = 0; i < numNotes && numTargets < NUM_VOICES; i++) {
+            if (chordNotes[i] == -1) continue;
+            int finalMidiNote = chordNotes[i] + newPitchBend; 
+            if (finalMidiNote < 0) finalMidiNote = 0;
+            if (finalMidiNote > 127) finalMidiNote = 127;
+            targetNotes[numTargets++] = finalMidiNote;
         }
-        // Stop unused voices
-         for (int i = numNotes; i < 4; ++i) {
-              if (state.currentChordNotes[i] != -1) {
-                   // Serial.print("  Stopping unused voice "); Serial.println(i); // Commented out
-                   stopNote(i);
-                   DEBUG_VERBOSE(CAT_MIDI, "Chord MIDI Note Off (Unused Voice): %d", state.currentChordNotes[i]);
-                   sendMidiNoteOff(state.currentChordNotes[i], 0, MIDI_CHANNEL);
-                   state.currentChordNotes[i] = -1;
-                   state.currentChordFrequencies[i] = 0.0;
-                   state.waveformOpen[i] = 1;
-              }
-         }
+        changeChord(state, targetNotes, numTargets);
     }
 
     // --- Update State for Next Cycle ---
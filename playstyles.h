@@ -18,6 +18,7 @@ struct SynthState;
 // Declare the mapping array as extern so it can be used elsewhere
 extern const int thunderstruckMidiNotes[MAX_NOTE_BUTTONS];
 extern const int buttonToMusicalPosition[MAX_NOTE_BUTTONS];
+extern const int musicalPositionToButton[MAX_NOTE_BUTTONS];
 
 // Renamed functions to match calls in main.ino
 void handleMonophonic(SynthState& state);
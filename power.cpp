@@ -0,0 +1,27 @@
+// power.cpp
+// Implements sleepUntilMicros(): a one-shot IntervalTimer bounds the sleep and WFI
+// halts the core until that or any other interrupt fires.
+
+#include "power.h"
+
+#ifdef SNES_HOST_BUILD
+void sleepUntilMicros(unsigned long deadlineMicros) {
+    // No interrupts on the host: block until the deadline (advances a simulated clock)
+    long remaining = (long)(deadlineMicros - micros());
+    if (remaining >= SLEEP_MIN_MICROS) delayMicroseconds((unsigned int)remaining);
+}
+#else
+static IntervalTimer wakeTimer;
+
+static void onWakeTimer() {
+    wakeTimer.end(); // One-shot: the interrupt itself is what ends the WFI
+}
+
+void sleepUntilMicros(unsigned long deadlineMicros) {
+    long remaining = (long)(deadlineMicros - micros());
+    if (remaining < SLEEP_MIN_MICROS) return;
+    if (!wakeTimer.begin(onWakeTimer, (unsigned int)remaining)) return; // No free PIT channel: just return
+    asm volatile("wfi");
+    wakeTimer.end();
+}
+#endif
@@ -0,0 +1,17 @@
+// power.h
+// Low-power idling for the event-driven main loop: sleep the core until a deadline
+// or until any interrupt (USB, audio DMA, systick) signals new work.
+
+#ifndef POWER_H
+#define POWER_H
+
+#include <Arduino.h>
+
+// Shorter waits are not worth arming the wake timer for
+#define SLEEP_MIN_MICROS 20
+
+// Returns at 'deadlineMicros' at the latest, or earlier on any interrupt. The caller
+// re-polls its event sources afterwards and sleeps again if nothing is due.
+void sleepUntilMicros(unsigned long deadlineMicros);
+
+#endif // POWER_H
@@ -0,0 +1,145 @@
+// riff.cpp
+// Implements the riff-step profile: the built-in riffs, the cursor moves and the
+// playstyle handler that sounds the note each move lands on.
+
+#include "riff.h"
+#include "playstyles.h"
+#include "voice_manager.h"
+#include "midi_utils.h"
+#include "button_defs.h"
+#include "debug.h"
+#include <Arduino.h>
+
+// Thunderstruck intro on the B string: fretted notes against the open B
+static const uint8_t thunderstruckRiff[] PROGMEM = {
+    75, 71, 78, 71, 76, 71, 78, 71, 75, 71, 78, 71, 76, 71, 78, 71,
+    80, 71, 79, 71, 78, 71, 79, 71, 78, 71, 76, 71, 78, 71, 76, 71,
+    75, 71, 76, 71, 75, 71, 76, 71,
+};
+
+// Boogie walking bass in E: a bar each on E, A and B
+static const uint8_t boogieWalkRiff[] PROGMEM = {
+    52, 56, 59, 61, 62, 61, 59, 56,
+    57, 61, 64, 66, 67, 66, 64, 61,
+    59, 63, 66, 68, 69, 68, 66, 63,
+};
+
+static const RiffDef riffs[] = {
+    {"thunderstruck", thunderstruckRiff, sizeof(thunderstruckRiff), {0, 16, 32, RIFF_NO_MARK}},
+    {"boogie-walk", boogieWalkRiff, sizeof(boogieWalkRiff), {0, 8, 16, RIFF_NO_MARK}},
+};
+#define NUM_RIFFS (int)(sizeof(riffs) / sizeof(riffs[0]))
+
+// Indices correspond to BTN_B(0), Y(1), Select(2), Start(3), Up(4), Down(5), Left(6), Right(7), A(8), X(9).
+// B and X both step so fast passages can alternate between them; the d-pad jumps to
+// the marks in musical order (Down, Left, Up, Right).
+static const uint8_t riffButtonActions[MAX_NOTE_BUTTONS] = {
+    RIFF_STEP,      // BTN_B
+    RIFF_REPEAT,    // BTN_Y
+    RIFF_PREV_RIFF, // BTN_SELECT
+    RIFF_NEXT_RIFF, // BTN_START
+    RIFF_JUMP + 2,  // BTN_UP
+    RIFF_JUMP + 0,  // BTN_DOWN
+    RIFF_JUMP + 1,  // BTN_LEFT
+    RIFF_JUMP + 3,  // BTN_RIGHT
+    RIFF_BACK,      // BTN_A
+    RIFF_STEP       // BTN_X
+};
+
+static int riffIndex = 0;
+static int cursor = -1;
+
+void selectRiff(int index) {
+    if (index < 0 || index >= NUM_RIFFS) return;
+    riffIndex = index;
+    cursor = -1;
+}
+
+int currentRiff() {
+    return riffIndex;
+}
+
+int riffCursor() {
+    return cursor;
+}
+
+int riffCount() {
+    return NUM_RIFFS;
+}
+
+const RiffDef& riffAt(int index) {
+    return riffs[index];
+}
+
+int riffMove(int action) {
+    const RiffDef& riff = riffs[riffIndex];
+    switch (action) {
+        case RIFF_STEP:
+            cursor = (cursor + 1 >= riff.length) ? 0 : cursor + 1;
+            break;
+        case RIFF_REPEAT:
+            if (cursor < 0) cursor = 0;
+            break;
+        case RIFF_BACK:
+            cursor = (cursor <= 0) ? riff.length - 1 : cursor - 1;
+            break;
+        case RIFF_PREV_RIFF:
+            selectRiff(riffIndex == 0 ? NUM_RIFFS - 1 : riffIndex - 1);
+            return -1;
+        case RIFF_NEXT_RIFF:
+            selectRiff(riffIndex + 1 == NUM_RIFFS ? 0 : riffIndex + 1);
+            return -1;
+        default: {
+            int mark = action - RIFF_JUMP;
+            if (mark < 0 || mark >= RIFF_MAX_MARKS || riff.marks[mark] >= riff.length) return -1;
+            cursor = riff.marks[mark];
+            break;
+        }
+    }
+    return riff.notes[cursor];
+}
+
+void handleRiff(SynthState& state) {
+    int octave = 0;
+    if (state.held[BTN_L] && !state.held[BTN_R]) octave = -12;
+    else if (state.held[BTN_R] && !state.held[BTN_L]) octave = 12;
+
+    // Each press moves the cursor; the last note landed on sounds
+    int note = -1;
+    int button = -1;
+    for (int b = 0; b < MAX_NOTE_BUTTONS; b++) {
+        if (!state.pressed[b]) continue;
+        int landed = riffMove(riffButtonActions[b]);
+        if (landed != -1) {
+            note = landed;
+            button = b;
+        } else if (riffButtonActions[b] >= RIFF_PREV_RIFF) {
+            DEBUG_INFO(CAT_PLAYSTYLE, "Riff: %s", riffs[riffIndex].name);
+        }
+    }
+
+    if (note != -1) {
+        int finalMidiNote = note + octave;
+        if (finalMidiNote < 0) finalMidiNote = 0;
+        if (finalMidiNote > 127) finalMidiNote = 127;
+        DEBUG_VERBOSE(CAT_PLAYSTYLE, "Riff step %d: note %d (Button %d)", cursor, finalMidiNote, button);
+        if (state.currentMidiNote != -1) sendMidiNoteOff(state.currentMidiNote, 0, MIDI_CHANNEL);
+        playNote(state, 0, finalMidiNote, OWNER_MONO);
+        sendMidiNoteOn(finalMidiNote, MIDI_VELOCITY, MIDI_CHANNEL);
+        state.currentMidiNote = finalMidiNote;
+        state.currentButton = button;
+        state.currentFrequency = midiToPitchFloat[finalMidiNote];
+        return;
+    }
+
+    // The note holds while any button that plays notes is held
+    if (state.currentMidiNote == -1) return;
+    for (int b = 0; b < MAX_NOTE_BUTTONS; b++) {
+        if (state.held[b] && riffButtonActions[b] < RIFF_PREV_RIFF) return;
+    }
+    sendMidiNoteOff(state.currentMidiNote, 0, MIDI_CHANNEL);
+    stopNote(0);
+    state.currentMidiNote = -1;
+    state.currentButton = -1;
+    state.currentFrequency = 0.0;
+}
@@ -0,0 +1,44 @@
+// riff.h
+// Riff-step profile (PROFILE_RIFF). A riff is a note sequence in flash with up to four
+// marked sections; instead of each button owning a note, buttons move a cursor through
+// the sequence: step on, repeat, step back, or jump to a mark. Every move is an O(1)
+// cursor update, so a long riff plays from two alternating step buttons.
+
+#ifndef RIFF_H
+#define RIFF_H
+
+#include <stdint.h>
+#include "synth_state.h"
+
+#define RIFF_MAX_MARKS 4
+#define RIFF_NO_MARK 0xFF
+
+struct RiffDef {
+    const char* name;
+    const uint8_t* notes; // MIDI notes, in flash
+    uint8_t length;
+    uint8_t marks[RIFF_MAX_MARKS]; // Step each jump button goes to, RIFF_NO_MARK unused
+};
+
+// What a note button does in the riff profile
+enum RiffAction {
+    RIFF_STEP,    // Next note (wraps at the end)
+    RIFF_REPEAT,  // Same note again
+    RIFF_BACK,    // Previous note
+    RIFF_JUMP,    // To a mark; RIFF_JUMP + n for mark n
+    RIFF_PREV_RIFF = RIFF_JUMP + RIFF_MAX_MARKS, // Select the previous riff (silent)
+    RIFF_NEXT_RIFF
+};
+
+// Playstyle handler while state.customProfileIndex == PROFILE_RIFF (mono, lead voice)
+void handleRiff(SynthState& state);
+
+// Moves the cursor and returns the note it lands on, or -1 for the silent actions
+int riffMove(int action);
+void selectRiff(int index); // Cursor back to the start
+int currentRiff();
+int riffCursor();           // Step of the last note played, -1 before the first
+int riffCount();
+const RiffDef& riffAt(int index);
+
+#endif // RIFF_H
@@ -0,0 +1,344 @@
+// sample_bank.cpp
+// Indexes BRR samples on the SD card and streams them to the S-DSP voices. Each
+// voice has two streams, so a key on waiting behind the sounding note's fade never
+// shares one with it; the filler reads up to half a stream (32 blocks, 288 bytes)
+// per SD access, stopping at the sample's end block and continuing from its loop point.
+// The first half of the selected sample is read ahead when it is selected, so a key on
+// never waits for the card: priming copies it, and serviceSampleBank() reads the rest.
+
+#include "sample_bank.h"
+#include "audio.h"
+#include "debug.h"
+#include <SD.h>
+#include <string.h>
+#include <ctype.h>
+
+#define SAMPLE_BANK_PATH_LENGTH (sizeof(SAMPLE_BANK_DIR) + SAMPLE_BANK_NAME_LENGTH)
+#define SPC_DIR_CHUNK_ENTRIES 64
+
+// Directory table: file names, then per sample where its blocks start in the file
+static char bankFiles[SAMPLE_BANK_MAX_FILES][SAMPLE_BANK_NAME_LENGTH];
+static int numBankFiles = 0;
+static BrrSample bankSamples[SAMPLE_BANK_MAX_ENTRIES];
+static uint8_t bankSampleFile[SAMPLE_BANK_MAX_ENTRIES];
+static uint32_t bankSampleOffset[SAMPLE_BANK_MAX_ENTRIES];
+static int numBankSamples = 0;
+static bool cardMounted = false;
+
+struct StreamFiller {
+    BrrStream stream;
+    const BrrSample* sample; // nullptr = not streaming
+    File file;
+    int fileIndex;           // bankFiles entry 'file' has open, -1 = none
+    uint32_t fillOffset;     // Next block to read, relative to the sample's first block
+    uint8_t fillHalf;
+    bool finished;           // The one-shot end block has been read
+};
+static StreamFiller fillers[SDSP_VOICES][2]; // Playing (or fading) and pending key on
+static StreamFiller head; // First half of the selected sample, in stream.blocks[0]
+
+static bool hasExtension(const char* name, const char* extension) {
+    size_t nameLength = strlen(name);
+    size_t extensionLength = strlen(extension);
+    if (nameLength <= extensionLength) return false;
+    const char* tail = name + nameLength - extensionLength;
+    for (size_t i = 0; i < extensionLength; i++) {
+        if (tolower((unsigned char)tail[i]) != extension[i]) return false;
+    }
+    return true;
+}
+
+static uint16_t readLe16(const uint8_t* bytes) {
+    return (uint16_t)(bytes[0] | (bytes[1] << 8));
+}
+
+static void bankPath(int fileIndex, char* path) {
+    snprintf(path, SAMPLE_BANK_PATH_LENGTH, "%s/%s", SAMPLE_BANK_DIR, bankFiles[fileIndex]);
+}
+
+static bool addSample(int fileIndex, uint32_t offset, uint32_t length, uint32_t loopOffset) {
+    if (numBankSamples >= SAMPLE_BANK_MAX_ENTRIES) return false;
+    if (loopOffset >= length || loopOffset % BRR_BLOCK_BYTES != 0) loopOffset = 0;
+    BrrSample& sample = bankSamples[numBankSamples];
+    sample.name = bankFiles[fileIndex];
+    sample.data = nullptr;
+    sample.length = length;
+    sample.loopOffset = loopOffset;
+    sample.rootHz = SAMPLE_BANK_ROOT_HZ;
+    bankSampleFile[numBankSamples] = (uint8_t)fileIndex;
+    bankSampleOffset[numBankSamples] = offset;
+    numBankSamples++;
+    return true;
+}
+
+// Raw BRR. A file two bytes longer than whole blocks starts with its loop point
+// (little-endian, in bytes), as written by the common BRR tools.
+static int indexBrrFile(File& file, int fileIndex) {
+    uint32_t size = (uint32_t)file.size();
+    uint32_t offset = 0;
+    uint32_t loopOffset = 0;
+    if (size % BRR_BLOCK_BYTES == 2) {
+        uint8_t loopBytes[2];
+        if (file.read(loopBytes, 2) != 2) return 0;
+        loopOffset = readLe16(loopBytes);
+        offset = 2;
+    }
+    uint32_t length = (size - offset) / BRR_BLOCK_BYTES * BRR_BLOCK_BYTES;
+    if (length < BRR_BLOCK_BYTES) return 0;
+    return addSample(fileIndex, offset, length, loopOffset) ? 1 : 0;
+}
+
+// Bytes from 'start' (ARAM address) up to and including the first end block, or 0
+// when the sample runs off the end of ARAM
+static uint32_t spcSampleLength(File& file, uint32_t start) {
+    uint8_t blocks[BRR_STREAM_HALF_BLOCKS * BRR_BLOCK_BYTES];
+    uint32_t address = start;
+    while (address + BRR_BLOCK_BYTES <= SPC_RAM_BYTES) {
+        uint32_t count = (SPC_RAM_BYTES - address) / BRR_BLOCK_BYTES;
+        if (count > BRR_STREAM_HALF_BLOCKS) count = BRR_STREAM_HALF_BLOCKS;
+        if (!file.seek(SPC_HEADER_BYTES + address)) return 0;
+        if (file.read(blocks, count * BRR_BLOCK_BYTES) != (int)(count * BRR_BLOCK_BYTES)) return 0;
+        for (uint32_t b = 0; b < count; b++) {
+            address += BRR_BLOCK_BYTES;
+            if (blocks[b * BRR_BLOCK_BYTES] & BRR_FLAG_END) return address - start;
+        }
+    }
+    return 0;
+}
+
+// SPC700 dump: the DSP's DIR register points at a table of (start, loop) address
+// pairs in ARAM. Entries are taken in order until the first one that is not a
+// playable sample.
+static int indexSpcFile(File& file, int fileIndex) {
+    static const char SPC_SIGNATURE[] = "SNES-SPC700 Sound File Data";
+    char signature[sizeof(SPC_SIGNATURE) - 1];
+    if (file.size() < SPC_DSP_OFFSET + 128) return 0;
+    if (file.read(signature, sizeof(signature)) != (int)sizeof(signature)) return 0;
+    if (memcmp(signature, SPC_SIGNATURE, sizeof(signature)) != 0) return 0;
+
+    uint8_t dirPage;
+    if (!file.seek(SPC_DSP_OFFSET + SPC_DSP_DIR) || file.read(&dirPage, 1) != 1) return 0;
+    uint32_t dirAddress = (uint32_t)dirPage << 8;
+    int maxEntries = (int)((SPC_RAM_BYTES - dirAddress) / 4);
+    if (maxEntries > 256) maxEntries = 256;
+
+    int firstSample = numBankSamples;
+    int added = 0;
+    uint8_t entries[SPC_DIR_CHUNK_ENTRIES * 4];
+    for (int chunk = 0; chunk < maxEntries; chunk += SPC_DIR_CHUNK_ENTRIES) {
+        int count = min(SPC_DIR_CHUNK_ENTRIES, maxEntries - chunk);
+        if (!file.seek(SPC_HEADER_BYTES + dirAddress + chunk * 4)) return added;
+        if (file.read(entries, count * 4) != count * 4) return added;
+        for (int e = 0; e < count; e++) {
+            uint32_t start = readLe16(entries + e * 4);
+            uint32_t loop = readLe16(entries + e * 4 + 2);
+            if (start == 0) return added;
+            bool duplicate = false;
+            for (int s = firstSample; s < numBankSamples; s++) {
+                if (bankSampleOffset[s] == SPC_HEADER_BYTES + start) duplicate = true;
+            }
+            if (duplicate) continue;
+            uint32_t length = spcSampleLength(file, start);
+            if (length == 0) return added;
+            uint32_t loopOffset = (loop >= start) ? loop - start : 0;
+            if (!addSample(fileIndex, SPC_HEADER_BYTES + start, length, loopOffset)) return added;
+            added++;
+            // spcSampleLength() moved the file position; the next chunk seeks again
+        }
+    }
+    return added;
+}
+
+int setupSampleBank() {
+    for (int v = 0; v < SDSP_VOICES; v++) {
+        for (StreamFiller& filler : fillers[v]) {
+            filler.sample = nullptr;
+            filler.file.close();
+            filler.fileIndex = -1;
+        }
+    }
+    head.sample = nullptr;
+    head.file.close();
+    head.fileIndex = -1;
+    numBankFiles = 0;
+    numBankSamples = 0;
+
+    cardMounted = SD.begin(SAMPLE_BANK_SD_CS_PIN);
+    if (!cardMounted) {
+        DEBUG_INFO(CAT_AUDIO, "No SD card, BRR sample bank empty");
+        return 0;
+    }
+    File dir = SD.open(SAMPLE_BANK_DIR);
+    if (!dir || !dir.isDirectory()) {
+        DEBUG_INFO(CAT_AUDIO, "No %s directory on the SD card", SAMPLE_BANK_DIR);
+        return 0;
+    }
+    while (numBankFiles < SAMPLE_BANK_MAX_FILES && numBankSamples < SAMPLE_BANK_MAX_ENTRIES) {
+        File file = dir.openNextFile();
+        if (!file) break;
+        const char* name = file.name();
+        bool isBrr = hasExtension(name, ".brr");
+        bool isSpc = hasExtension(name, ".spc");
+        if (file.isDirectory() || (!isBrr && !isSpc) || strlen(name) >= SAMPLE_BANK_NAME_LENGTH) {
+            file.close();
+            continue;
+        }
+        int fileIndex = numBankFiles;
+        strcpy(bankFiles[fileIndex], name);
+        int found = isBrr ? indexBrrFile(file, fileIndex) : indexSpcFile(file, fileIndex);
+        file.close();
+        if (found > 0) {
+            numBankFiles++;
+            DEBUG_INFO(CAT_AUDIO, "Sample bank: %s, %d sample(s)", name, found);
+        }
+    }
+    dir.close();
+    DEBUG_INFO(CAT_AUDIO, "Sample bank: %d sample(s) in %d file(s)", numBankSamples, numBankFiles);
+    return numBankSamples;
+}
+
+bool sdCardMounted() {
+    return cardMounted;
+}
+
+int sampleBankCount() {
+    return numBankSamples;
+}
+
+const BrrSample* sampleBankAt(int index) {
+    if (index < 0 || index >= numBankSamples) return nullptr;
+    return &bankSamples[index];
+}
+
+static int bankIndexOf(const BrrSample* sample) {
+    if (sample < bankSamples || sample >= bankSamples + numBankSamples) return -1;
+    return (int)(sample - bankSamples);
+}
+
+const char* sampleBankFileName(const BrrSample* sample) {
+    int index = bankIndexOf(sample);
+    return index < 0 ? "" : bankFiles[bankSampleFile[index]];
+}
+
+// Fills the free half in playback order: runs of blocks up to the sample's end block,
+// continuing from the loop point, so a half is only short when a one-shot ends in it
+static void fillNextHalf(StreamFiller& filler) {
+    int index = bankIndexOf(filler.sample);
+    if (index < 0) {
+        filler.finished = true;
+        return;
+    }
+    int fileIndex = bankSampleFile[index];
+    if (filler.fileIndex != fileIndex) {
+        char path[SAMPLE_BANK_PATH_LENGTH];
+        bankPath(fileIndex, path);
+        filler.file.close();
+        filler.file = SD.open(path);
+        filler.fileIndex = filler.file ? fileIndex : -1;
+    }
+
+    const BrrSample* sample = filler.sample;
+    uint8_t* blocks = filler.stream.blocks[filler.fillHalf];
+    uint32_t filled = 0;
+    while (filled < BRR_STREAM_HALF_BLOCKS && !filler.finished) {
+        uint32_t count = (sample->length - filler.fillOffset) / BRR_BLOCK_BYTES;
+        if (count > BRR_STREAM_HALF_BLOCKS - filled) count = BRR_STREAM_HALF_BLOCKS - filled;
+        uint8_t* run = blocks + filled * BRR_BLOCK_BYTES;
+        if (filler.fileIndex < 0 || count == 0 ||
+            !filler.file.seek(bankSampleOffset[index] + filler.fillOffset) ||
+            filler.file.read(run, count * BRR_BLOCK_BYTES) != (int)(count * BRR_BLOCK_BYTES)) {
+            DEBUG_WARNING(CAT_AUDIO, "Sample bank read failed: %s", sample->name);
+            filler.finished = true;
+            break;
+        }
+
+        bool reachesEnd = filler.fillOffset + count * BRR_BLOCK_BYTES >= sample->length;
+        for (uint32_t b = 0; b < count; b++) {
+            uint8_t& header = run[b * BRR_BLOCK_BYTES];
+            if (reachesEnd && b == count - 1) header |= BRR_FLAG_END; // File cut short of its end flag
+            if (header & BRR_FLAG_END) {
+                count = b + 1;
+                break;
+            }
+        }
+        uint8_t lastHeader = run[(count - 1) * BRR_BLOCK_BYTES];
+        filled += count;
+        filler.fillOffset += count * BRR_BLOCK_BYTES;
+        if (lastHeader & BRR_FLAG_END) {
+            if (lastHeader & BRR_FLAG_LOOP) filler.fillOffset = sample->loopOffset;
+            else filler.finished = true;
+        }
+    }
+    if (filled == 0) return;
+    filler.stream.count[filler.fillHalf] = (uint8_t)filled; // Publish after the data
+    filler.fillHalf ^= 1;
+}
+
+static void fillFreeHalves(StreamFiller& filler) {
+    while (!filler.finished && filler.stream.count[filler.fillHalf] == 0) fillNextHalf(filler);
+}
+
+void sampleBankSelect(const BrrSample* sample) {
+    head.sample = nullptr;
+    if (bankIndexOf(sample) < 0) {
+        head.file.close();
+        head.fileIndex = -1;
+        return;
+    }
+    head.stream.count[0] = 0;
+    head.fillOffset = 0;
+    head.fillHalf = 0;
+    head.finished = false;
+    head.sample = sample;
+    fillNextHalf(head);
+    head.file.close(); // Voices open their own
+    head.fileIndex = -1;
+    if (head.stream.count[0] == 0) head.sample = nullptr; // Read failed: stream on demand
+}
+
+BrrStream* sampleBankPrime(int voice, const BrrSample* sample) {
+    if (voice < 0 || voice >= SDSP_VOICES || bankIndexOf(sample) < 0) return nullptr;
+    // The voice may still be fading out the old note from one stream; prime the other
+    int slot = (sdsp.voiceState(voice).stream == &fillers[voice][0].stream) ? 1 : 0;
+    StreamFiller& filler = fillers[voice][slot];
+    bool prefetched = (head.sample == sample);
+    AudioNoInterrupts(); // A key on still pending from this stream may start meanwhile
+    filler.stream.count[0] = 0;
+    filler.stream.count[1] = 0;
+    filler.stream.readHalf = 0;
+    filler.stream.readBlock = 0;
+    if (prefetched) {
+        memcpy(filler.stream.blocks[0], head.stream.blocks[0], head.stream.count[0] * BRR_BLOCK_BYTES);
+        filler.stream.count[0] = head.stream.count[0];
+    }
+    AudioInterrupts();
+    // No card access here: serviceSampleBank() reads the second half (or, for a sample
+    // that was not read ahead, both)
+    filler.sample = sample;
+    filler.fillOffset = prefetched ? head.fillOffset : 0;
+    filler.fillHalf = prefetched ? 1 : 0;
+    filler.finished = prefetched && head.finished;
+    return &filler.stream;
+}
+
+void serviceSampleBank() {
+    for (int v = 0; v < SDSP_VOICES; v++) {
+        const SDspVoice& voice = sdsp.voiceState(v);
+        for (StreamFiller& filler : fillers[v]) {
+            if (!filler.sample) continue;
+            bool playing = sdsp.voiceActive(v) && voice.stream == &filler.stream;
+            bool pending = voice.pendingSample && voice.pendingStream == &filler.stream;
+            if (!playing && !pending) {
+                filler.sample = nullptr; // The voice finished or moved on to another sample
+                continue;
+            }
+            fillFreeHalves(filler);
+        }
+    }
+}
+
+uint32_t sampleBankUnderruns() {
+    uint32_t total = 0;
+    for (int v = 0; v < SDSP_VOICES; v++) total += fillers[v][0].stream.underruns + fillers[v][1].stream.underruns;
+    return total;
+}
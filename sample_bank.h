@@ -0,0 +1,54 @@
+// sample_bank.h
+// BRR sample banks on the Audio Shield's SD card. At boot every .brr file and every
+// sample in the source directory of each .spc dump under SAMPLE_BANK_DIR is indexed
+// into a small directory table; no sample data is loaded. S-DSP voices playing a bank
+// sample stream its blocks from the card through a double-buffered BrrStream that the
+// main loop refills, so banks can be far larger than RAM.
+
+#ifndef SAMPLE_BANK_H
+#define SAMPLE_BANK_H
+
+#include "sdsp.h"
+
+#define SAMPLE_BANK_SD_CS_PIN 10 // Audio Shield SD card
+#define SAMPLE_BANK_DIR "/BRR"
+#define SAMPLE_BANK_MAX_FILES 16
+#define SAMPLE_BANK_MAX_ENTRIES 128
+#define SAMPLE_BANK_NAME_LENGTH 13 // 8.3 name plus terminator
+
+// Pitch heard at SDSP_PITCH_UNITY. Extracted samples carry no tuning; middle C is a
+// common convention and "brr sample" users can transpose from there.
+#define SAMPLE_BANK_ROOT_HZ 261.63f
+
+// SPC700 dump layout
+#define SPC_HEADER_BYTES 0x100
+#define SPC_RAM_BYTES 0x10000
+#define SPC_DSP_OFFSET (SPC_HEADER_BYTES + SPC_RAM_BYTES)
+#define SPC_DSP_DIR 0x5D // Sample directory page register
+
+// Mounts the card and indexes SAMPLE_BANK_DIR. Returns the number of samples found
+// (0 with no card). Safe to call again to rescan.
+int setupSampleBank();
+bool sdCardMounted(); // By the last setupSampleBank(); the WAV recorder writes to it too
+
+int sampleBankCount();
+const BrrSample* sampleBankAt(int index); // nullptr when out of range
+const char* sampleBankFileName(const BrrSample* sample); // File the sample comes from
+
+// Reads the first stream half of 'sample' ahead, for key ons to start from without an
+// SD access. Call when the sample is selected; built-in samples just drop the read-ahead.
+void sampleBankSelect(const BrrSample* sample);
+
+// Resets the one of 'voice's two streams it is not playing from and starts it with the
+// read-ahead of 'sample', so the old note can fade out from its own stream while the
+// key on waits. Never reads the card: serviceSampleBank() fills the rest (all of it for
+// a sample that was not selected). Returns nullptr for samples held in memory.
+BrrStream* sampleBankPrime(int voice, const BrrSample* sample);
+
+// Refills stream halves the audio update has finished with. Every loop() pass.
+void serviceSampleBank();
+
+// Blocks the audio update found missing, summed over all streams
+uint32_t sampleBankUnderruns();
+
+#endif // SAMPLE_BANK_H
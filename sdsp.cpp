@@ -0,0 +1,340 @@
+// sdsp.cpp
+// Implements the S-DSP style voice engine. BRR decoding, Gaussian interpolation and
+// the envelope steps follow the S-DSP's integer arithmetic. Output runs at the Teensy
+// audio rate: pitch counters are scaled to it, and envelopes are stepped whenever
+// a 32 kHz S-DSP sample has elapsed.
+
+#include "sdsp.h"
+#include <math.h>
+
+// S-DSP samples per output sample, 16.16 fixed point
+static const uint32_t DSP_CLOCK_STEP = (uint32_t)(SDSP_SAMPLE_RATE * 65536.0 / AUDIO_SAMPLE_RATE_EXACT);
+
+// Envelope rate periods in S-DSP samples (rate 0 = never steps)
+static const uint16_t envelopeRatePeriods[32] = {
+    0, 2048, 1536, 1280, 1024, 768, 640, 512, 384, 320, 256, 192, 160, 128, 96, 80,
+    64, 48, 40, 32, 24, 20, 16, 12, 10, 8, 6, 5, 4, 3, 2, 1
+};
+
+// Gaussian interpolation kernel, indexed like the S-DSP table: entry j weights a tap
+// (511 - j) / 256 samples from the interpolated point. Generated at start-up from a
+// Gaussian fitted to the hardware table (centre tap 1305/2048, four taps summing to
+// ~2048 at every offset) rather than copied bit for bit.
+static int16_t gaussTable[512];
+
+static inline int clamp16(int s) {
+    if (s > 32767) return 32767;
+    if (s < -32768) return -32768;
+    return s;
+}
+
+uint8_t brrDecodeBlock(const uint8_t* block, int16_t* out) {
+    uint8_t header = block[0];
+    int shift = header >> 4;
+    int filter = (header >> 2) & 0x03;
+
+    for (int i = 0; i < BRR_BLOCK_SAMPLES; i++) {
+        uint8_t byte = block[1 + (i >> 1)];
+        int s = (int)(int8_t)((i & 1) ? (byte << 4) : byte) >> 4; // Signed nibble, high first
+        s = (s * (1 << shift)) >> 1;
+        if (shift >= 13) s = (s < 0) ? -2048 : 0; // Invalid ranges on the hardware
+
+        int p1 = out[i - 1];
+        int p2 = out[i - 2] >> 1;
+        switch (filter) {
+            case 1: s += p1 >> 1; s += (-p1) >> 5; break;
+            case 2: s += p1; s -= p2; s += p2 >> 4; s += (p1 * -3) >> 6; break;
+            case 3: s += p1; s -= p2; s += (p1 * -13) >> 7; s += (p2 * 3) >> 4; break;
+            default: break;
+        }
+        out[i] = (int16_t)(clamp16(s) * 2); // 15-bit samples, stored doubled like the S-DSP
+    }
+    return header;
+}
+
+uint16_t sdspPitchFor(const BrrSample* sample, float hz) {
+    if (!sample || sample->rootHz <= 0.0f) return 0;
+    float pitch = hz / sample->rootHz * SDSP_PITCH_UNITY;
+    if (pitch > SDSP_PITCH_MAX) pitch = SDSP_PITCH_MAX;
+    if (pitch < 0.0f) pitch = 0.0f;
+    return (uint16_t)pitch;
+}
+
+static uint16_t outputStep(uint16_t pitch) {
+    return (uint16_t)(((uint32_t)pitch * DSP_CLOCK_STEP) >> 16);
+}
+
+AudioSynthSDsp::AudioSynthSDsp() : AudioStream(0, NULL) {
+    static bool tableReady = false;
+    if (!tableReady) {
+        for (int j = 0; j < 512; j++) {
+            float distance = (511 - j) / 256.0f;
+            gaussTable[j] = (int16_t)lroundf(1305.0f * expf(-1.258f * distance * distance));
+        }
+        tableReady = true;
+    }
+    for (int i = 0; i < SDSP_VOICES; i++) {
+        SDspVoice& v = voices[i];
+        v.sample = nullptr;
+        v.stream = nullptr;
+        v.blockOffset = 0;
+        v.header = 0;
+        for (int s = 0; s < 3 + BRR_BLOCK_SAMPLES; s++) v.decoded[s] = 0;
+        v.position = 0;
+        v.counter = 0;
+        v.pitch = SDSP_PITCH_UNITY;
+        v.step = outputStep(v.pitch);
+        v.ended = false;
+        v.adsr1 = 0x8F; // ADSR on, fastest attack, fastest decay
+        v.adsr2 = 0xE0; // Sustain at the top, held
+        v.gain = 0;
+        v.envelopeMode = SDSP_ENV_RELEASE;
+        v.envelope = 0;
+        v.volume = SDSP_DEFAULT_VOLUME;
+        v.volumeNow = SDSP_DEFAULT_VOLUME * 256;
+        v.fade = 0;
+        v.pendingSample = nullptr;
+        v.pendingStream = nullptr;
+        v.pendingPitch = SDSP_PITCH_UNITY;
+    }
+    rateCounter = 0;
+    dspClock = 0;
+}
+
+void AudioSynthSDsp::keyOn(int voice, const BrrSample* sample, float hz, BrrStream* stream) {
+    if (voice < 0 || voice >= SDSP_VOICES || !sample || sample->length < BRR_BLOCK_BYTES) return;
+    if (!sample->data && !stream) return;
+    uint16_t pitch = sdspPitchFor(sample, hz);
+    AudioNoInterrupts();
+    SDspVoice& v = voices[voice];
+    if (v.sample && v.envelope > 0) {
+        // Sounding: jumping the envelope to zero would click
+        v.pendingSample = sample;
+        v.pendingStream = stream;
+        v.pendingPitch = pitch;
+        if (!v.fade) v.fade = SDSP_FADE_SAMPLES;
+    } else {
+        start(v, sample, pitch, stream);
+    }
+    AudioInterrupts();
+}
+
+void AudioSynthSDsp::start(SDspVoice& v, const BrrSample* sample, uint16_t pitch, BrrStream* stream) {
+    v.sample = sample;
+    v.stream = sample->data ? nullptr : stream;
+    v.blockOffset = 0;
+    for (int s = 0; s < 3; s++) v.decoded[s] = 0;
+    decodeNext(v, v.stream ? brrStreamNextBlock(*v.stream) : sample->data);
+    v.position = 0;
+    v.counter = 0;
+    v.pitch = pitch;
+    v.step = outputStep(v.pitch);
+    v.ended = false;
+    v.envelope = 0;
+    v.envelopeMode = SDSP_ENV_ATTACK;
+    v.volumeNow = v.volume * 256; // From silence: nothing to glide
+    v.fade = 0;
+    v.pendingSample = nullptr;
+}
+
+void AudioSynthSDsp::keyOff(int voice) {
+    if (voice < 0 || voice >= SDSP_VOICES) return;
+    voices[voice].pendingSample = nullptr; // A fade in progress now just ends the voice
+    voices[voice].envelopeMode = SDSP_ENV_RELEASE;
+}
+
+void AudioSynthSDsp::setFrequency(int voice, float hz) {
+    if (voice < 0 || voice >= SDSP_VOICES || !voices[voice].sample) return;
+    SDspVoice& v = voices[voice];
+    AudioNoInterrupts();
+    if (v.pendingSample) {
+        v.pendingPitch = sdspPitchFor(v.pendingSample, hz); // Keep the fading note's pitch
+    } else {
+        v.pitch = sdspPitchFor(v.sample, hz);
+        v.step = outputStep(v.pitch);
+    }
+    AudioInterrupts();
+}
+
+void AudioSynthSDsp::setAdsr(int voice, uint8_t adsr1, uint8_t adsr2) {
+    if (voice < 0 || voice >= SDSP_VOICES) return;
+    voices[voice].adsr1 = adsr1;
+    voices[voice].adsr2 = adsr2;
+}
+
+void AudioSynthSDsp::setGain(int voice, uint8_t gain) {
+    if (voice < 0 || voice >= SDSP_VOICES) return;
+    voices[voice].gain = gain;
+}
+
+void AudioSynthSDsp::setVolume(int voice, int8_t volume) {
+    if (voice < 0 || voice >= SDSP_VOICES) return;
+    voices[voice].volume = volume;
+}
+
+bool AudioSynthSDsp::voiceActive(int voice) const {
+    if (voice < 0 || voice >= SDSP_VOICES) return false;
+    return voices[voice].sample != nullptr;
+}
+
+void AudioSynthSDsp::stepEnvelope(SDspVoice& v) {
+    int env = v.envelope;
+    if (v.envelopeMode == SDSP_ENV_RELEASE) {
+        env -= 8; // Fixed release: every sample, no rate
+        v.envelope = env < 0 ? 0 : env;
+        if (v.envelope == 0) v.sample = nullptr;
+        return;
+    }
+
+    int rate;
+    if (v.adsr1 & 0x80) {
+        if (v.envelopeMode == SDSP_ENV_ATTACK) {
+            rate = ((v.adsr1 & 0x0F) << 1) + 1;
+            env += (rate < 31) ? 0x20 : 0x400;
+        } else {
+            env--;
+            env -= env >> 8;
+            rate = (v.envelopeMode == SDSP_ENV_DECAY) ? (((v.adsr1 >> 4) & 0x07) << 1) + 16 : (v.adsr2 & 0x1F);
+        }
+        if (v.envelopeMode == SDSP_ENV_DECAY && (env >> 8) == (v.adsr2 >> 5)) v.envelopeMode = SDSP_ENV_SUSTAIN;
+    } else if (!(v.gain & 0x80)) {
+        env = (v.gain & 0x7F) << 4; // Direct
+        rate = 31;
+    } else {
+        rate = v.gain & 0x1F;
+        switch ((v.gain >> 5) & 0x03) {
+            case 0: env -= 0x20; break;                              // Linear decrease
+            case 1: env--; env -= env >> 8; break;                   // Exponential decrease
+            case 2: env += 0x20; break;                              // Linear increase
+            case 3: env += (v.envelope < 0x600) ? 0x20 : 0x08; break; // Bent increase
+        }
+    }
+
+    if (env > SDSP_ENVELOPE_MAX || env < 0) {
+        env = env < 0 ? 0 : SDSP_ENVELOPE_MAX;
+        if (v.envelopeMode == SDSP_ENV_ATTACK) v.envelopeMode = SDSP_ENV_DECAY;
+    }
+    // The hardware also offsets each rate's phase; a plain modulo keeps the periods
+    if (rate && rateCounter % envelopeRatePeriods[rate] == 0) v.envelope = env;
+}
+
+void AudioSynthSDsp::advance(SDspVoice& v) {
+    uint32_t counter = (uint32_t)v.counter + v.step;
+    uint32_t position = v.position + (counter >> 12);
+    v.counter = counter & 0x0FFF;
+
+    while (position >= BRR_BLOCK_SAMPLES) {
+        position -= BRR_BLOCK_SAMPLES;
+        // Keep the last three samples as interpolation and filter history
+        v.decoded[0] = v.decoded[BRR_BLOCK_SAMPLES];
+        v.decoded[1] = v.decoded[BRR_BLOCK_SAMPLES + 1];
+        v.decoded[2] = v.decoded[BRR_BLOCK_SAMPLES + 2];
+
+        uint32_t next = v.blockOffset + BRR_BLOCK_BYTES;
+        if (v.header & BRR_FLAG_END) {
+            if (!(v.header & BRR_FLAG_LOOP)) {
+                // One-shot finished: the S-DSP silences the voice at once
+                v.ended = true;
+                v.envelope = 0;
+                v.envelopeMode = SDSP_ENV_RELEASE;
+                v.sample = nullptr;
+                return;
+            }
+            next = v.sample->loopOffset;
+        }
+        if (v.stream) {
+            decodeNext(v, brrStreamNextBlock(*v.stream)); // Already in playback order
+        } else {
+            if (next + BRR_BLOCK_BYTES > v.sample->length) next = 0;
+            v.blockOffset = next;
+            decodeNext(v, v.sample->data + next);
+        }
+    }
+    v.position = (uint8_t)position;
+}
+
+void AudioSynthSDsp::decodeNext(SDspVoice& v, const uint8_t* block) {
+    if (block) {
+        v.header = brrDecodeBlock(block, v.decoded + 3);
+        return;
+    }
+    // Stream underrun: a block of silence, then carry on with whatever arrives
+    for (int s = 0; s < BRR_BLOCK_SAMPLES; s++) v.decoded[3 + s] = 0;
+    v.header = 0;
+}
+
+const uint8_t* brrStreamNextBlock(BrrStream& stream) {
+    if (stream.readBlock >= stream.count[stream.readHalf]) {
+        if (stream.count[stream.readHalf]) {
+            // Finished with this half: hand it back to the filler
+            stream.count[stream.readHalf] = 0;
+            stream.readHalf ^= 1;
+            stream.readBlock = 0;
+        }
+        if (stream.count[stream.readHalf] == 0) {
+            stream.underruns = stream.underruns + 1;
+            return nullptr;
+        }
+    }
+    return &stream.blocks[stream.readHalf][BRR_BLOCK_BYTES * stream.readBlock++];
+}
+
+int AudioSynthSDsp::interpolate(const SDspVoice& v) const {
+    int offset = (v.counter >> 4) & 0xFF;
+    const int16_t* p = v.decoded + v.position; // p[0] oldest .. p[3] newest
+    int out = (gaussTable[255 - offset] * p[0]) >> 11;
+    out += (gaussTable[511 - offset] * p[1]) >> 11;
+    out += (gaussTable[256 + offset] * p[2]) >> 11;
+    out = (int16_t)out; // The hardware wraps here before the last tap
+    out += (gaussTable[offset] * p[3]) >> 11;
+    return clamp16(out) & ~1;
+}
+
+bool AudioSynthSDsp::isActive() const {
+    for (int i = 0; i < SDSP_VOICES; i++) {
+        if (voices[i].sample) return true;
+    }
+    return false;
+}
+
+bool AudioSynthSDsp::renderBlock(int16_t* out) {
+    if (!isActive()) return false;
+
+    for (int n = 0; n < AUDIO_BLOCK_SAMPLES; n++) {
+        dspClock += DSP_CLOCK_STEP;
+        uint32_t dspTicks = dspClock >> 16;
+        dspClock &= 0xFFFF;
+
+        int mix = 0;
+        for (int i = 0; i < SDSP_VOICES; i++) {
+            SDspVoice& v = voices[i];
+            if (!v.sample) continue;
+            for (uint32_t t = 0; t < dspTicks && v.sample; t++) stepEnvelope(v);
+            // Ended on its own before the fade finished: the pending key on starts now
+            if (!v.sample && v.pendingSample) start(v, v.pendingSample, v.pendingPitch, v.pendingStream);
+            if (!v.sample) continue;
+            int sample = (interpolate(v) * v.envelope) >> 11;
+            if (v.fade) sample = sample * v.fade / SDSP_FADE_SAMPLES;
+            v.volumeNow += (v.volume * 256 - v.volumeNow) >> SDSP_VOLUME_SLEW_SHIFT;
+            mix += (sample * v.volumeNow) >> 15;
+            if (v.fade && --v.fade == 0) {
+                // Faded to silence: start the pending key on, or free the voice
+                if (v.pendingSample) start(v, v.pendingSample, v.pendingPitch, v.pendingStream);
+                else v.sample = nullptr;
+            } else {
+                advance(v);
+            }
+        }
+        rateCounter += dspTicks;
+        out[n] = (int16_t)clamp16(mix);
+    }
+    return true;
+}
+
+void AudioSynthSDsp::update(void) {
+    if (!isActive()) return; // No voice keyed on: no block allocated
+    audio_block_t* block = allocate();
+    if (!block) return;
+    if (renderBlock(block->data)) transmit(block);
+    release(block);
+}
@@ -0,0 +1,132 @@
+// sdsp.h
+// SNES S-DSP style sample voices: BRR blocks are decoded on the fly from flash (16
+// samples at a time, no expanded PCM in RAM), resampled with the S-DSP's 4-point
+// Gaussian interpolation from a 14-bit pitch register, and shaped by ADSR or GAIN
+// envelopes stepped at the S-DSP's 32 kHz rate. Selected with "engine brr".
+
+#ifndef SDSP_H
+#define SDSP_H
+
+#include <Audio.h>
+#include <stdint.h>
+
+#define SDSP_VOICES 8
+#define SDSP_SAMPLE_RATE 32000
+#define SDSP_PITCH_UNITY 0x1000 // One BRR sample per S-DSP sample
+#define SDSP_PITCH_MAX 0x3FFF   // 14-bit pitch register
+#define SDSP_ENVELOPE_MAX 0x7FF
+#define SDSP_DEFAULT_VOLUME 100
+#define SDSP_VOLUME_SLEW_SHIFT 5 // Volume changes glide in over ~32 output samples
+#define SDSP_FADE_SAMPLES 64    // Output samples (~1.5 ms) to fade a sounding voice before a key on
+
+#define BRR_BLOCK_BYTES 9
+#define BRR_BLOCK_SAMPLES 16
+#define BRR_FLAG_END 0x01
+#define BRR_FLAG_LOOP 0x02
+
+struct BrrSample {
+    const char* name;
+    const uint8_t* data;  // BRR blocks (flash); the final block carries BRR_FLAG_END.
+                          // nullptr for SD bank samples, which play through a BrrStream
+    uint32_t length;      // Bytes, a multiple of BRR_BLOCK_BYTES
+    uint32_t loopOffset;  // Byte offset of the block to loop to when the end block has BRR_FLAG_LOOP
+    float rootHz;         // Pitch heard at SDSP_PITCH_UNITY
+};
+
+// Built-in single-cycle samples (brr_samples.cpp)
+extern const BrrSample brrBuiltinSamples[];
+extern const int NUM_BRR_BUILTIN_SAMPLES;
+
+// Sample directory used by "brr sample <n>": the built-ins, then the SD card bank
+// (sample_bank.h). Out-of-range indices clamp.
+int brrSampleCount();
+const BrrSample* brrSampleAt(int index);
+
+// Double-buffered block source for samples that are not in memory (sample_bank.h).
+// The audio update consumes one half while the main loop refills the other; blocks
+// arrive already in playback order, with loop jumps resolved by the filler.
+#define BRR_STREAM_HALF_BLOCKS 32
+
+struct BrrStream {
+    uint8_t blocks[2][BRR_STREAM_HALF_BLOCKS * BRR_BLOCK_BYTES];
+    volatile uint8_t count[2]; // Blocks in each half; 0 = free for the filler
+    uint8_t readHalf;          // Audio side
+    uint8_t readBlock;
+    volatile uint32_t underruns;
+};
+
+// Next block for the audio update, or nullptr when the filler has fallen behind
+const uint8_t* brrStreamNextBlock(BrrStream& stream);
+
+enum SDspEnvelopeMode {
+    SDSP_ENV_RELEASE,
+    SDSP_ENV_ATTACK,
+    SDSP_ENV_DECAY,
+    SDSP_ENV_SUSTAIN
+};
+
+struct SDspVoice {
+    const BrrSample* sample;     // nullptr = voice off
+    BrrStream* stream;           // Block source when sample->data is nullptr
+    uint32_t blockOffset;        // Byte offset of the block in 'decoded' (in-memory samples)
+    uint8_t header;              // Header byte of the block in 'decoded'
+    int16_t decoded[3 + BRR_BLOCK_SAMPLES]; // Last 3 samples of the previous block, then this block
+    uint8_t position;            // Sample index within the block (0-15)
+    uint16_t counter;            // Pitch counter: 12 fractional bits per sample
+    uint16_t pitch;              // 14-bit pitch register
+    uint16_t step;               // Pitch scaled to the output rate
+    bool ended;                  // Played an end block without the loop flag
+    // Envelope registers as on the S-DSP
+    uint8_t adsr1, adsr2, gain;
+    uint8_t envelopeMode;        // SDspEnvelopeMode
+    int envelope;                // 0..SDSP_ENVELOPE_MAX
+    int8_t volume;               // -128..127
+    int32_t volumeNow;           // Volume being applied, << 8; slews towards 'volume' per sample
+    // Key on that arrived while the voice sounded: applied when 'fade' reaches zero
+    uint8_t fade;
+    const BrrSample* pendingSample; // nullptr = just fade out (keyed off meanwhile)
+    BrrStream* pendingStream;
+    uint16_t pendingPitch;
+};
+
+// Decodes one 9-byte BRR block into out[0..15]. out[-1] and out[-2] must hold the
+// two previous samples (the filter history). Returns the block's header byte.
+uint8_t brrDecodeBlock(const uint8_t* block, int16_t* out);
+
+class AudioSynthSDsp : public AudioStream {
+public:
+    AudioSynthSDsp();
+
+    // Streamed samples (no data pointer) need a primed stream. Unlike the hardware, a
+    // key on while the voice sounds fades it out over SDSP_FADE_SAMPLES first.
+    void keyOn(int voice, const BrrSample* sample, float hz, BrrStream* stream = nullptr);
+    void keyOff(int voice);
+    void setFrequency(int voice, float hz);
+    void setAdsr(int voice, uint8_t adsr1, uint8_t adsr2); // adsr1 bit 7 enables ADSR
+    void setGain(int voice, uint8_t gain);                 // Used while ADSR is disabled
+    void setVolume(int voice, int8_t volume);
+    bool voiceActive(int voice) const; // Keyed on, or still releasing
+    bool isActive() const;             // Any voice active
+    const SDspVoice& voiceState(int voice) const { return voices[voice]; }
+
+    // Renders one output block (AUDIO_SAMPLE_RATE_EXACT) of every active voice. Called
+    // by update(); public for host tests and benchmarks. Returns false when silent.
+    bool renderBlock(int16_t* out);
+    virtual void update(void);
+
+private:
+    void stepEnvelope(SDspVoice& v);
+    void advance(SDspVoice& v);
+    void decodeNext(SDspVoice& v, const uint8_t* block);
+    void start(SDspVoice& v, const BrrSample* sample, uint16_t pitch, BrrStream* stream);
+    int interpolate(const SDspVoice& v) const;
+
+    SDspVoice voices[SDSP_VOICES];
+    uint32_t rateCounter;  // S-DSP samples since start, drives the envelope rates
+    uint32_t dspClock;     // 16.16 fraction of an S-DSP sample per output sample
+};
+
+// Pitch register value that plays 'sample' at 'hz'
+uint16_t sdspPitchFor(const BrrSample* sample, float hz);
+
+#endif // SDSP_H
@@ -0,0 +1,404 @@
+// smf_player.cpp
+// Implements the backing track player: the SMF parser, the loop cursor and the note
+// routing to spare voices and MIDI out. Position is kept in 16.16 fixed-point file
+// ticks so the per-tick fraction never drifts.
+
+#include "smf_player.h"
+#include "voice_manager.h"
+#include "control_tick.h"
+#include "sample_bank.h"
+#include "midi.h"
+#include "debug.h"
+#include <SD.h>
+#include <string.h>
+
+#define SMF_DEFAULT_US_PER_QUARTER 500000 // 120 BPM when the file has no tempo
+#define MIDI_CLOCKS_PER_QUARTER 24
+
+struct SmfTempo {
+    uint32_t tick;
+    uint32_t usPerQuarter;
+};
+
+// One bar of boogie bass on C, division 96: running status with velocity-0 note-offs
+static const uint8_t smfDemo[] PROGMEM = {
+    'M', 'T', 'h', 'd', 0x00, 0x00, 0x00, 0x06, 0x00, 0x00, 0x00, 0x01, 0x00, 0x60,
+    'M', 'T', 'r', 'k', 0x00, 0x00, 0x00, 0x3C,
+    0x00, 0xFF, 0x51, 0x03, 0x07, 0xA1, 0x20, 0x00, 0x90, 0x24, 0x64, 0x28, 0x24, 0x00,
+    0x08, 0x28, 0x64, 0x28, 0x28, 0x00, 0x08, 0x2B, 0x64, 0x28, 0x2B, 0x00, 0x08, 0x2D,
+    0x64, 0x28, 0x2D, 0x00, 0x08, 0x2E, 0x64, 0x28, 0x2E, 0x00, 0x08, 0x2D, 0x64, 0x28,
+    0x2D, 0x00, 0x08, 0x2B, 0x64, 0x28, 0x2B, 0x00, 0x08, 0x28, 0x64, 0x28, 0x28, 0x00,
+    0x08, 0xFF, 0x2F, 0x00,
+};
+
+// Parsed song
+static SmfEvent events[SMF_MAX_EVENTS];
+static int numEvents = 0;
+static SmfTempo tempos[SMF_MAX_TEMPOS];
+static int numTempos = 0;
+static uint16_t division = 96;
+static uint32_t lengthTicks = 0;
+static char songName[SMF_NAME_LENGTH] = "";
+DMAMEM static uint8_t loadBuffer[SMF_MAX_FILE_BYTES];
+
+// Playback
+static bool playing = false;
+static bool clockStopped = false; // MIDI Stop until the next Start
+static uint8_t outputs = SMF_OUT_VOICES;
+static uint64_t positionQ16 = 0;
+static uint64_t clockAnchorQ16 = 0; // Position of the last MIDI clock
+static int cursor = 0;
+static uint16_t backingKey[NUM_VOICES]; // ((channel << 7) | note) + 1 sounding on a voice, 0 = none
+static uint8_t midiHeld[16][128 / 8];   // Notes sent to MIDI out and not yet released
+
+static uint32_t readBe32(const uint8_t* bytes) {
+    return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | bytes[3];
+}
+
+static uint16_t readBe16(const uint8_t* bytes) {
+    return (uint16_t)((bytes[0] << 8) | bytes[1]);
+}
+
+static bool readVariableLength(const uint8_t*& p, const uint8_t* end, uint32_t& value) {
+    value = 0;
+    for (int i = 0; i < 4; i++) {
+        if (p >= end) return false;
+        uint8_t byte = *p++;
+        value = (value << 7) | (byte & 0x7F);
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+// Ticks first; at the same tick note-offs before note-ons, so a repeated note restarts
+static bool eventBefore(const SmfEvent& a, const SmfEvent& b) {
+    if (a.tick != b.tick) return a.tick < b.tick;
+    return (a.status & 0xF0) == 0x80 && (b.status & 0xF0) == 0x90;
+}
+
+// Insertion sort: each track is already in order, so the merge only moves the
+// interleaved events. Runs once at load.
+static void sortEvents() {
+    for (int i = 1; i < numEvents; i++) {
+        SmfEvent event = events[i];
+        int j = i;
+        while (j > 0 && eventBefore(event, events[j - 1])) {
+            events[j] = events[j - 1];
+            j--;
+        }
+        events[j] = event;
+    }
+    for (int i = 1; i < numTempos; i++) {
+        SmfTempo tempo = tempos[i];
+        int j = i;
+        while (j > 0 && tempo.tick < tempos[j - 1].tick) {
+            tempos[j] = tempos[j - 1];
+            j--;
+        }
+        tempos[j] = tempo;
+    }
+}
+
+static bool parseTrack(const uint8_t* p, const uint8_t* end) {
+    uint32_t tick = 0;
+    uint8_t runningStatus = 0;
+    while (p < end) {
+        uint32_t delta;
+        if (!readVariableLength(p, end, delta) || p >= end) return false;
+        tick += delta;
+        uint8_t byte = *p;
+
+        if (byte == 0xFF) { // Meta event
+            if (end - p < 2) return false;
+            uint8_t type = p[1];
+            p += 2;
+            uint32_t length;
+            if (!readVariableLength(p, end, length) || length > (uint32_t)(end - p)) return false;
+            if (type == 0x51 && length == 3 && numTempos < SMF_MAX_TEMPOS) {
+                tempos[numTempos].tick = tick;
+                tempos[numTempos].usPerQuarter = ((uint32_t)p[0] << 16) | (p[1] << 8) | p[2];
+                numTempos++;
+            }
+            p += length;
+            if (type == 0x2F) break; // End of track
+            continue;
+        }
+        if (byte == 0xF0 || byte == 0xF7) { // SysEx: skipped, and it cancels running status
+            p++;
+            uint32_t length;
+            if (!readVariableLength(p, end, length) || length > (uint32_t)(end - p)) return false;
+            p += length;
+            runningStatus = 0;
+            continue;
+        }
+
+        uint8_t status = runningStatus;
+        if (byte & 0x80) {
+            status = byte;
+            runningStatus = byte;
+            p++;
+        }
+        if (status < 0x80) return false; // Data byte with no running status
+        uint8_t type = status & 0xF0;
+        int dataBytes = (type == 0xC0 || type == 0xD0) ? 1 : 2;
+        if (end - p < dataBytes) return false;
+        if ((type == 0x80 || type == 0x90) && numEvents < SMF_MAX_EVENTS) {
+            SmfEvent& event = events[numEvents++];
+            event.tick = tick;
+            event.note = p[0] & 0x7F;
+            event.velocity = p[1] & 0x7F;
+            event.status = (type == 0x90 && event.velocity > 0) ? status : (uint8_t)(0x80 | (status & 0x0F));
+        }
+        p += dataBytes;
+    }
+    if (tick > lengthTicks) lengthTicks = tick;
+    return true;
+}
+
+int loadSmf(const uint8_t* data, uint32_t length, const char* name) {
+    stopSmf();
+    numEvents = 0;
+    numTempos = 0;
+    lengthTicks = 0;
+    songName[0] = '\0';
+
+    if (length < 14 || memcmp(data, "MThd", 4) != 0) return -1;
+    uint32_t headerLength = readBe32(data + 4);
+    uint16_t tracks = readBe16(data + 10);
+    division = readBe16(data + 12);
+    if (headerLength < 6 || headerLength > length - 8 || division == 0 || (division & 0x8000)) {
+        DEBUG_WARNING(CAT_MIDI, "SMF: unsupported header (SMPTE time is not supported)");
+        return -1;
+    }
+
+    const uint8_t* p = data + 8 + headerLength;
+    const uint8_t* end = data + length;
+    int parsedTracks = 0;
+    while (end - p >= 8 && parsedTracks < tracks && parsedTracks < SMF_MAX_TRACKS) {
+        uint32_t chunkLength = readBe32(p + 4);
+        const uint8_t* chunk = p + 8;
+        if (chunkLength > (uint32_t)(end - chunk)) chunkLength = (uint32_t)(end - chunk); // Truncated file
+        if (memcmp(p, "MTrk", 4) == 0) {
+            if (!parseTrack(chunk, chunk + chunkLength)) {
+                DEBUG_WARNING(CAT_MIDI, "SMF: malformed track %d", parsedTracks);
+                numEvents = 0;
+                return -1;
+            }
+            parsedTracks++;
+        }
+        p = chunk + chunkLength;
+    }
+    if (numEvents == SMF_MAX_EVENTS) DEBUG_WARNING(CAT_MIDI, "SMF: only the first %d notes were kept", SMF_MAX_EVENTS);
+    if (numTempos == 0) {
+        tempos[0].tick = 0;
+        tempos[0].usPerQuarter = SMF_DEFAULT_US_PER_QUARTER;
+        numTempos = 1;
+    }
+    sortEvents();
+    if (numEvents > 0 && events[numEvents - 1].tick >= lengthTicks) lengthTicks = events[numEvents - 1].tick + 1;
+    strncpy(songName, name, SMF_NAME_LENGTH - 1);
+    songName[SMF_NAME_LENGTH - 1] = '\0';
+    DEBUG_INFO(CAT_MIDI, "SMF %s: %d notes, %d track(s), %lu ticks at %u/quarter",
+               songName, numEvents, parsedTracks, (unsigned long)lengthTicks, division);
+    return numEvents;
+}
+
+int loadSmfFromSd(const char* fileName) {
+    if (!sdCardMounted()) return -1;
+    File file = SD.open(fileName);
+    if (!file || file.isDirectory()) return -1;
+    uint32_t size = (uint32_t)file.size();
+    if (size > SMF_MAX_FILE_BYTES) {
+        DEBUG_WARNING(CAT_MIDI, "SMF %s is larger than %d bytes", fileName, SMF_MAX_FILE_BYTES);
+        file.close();
+        return -1;
+    }
+    int read = file.read(loadBuffer, size);
+    file.close();
+    if (read != (int)size) return -1;
+    return loadSmf(loadBuffer, size, fileName);
+}
+
+int loadSmfDemo() {
+    return loadSmf(smfDemo, sizeof(smfDemo), "demo");
+}
+
+// --- Note routing ---
+
+// A silent spare voice, else one still releasing, else the oldest backing voice. Voice 0
+// (the lead) and voices the player holds are never taken; -1 drops the note.
+static int backingVoice() {
+    for (int v = NUM_VOICES - 1; v >= 1; v--) {
+        if (voices.envPhase[v] == ENV_IDLE) return v;
+    }
+    for (int v = NUM_VOICES - 1; v >= 1; v--) {
+        if (voices.envPhase[v] == ENV_RELEASE) return v;
+    }
+    int oldest = -1;
+    for (int v = NUM_VOICES - 1; v >= 1; v--) {
+        if (voices.owner[v] == OWNER_BACKING && (oldest < 0 || voices.age[v] < voices.age[oldest])) oldest = v;
+    }
+    return oldest;
+}
+
+static void startBackingNote(SynthState& state, uint16_t key, uint8_t note) {
+    int voice = backingVoice();
+    if (voice < 0) return;
+    playNote(state, voice, note, OWNER_BACKING);
+    backingKey[voice] = key;
+}
+
+static void stopBackingNote(uint16_t key) {
+    for (int v = 0; v < NUM_VOICES; v++) {
+        if (backingKey[v] != key) continue;
+        backingKey[v] = 0;
+        if (voices.owner[v] == OWNER_BACKING && voiceActive(v)) stopNote(v);
+    }
+}
+
+static void sendEvent(SynthState& state, const SmfEvent& event) {
+    uint8_t channel = event.status & 0x0F;
+    bool on = (event.status & 0xF0) == 0x90;
+    uint8_t mask = 1 << (event.note & 7);
+    if (outputs & SMF_OUT_MIDI) {
+        if (on) {
+            sendMidiNoteOn(event.note, event.velocity, channel + 1);
+            midiHeld[channel][event.note >> 3] |= mask;
+        } else {
+            sendMidiNoteOff(event.note, 0, channel + 1);
+            midiHeld[channel][event.note >> 3] &= ~mask;
+        }
+    }
+    if (outputs & SMF_OUT_VOICES) {
+        uint16_t key = (uint16_t)(((channel << 7) | event.note) + 1);
+        if (on) startBackingNote(state, key, event.note);
+        else stopBackingNote(key);
+    }
+}
+
+static void releaseAllNotes() {
+    for (int v = 0; v < NUM_VOICES; v++) {
+        if (backingKey[v]) stopBackingNote(backingKey[v]);
+    }
+    for (int channel = 0; channel < 16; channel++) {
+        for (int note = 0; note < 128; note++) {
+            if (midiHeld[channel][note >> 3] & (1 << (note & 7))) sendMidiNoteOff(note, 0, channel + 1);
+        }
+    }
+    memset(midiHeld, 0, sizeof(midiHeld));
+}
+
+static void rewind() {
+    positionQ16 = 0;
+    clockAnchorQ16 = 0;
+    cursor = 0;
+}
+
+void playSmf() {
+    if (numEvents == 0) return;
+    releaseAllNotes();
+    rewind();
+    clockStopped = false;
+    playing = true;
+}
+
+void stopSmf() {
+    if (!playing) return;
+    playing = false;
+    releaseAllNotes();
+}
+
+bool smfPlaying() {
+    return playing;
+}
+
+void setSmfOutput(uint8_t newOutputs) {
+    if (newOutputs == outputs) return;
+    releaseAllNotes(); // Offs must go where their ons went
+    outputs = newOutputs & SMF_OUT_BOTH;
+}
+
+uint8_t smfOutput() {
+    return outputs;
+}
+
+// --- Transport ---
+
+static uint64_t clockStepQ16() {
+    return ((uint64_t)division << 16) / MIDI_CLOCKS_PER_QUARTER;
+}
+
+void smfClockStart() {
+    if (!playing) return;
+    releaseAllNotes();
+    rewind();
+    clockStopped = false;
+}
+
+static bool clockLocked(const SynthState& state) {
+    return state.midiSyncEnabled && state.tempoEstablished && state.usPerMidiTick > 0.0f;
+}
+
+void smfClockTick(const SynthState& state) {
+    if (!playing || clockStopped || !clockLocked(state)) return;
+    clockAnchorQ16 += clockStepQ16();
+    if (positionQ16 < clockAnchorQ16) positionQ16 = clockAnchorQ16; // Running late: catch up
+}
+
+void smfClockStop() {
+    if (!playing) return;
+    clockStopped = true;
+    releaseAllNotes();
+}
+
+static float usPerQuarterAt(const SynthState& state, uint32_t tick) {
+    if (state.tempoEstablished && state.usPerMidiTick > 0.0f) return state.usPerMidiTick * MIDI_CLOCKS_PER_QUARTER;
+    uint32_t usPerQuarter = tempos[0].usPerQuarter;
+    for (int i = 1; i < numTempos && tempos[i].tick <= tick; i++) usPerQuarter = tempos[i].usPerQuarter;
+    return (float)usPerQuarter;
+}
+
+void updateSmfPlayer(SynthState& state) {
+    if (!playing || clockStopped) return;
+    uint32_t tick = (uint32_t)(positionQ16 >> 16);
+    float ticksPerTick = CONTROL_TICK_US * division / usPerQuarterAt(state, tick);
+    positionQ16 += (uint64_t)(ticksPerTick * 65536.0f);
+    if (clockLocked(state)) {
+        // Between clocks, never run past where the next one will put us
+        uint64_t limit = clockAnchorQ16 + clockStepQ16();
+        if (positionQ16 > limit) positionQ16 = limit;
+    } else {
+        clockAnchorQ16 = positionQ16;
+    }
+
+    tick = (uint32_t)(positionQ16 >> 16);
+    while (cursor < numEvents && events[cursor].tick <= tick) sendEvent(state, events[cursor++]);
+    if (tick >= lengthTicks) {
+        uint64_t loopQ16 = (uint64_t)lengthTicks << 16;
+        positionQ16 -= loopQ16;
+        clockAnchorQ16 = clockAnchorQ16 > loopQ16 ? clockAnchorQ16 - loopQ16 : 0;
+        cursor = 0;
+        tick = (uint32_t)(positionQ16 >> 16);
+        while (cursor < numEvents && events[cursor].tick <= tick) sendEvent(state, events[cursor++]);
+    }
+}
+
+const char* smfName() {
+    return songName;
+}
+
+int smfEventCount() {
+    return numEvents;
+}
+
+uint16_t smfDivision() {
+    return division;
+}
+
+uint32_t smfLengthTicks() {
+    return lengthTicks;
+}
+
+uint32_t smfPositionTicks() {
+    return (uint32_t)(positionQ16 >> 16);
+}
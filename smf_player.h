@@ -0,0 +1,61 @@
+// smf_player.h
+// Plays a Standard MIDI File as a looping backing track. Loading parses the whole file
+// once (any format, running status, tempo meta events) into a tick-sorted note array;
+// playback is a cursor over that array, advanced once per control tick. While a MIDI
+// clock tempo is locked (the Boogie tempo source) playback follows the clock tick by
+// tick; without one it runs at the file's own tempo map.
+
+#ifndef SMF_PLAYER_H
+#define SMF_PLAYER_H
+
+#include <Arduino.h>
+#include "synth_state.h"
+
+#define SMF_MAX_FILE_BYTES 16384  // Load buffer for files from the SD card
+#define SMF_MAX_EVENTS 4096       // Note on/off events kept after parsing
+#define SMF_MAX_TEMPOS 32         // Tempo map entries
+#define SMF_MAX_TRACKS 16
+#define SMF_NAME_LENGTH 13
+
+// Note events only: what the internal voices and the MIDI out path can use
+struct SmfEvent {
+    uint32_t tick;
+    uint8_t status; // 0x8n / 0x9n (velocity 0 note-ons become 0x8n)
+    uint8_t note;
+    uint8_t velocity;
+};
+
+enum SmfOutput {
+    SMF_OUT_VOICES = 1, // Spare internal voices (never voice 0, the lead)
+    SMF_OUT_MIDI = 2,   // USB MIDI out
+    SMF_OUT_BOTH = 3
+};
+
+// Parses 'data' (flash or the load buffer) and replaces the loaded song. Returns the
+// number of note events, or -1 if the file is not a usable SMF (nothing is loaded then).
+int loadSmf(const uint8_t* data, uint32_t length, const char* name);
+int loadSmfFromSd(const char* fileName); // From the card's root
+int loadSmfDemo();                       // Built-in one-bar boogie bass line
+
+void playSmf();  // From the top, looping
+void stopSmf();  // Releases every note it holds
+bool smfPlaying();
+void setSmfOutput(uint8_t outputs);
+uint8_t smfOutput();
+
+// MIDI transport: Start rewinds a playing song onto the downbeat, each Clock pins the
+// position to the clock once its tempo is locked, Stop silences it until the next Start
+void smfClockStart();
+void smfClockTick(const SynthState& state);
+void smfClockStop();
+
+// Advances the cursor and sends the due events. Once per control tick.
+void updateSmfPlayer(SynthState& state);
+
+const char* smfName();      // "" with nothing loaded
+int smfEventCount();
+uint16_t smfDivision();
+uint32_t smfLengthTicks();
+uint32_t smfPositionTicks();
+
+#endif // SMF_PLAYER_H
@@ -5,6 +5,8 @@
 #include "synth.h"
 #include "audio.h"
 #include "debug.h"
+#include "controller.h"
+#include "change_queue.h"
 #include <Arduino.h>
 
 // Global scale definitions
@@ -49,15 +51,21 @@ void initializeSynthState(SynthState& state) {
         state.pressed[i] = 0;
         state.released[i] = 0;
     }
-    // Initialize last pressed buffer (e.g., with -1)
-    for (int i = 0; i < LAST_PRESS_BUFFER_SIZE; ++i) {
-        state.lastPressedBuffer[i] = -1;
-    }
-    state.lastPressedIndex = 0;
+    resetHeldOrder(state);
+    resetChangeQueue();
+    state.notePriority = PRIORITY_LAST;
     
     // Initialize MIDI sync and rhythmic mode
     state.midiSyncEnabled = false;
     state.boogieModeEnabled = false; // Start with Boogie OFF by default
+    state.drumsEnabled = false;
+    state.voiceEngine = 0; // Oscillators
+    state.brrSampleIndex = 0;
+    state.echoEnabled = false;
+    state.echoVolume = 48;
+    state.echoFeedback = 64;
+    state.echoSyncTicks = 6; // A 16th note
+    state.echoDelayMs = 120;
     state.rhythmicModeEnabled = false; // Start with Rhythmic OFF by default
     
     // Boogie State Init
@@ -5,14 +5,17 @@
 #include <stdint.h>
 
 #define MAX_NOTE_BUTTONS 10
-#define LAST_PRESS_BUFFER_SIZE 8 // Remember last 8 presses
 #define MIDI_TICK_BUFFER_SIZE 8 // KEEP for initial averaging window if needed?
                                    // Let's reuse buffer but define sample count separately
 #define NUM_SAMPLES_FOR_LOCK 24 // Number of ticks to sample before locking tempo
+#define MIN_LOCKED_US_PER_TICK 6250.0f   // Fastest lockable tempo: 400 BPM at 24 PPQN
+#define MAX_LOCKED_US_PER_TICK 125000.0f // Slowest lockable tempo: 20 BPM at 24 PPQN
 
 // Mapping Profiles
 #define PROFILE_SCALE 0
 #define PROFILE_THUNDERSTRUCK 1
+#define PROFILE_RIFF 2          // Buttons step through a riff (riff.h)
+#define NUM_MAPPING_PROFILES 3
 
 // Play styles
 enum PlayStyle {
@@ -21,6 +24,14 @@ enum PlayStyle {
     CHORD_BUTTON
 };
 
+// Which held note button sounds (mono, Boogie) or picks the chord
+enum NotePriority {
+    PRIORITY_LAST,    // Most recently pressed
+    PRIORITY_LOWEST,  // Lowest musical position
+    PRIORITY_HIGHEST, // Highest musical position
+    NUM_NOTE_PRIORITIES
+};
+
 struct SynthState {
     // Controller state
     short snesRegister = 32767;
@@ -32,8 +43,13 @@ struct SynthState {
     bool prevHeld[12] = {0};
     uint8_t pressed[12] = {0};
     uint8_t released[12] = {0};
-    int lastPressedBuffer[LAST_PRESS_BUFFER_SIZE];
-    int lastPressedIndex = 0;
+    // Held note buttons in press order, newest first: an intrusive list through
+    // heldOlder/heldNewer (-1 ends it), kept by processButtonEdges()
+    int8_t heldNewest = -1;
+    int8_t heldOlder[MAX_NOTE_BUTTONS];
+    int8_t heldNewer[MAX_NOTE_BUTTONS];
+    uint16_t heldPositions = 0; // Bit per musical position of each held note button
+    int notePriority = PRIORITY_LAST;
     
     // Synth state
     int baseNote = 60;  // Middle C
@@ -43,10 +59,6 @@ struct SynthState {
     bool needsScaleUpdate = true;
     int scaleHolder[12];  // Computed scale notes
     
-    // Voice tracking
-    bool voiceActive[4] = {0};  // Track which voices are active
-    int voiceToNote[4] = {-1};  // Which note each voice is playing
-    
     // Play style
     PlayStyle playStyle = MONOPHONIC;
     int chordProfile = 0;  // Current chord type (major, minor, etc.)
@@ -54,7 +66,7 @@ struct SynthState {
     int currentWaveform = 0; // 0: Sine, 1: Saw, 2: Square, 3: Triangle
     int vibratoRate = 1;     // Default to 5Hz (Index 1)
     int vibratoDepth = 2;    // Default to Medium (Index 2)
-    int customProfileIndex = PROFILE_SCALE; // 0=Scale, 1=Thunderstruck, etc.
+    int customProfileIndex = PROFILE_SCALE; // 0=Scale, 1=Thunderstruck, 2=Riff
 
     // MIDI and pitch control
     int pitchBend = 0;
@@ -63,10 +75,7 @@ struct SynthState {
     int currentButton = -1;
     float currentFrequency = 0.0;
     
-    // Chord state
-    int currentChordNotes[4] = {-1, -1, -1, -1};
-    float currentChordFrequencies[4] = {0.0, 0.0, 0.0, 0.0};
-    bool waveformOpen[4] = {1, 1, 1, 1};  // 1 = open (no sound), 0 = closed (playing)
+    // Chord voices and per-voice notes are tracked by the VoiceManager (voice_manager.h)
     
     // Additional state
     int arpeggioOffset = 0;
@@ -80,6 +89,14 @@ struct SynthState {
     bool tempoEstablished = false;      // Has a tempo ever been set by the MIDI clock?
     bool boogieModeEnabled = false;     // Is Boogie mode selected?
     bool rhythmicModeEnabled = false;   // Is Rhythmic mode selected?
+    bool drumsEnabled = false;          // Boogie/Rhythmic onsets also trigger the drum kit
+    int voiceEngine = 0;                // VoiceEngine for new notes (0 = oscillator, 1 = S-DSP BRR)
+    int brrSampleIndex = 0;             // brrSampleAt() index played by S-DSP voices
+    bool echoEnabled = false;           // S-DSP style master echo (echo.h)
+    int echoVolume = 48;                // EVOL, -128..127
+    int echoFeedback = 64;              // EFB, -128..127
+    int echoSyncTicks = 6;              // Delay in MIDI clock ticks while a tempo is known (0 = use echoDelayMs)
+    int echoDelayMs = 120;              // Free-running delay, 1..ECHO_MAX_MS
     unsigned long lastTickTimeMicros = 0;
     float currentTempoBPM = 120.0f;     // Default tempo
     float ticksPerQuarterNote = 24.0f;
@@ -27,7 +27,7 @@ void printStatus(SynthState& state) {
 
     // Print Profile
     Serial.print(" | PROFILE:");
-    Serial.print(state.customProfileIndex == PROFILE_SCALE ? "Scale" : "Thunder");
+    Serial.print(profileName(state.customProfileIndex));
 
     // Print Key
     Serial.print(" | KEY:");
@@ -60,4 +60,9 @@ void printStatus(SynthState& state) {
     // if (state.currentWaveform >= 0 && state.currentWaveform < 4) Serial.print(waveformNames[state.currentWaveform]); else Serial.print("?");
 
     Serial.println(); // Finish the line
-}
\ No newline at end of file
+}
+
+const char* profileName(int profile) {
+    static const char* const names[NUM_MAPPING_PROFILES] = {"Scale", "Thunderstruck", "Riff"};
+    return (profile >= 0 && profile < NUM_MAPPING_PROFILES) ? names[profile] : "?";
+}
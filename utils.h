@@ -8,5 +8,6 @@
 #include "synth_state.h"
 
 void printStatus(SynthState& state);
+const char* profileName(int profile); // "Scale", "Thunderstruck", "Riff"
 
 #endif
\ No newline at end of file
@@ -0,0 +1,134 @@
+// voice_envelope.cpp
+// Implements VoiceEnvelope. tick() moves the level along linear segments and publishes
+// it as a Q16 gain; renderBlock() interpolates from the gain it ended the last block
+// on to that target across the block.
+
+#include "voice_envelope.h"
+#include <dspinst.h>
+
+VoiceEnvelope::VoiceEnvelope() : AudioStream(1, inputQueueArray) {
+    stage = VENV_IDLE;
+    restartPending = false;
+    envelopeLevel = 0.0f;
+    levelGain = 1.0f;
+    attackUs = 10000.0f;
+    decayUs = 200000.0f;
+    sustainLevel = 1.0f;
+    releaseUs = VOICE_FADE_US;
+    releaseStep = 0.0f;
+    settleUs = 0;
+    targetGain = 0;
+    gain = 0;
+}
+
+void VoiceEnvelope::attack(float ms) {
+    attackUs = ms * 1000.0f;
+}
+
+void VoiceEnvelope::decay(float ms) {
+    decayUs = ms * 1000.0f;
+}
+
+void VoiceEnvelope::sustain(float level) {
+    sustainLevel = level < 0.0f ? 0.0f : (level > 1.0f ? 1.0f : level);
+}
+
+void VoiceEnvelope::release(float ms) {
+    releaseUs = ms * 1000.0f;
+    if (releaseUs < VOICE_FADE_US) releaseUs = VOICE_FADE_US;
+}
+
+void VoiceEnvelope::setGain(float newGain) {
+    levelGain = newGain < 0.0f ? 0.0f : (newGain > VOICE_GAIN_MAX ? VOICE_GAIN_MAX : newGain);
+    setLevel(envelopeLevel);
+}
+
+void VoiceEnvelope::noteOn() {
+    if (stage == VENV_IDLE) {
+        restartPending = false;
+        stage = VENV_ATTACK;
+        return;
+    }
+    // Still sounding (or still settling from a fade): fade out, then attack from zero
+    restartPending = true;
+    if (stage != VENV_SETTLE) stage = VENV_FADE;
+}
+
+void VoiceEnvelope::retrigger() {
+    restartPending = false;
+    stage = VENV_ATTACK; // tick() climbs from envelopeLevel
+}
+
+void VoiceEnvelope::noteOff() {
+    restartPending = false;
+    if (stage == VENV_IDLE || stage == VENV_SETTLE) return;
+    releaseStep = envelopeLevel / releaseUs;
+    stage = VENV_RELEASE;
+}
+
+void VoiceEnvelope::setLevel(float newLevel) {
+    envelopeLevel = newLevel;
+    targetGain = (int32_t)(newLevel * levelGain * VOICE_GAIN_UNITY);
+}
+
+void VoiceEnvelope::tick(uint32_t elapsedUs) {
+    float level = envelopeLevel;
+    switch (stage) {
+        case VENV_IDLE:
+            return;
+        case VENV_ATTACK:
+            level += elapsedUs / attackUs;
+            if (level >= 1.0f) {
+                level = 1.0f;
+                stage = VENV_DECAY;
+            }
+            break;
+        case VENV_DECAY:
+            level -= (1.0f - sustainLevel) * elapsedUs / decayUs;
+            if (level <= sustainLevel) {
+                level = sustainLevel;
+                stage = VENV_SUSTAIN;
+            }
+            break;
+        case VENV_SUSTAIN:
+            level = sustainLevel;
+            break;
+        case VENV_RELEASE:
+        case VENV_FADE:
+            level -= (stage == VENV_RELEASE) ? releaseStep * elapsedUs : (float)elapsedUs / VOICE_FADE_US;
+            if (level <= 0.0f) {
+                level = 0.0f;
+                settleUs = 0;
+                stage = VENV_SETTLE;
+            }
+            break;
+        case VENV_SETTLE:
+            settleUs += elapsedUs;
+            if (settleUs >= VOICE_SETTLE_US) {
+                stage = restartPending ? VENV_ATTACK : VENV_IDLE;
+                restartPending = false;
+            }
+            break;
+    }
+    setLevel(level);
+}
+
+bool VoiceEnvelope::renderBlock(int16_t* samples) {
+    int32_t target = targetGain;
+    if (gain == 0 && target == 0) return false;
+    int32_t step = (target - gain) / AUDIO_BLOCK_SAMPLES;
+    int32_t g = gain;
+    for (int n = 0; n < AUDIO_BLOCK_SAMPLES; n++) {
+        g += step;
+        samples[n] = (int16_t)signed_saturate_rshift((int32_t)samples[n] * (g >> 1), 16, 15); // Gain may pass unity
+    }
+    gain = target; // Absorb the division remainder
+    return true;
+}
+
+void VoiceEnvelope::update(void) {
+    audio_block_t* block = receiveWritable(0);
+    if (!block) return;
+    if (renderBlock(block->data)) transmit(block);
+    AudioStream::release(block); // release(float) hides it
+}
@@ -0,0 +1,79 @@
+// voice_envelope.h
+// Oscillator voice envelope with click-free transitions. The ADSR runs at control
+// rate (advanced by updateVoices); the audio update ramps its gain sample by sample
+// towards the latest level, so no level change ever lands as a step. A retrigger on
+// the same oscillator restarts the attack from the current level; a note-on that needs
+// a fresh oscillator (new waveform, stolen voice) fades the old sound out first, and a
+// release never ends faster than that fade. Drop-in for the AudioEffectEnvelope calls
+// the synth used.
+
+#ifndef VOICE_ENVELOPE_H
+#define VOICE_ENVELOPE_H
+
+#include <Audio.h>
+
+#define VOICE_FADE_US 2000   // Full scale to silence before a waveform change or a steal
+// Silence held after a fade before the voice is retriggered or freed: one audio block,
+// so the sample ramp has reached zero before the oscillator changes or is gated
+#define VOICE_SETTLE_US 3000
+#define VOICE_GAIN_UNITY 65536 // Q16
+#define VOICE_GAIN_MAX 1.25f   // Highest setGain(); the block output saturates
+
+enum VoiceEnvelopeStage {
+    VENV_IDLE,
+    VENV_ATTACK,
+    VENV_DECAY,
+    VENV_SUSTAIN,
+    VENV_RELEASE,
+    VENV_FADE,   // Fading out for a fresh oscillator
+    VENV_SETTLE  // At zero, waiting for the audio ramp to catch up
+};
+
+class VoiceEnvelope : public AudioStream {
+public:
+    VoiceEnvelope();
+
+    void attack(float ms);
+    void decay(float ms);
+    void sustain(float level);
+    void release(float ms); // Never shorter than VOICE_FADE_US
+    // Voice level on top of the envelope (1 = unity), ramped in with the envelope
+    void setGain(float gain);
+    float voiceGain() const { return levelGain; }
+
+    // From silence the attack starts at once. While the voice sounds it fades out
+    // and settles first; retriggering() stays true until the attack begins, and the
+    // caller holds back oscillator changes until then.
+    void noteOn();
+    // Next note on the oscillator that is already running: the attack restarts from the
+    // current level, so there is no gap and no step
+    void retrigger();
+    void noteOff();
+    bool isActive() const { return stage != VENV_IDLE; }
+    bool retriggering() const { return restartPending; }
+    uint8_t currentStage() const { return stage; }
+    float level() const { return envelopeLevel; }
+
+    void tick(uint32_t elapsedUs); // Once per control tick
+
+    // Applies one block of gain ramp to 'samples' in place. Called by update();
+    // public for host tests. Returns false when the block is silent.
+    bool renderBlock(int16_t* samples);
+    virtual void update(void);
+
+private:
+    void setLevel(float newLevel);
+
+    audio_block_t* inputQueueArray[1];
+    volatile uint8_t stage;
+    bool restartPending;
+    float envelopeLevel;     // 0..1, control rate
+    float levelGain;         // setGain()
+    float attackUs, decayUs, sustainLevel, releaseUs;
+    float releaseStep;       // Level per microsecond, fixed at noteOff
+    uint32_t settleUs;       // Time spent in VENV_SETTLE
+    volatile int32_t targetGain; // Q16, written by tick()
+    int32_t gain;            // Q16, audio side
+};
+
+#endif // VOICE_ENVELOPE_H
@@ -0,0 +1,308 @@
+// voice_manager.cpp
+// Implements voice start/stop and portamento on top of the audio graph in audio.cpp.
+// Per-voice data lives in parallel arrays so the per-tick glide loop stays branch-free.
+
+#include "voice_manager.h"
+#include "audio.h"
+#include "control_tick.h"
+#include "lfo_bank.h"
+#include "mod_matrix.h"
+#include "sample_bank.h"
+#include "debug.h"
+#include <Audio.h>
+#include <math.h>
+
+// Glide time constant. Applied once per control tick, so the glide no longer speeds up
+// or slows down with the main loop (0.008 per ~250 us pass before the fixed tick).
+static const float PORTAMENTO_TIME_CONSTANT_S = 0.031f;
+static const float PORTAMENTO_RATE = 1.0f / (PORTAMENTO_TIME_CONSTANT_S * CONTROL_RATE_HZ);  // Fraction of remaining distance per tick
+static const float PORTAMENTO_SNAP_HZ = 0.1f; // Close enough: end the glide
+
+// Helper array to map state index to Teensy waveform constants
+static const int waveformTypes[] = {
+    WAVEFORM_SINE, 
+    WAVEFORM_SAWTOOTH, 
+    WAVEFORM_SQUARE, 
+    WAVEFORM_TRIANGLE
+};
+
+VoiceManager voices;
+
+void resetVoices() {
+    for (int v = 0; v < NUM_VOICES; v++) {
+        voices.frequency[v] = 0.0f;
+        voices.target[v] = 0.0f;
+        voices.previous[v] = 0.0f;
+        voices.gliding[v] = false;
+        voices.note[v] = -1;
+        voices.owner[v] = OWNER_NONE;
+        voices.envPhase[v] = ENV_IDLE;
+        voices.age[v] = 0;
+        voices.muted[v] = false;
+        voices.restartPending[v] = false;
+        voices.waveform[v] = 0;
+        voices.engine[v] = ENGINE_OSCILLATOR;
+        voices.sample[v] = nullptr;
+    }
+    voices.nextAge = 1;
+    voices.voiceLimit = NUM_VOICES;
+    voices.stolen = 0;
+    voices.pitchModulated = false;
+    voices.amplitudeModulated = false;
+    smoothJump(voices.vibratoDepth, 0.0f);
+    for (int v = 0; v < NUM_VOICES; v++) smoothJump(voices.gain[v], 1.0f);
+}
+
+static float voiceGain(int voice) {
+    return voice == 0 ? MIXER_GAIN_LEAD : MIXER_GAIN_CHORD;
+}
+
+// True if voice a is kept over voice b when not all held voices may sound
+static bool voiceOutranks(int a, int b) {
+    if (voiceGain(a) != voiceGain(b)) return voiceGain(a) > voiceGain(b);
+    return voices.age[a] > voices.age[b];
+}
+
+// --- Engine dispatch: oscillator + envelope, or an S-DSP sample voice ---
+
+// inPlace: the oscillator keeps running under the new note, so the attack restarts from
+// the envelope's current level
+static void startVoiceSound(int voice, bool inPlace) {
+    if (voices.engine[voice] == ENGINE_SDSP) {
+        const BrrSample* sample = voices.sample[voice];
+        sdsp.keyOn(voice, sample, voices.frequency[voice], sampleBankPrime(voice, sample));
+        return;
+    }
+    connectVoice(voice); // In case the play style changed without updateAudioGraph() yet
+    waveformMod[voice].amplitude(VOICE_AMPLITUDE);
+    waveformMod[voice].gate(false);
+    if (inPlace) envelope[voice].retrigger();
+    else envelope[voice].noteOn();
+}
+
+static void releaseVoiceSound(int voice) {
+    if (voices.engine[voice] == ENGINE_SDSP) sdsp.keyOff(voice);
+    else envelope[voice].noteOff();
+}
+
+static bool voiceSoundActive(int voice) {
+    if (voices.engine[voice] == ENGINE_SDSP) return sdsp.voiceActive(voice);
+    return envelope[voice].isActive();
+}
+
+static void setVoiceFrequency(int voice, float hz) {
+    if (voices.engine[voice] == ENGINE_SDSP) sdsp.setFrequency(voice, hz);
+    else if (!voices.restartPending[voice]) waveformMod[voice].frequency(hz); // Old note still fading
+}
+
+// Scales the voice's level (1 = unmodulated) on both engines, so it carries over an
+// engine switch. Both ramp it in per sample.
+static void setVoiceGain(int voice, float gain) {
+    sdsp.setVolume(voice, (int8_t)(SDSP_DEFAULT_VOLUME * gain));
+    envelope[voice].setGain(gain);
+}
+
+// Fades out like a release; updateVoices() gates the oscillator once it is silent
+static void muteVoice(int voice) {
+    releaseVoiceSound(voice);
+    voices.muted[voice] = true;
+}
+
+static void unmuteVoice(int voice) {
+    voices.muted[voice] = false;
+    startVoiceSound(voice, false);
+}
+
+// Mutes held voices that rank below the voiceLimit best, unmutes the ones that fit again
+static void enforceVoiceLimit() {
+    for (int v = 0; v < NUM_VOICES; v++) {
+        if (voices.envPhase[v] != ENV_HELD) continue;
+        int betterVoices = 0;
+        for (int other = 0; other < NUM_VOICES; other++) {
+            if (other != v && voices.envPhase[other] == ENV_HELD && voiceOutranks(other, v)) betterVoices++;
+        }
+        bool keep = betterVoices < voices.voiceLimit;
+        if (!keep && !voices.muted[v]) {
+            muteVoice(v);
+            voices.stolen++;
+            DEBUG_INFO(CAT_AUDIO, "Voice %d silenced (limit %d)", v, voices.voiceLimit);
+        } else if (keep && voices.muted[v]) {
+            unmuteVoice(v);
+            DEBUG_INFO(CAT_AUDIO, "Voice %d resumed (limit %d)", v, voices.voiceLimit);
+        }
+    }
+}
+
+void setVoiceLimit(int limit) {
+    if (limit < 1) limit = 1;
+    if (limit > NUM_VOICES) limit = NUM_VOICES;
+    voices.voiceLimit = limit;
+    enforceVoiceLimit();
+}
+
+void playNote(SynthState& state, int voice, int midiNote, VoiceOwner owner) {
+    if (voice < 0 || voice >= NUM_VOICES) {
+        DEBUG_WARNING(CAT_AUDIO, "playNote: Invalid voice %d", voice);
+        return;
+    }
+    float freq = 440.0 * pow(2.0, (midiNote - 69.0) / 12.0);  
+    DEBUG_INFO(CAT_AUDIO, ">>> playNote called: voice=%d, midiNote=%d, freq=%.2f", voice, midiNote, freq); // <<< ADDED DEBUG
+    
+    // Switching engines: silence whatever the voice was playing on the other one
+    VoiceEngine engine = (state.voiceEngine == ENGINE_SDSP) ? ENGINE_SDSP : ENGINE_OSCILLATOR;
+    if (voices.engine[voice] != engine && voices.envPhase[voice] != ENV_IDLE) {
+        releaseVoiceSound(voice); // The oscillator fades out and is gated by updateVoices()
+        voices.envPhase[voice] = ENV_IDLE; // No glide across engines
+    }
+    voices.engine[voice] = engine;
+    voices.sample[voice] = brrSampleAt(state.brrSampleIndex);
+
+    // A sounding voice on the same waveform and owner keeps its oscillator: the pitch
+    // changes in place and the attack climbs from the current level, with no gap.
+    // Resetting the oscillator (new waveform, stolen voice) under a sounding note clicks,
+    // so then the envelope fades the old note out and the new waveform and pitch wait
+    // for updateVoices()
+    bool sounding = (engine == ENGINE_OSCILLATOR && envelope[voice].isActive());
+    bool inPlace = sounding && !voices.restartPending[voice] &&
+                   voices.waveform[voice] == state.currentWaveform && voices.owner[voice] == owner;
+    voices.restartPending[voice] = sounding && !inPlace;
+    if (!sounding) {
+        waveformMod[voice].begin(waveformTypes[state.currentWaveform]);
+        voices.waveform[voice] = state.currentWaveform;
+    }
+
+    // --- Portamento Logic --- 
+    if (state.portamentoEnabled && voices.envPhase[voice] == ENV_HELD) {
+        // Store current frequency as previous before updating target
+        voices.previous[voice] = voices.frequency[voice];
+        
+        // Set up portamento - keep current frequency and set new target
+        voices.target[voice] = freq;
+        voices.gliding[voice] = true;
+        DEBUG_DEBUG(CAT_AUDIO, "Portamento active on voice %d: %f -> %f", voice, voices.frequency[voice], freq);
+    } else {
+        // No portamento, or first note after stopping - set frequency directly
+        voices.previous[voice] = freq;  // Store for future portamento
+        voices.frequency[voice] = freq;
+        voices.target[voice] = freq;
+        voices.gliding[voice] = false;
+        setVoiceFrequency(voice, freq);
+        DEBUG_DEBUG(CAT_AUDIO, "Direct frequency set on voice %d: %f", voice, freq);
+    }
+    
+    voices.muted[voice] = false;
+    startVoiceSound(voice, inPlace);
+    voices.note[voice] = midiNote;
+    voices.owner[voice] = owner;
+    voices.envPhase[voice] = ENV_HELD;
+    voices.age[voice] = voices.nextAge++;
+    voices.onMicros[voice] = micros();
+    
+    if (engine == ENGINE_OSCILLATOR && !envelope[voice].isActive()) {
+        DEBUG_WARNING(CAT_AUDIO, "Voice %d envelope not active after noteOn", voice);
+    }
+
+    // Under the load governor the new note may take another voice's place (or lose its own)
+    if (voices.voiceLimit < NUM_VOICES) enforceVoiceLimit();
+}
+
+void stopNote(int voice) {
+    if (voice < 0 || voice >= NUM_VOICES) return;
+    DEBUG_INFO(CAT_AUDIO, ">>> stopNote called: voice=%d", voice); // <<< ADDED DEBUG
+    DEBUG_VERBOSE(CAT_AUDIO, "Stopping voice %d", voice);
+    releaseVoiceSound(voice);
+    voices.restartPending[voice] = false; // The old note releases on its own waveform and pitch
+    voices.note[voice] = -1;
+    if (voices.envPhase[voice] == ENV_HELD) voices.envPhase[voice] = ENV_RELEASE;
+    
+    // If portamento is active, start sliding back to the previous frequency
+    if (voices.gliding[voice] && voices.previous[voice] > 0) {
+        voices.target[voice] = voices.previous[voice];
+        DEBUG_VERBOSE(CAT_AUDIO, "Portamento return on voice %d to %f", voice, voices.previous[voice]);
+    }
+}
+
+void updateVoices(SynthState& state) {
+    voices.vibratoDepth.target = vibratoDepthOctaves(state);
+    float vibratoOctaves = smoothTick(voices.vibratoDepth, SMOOTH_VIBRATO);
+    bool pitchModulated = vibratoOctaves > 0.0f || (modDeltas.active & (1 << MOD_DST_PITCH));
+
+    // Envelopes advance here; the audio update only interpolates between their levels
+    for (int v = 0; v < NUM_VOICES; v++) envelope[v].tick(CONTROL_TICK_US);
+    for (int v = 0; v < NUM_VOICES; v++) {
+        if (!voices.restartPending[v] || envelope[v].retriggering()) continue;
+        // Faded out and settled: the new note's attack starts from silence
+        voices.restartPending[v] = false;
+        waveformMod[v].begin(waveformTypes[state.currentWaveform]);
+        voices.waveform[v] = state.currentWaveform;
+        waveformMod[v].frequency(voices.frequency[v]);
+    }
+
+    if (state.portamentoEnabled) {
+        // Branch-free over the arrays so the compiler can vectorize the glide step
+        for (int v = 0; v < NUM_VOICES; v++) {
+            float step = (voices.target[v] - voices.frequency[v]) * PORTAMENTO_RATE;
+            voices.frequency[v] += voices.gliding[v] ? step : 0.0f;
+        }
+        for (int v = 0; v < NUM_VOICES; v++) {
+            if (!voices.gliding[v]) continue;
+            // If we're very close to the target, snap to it
+            if (fabsf(voices.target[v] - voices.frequency[v]) < PORTAMENTO_SNAP_HZ) {
+                voices.frequency[v] = voices.target[v];
+                voices.gliding[v] = false;
+            }
+            if (!pitchModulated) setVoiceFrequency(v, voices.frequency[v]);
+        }
+    }
+
+    // Vibrato: every sounding voice reads the shared LFO at its own phase offset, plus
+    // whatever the modulation matrix routes to pitch
+    if (pitchModulated) {
+        for (int v = 0; v < NUM_VOICES; v++) {
+            if (voices.envPhase[v] == ENV_IDLE) continue;
+            float octaves = modDeltas.pitchOctaves[v];
+            if (vibratoOctaves > 0.0f) octaves += lfoValue(LFO_VIBRATO, v) * vibratoOctaves;
+            setVoiceFrequency(v, voices.frequency[v] * exp2f(octaves));
+        }
+        voices.pitchModulated = true;
+    } else if (voices.pitchModulated) {
+        // Modulation just went off: settle every voice back on its unmodulated pitch
+        for (int v = 0; v < NUM_VOICES; v++) setVoiceFrequency(v, voices.frequency[v]);
+        voices.pitchModulated = false;
+    }
+
+    // Amplitude routes ease each voice's gain towards its target; once the routes are
+    // gone the gains ease back to unity and the work stops
+    bool amplitudeRouted = modDeltas.active & (1 << MOD_DST_AMPLITUDE);
+    if (amplitudeRouted || voices.amplitudeModulated) {
+        bool atUnity = true;
+        for (int v = 0; v < NUM_VOICES; v++) {
+            float gain = amplitudeRouted ? 1.0f + modDeltas.amplitude[v] : 1.0f;
+            voices.gain[v].target = gain < 0.0f ? 0.0f : (gain > MOD_AMPLITUDE_MAX ? MOD_AMPLITUDE_MAX : gain);
+            setVoiceGain(v, smoothTick(voices.gain[v], SMOOTH_AMPLITUDE));
+            atUnity = atUnity && voices.gain[v].value == 1.0f;
+        }
+        voices.amplitudeModulated = amplitudeRouted || !atUnity;
+    }
+
+    // A released voice is free once its envelope has finished fading
+    for (int v = 0; v < NUM_VOICES; v++) {
+        if (voices.envPhase[v] == ENV_RELEASE && !voiceSoundActive(v)) {
+            voices.envPhase[v] = ENV_IDLE;
+            voices.owner[v] = OWNER_NONE;
+        }
+        // Released, muted or switched to the S-DSP: no audio CPU once faded
+        if (!envelope[v].isActive() && !waveformMod[v].isGated()) waveformMod[v].gate(true);
+    }
+
+    // A released voice may have made room for one that was silenced
+    if (voices.voiceLimit < NUM_VOICES) enforceVoiceLimit();
+}
+
+// True while any voice is still gliding towards its target frequency
+bool voicesGliding() {
+    for (int v = 0; v < NUM_VOICES; v++) {
+        if (voices.gliding[v]) return true;
+    }
+    return false;
+}
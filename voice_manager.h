@@ -0,0 +1,82 @@
+// voice_manager.h
+// Owns all per-voice state in struct-of-arrays form and is the only voice API the
+// playstyles use: playNote/stopNote start and release voices, updateVoices runs the
+// per-tick work (envelopes, portamento glides, vibrato and modulation matrix deltas,
+// envelope phase tracking). The load governor
+// caps how many of the held voices actually sound.
+
+#ifndef VOICE_MANAGER_H
+#define VOICE_MANAGER_H
+
+#include "synth_state.h"
+#include "sdsp.h"
+#include "param_smooth.h"
+#include <stdint.h>
+
+// Compile-time voice count; the audio graph in audio.cpp is sized from it
+#define NUM_VOICES 4
+
+// Which playstyle started the note on a voice
+enum VoiceOwner {
+    OWNER_NONE,
+    OWNER_MONO,
+    OWNER_CHORD,
+    OWNER_BOOGIE,
+    OWNER_RHYTHMIC,
+    OWNER_BACKING // SMF backing track (smf_player.h)
+};
+
+// What renders a voice (state.voiceEngine at note-on)
+enum VoiceEngine {
+    ENGINE_OSCILLATOR, // waveformMod + envelope (audio.cpp)
+    ENGINE_SDSP        // S-DSP BRR sample voice (sdsp.h)
+};
+
+enum VoiceEnvPhase {
+    ENV_IDLE,    // Silent, free
+    ENV_HELD,    // Note on (attack/decay/sustain)
+    ENV_RELEASE  // Note off, envelope still fading
+};
+
+struct VoiceManager {
+    float frequency[NUM_VOICES]; // Current oscillator frequency (Hz), moves during a glide
+    float target[NUM_VOICES];    // Glide target (Hz)
+    float previous[NUM_VOICES];  // Frequency before the last glide, returned to on release
+    bool gliding[NUM_VOICES];
+    int note[NUM_VOICES];        // MIDI note, -1 when the voice has never played or was freed
+    uint8_t owner[NUM_VOICES];   // VoiceOwner
+    uint8_t envPhase[NUM_VOICES]; // VoiceEnvPhase
+    uint32_t age[NUM_VOICES];    // Note-on stamp, larger = newer
+    uint32_t onMicros[NUM_VOICES]; // micros() at note-on (mod matrix "held" source)
+    bool muted[NUM_VOICES];      // Held but silenced because it is over voiceLimit
+    bool restartPending[NUM_VOICES]; // Oscillator waveform/pitch held back until the envelope's retrigger fade ends
+    uint8_t waveform[NUM_VOICES]; // state.currentWaveform the oscillator was last begun with
+    uint8_t engine[NUM_VOICES];  // VoiceEngine
+    const BrrSample* sample[NUM_VOICES]; // Sample played by an ENGINE_SDSP voice
+    uint32_t nextAge;
+    int voiceLimit;              // Most voices allowed to sound at once (governor.cpp)
+    uint32_t stolen;             // Held voices silenced to stay under voiceLimit
+    bool pitchModulated;         // Voice frequencies currently carry vibrato or pitch routes
+    bool amplitudeModulated;     // Voice gains are off unity (amplitude routes, or easing back)
+    ParamSmoother vibratoDepth;  // Octaves, eased towards the vibrato depth setting
+    ParamSmoother gain[NUM_VOICES]; // Voice level from amplitude routes, 1 = unity
+};
+
+extern VoiceManager voices;
+
+void resetVoices();
+void playNote(SynthState& state, int voice, int midiNote, VoiceOwner owner);
+void stopNote(int voice);
+void updateVoices(SynthState& state); // Once per control tick
+bool voicesGliding();
+
+// Lets at most 'limit' held voices sound. Over the limit the lowest-priority voices are
+// silenced (lower mixer gain first, then oldest); they keep their note and resume
+// when the limit is raised again while they are still held.
+void setVoiceLimit(int limit);
+
+inline bool voiceActive(int voice) { return voices.envPhase[voice] == ENV_HELD; }
+inline int voiceNote(int voice) { return voices.note[voice]; }
+inline bool voiceSounding(int voice) { return voiceActive(voice) && !voices.muted[voice]; }
+
+#endif // VOICE_MANAGER_H
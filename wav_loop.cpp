@@ -0,0 +1,346 @@
+// wav_loop.cpp
+// Implements the WAV loop player: the RIFF parser, the main-loop filler that reads and
+// downmixes the file into the double buffer, the resampling audio update and the tempo
+// lock. Stereo files are mixed to mono on the way in, since the whole output path after
+// the output mixer is mono.
+
+#include "wav_loop.h"
+#include "audio.h"
+#include "sample_bank.h"
+#include "debug.h"
+#include <SD.h>
+#include <string.h>
+#include <math.h>
+
+#define WAV_LOOP_MAX_RATE 4.0f      // Fastest playback, so the card can keep up
+#define WAV_LOOP_TRIM_US 500000.0f  // Phase errors are trimmed out over about this long
+#define WAV_LOOP_DEFAULT_US_PER_QUARTER 500000.0f // 120 BPM before any tempo is known
+
+static File loopFile;
+static char loopName[WAV_LOOP_NAME_LENGTH] = "";
+static uint32_t dataOffset = 0;
+static uint32_t totalFrames = 0;
+static uint16_t channels = 0;
+static uint32_t sampleRate = 0;
+DMAMEM static uint8_t readBuffer[WAV_LOOP_HALF_FRAMES * 4]; // One half of 16-bit stereo
+
+// Filler (main loop)
+static uint32_t fillFrame = 0;  // Next file frame to read
+static uint8_t fillHalf = 0;
+static bool readFailed = false;
+static uint32_t startFrame = 0; // File frame the stream was primed at
+
+// Playback and tempo lock
+static bool playing = false;
+static bool clockStopped = false;
+static int beats = WAV_LOOP_DEFAULT_BEATS;
+static float usPerQuarter = WAV_LOOP_DEFAULT_US_PER_QUARTER;
+static float trim = 0.0f;        // Speed correction from the clock phase
+static uint32_t clockCount = 0;  // MIDI clocks since Start
+static uint32_t resyncs = 0;
+
+AudioPlayWavLoop::AudioPlayWavLoop() : AudioStream(0, nullptr) {
+    memset(&stream, 0, sizeof(stream));
+    playing = false;
+    stepQ16 = 0x10000;
+    restart();
+}
+
+void AudioPlayWavLoop::setPlaying(bool on) {
+    playing = on;
+}
+
+void AudioPlayWavLoop::restart() {
+    AudioNoInterrupts();
+    stream.count[0] = 0;
+    stream.count[1] = 0;
+    stream.readHalf = 0;
+    stream.readFrame = 0;
+    stream.framesPlayed = 0;
+    stream.minFill = 2 * WAV_LOOP_HALF_FRAMES;
+    phaseQ16 = 0;
+    previous = 0;
+    current = 0;
+    AudioInterrupts();
+}
+
+bool AudioPlayWavLoop::nextFrame(int16_t& frame) {
+    uint8_t half = stream.readHalf;
+    uint16_t count = stream.count[half];
+    if (count == 0) return false;
+    frame = stream.frames[half][stream.readFrame++];
+    stream.framesPlayed = stream.framesPlayed + 1;
+    if (stream.readFrame >= count) {
+        stream.count[half] = 0; // Hand the half back to the filler
+        stream.readHalf = half ^ 1;
+        stream.readFrame = 0;
+    }
+    return true;
+}
+
+bool AudioPlayWavLoop::renderBlock(int16_t* out) {
+    if (!playing) return false;
+    bool starved = false;
+    for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+        phaseQ16 += stepQ16;
+        while (phaseQ16 >= 0x10000) {
+            phaseQ16 -= 0x10000;
+            previous = current;
+            if (!nextFrame(current)) {
+                current = 0; // The filler fell behind: silence until it catches up
+                starved = true;
+            }
+        }
+        out[i] = (int16_t)(previous + (((int32_t)(current - previous) * (int32_t)(phaseQ16 >> 1)) >> 15));
+    }
+    if (starved) stream.underruns = stream.underruns + 1;
+    uint32_t fill = stream.count[stream.readHalf] - stream.readFrame + stream.count[stream.readHalf ^ 1];
+    if (fill < stream.minFill) stream.minFill = fill;
+    return true;
+}
+
+void AudioPlayWavLoop::update(void) {
+    if (!playing) return;
+    audio_block_t* block = allocate();
+    if (!block) return;
+    if (renderBlock(block->data)) transmit(block);
+    AudioStream::release(block);
+}
+
+// --- Loading ---
+
+static uint32_t readLe32(const uint8_t* bytes) {
+    return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+static uint16_t readLe16(const uint8_t* bytes) {
+    return (uint16_t)(bytes[0] | (bytes[1] << 8));
+}
+
+// Walks the RIFF chunks for "fmt " and "data"; anything else (LIST, JUNK, cue) is skipped
+static bool parseWavHeader(File& file) {
+    uint8_t header[16];
+    if (file.read(header, 12) != 12 || memcmp(header, "RIFF", 4) != 0 || memcmp(header + 8, "WAVE", 4) != 0) return false;
+    bool haveFormat = false;
+    uint32_t position = 12;
+    while (file.seek(position) && file.read(header, 8) == 8) {
+        uint32_t chunkBytes = readLe32(header + 4);
+        if (memcmp(header, "fmt ", 4) == 0) {
+            if (chunkBytes < 16 || file.read(header, 16) != 16) return false;
+            uint16_t format = readLe16(header);
+            channels = readLe16(header + 2);
+            sampleRate = readLe32(header + 4);
+            uint16_t bits = readLe16(header + 14);
+            if (format != 1 || bits != 16 || channels < 1 || channels > 2 || sampleRate == 0) return false;
+            haveFormat = true;
+        } else if (memcmp(header, "data", 4) == 0) {
+            if (!haveFormat) return false;
+            dataOffset = position + 8;
+            uint32_t available = (uint32_t)file.size() - dataOffset;
+            if (chunkBytes > available) chunkBytes = available; // Truncated recording
+            totalFrames = chunkBytes / (channels * 2);
+            return totalFrames > 0;
+        }
+        position += 8 + chunkBytes + (chunkBytes & 1);
+    }
+    return false;
+}
+
+bool loadWavLoop(const char* fileName) {
+    stopWavLoop();
+    loopFile.close();
+    loopName[0] = '\0';
+    totalFrames = 0;
+    if (!sdCardMounted()) {
+        DEBUG_WARNING(CAT_AUDIO, "No SD card, no WAV loop");
+        return false;
+    }
+    loopFile = SD.open(fileName);
+    if (!loopFile || !parseWavHeader(loopFile)) {
+        DEBUG_WARNING(CAT_AUDIO, "%s is not a 16-bit PCM WAV", fileName);
+        loopFile.close();
+        totalFrames = 0;
+        return false;
+    }
+    strncpy(loopName, fileName, sizeof(loopName) - 1);
+    loopName[sizeof(loopName) - 1] = '\0';
+    DEBUG_INFO(CAT_AUDIO, "WAV loop %s: %lu frames, %u channel(s), %lu Hz", loopName, (unsigned long)totalFrames,
+               channels, (unsigned long)sampleRate);
+    return true;
+}
+
+// --- Filler ---
+
+// Reads a half in playback order, wrapping from the last frame to the first
+static void fillNextHalf() {
+    int16_t* frames = wavLoop.stream.frames[fillHalf];
+    uint32_t frameBytes = channels * 2;
+    uint32_t filled = 0;
+    while (filled < WAV_LOOP_HALF_FRAMES) {
+        uint32_t count = totalFrames - fillFrame;
+        if (count > WAV_LOOP_HALF_FRAMES - filled) count = WAV_LOOP_HALF_FRAMES - filled;
+        if (!loopFile.seek(dataOffset + fillFrame * frameBytes) ||
+            loopFile.read(readBuffer, count * frameBytes) != (int)(count * frameBytes)) {
+            DEBUG_WARNING(CAT_AUDIO, "WAV loop read failed: %s", loopName);
+            readFailed = true;
+            break;
+        }
+        for (uint32_t f = 0; f < count; f++) {
+            const uint8_t* bytes = readBuffer + f * frameBytes;
+            int32_t sample = (int16_t)readLe16(bytes);
+            if (channels == 2) sample = (sample + (int16_t)readLe16(bytes + 2)) >> 1;
+            frames[filled + f] = (int16_t)sample;
+        }
+        filled += count;
+        fillFrame += count;
+        if (fillFrame >= totalFrames) fillFrame = 0;
+    }
+    if (filled == 0) return;
+    wavLoop.stream.count[fillHalf] = (uint16_t)filled; // Publish after the data
+    fillHalf ^= 1;
+}
+
+static void fillFreeHalves() {
+    while (!readFailed && wavLoop.stream.count[fillHalf] == 0) fillNextHalf();
+}
+
+// Empties the buffer and refills both halves from 'frame'. Blocks for two SD reads.
+static void primeAt(uint32_t frame) {
+    wavLoop.restart();
+    startFrame = frame % totalFrames;
+    fillFrame = startFrame;
+    fillHalf = 0;
+    readFailed = false;
+    fillFreeHalves();
+}
+
+void serviceWavLoop() {
+    if (!playing || clockStopped) return;
+    fillFreeHalves();
+}
+
+// --- Playback ---
+
+void playWavLoop() {
+    if (totalFrames == 0) return;
+    playing = true;
+    clockStopped = false;
+    trim = 0.0f;
+    clockCount = 0;
+    resyncs = 0;
+    wavLoop.stream.underruns = 0;
+    primeAt(0);
+    wavLoop.setPlaying(true);
+}
+
+void stopWavLoop() {
+    playing = false;
+    wavLoop.setPlaying(false);
+}
+
+bool wavLoopPlaying() {
+    return playing;
+}
+
+void setWavLoopBeats(int count) {
+    if (count < 1) count = 1;
+    if (count > WAV_LOOP_MAX_BEATS) count = WAV_LOOP_MAX_BEATS;
+    beats = count;
+}
+
+int wavLoopBeats() {
+    return beats;
+}
+
+// --- Transport ---
+
+static bool clockLocked(const SynthState& state) {
+    return state.midiSyncEnabled && state.tempoEstablished && state.usPerMidiTick > 0.0f;
+}
+
+void wavLoopClockStart() {
+    clockCount = 0;
+    trim = 0.0f;
+    if (!playing) return;
+    clockStopped = false;
+    primeAt(0);
+    wavLoop.setPlaying(true);
+}
+
+void wavLoopClockTick(const SynthState& state) {
+    if (!playing || clockStopped || !state.midiSyncEnabled) return;
+    uint32_t clocksPerLoop = (uint32_t)beats * (uint32_t)state.ticksPerQuarterNote;
+    uint32_t clock = clockCount++ % clocksPerLoop; // Counted while the tempo is still being sampled
+    if (!clockLocked(state)) return;
+
+    float expected = (float)clock / clocksPerLoop;
+    float error = expected - (float)wavLoopPosition() / totalFrames; // Positive: the loop is behind
+    if (error >= 0.5f) error -= 1.0f;
+    if (error < -0.5f) error += 1.0f;
+    float loopUs = clocksPerLoop * state.usPerMidiTick;
+    if (fabsf(error) * loopUs > WAV_LOOP_RESYNC_US) {
+        primeAt((uint32_t)(expected * totalFrames));
+        trim = 0.0f;
+        resyncs++;
+        return;
+    }
+    trim = error * loopUs / WAV_LOOP_TRIM_US;
+    if (trim > WAV_LOOP_MAX_TRIM) trim = WAV_LOOP_MAX_TRIM;
+    if (trim < -WAV_LOOP_MAX_TRIM) trim = -WAV_LOOP_MAX_TRIM;
+}
+
+void wavLoopClockStop() {
+    if (!playing) return;
+    clockStopped = true;
+    wavLoop.setPlaying(false);
+}
+
+void updateWavLoop(const SynthState& state) {
+    if (!playing || clockStopped) return;
+    // The clock tempo, or the internal one; the last known tempo holds while a new clock is sampled
+    if (state.usPerMidiTick > 0.0f) usPerQuarter = state.usPerMidiTick * state.ticksPerQuarterNote;
+    float loopSamples = beats * usPerQuarter * (AUDIO_SAMPLE_RATE_EXACT / 1000000.0f);
+    float rate = (float)totalFrames / loopSamples * (1.0f + trim);
+    if (rate > WAV_LOOP_MAX_RATE) rate = WAV_LOOP_MAX_RATE;
+    wavLoop.setRate((uint32_t)(rate * 65536.0f));
+}
+
+// --- Status ---
+
+const char* wavLoopName() {
+    return loopName;
+}
+
+uint32_t wavLoopFrames() {
+    return totalFrames;
+}
+
+uint16_t wavLoopChannels() {
+    return channels;
+}
+
+uint32_t wavLoopSampleRate() {
+    return sampleRate;
+}
+
+uint32_t wavLoopPosition() {
+    if (totalFrames == 0) return 0;
+    return (startFrame + wavLoop.stream.framesPlayed) % totalFrames;
+}
+
+uint32_t wavLoopFill() {
+    const WavLoopStream& stream = wavLoop.stream;
+    return stream.count[stream.readHalf] - stream.readFrame + stream.count[stream.readHalf ^ 1];
+}
+
+uint32_t wavLoopMinFill() {
+    return wavLoop.stream.minFill;
+}
+
+uint32_t wavLoopUnderruns() {
+    return wavLoop.stream.underruns;
+}
+
+uint32_t wavLoopResyncs() {
+    return resyncs;
+}
@@ -0,0 +1,91 @@
+// wav_loop.h
+// Streams a WAV loop from the SD card as a backing track, locked to the tempo. The main
+// loop reads the file into one half of a double buffer while the audio update plays the
+// other, so the next half is always on hand a whole half (eight blocks) ahead. The loop
+// is resampled so its length spans a set number of beats at the MIDI clock tempo (or
+// the internal one); with a clock running its phase is trimmed against the clock and it
+// restarts on the downbeat when it drifts too far.
+
+#ifndef WAV_LOOP_H
+#define WAV_LOOP_H
+
+#include <Audio.h>
+#include "synth_state.h"
+
+#define WAV_LOOP_HALF_FRAMES 1024   // Per buffer half, mono after the downmix (~23 ms)
+#define WAV_LOOP_DEFAULT_BEATS 4    // One bar
+#define WAV_LOOP_MAX_BEATS 64
+#define WAV_LOOP_MAX_TRIM 0.03f     // Largest phase-correction speed change (about half a semitone)
+#define WAV_LOOP_RESYNC_US 50000    // Drift beyond this restarts the loop where the clock is
+#define WAV_LOOP_NAME_LENGTH 13
+
+// Double buffer of mono frames. The main loop fills a half whose count is 0; the audio
+// update plays a half and frees it by zeroing its count.
+struct WavLoopStream {
+    int16_t frames[2][WAV_LOOP_HALF_FRAMES];
+    volatile uint16_t count[2];
+    uint8_t readHalf;   // Audio side
+    uint16_t readFrame;
+    volatile uint32_t underruns;
+    volatile uint32_t framesPlayed; // Since the last prime
+    volatile uint32_t minFill;      // Lowest fill seen after a block since the last prime
+};
+
+class AudioPlayWavLoop : public AudioStream {
+public:
+    AudioPlayWavLoop();
+
+    void setPlaying(bool on);
+    void restart(); // Empties the buffer for the filler to prime
+    bool isPlaying() const { return playing; }
+    void setRate(uint32_t rateQ16) { stepQ16 = rateQ16; } // File frames per output sample, 16.16
+    uint32_t rate() const { return stepQ16; }
+
+    // Fills one block; false (block untouched) while stopped. Called by update(); public
+    // for host tests.
+    bool renderBlock(int16_t* out);
+    virtual void update(void);
+
+    WavLoopStream stream;
+
+private:
+    bool nextFrame(int16_t& frame);
+
+    volatile bool playing;
+    uint32_t stepQ16;
+    uint32_t phaseQ16;
+    int16_t previous;
+    int16_t current;
+};
+
+// Opens a 16-bit PCM WAV (mono or stereo, any rate) from the card's root. Playback
+// stops while it loads. False when the card or file is unusable.
+bool loadWavLoop(const char* fileName);
+void playWavLoop(); // From the top
+void stopWavLoop();
+bool wavLoopPlaying();
+void setWavLoopBeats(int beats);
+int wavLoopBeats();
+
+// MIDI transport: Start restarts the loop on the downbeat, each Clock checks its phase,
+// Stop silences it until the next Start
+void wavLoopClockStart();
+void wavLoopClockTick(const SynthState& state);
+void wavLoopClockStop();
+
+// Playback speed from the tempo. Once per control tick.
+void updateWavLoop(const SynthState& state);
+// Refills free buffer halves. Every loop() pass.
+void serviceWavLoop();
+
+const char* wavLoopName();       // "" with nothing loaded
+uint32_t wavLoopFrames();        // Loop length in file frames
+uint16_t wavLoopChannels();
+uint32_t wavLoopSampleRate();
+uint32_t wavLoopPosition();      // Frame being played
+uint32_t wavLoopFill();          // Frames buffered ahead of the audio update
+uint32_t wavLoopMinFill();       // Lowest fill since play started
+uint32_t wavLoopUnderruns();
+uint32_t wavLoopResyncs();
+
+#endif // WAV_LOOP_H
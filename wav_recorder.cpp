@@ -0,0 +1,241 @@
+// wav_recorder.cpp
+// Implements the WAV recorder: a single-producer/single-consumer block queue filled by
+// the audio update, and the main-loop writer that streams it to the card. The writer
+// is a small state machine that polls the card's busy line before each step, so a
+// card stall (tens to hundreds of ms) costs passes nothing; the queue absorbs it.
+
+#include "wav_recorder.h"
+#include "audio.h"
+#include "sample_bank.h"
+#include "debug.h"
+#include <SD.h>
+#include <string.h>
+
+#define WAV_BLOCK_BYTES (AUDIO_BLOCK_SAMPLES * 2)
+#define WAV_SAMPLE_RATE 44100 // Nominal; the Teensy's I2S runs at 44117.6 Hz
+#define WAV_RIFF_SIZE_OFFSET 4
+#define WAV_DATA_SIZE_OFFSET (WAV_HEADER_BYTES - 4)
+
+// Stopping is the recorder being disarmed; the writer drains the queue, then closes
+enum WavWriterState {
+    WAV_IDLE,
+    WAV_OPENING, // Armed; the file is created on the first pass the card is free
+    WAV_HEADER,  // Created; the header goes out next
+    WAV_WRITING
+};
+
+static File wavFile;
+static uint8_t writerState = WAV_IDLE;
+static char fileName[WAV_NAME_LENGTH] = "";
+static uint32_t dataBytes = 0;
+static int nextFileNumber = 0;
+
+AudioRecordWav::AudioRecordWav(int16_t* queueMemory) : AudioStream(1, inputQueueArray) {
+    queue = queueMemory;
+    armed = false;
+    head = 0;
+    tail = 0;
+    overrunCount = 0;
+    peak = 0;
+}
+
+void AudioRecordWav::setArmed(bool on) {
+    AudioNoInterrupts();
+    if (on) {
+        head = 0;
+        tail = 0;
+        overrunCount = 0;
+        peak = 0;
+    }
+    armed = on;
+    AudioInterrupts();
+}
+
+void AudioRecordWav::captureBlock(const int16_t* samples) {
+    if (!armed) return;
+    uint32_t queued = head - tail;
+    if (queued >= WAV_QUEUE_BLOCKS) {
+        overrunCount++; // The card fell behind: drop the block rather than wait
+        return;
+    }
+    int16_t* slot = queue + (head % WAV_QUEUE_BLOCKS) * AUDIO_BLOCK_SAMPLES;
+    if (samples) memcpy(slot, samples, WAV_BLOCK_BYTES);
+    else memset(slot, 0, WAV_BLOCK_BYTES);
+    head = head + 1; // Publish after the data
+    if (queued + 1 > peak) peak = queued + 1;
+}
+
+void AudioRecordWav::update(void) {
+    audio_block_t* block = receiveReadOnly(0);
+    captureBlock(block ? block->data : nullptr);
+    if (block) release(block);
+}
+
+const int16_t* AudioRecordWav::readPointer() const {
+    return queue + (tail % WAV_QUEUE_BLOCKS) * AUDIO_BLOCK_SAMPLES;
+}
+
+void AudioRecordWav::consume(uint32_t blocks) {
+    tail = tail + blocks;
+}
+
+static void putLe32(uint8_t* bytes, uint32_t value) {
+    for (int i = 0; i < 4; i++) bytes[i] = (uint8_t)(value >> (8 * i));
+}
+
+static void putLe16(uint8_t* bytes, uint16_t value) {
+    bytes[0] = (uint8_t)value;
+    bytes[1] = (uint8_t)(value >> 8);
+}
+
+// RIFF/fmt header, a JUNK chunk padding it to WAV_HEADER_BYTES, then the data chunk header.
+// Sizes start at zero and are patched when the recording is closed.
+static void buildHeader(uint8_t* header) {
+    memset(header, 0, WAV_HEADER_BYTES);
+    memcpy(header + 0, "RIFF", 4);
+    memcpy(header + 8, "WAVE", 4);
+    memcpy(header + 12, "fmt ", 4);
+    putLe32(header + 16, 16);
+    putLe16(header + 20, 1); // PCM
+    putLe16(header + 22, 1); // Mono
+    putLe32(header + 24, WAV_SAMPLE_RATE);
+    putLe32(header + 28, WAV_SAMPLE_RATE * 2);
+    putLe16(header + 32, 2);
+    putLe16(header + 34, 16);
+    memcpy(header + 36, "JUNK", 4);
+    putLe32(header + 40, WAV_DATA_SIZE_OFFSET - 4 - 44);
+    memcpy(header + WAV_DATA_SIZE_OFFSET - 4, "data", 4);
+}
+
+// nnn of a RECnnn.WAV name, -1 for any other name
+static int recFileNumber(const char* name) {
+    if (strlen(name) != 10 || strncmp(name, "REC", 3) != 0 || strcmp(name + 6, ".WAV") != 0) return -1;
+    int number = 0;
+    for (int i = 3; i < 6; i++) {
+        if (name[i] < '0' || name[i] > '9') return -1;
+        number = number * 10 + (name[i] - '0');
+    }
+    return number;
+}
+
+void setupWavRecorder() {
+    nextFileNumber = 0;
+    if (!sdCardMounted()) return;
+    File root = SD.open("/");
+    if (!root || !root.isDirectory()) return;
+    while (File entry = root.openNextFile()) {
+        int number = entry.isDirectory() ? -1 : recFileNumber(entry.name());
+        if (number >= nextFileNumber) nextFileNumber = number + 1;
+        entry.close();
+    }
+    root.close();
+}
+
+bool startWavRecording() {
+    if (writerState != WAV_IDLE) return false;
+    if (!sdCardMounted()) {
+        DEBUG_WARNING(CAT_AUDIO, "No SD card, not recording");
+        return false;
+    }
+    if (nextFileNumber >= WAV_MAX_FILES) {
+        DEBUG_WARNING(CAT_AUDIO, "No free REC file name on the SD card");
+        fileName[0] = '\0';
+        return false;
+    }
+    snprintf(fileName, sizeof(fileName), "REC%03d.WAV", nextFileNumber++);
+    dataBytes = 0;
+    wavRecorder.setArmed(true); // Blocks queue up while the file is created
+    writerState = WAV_OPENING;
+    DEBUG_INFO(CAT_AUDIO, "Recording to %s", fileName);
+    return true;
+}
+
+void stopWavRecording() {
+    if (writerState == WAV_IDLE) return;
+    wavRecorder.setArmed(false);
+}
+
+static void patchSize(uint32_t offset, uint32_t value) {
+    uint8_t bytes[4];
+    putLe32(bytes, value);
+    wavFile.seek(offset);
+    wavFile.write(bytes, 4);
+}
+
+static void closeRecording() {
+    patchSize(WAV_RIFF_SIZE_OFFSET, WAV_HEADER_BYTES - 8 + dataBytes);
+    patchSize(WAV_DATA_SIZE_OFFSET, dataBytes);
+    wavFile.close();
+    writerState = WAV_IDLE;
+    if (wavRecorder.overruns() > 0) {
+        DEBUG_WARNING(CAT_AUDIO, "%s: %lu block(s) lost to SD overruns", fileName, (unsigned long)wavRecorder.overruns());
+    }
+    DEBUG_INFO(CAT_AUDIO, "Recorded %lu bytes to %s", (unsigned long)dataBytes, fileName);
+}
+
+// The file could not be created or written: drop the queue and stop
+static void abandonRecording(const char* reason) {
+    DEBUG_WARNING(CAT_AUDIO, "%s: %s, recording stopped", fileName, reason);
+    wavRecorder.setArmed(false);
+    wavRecorder.consume(wavRecorder.queuedBlocks());
+}
+
+void serviceWavRecorder() {
+    if (writerState == WAV_IDLE) return;
+    // Still programming the last write: any SD call now would wait for it
+    if (SD.sdfs.card()->isBusy()) return;
+
+    if (writerState == WAV_OPENING) {
+        wavFile = SD.open(fileName, FILE_WRITE);
+        if (!wavFile) {
+            abandonRecording("cannot create");
+            writerState = WAV_IDLE;
+            return;
+        }
+        writerState = WAV_HEADER;
+        return;
+    }
+    if (writerState == WAV_HEADER) {
+        uint8_t header[WAV_HEADER_BYTES];
+        buildHeader(header);
+        if (wavFile.write(header, WAV_HEADER_BYTES) != WAV_HEADER_BYTES) {
+            abandonRecording("header write failed");
+            wavFile.close();
+            writerState = WAV_IDLE;
+            return;
+        }
+        writerState = WAV_WRITING;
+        return;
+    }
+
+    bool stopping = !wavRecorder.isArmed();
+    uint32_t queued = wavRecorder.queuedBlocks();
+    // Whole chunks only while recording, so every write stays sector-aligned; the
+    // remainder goes out once the recorder is disarmed
+    uint32_t blocks = queued >= WAV_CHUNK_BLOCKS ? WAV_CHUNK_BLOCKS : 0;
+    if (stopping) blocks = queued < WAV_CHUNK_BLOCKS ? queued : WAV_CHUNK_BLOCKS;
+    if (blocks > 0) {
+        size_t bytes = blocks * WAV_BLOCK_BYTES;
+        if (wavFile.write(wavRecorder.readPointer(), bytes) != bytes) {
+            abandonRecording("SD write failed");
+            closeRecording();
+            return;
+        }
+        wavRecorder.consume(blocks);
+        dataBytes += bytes;
+        return;
+    }
+    if (stopping) closeRecording();
+}
+
+bool wavRecording() {
+    return writerState != WAV_IDLE;
+}
+
+const char* wavFileName() {
+    return fileName;
+}
+
+uint32_t wavDataBytes() {
+    return dataBytes;
+}
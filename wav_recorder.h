@@ -0,0 +1,70 @@
+// wav_recorder.h
+// Records the master output to a WAV file on the SD card. The audio update only copies
+// each block into a large RAM queue; the main loop writes the queue out a sector at a
+// time, one SD write per pass and only while the card is not busy, and patches the
+// header sizes when recording stops. Neither side ever waits on the card: a full queue
+// drops the block and counts an overrun.
+
+#ifndef WAV_RECORDER_H
+#define WAV_RECORDER_H
+
+#include <Audio.h>
+
+#define WAV_QUEUE_BLOCKS 64      // 16 KB (~186 ms), DMAMEM on the Teensy
+#define WAV_CHUNK_BLOCKS 2       // 512 bytes, one sector, per SD write
+#define WAV_HEADER_BYTES 512     // Padded with a JUNK chunk so sample data starts on a sector
+#define WAV_MAX_FILES 1000       // REC000.WAV .. REC999.WAV in the card's root
+#define WAV_NAME_LENGTH 13
+
+static_assert(WAV_QUEUE_BLOCKS % WAV_CHUNK_BLOCKS == 0, "chunks must not wrap the queue");
+
+// Mono 16-bit tap on the master output (the I2S channels carry the same signal)
+class AudioRecordWav : public AudioStream {
+public:
+    // queueMemory holds WAV_QUEUE_BLOCKS blocks
+    explicit AudioRecordWav(int16_t* queueMemory);
+
+    void setArmed(bool on); // Arming empties the queue and clears the counters
+    bool isArmed() const { return armed; }
+
+    // Queues one block; nullptr records silence (no block arrived). Called by update();
+    // public for host tests.
+    void captureBlock(const int16_t* samples);
+    virtual void update(void);
+
+    // Writer side (main loop)
+    uint32_t queuedBlocks() const { return head - tail; }
+    const int16_t* readPointer() const;
+    void consume(uint32_t blocks);
+
+    uint32_t overruns() const { return overrunCount; }
+    uint32_t queuePeak() const { return peak; }
+
+private:
+    audio_block_t* inputQueueArray[1];
+    int16_t* queue;
+    volatile bool armed;
+    volatile uint32_t head; // Blocks written by the audio update (free running)
+    volatile uint32_t tail; // Blocks written to the card
+    volatile uint32_t overrunCount;
+    uint32_t peak;
+};
+
+// Finds the next free RECnnn.WAV number with one pass over the card's root. After
+// every mount (setupSampleBank()).
+void setupWavRecorder();
+// Arms the recorder for the next free RECnnn.WAV without touching the card; the file
+// is created by serviceWavRecorder(), and recording stops there if that fails. False
+// with no card, while already recording or with no free name left.
+bool startWavRecording();
+// Disarms the recorder; the queue drains and the header is patched by serviceWavRecorder()
+void stopWavRecording();
+// One SD step per call (create, header, a sector, or the closing size patch), none
+// while the card is busy. Every loop() pass.
+void serviceWavRecorder();
+
+bool wavRecording();      // From start until the file is closed
+const char* wavFileName(); // Current or last file, "" before the first recording
+uint32_t wavDataBytes();   // Sample bytes written to the current or last file
+
+#endif // WAV_RECORDER_H